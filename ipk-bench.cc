@@ -0,0 +1,629 @@
+/**
+ *  @file       ipk-bench.cc
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Loopback benchmark implementation.
+ * 
+ *  Usage: ipk-bench [-t ms] [-s sizes] [-j threads] [-k backends] [-o path]
+ * 
+ *  * -t ms               length of every case (default 1000)
+ *  * -s sizes            probe sizes, comma separated (default 64,512,1472)
+ *  * -j threads          sender & receiver pairs, comma separated (default 1,2)
+ *  * -k backends         send,mmsg,gso,uring (default all of them)
+ *  * -o path             writes the results as a JSON document to 'path' as well
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <random>
+#include <cstring>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+
+#include "ipk-bench.h"
+#include "ipk-mtrip.h"
+#include "ipk-clock.h"
+
+// frames of a sender ring, in batches (the pacer releases one batch at a time)
+#define BENCH_RING_BATCHES 2
+
+
+/**
+ * @brief Opens the cycle counter of the calling thread
+ * 
+ * @desc Kernel cycles are counted as well, a syscall costs what it costs.
+ * That needs perf_event_paranoid <= 1 (or CAP_PERFMON), otherwise the CPU
+ * time of the thread is used.
+ */
+CycleCounter::CycleCounter() : perf_fd {-1}, start_cycles {0}, start_cpu_ns {0}
+{
+  struct perf_event_attr attr {};
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_CPU_CYCLES;
+  attr.exclude_hv = 1;
+
+  perf_fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+
+CycleCounter::~CycleCounter()
+{
+  if (perf_fd >= 0)
+    close(perf_fd);
+}
+
+
+/**
+ * @brief Starts counting
+ */
+void CycleCounter::start()
+{
+  if (perf_fd < 0 || read(perf_fd, &start_cycles, sizeof(start_cycles)) != sizeof(start_cycles))
+    start_cycles = 0;
+  start_cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+}
+
+
+/**
+ * @brief Cycles of the thread since start()
+ * 
+ * @return cycles, the CPU time at the TSC rate without the hardware counter
+ *         (0 where there is no TSC either)
+ */
+double CycleCounter::stop()
+{
+  uint64_t cycles;
+  if (perf_fd >= 0 && read(perf_fd, &cycles, sizeof(cycles)) == sizeof(cycles))
+    return static_cast<double>(cycles - start_cycles);
+
+  return (clock_ns(CLOCK_THREAD_CPUTIME_ID) - start_cpu_ns) * bench_tsc_rate();
+}
+
+
+/**
+ * @brief TSC ticks per ns, measured once over 20 ms
+ * 
+ * @return ticks per ns, 0 where there is no TSC
+ */
+double bench_tsc_rate()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  static double rate = []() {
+    uint64_t start = monotonic_ns();
+    uint64_t ticks = __rdtsc();
+    while (monotonic_ns() - start < 20 * NSEC_PER_MSEC)
+      ;
+    return (__rdtsc() - ticks) / static_cast<double>(monotonic_ns() - start);
+  }();
+  return rate;
+#else
+  return 0.0;
+#endif
+}
+
+
+/**
+ * @brief Receive loop of one reflector worker, without the replies
+ * 
+ * @desc What Reflector::serve() does for a data probe: batch receive, GRO
+ * buffers split back into probes, session lookup through the cache of the
+ * worker and tracking of sequence number & one-way delay.
+ * @param socket receiving socket of the worker
+ * @param frames receive frames of the worker
+ * @param sessions session table, holds the session of the senders
+ * @param worker index of the worker, its slot in the session
+ * @param stopping set once the senders are done and their probes drained
+ * @param counters receive syscalls of the worker
+ * @param cycles output, CPU cycles of the loop
+ * @return probes tracked
+ */
+static long bench_receive(std::shared_ptr<SocketEntity> socket, FrameRing& frames, SessionTable& sessions, unsigned worker,
+                          const std::atomic<bool>& stopping, thread_metrics_t& counters, double& cycles)
+{
+  SessionCache cache(sessions);
+  CycleCounter counter;
+
+  unsigned depth = std::min(socket->get_batch_depth(), frames.size());
+  char* const* buffers = frames.window();
+  std::vector<const char*> payloads(buffers, buffers + depth);
+  std::vector<size_t> lengths(depth);
+  std::vector<size_t> segment_sizes(depth);
+  std::vector<uint64_t> rx_timestamps(depth);
+  std::vector<struct sockaddr_storage> sources(depth);
+
+  unsigned uring_buffers = 64;
+  while (uring_buffers < 4 * depth)
+    uring_buffers *= 2;
+  bool borrowed = socket->get_io_backend() == SocketEntity::URING_IO && socket->start_receiving(MAX_DATAGRAM_SIZE, uring_buffers);
+
+  long tracked { 0 };
+  probe_header_t probe;
+
+  counter.start();
+  while (!stopping.load(std::memory_order_relaxed))
+  {
+    int received = borrowed
+      ? socket->recv_borrowed(payloads.data(), depth, lengths.data(), rx_timestamps.data(), segment_sizes.data(), BENCH_TICK_MS, sources.data())
+      : socket->recv_batch(buffers, MAX_DATAGRAM_SIZE, depth, lengths.data(), rx_timestamps.data(), segment_sizes.data(), sources.data());
+    uint64_t now = monotonic_ns();
+    metric_add(counters.recv_syscalls, 1);
+
+    for (int i = 0; i < received; i++)
+    {
+      size_t segment = segment_sizes[i] > 0 ? segment_sizes[i] : lengths[i];
+      for (size_t offset = 0; offset < lengths[i]; offset += segment)
+      {
+        size_t length = std::min(segment, lengths[i] - offset);
+        if (!probe_read(payloads[i] + offset, length, probe))
+          continue;
+
+        Session* session = cache.find(Session::make_key(sources[i], probe.session_id));
+        if (session == nullptr)
+          continue;
+
+        session->track(worker, probe, length, rx_timestamps[i], now);
+        tracked++;
+      }
+    }
+  }
+  cycles = counter.stop();
+
+  if (borrowed)
+    socket->stop_receiving();
+
+  return tracked;
+}
+
+
+/**
+ * @brief Runs one case over loopback
+ * 
+ * @desc The receivers form a SO_REUSEPORT group on an ephemeral port, like
+ * the workers of a reflector, every sender has a connected socket of its own
+ * and runs the round loop of the meter (send_paced) at a rate no pacer holds
+ * back. Counting starts when the threads are up, so their setup is left out.
+ * @param run backend, probe size & threads of the case
+ * @param duration_ms how long the senders send
+ * @return results, 'measured' false when the backend is not available
+ */
+bench_result_t bench_run(const bench_case_t& run, unsigned duration_ms)
+{
+  bench_result_t result {run, false, "", 0, 0, 0.0, 0.0, 0.0, 0.0, 0.0};
+
+  mtrip_options_t options;
+  options.batch_depth = run.backend == SEND_BACKEND ? 1 : BENCH_BATCH_DEPTH;
+  options.io_backend = run.backend == URING_BACKEND ? SocketEntity::URING_IO : SocketEntity::BLOCKING_IO;
+  options.pacing_mode = Pacer::BURST_PACING;
+
+  std::vector<std::shared_ptr<SocketEntity>> receivers;
+  unsigned short port = 0;
+  for (unsigned i = 0; i < run.threads; i++)
+  {
+    std::shared_ptr<SocketEntity> socket = std::make_shared<SocketEntity>();
+    if (socket->setup_server(port, true, AF_INET) != EXIT_SUCCESS)
+    {
+      result.note = "receivers can not be bound";
+      return result;
+    }
+    configure_socket(socket, options);
+    socket->grow_recv_buffer(SOCKET_BUFFER_MIN);
+    socket->set_recv_timeout(BENCH_TICK_MS);
+    if (run.backend == GSO_BACKEND && !socket->set_gro(true))
+    {
+      result.note = "UDP GRO not available";
+      return result;
+    }
+    port = socket->get_local_port();
+    receivers.push_back(socket);
+  }
+
+  std::vector<struct sockaddr_storage> addresses = SocketEntity::resolve("127.0.0.1", port, AF_INET);
+  if (addresses.empty())
+    return result;
+
+  std::vector<std::shared_ptr<SocketEntity>> senders;
+  for (unsigned i = 0; i < run.threads; i++)
+  {
+    std::shared_ptr<SocketEntity> socket = std::make_shared<SocketEntity>();
+    if (socket->setup_connection(addresses[0]) != EXIT_SUCCESS)
+    {
+      result.note = "senders can not connect";
+      return result;
+    }
+    configure_socket(socket, options);
+    socket->grow_send_buffer(SOCKET_BUFFER_MIN);
+    if (run.backend == GSO_BACKEND && socket->enable_gso(run.probe_size) == 0)
+    {
+      result.note = "UDP GSO not available for " + std::to_string(run.probe_size) + "B probes";
+      return result;
+    }
+    senders.push_back(socket);
+  }
+
+  if (run.backend == URING_BACKEND && (senders[0]->get_io_backend() != SocketEntity::URING_IO
+                                       || receivers[0]->get_io_backend() != SocketEntity::URING_IO))
+  {
+    result.note = "io_uring not available";
+    return result;
+  }
+
+  // the session a hello of the senders would open
+  uint32_t session_id = std::random_device{}();
+  SessionTable sessions(run.threads);
+  control_hello_t hello {static_cast<uint32_t>(run.probe_size), 1, run.threads, duration_ms,
+                         CAP_MULTI_STREAM | CAP_BATCHING | CAP_ROUND_LENGTH, options.batch_depth, 0, 0};
+  control_ack_t ack {hello.capabilities, run.threads, duration_ms, options.batch_depth, 0};
+  bool created = false;
+  if (!sessions.open(addresses[0], session_id, hello, ack, created))
+    return result;
+
+  // preformatted probe frames of the senders, receive frames as large as a GRO buffer
+  unsigned depth = options.batch_depth;
+  unsigned ring_frames = BENCH_RING_BATCHES * depth;
+  BufferArena send_arena(run.probe_size, run.threads * ring_frames);
+  BufferArena recv_arena(MAX_DATAGRAM_SIZE, run.threads * depth);
+  if (!send_arena.valid() || !recv_arena.valid())
+    return result;
+
+  std::vector<FrameRing> send_rings, recv_rings;
+  for (unsigned i = 0; i < run.threads; i++)
+  {
+    send_rings.emplace_back(send_arena, i * ring_frames, ring_frames);
+    recv_rings.emplace_back(recv_arena, i * depth, depth);
+
+    probe_header_t header {PROBE_MAGIC, session_id, 0, static_cast<uint16_t>(i), PROBE_DATA, 0, 0};
+    for (unsigned frame = 0; frame < ring_frames; frame++)
+      probe_format(send_rings.back().at(frame), run.probe_size, header);
+  }
+
+  // counters: senders first, receivers after them
+  Metrics metrics("bench", 2 * run.threads);
+  std::vector<double> cycles(2 * run.threads, 0.0);
+  std::vector<long> sent(run.threads, 0), tracked(run.threads, 0);
+  std::atomic<bool> go {false}, stopping {false};
+  std::atomic<uint64_t> round_end {0};
+
+  std::vector<std::thread> receive_threads, send_threads;
+  for (unsigned i = 0; i < run.threads; i++)
+  {
+    receive_threads.emplace_back([&, i]() {
+      tracked[i] = bench_receive(receivers[i], recv_rings[i], sessions, i, stopping, metrics.thread(run.threads + i),
+                                 cycles[run.threads + i]);
+    });
+    pin_thread_to_core(receive_threads.back().native_handle(), run.threads + i);
+  }
+
+  for (unsigned i = 0; i < run.threads; i++)
+  {
+    send_threads.emplace_back([&, i]() {
+      CycleCounter counter;
+      pacer_stats_t pacing;
+      Timeline timeline;
+      while (!go.load())
+        std::this_thread::yield();
+
+      counter.start();
+      sent[i] = send_paced(senders[i], send_rings[i], BENCH_RATE / run.threads, run.probe_size, 0, round_end.load(), 0,
+                           Pacer::BURST_PACING, metrics.thread(i), pacing, timeline);
+      cycles[i] = counter.stop();
+    });
+    pin_thread_to_core(send_threads.back().native_handle(), i);
+  }
+
+  uint64_t start = monotonic_ns();
+  round_end.store(start + duration_ms * NSEC_PER_MSEC);
+  go.store(true);
+
+  for (std::thread& thread : send_threads)
+    thread.join();
+  result.seconds = (monotonic_ns() - start) / static_cast<double>(NSEC_PER_SEC);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(BENCH_DRAIN_MS));
+  stopping.store(true);
+  for (std::thread& thread : receive_threads)
+    thread.join();
+
+  double total_cycles { 0.0 };
+  double syscalls { 0.0 };
+  for (unsigned i = 0; i < run.threads; i++)
+  {
+    result.sent += sent[i];
+    result.received += tracked[i];
+    syscalls += metrics.thread(i).send_syscalls.load() + metrics.thread(run.threads + i).recv_syscalls.load();
+  }
+  for (double thread_cycles : cycles)
+    total_cycles += thread_cycles;
+
+  result.measured = true;
+  if (result.received > 0)
+  {
+    result.pps = result.received / result.seconds;
+    result.gbps = result.pps * run.probe_size * 8 / 1e9;
+    result.cycles_per_packet = total_cycles / result.received;
+    result.syscalls_per_packet = syscalls / result.received;
+  }
+  if (result.received < result.sent)
+    result.note = "receivers fell behind";
+
+  return result;
+}
+
+
+/**
+ * @brief Name of a backend as '-k' takes it
+ */
+const char* bench_backend_name(bench_backend_t backend)
+{
+  switch (backend)
+  {
+    case SEND_BACKEND:
+      return "send";
+    case MMSG_BACKEND:
+      return "mmsg";
+    case GSO_BACKEND:
+      return "gso";
+    case URING_BACKEND:
+      return "uring";
+    default:
+      return "unknown";
+  }
+}
+
+
+/**
+ * @brief Parses a list of positive numbers
+ * 
+ * @param spec comma separated numbers, e.g. "64,512"
+ * @param numbers output, in the given order
+ * @return false when malformed
+ */
+bool bench_parse_numbers(const std::string& spec, std::vector<size_t>& numbers)
+{
+  numbers.clear();
+
+  size_t start = 0;
+  while (start <= spec.size())
+  {
+    size_t end = spec.find(',', start);
+    if (end == string::npos)
+      end = spec.size();
+
+    string item = spec.substr(start, end - start);
+    char* rest = nullptr;
+    long number = std::strtol(item.c_str(), &rest, 10);
+    if (item.empty() || *rest != '\0' || number <= 0)
+      return false;
+    numbers.push_back(static_cast<size_t>(number));
+
+    start = end + 1;
+  }
+
+  return !numbers.empty();
+}
+
+
+/**
+ * @brief Parses a list of backends
+ * 
+ * @param spec comma separated names, e.g. "mmsg,uring"
+ * @param backends output, in the given order
+ * @return false when a name is unknown
+ */
+bool bench_parse_backends(const std::string& spec, std::vector<bench_backend_t>& backends)
+{
+  backends.clear();
+
+  size_t start = 0;
+  while (start <= spec.size())
+  {
+    size_t end = spec.find(',', start);
+    if (end == string::npos)
+      end = spec.size();
+
+    string item = spec.substr(start, end - start);
+    int found = -1;
+    for (int i = 0; i < BENCH_BACKENDS; i++)
+      if (item == bench_backend_name(static_cast<bench_backend_t>(i)))
+        found = i;
+    if (found < 0)
+      return false;
+    backends.push_back(static_cast<bench_backend_t>(found));
+
+    start = end + 1;
+  }
+
+  return !backends.empty();
+}
+
+
+/**
+ * @brief Prints all cases as a table
+ * 
+ * @param results cases in the order they ran
+ * @param hardware_cycles cycles come from the hardware counter, not the CPU time
+ */
+void bench_print_table(const std::vector<bench_result_t>& results, bool hardware_cycles)
+{
+  cout << "\n--------------------------------------------------------------------------------" << endl;
+  cout << "  " << BOLD << "LOOPBACK BENCHMARK" << RESET << " (cycles " << (hardware_cycles ? "counted by the CPU" : "from CPU time at the TSC rate")
+       << ", per received probe)" << endl;
+  cout << "--------------------------------------------------------------------------------\n" << endl;
+
+  cout << std::left << std::setw(8) << "backend" << std::right << std::setw(7) << "size" << std::setw(5) << "thr"
+       << std::setw(12) << "sent pps" << std::setw(12) << "recv pps" << std::setw(9) << "Gb/s" << std::setw(8) << "loss"
+       << std::setw(12) << "cycles/pkt" << std::setw(11) << "calls/pkt" << "  note" << endl;
+
+  for (const bench_result_t& result : results)
+  {
+    cout << std::left << std::setw(8) << bench_backend_name(result.run.backend) << std::right << std::setw(7) << result.run.probe_size
+         << std::setw(5) << result.run.threads;
+    if (!result.measured)
+    {
+      cout << std::setw(12) << "-" << std::setw(12) << "-" << std::setw(9) << "-" << std::setw(8) << "-" << std::setw(12) << "-"
+           << std::setw(11) << "-" << "  " << result.note << endl;
+      continue;
+    }
+
+    double loss = result.sent > 0 ? 100.0 - 100.0 * result.received / result.sent : 0.0;
+    cout << std::fixed << std::setprecision(0) << std::setw(12) << result.sent / result.seconds << std::setw(12) << result.pps
+         << std::setprecision(3) << std::setw(9) << result.gbps << std::setprecision(1) << std::setw(7) << loss << "%"
+         << std::setprecision(0) << std::setw(12);
+    if (result.cycles_per_packet > 0.0)
+      cout << result.cycles_per_packet;
+    else
+      cout << "-";
+    cout << std::setprecision(3) << std::setw(11) << result.syscalls_per_packet << "  " << result.note << endl;
+  }
+  cout << endl;
+}
+
+
+/**
+ * @brief Writes all cases as a JSON document
+ * 
+ * @param path file to be (re)written
+ * @param results cases in the order they ran
+ * @param duration_ms length of every case
+ * @param hardware_cycles cycles come from the hardware counter, not the CPU time
+ * @return false when the file can not be written
+ */
+bool bench_write_json(const std::string& path, const std::vector<bench_result_t>& results, unsigned duration_ms,
+                      bool hardware_cycles)
+{
+  std::ofstream out(path);
+  if (!out)
+  {
+    cerr << "Can not write " << path << endl;
+    return false;
+  }
+
+  out << std::fixed << std::setprecision(3);
+  out << "{\n  \"timestamp\": " << realtime_ns() << ", \"duration_ms\": " << duration_ms << ", \"batch_depth\": " << BENCH_BATCH_DEPTH
+      << ", \"cycles_source\": \"" << (hardware_cycles ? "perf" : "cputime") << "\",\n  \"cases\": [";
+
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const bench_result_t& r = results[i];
+    out << (i == 0 ? "\n" : ",\n") << "    {\"backend\": \"" << bench_backend_name(r.run.backend) << "\", \"probe_size\": " << r.run.probe_size
+        << ", \"threads\": " << r.run.threads << ", \"measured\": " << (r.measured ? "true" : "false");
+    if (r.measured)
+      out << ", \"sent\": " << r.sent << ", \"received\": " << r.received << ", \"seconds\": " << r.seconds
+          << ", \"pps\": " << r.pps << ", \"gbps\": " << r.gbps << ", \"cycles_per_packet\": " << r.cycles_per_packet
+          << ", \"syscalls_per_packet\": " << r.syscalls_per_packet;
+    out << ", \"note\": \"" << r.note << "\"}";
+  }
+  out << "\n  ]\n}\n";
+
+  return static_cast<bool>(out);
+}
+
+
+/**
+ *  @brief Benchmark entry point, sweeps all cases one after another
+ * 
+ *  @param argc number of string arguments pointed to by argv
+ *  @param argv vector of string arguments passed to the program
+ *  @return exit code as an int
+ */
+int main(int argc, char **argv)
+{
+  // SIGINT ends the sweep after the current case, with the results so far
+  struct sigaction action {};
+  action.sa_handler = interrupt_handler;
+  sigemptyset(&action.sa_mask);
+  for (int signum : {SIGINT, SIGTERM})
+    sigaction(signum, &action, nullptr);
+
+  unsigned duration_ms = BENCH_DEFAULT_MS;
+  std::vector<size_t> sizes {64, 512, 1472};
+  std::vector<size_t> threads {1, 2};
+  std::vector<bench_backend_t> backends {SEND_BACKEND, MMSG_BACKEND, GSO_BACKEND, URING_BACKEND};
+  string json_path;
+
+  int c;
+  while ((c = getopt(argc, argv, "t:s:j:k:o:")) != -1)
+  {
+    switch (c)
+    {
+      case 't':
+        duration_ms = static_cast<unsigned>(std::max(1, atoi(optarg)));
+        break;
+      case 's':
+        if (!bench_parse_numbers(optarg, sizes))
+        {
+          cerr << "Malformed probe sizes '" << optarg << "' (e.g. 64,512,1472)" << endl;
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'j':
+        if (!bench_parse_numbers(optarg, threads))
+        {
+          cerr << "Malformed thread counts '" << optarg << "' (e.g. 1,2)" << endl;
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'k':
+        if (!bench_parse_backends(optarg, backends))
+        {
+          cerr << "Unknown backends '" << optarg << "' (send,mmsg,gso,uring)" << endl;
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'o':
+        json_path = optarg;
+        break;
+      default:
+        cerr << "Usage: ipk-bench [-t ms] [-s sizes] [-j threads] [-k backends] [-o path]" << endl;
+        return EXIT_FAILURE;
+    }
+  }
+
+  for (size_t size : sizes)
+  {
+    if (size < PROBE_HEADER_SIZE || size > MAX_DATAGRAM_SIZE)
+    {
+      cerr << "Probe size has to be " << PROBE_HEADER_SIZE << " - " << MAX_DATAGRAM_SIZE << " bytes" << endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::vector<bench_result_t> results;
+  for (bench_backend_t backend : backends)
+    for (size_t size : sizes)
+      for (size_t count : threads)
+      {
+        if (shutdown_signal)
+          break;
+
+        bench_case_t run {backend, size, static_cast<unsigned>(count)};
+        cout << "~ " << bench_backend_name(backend) << ", " << size << "B probes, " << count << " thread(s)" << endl;
+        results.push_back(bench_run(run, duration_ms));
+      }
+
+  bool hardware_cycles = CycleCounter().hardware();
+  bench_print_table(results, hardware_cycles);
+
+  if (!json_path.empty())
+  {
+    if (!bench_write_json(json_path, results, duration_ms, hardware_cycles))
+      return EXIT_FAILURE;
+    cout << "~ Results written to " << BOLD << json_path << RESET << " (json)" << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
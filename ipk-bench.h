@@ -0,0 +1,137 @@
+/**
+ *  @file       ipk-bench.h
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Loopback benchmark of the hot paths.
+ * 
+ *  @section Description
+ * 
+ *  A measurement can only tell the path apart from the tool when the tool
+ *  itself is known to be fast enough. The benchmark ('make bench') runs the
+ *  sender of the meter rounds (send_paced) and the receive path of a
+ *  reflector worker (batch receive, GRO split, session lookup, sequence &
+ *  delay tracking) in one process over loopback, with nothing paced, and
+ *  sweeps probe sizes, thread counts and I/O backends:
+ * 
+ *  * send   one datagram per send()/recv()
+ *  * mmsg   sendmmsg/recvmmsg batches
+ *  * gso    sendmmsg with UDP GSO, GRO on the receiving side
+ *  * uring  io_uring sends, multishot receive into provided buffers
+ * 
+ *  Every case reports packets/second, Gb/s, CPU cycles and syscalls per
+ *  received packet, as a table and as a JSON document ('-o path'), so a
+ *  change of SocketEntity or of the round loops shows up as a number.
+ * 
+ *  Cycles come from the CPU cycle counter of every thread (perf_event_open),
+ *  where that is not permitted the CPU time of the threads is converted
+ *  at the TSC rate. Kernel time spent in the syscalls counts in both.
+ */
+
+#ifndef IPK_BENCH_H_
+#define IPK_BENCH_H_
+
+    #include <stdint.h>
+    #include <string>
+    #include <vector>
+
+    // length of one case unless '-t' gives one
+    #define BENCH_DEFAULT_MS 1000
+
+    // rate of the pacer, no loopback gets near it, so it never holds a batch back
+    #define BENCH_RATE 1000000000LL
+
+    // batch depth of the batched backends
+    #define BENCH_BATCH_DEPTH 32
+
+    // the receivers drain their queues this long after the senders are done,
+    // they check for the end at least every BENCH_TICK_MS
+    #define BENCH_DRAIN_MS 50
+    #define BENCH_TICK_MS 10
+
+    /**
+     * @brief Send & receive calls a case runs on
+     */
+    enum bench_backend_t
+    {
+        SEND_BACKEND  = 0,
+        MMSG_BACKEND  = 1,
+        GSO_BACKEND   = 2,
+        URING_BACKEND = 3,
+        BENCH_BACKENDS = 4
+    };
+
+    /**
+     * @brief One combination of the sweep
+     */
+    struct bench_case_t
+    {
+        bench_backend_t backend;
+        size_t probe_size;
+        unsigned threads; // sender & receiver pairs
+    };
+
+    /**
+     * @brief What one case came to, all per packet values are per received probe
+     */
+    struct bench_result_t
+    {
+        bench_case_t run;
+        bool measured;           // false when the backend is not available here
+        std::string note;        // why not, or what was given up
+        long sent;
+        long received;
+        double seconds;          // send time of the case
+        double pps;              // received probes/second
+        double gbps;             // received UDP payload
+        double cycles_per_packet;
+        double syscalls_per_packet;
+    };
+
+    /**
+     * @brief CPU cycles of the calling thread, kernel included
+     */
+    class CycleCounter
+    {
+        private:
+            int perf_fd;          // -1 when the hardware counter is not permitted
+            uint64_t start_cycles;
+            uint64_t start_cpu_ns;
+
+        public:
+            CycleCounter();
+            ~CycleCounter();
+
+            void start();
+
+            // cycles since start()
+            double stop();
+
+            // true when the hardware counter is used, the CPU time otherwise
+            inline bool hardware() const { return perf_fd >= 0; }
+    };
+
+    // TSC ticks per ns measured against CLOCK_MONOTONIC, 0 where there is no TSC
+    double bench_tsc_rate();
+
+    // runs one case over loopback for 'duration_ms'
+    bench_result_t bench_run(const bench_case_t& run, unsigned duration_ms);
+
+    // "send|mmsg|gso|uring"
+    const char* bench_backend_name(bench_backend_t backend);
+
+    // "64,512" -> sizes / thread counts, false when malformed
+    bool bench_parse_numbers(const std::string& spec, std::vector<size_t>& numbers);
+
+    // "mmsg,uring" -> backends, false when malformed
+    bool bench_parse_backends(const std::string& spec, std::vector<bench_backend_t>& backends);
+
+    // table of all cases
+    void bench_print_table(const std::vector<bench_result_t>& results, bool hardware_cycles);
+
+    // JSON document of all cases, false when 'path' can not be written
+    bool bench_write_json(const std::string& path, const std::vector<bench_result_t>& results, unsigned duration_ms,
+                          bool hardware_cycles);
+
+#endif // IPK_BENCH_H_
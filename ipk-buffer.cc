@@ -0,0 +1,103 @@
+/**
+ *  @file       ipk-buffer.cc
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Probe buffer arena implementation.
+ *  
+ *  @section Description
+ *  
+ *  The arena first asks for explicit huge pages (MAP_HUGETLB), which only
+ *  works when they were reserved by the administrator. Otherwise it takes
+ *  normal pages and advises transparent huge pages for the range.
+ */
+
+#include <iostream>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "ipk-buffer.h"
+
+using std::cerr;
+using std::endl;
+
+// size of a 2nd level huge page on x86-64/aarch64
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+
+/**
+ * @brief Maps the arena
+ * 
+ * @param frame_size usable bytes of every frame
+ * @param frames number of frames
+ */
+BufferArena::BufferArena(size_t frame_size, unsigned frames)
+  : base {nullptr},
+    length {0},
+    stride {(frame_size + FRAME_ALIGNMENT - 1) / FRAME_ALIGNMENT * FRAME_ALIGNMENT},
+    frame_size {frame_size},
+    frames {frames},
+    huge_pages {false}
+{
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t bytes = stride * frames;
+  if (bytes == 0)
+    bytes = page_size;
+
+  // explicit huge pages, only for arenas that fill at least one
+  if (bytes >= HUGE_PAGE_SIZE)
+  {
+    length = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mapping != MAP_FAILED)
+    {
+      base = static_cast<char*>(mapping);
+      huge_pages = true;
+      return;
+    }
+  }
+
+  length = (bytes + page_size - 1) / page_size * page_size;
+  void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapping == MAP_FAILED)
+  {
+    cerr << "probe buffer arena allocation failed" << endl;
+    length = 0;
+    return;
+  }
+  base = static_cast<char*>(mapping);
+
+  #ifdef MADV_HUGEPAGE
+  if (length >= HUGE_PAGE_SIZE)
+    madvise(base, length, MADV_HUGEPAGE);
+  #endif
+}
+
+
+/**
+ * @brief Unmaps the arena
+ */
+BufferArena::~BufferArena()
+{
+  if (base != nullptr)
+    munmap(base, length);
+}
+
+
+/*****************************************************************************/
+
+/**
+ * @brief Creates a ring over the frames [first, first + count) of the arena
+ */
+FrameRing::FrameRing(const BufferArena& arena, unsigned first, unsigned count)
+  : slots(2 * static_cast<size_t>(count)),
+    count {count},
+    head {0}
+{
+  for (unsigned i = 0; i < count; i++)
+  {
+    slots[i] = arena.frame(first + i);
+    slots[count + i] = slots[i];
+  }
+}
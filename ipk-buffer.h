@@ -0,0 +1,88 @@
+/**
+ *  @file       ipk-buffer.h
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Probe buffer arena.
+ *  
+ *  @section Description
+ *  
+ *  All probe frames of a measurement session live in one page-aligned mapping
+ *  (huge pages when the system has them), allocated once when the session
+ *  starts. Frames are cache line aligned. Each sender/receiver thread gets its
+ *  own FrameRing over a disjoint part of the arena, so the hot paths only
+ *  borrow frames and patch the probe headers in place.
+ */
+
+#ifndef IPK_BUFFER_H_
+#define IPK_BUFFER_H_
+
+    #include <stddef.h>
+    #include <vector>
+
+    // frames start on a cache line boundary
+    #define FRAME_ALIGNMENT 64
+
+    /**
+     * @brief One mmap()ed block of equally sized frames
+     */
+    class BufferArena
+    {
+        private:
+            char* base;
+            size_t length;      // of the mapping
+            size_t stride;      // distance of two frames
+            size_t frame_size;  // usable bytes of a frame
+            unsigned frames;
+            bool huge_pages;
+
+        public:
+            // maps 'frames' zeroed frames of at least 'frame_size' bytes
+            BufferArena(size_t frame_size, unsigned frames);
+            ~BufferArena();
+
+            BufferArena(const BufferArena&) = delete;
+            BufferArena& operator=(const BufferArena&) = delete;
+
+            // false when the mapping failed
+            inline bool valid() const { return base != nullptr; }
+
+            inline char* frame(unsigned index) const { return base + index * stride; }
+            inline size_t get_frame_size() const { return frame_size; }
+            inline unsigned get_frames() const { return frames; }
+            inline bool uses_huge_pages() const { return huge_pages; }
+    };
+
+
+    /**
+     * @brief Ring over a contiguous range of frames of an arena
+     * 
+     * @desc Every frame pointer is stored twice in a row, so any window of up
+     * to size() frames starting anywhere in the ring is one contiguous array
+     * that can be handed to the batched socket calls directly.
+     */
+    class FrameRing
+    {
+        private:
+            std::vector<char*> slots;
+            unsigned count;
+            unsigned head;
+
+        public:
+            FrameRing() : count {0}, head {0} {}
+            FrameRing(const BufferArena& arena, unsigned first, unsigned count);
+
+            inline unsigned size() const { return count; }
+
+            // frame at the current position + offset
+            inline char* at(unsigned offset) const { return slots[head + offset]; }
+
+            // window of up to size() frames starting at the current position
+            inline char* const* window() const { return &slots[head]; }
+
+            // moves the current position past 'n' frames
+            inline void advance(unsigned n) { head = (head + n) % count; }
+    };
+
+#endif // IPK_BUFFER_H_
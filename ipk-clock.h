@@ -0,0 +1,49 @@
+/**
+ *  @file       ipk-clock.h
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Clock helpers.
+ *  
+ *  @section Description
+ *  
+ *  Thin inline wrappers around clock_gettime(), all time values in the program
+ *  are plain 64-bit nanosecond counts so they can be stored in packets and
+ *  subtracted without any chrono conversions on the hot path.
+ */
+
+#ifndef IPK_CLOCK_H_
+#define IPK_CLOCK_H_
+
+    #include <stdint.h>
+    #include <time.h>
+
+    #define NSEC_PER_SEC  1000000000ULL
+    #define NSEC_PER_MSEC 1000000ULL
+    #define NSEC_PER_USEC 1000ULL
+
+    // nanoseconds of the given clock
+    inline uint64_t clock_ns(clockid_t clock_id)
+    {
+        struct timespec ts;
+        clock_gettime(clock_id, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * NSEC_PER_SEC + ts.tv_nsec;
+    }
+
+    // steady clock (vDSO, TSC backed on x86), used for pacing and intervals
+    inline uint64_t monotonic_ns() { return clock_ns(CLOCK_MONOTONIC); }
+
+    // wall clock, used for timestamps that travel between hosts
+    inline uint64_t realtime_ns() { return clock_ns(CLOCK_REALTIME); }
+
+    // converts nanoseconds to timespec (for clock_nanosleep & co.)
+    inline struct timespec ns_to_timespec(uint64_t ns)
+    {
+        struct timespec ts;
+        ts.tv_sec = ns / NSEC_PER_SEC;
+        ts.tv_nsec = ns % NSEC_PER_SEC;
+        return ts;
+    }
+
+#endif // IPK_CLOCK_H_
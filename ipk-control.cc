@@ -0,0 +1,419 @@
+/**
+ *  @file       ipk-control.cc
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Control protocol implementation.
+ */
+
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <endian.h>
+#include <poll.h>
+
+#include "ipk-control.h"
+#include "ipk-clock.h"
+
+
+/**
+ * @brief Builds a control message in network byte order
+ * 
+ * @param buffer output, at least CONTROL_FRAME_MAX bytes
+ * @param type CONTROL_* message type
+ * @param session_id session the message belongs to
+ * @param round round the message refers to
+ * @param payload serialized payload, may be nullptr when 'length' is 0
+ * @param length payload size, at most CONTROL_FRAME_MAX - CONTROL_HEADER_SIZE
+ * @return size of the whole message
+ */
+size_t control_write(char* buffer, uint8_t type, uint32_t session_id, uint32_t round,
+                     const char* payload, size_t length)
+{
+  control_header_t wire;
+
+  wire.magic = htobe32(CONTROL_MAGIC);
+  wire.version = CONTROL_VERSION;
+  wire.type = type;
+  wire.length = htobe16(static_cast<uint16_t>(length));
+  wire.session_id = htobe32(session_id);
+  wire.round = htobe32(round);
+
+  std::memcpy(buffer, &wire, sizeof(wire));
+  if (length > 0)
+    std::memcpy(buffer + sizeof(wire), payload, length);
+
+  return sizeof(wire) + length;
+}
+
+
+/**
+ * @brief Parses the header of a control message
+ * 
+ * @desc The version is not checked here, the receiver decides what to do
+ * with a message of another version.
+ * @param buffer received datagram
+ * @param length datagram length
+ * @param header output, header in host byte order
+ * @param payload output, start of the payload inside 'buffer'
+ * @return false when the datagram is not a (complete) control message
+ */
+bool control_read(const char* buffer, size_t length, control_header_t& header, const char** payload)
+{
+  if (length < sizeof(header))
+    return false;
+
+  std::memcpy(&header, buffer, sizeof(header));
+
+  header.magic = be32toh(header.magic);
+  if (header.magic != CONTROL_MAGIC)
+    return false;
+
+  header.length = be16toh(header.length);
+  header.session_id = be32toh(header.session_id);
+  header.round = be32toh(header.round);
+
+  if (length < sizeof(header) + header.length)
+    return false;
+
+  *payload = buffer + sizeof(header);
+  return true;
+}
+
+
+/**
+ * @brief Writes 32 bit fields in network byte order
+ */
+static void write_fields(char* buffer, const uint32_t* fields, size_t count)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    uint32_t wire = htobe32(fields[i]);
+    std::memcpy(buffer + i * sizeof(wire), &wire, sizeof(wire));
+  }
+}
+
+
+/**
+ * @brief Reads the 32 bit fields present in 'length' bytes, the others keep their value
+ */
+static void read_fields(const char* buffer, size_t length, uint32_t* const* fields, size_t count)
+{
+  for (size_t i = 0; i < count && (i + 1) * sizeof(uint32_t) <= length; i++)
+  {
+    uint32_t wire;
+    std::memcpy(&wire, buffer + i * sizeof(wire), sizeof(wire));
+    *fields[i] = be32toh(wire);
+  }
+}
+
+
+/**
+ * @brief Serializes the parameters of a hello
+ * 
+ * @param buffer output, CONTROL_HELLO_SIZE bytes
+ * @param hello parameters in host byte order
+ */
+void control_hello_write(char* buffer, const control_hello_t& hello)
+{
+  const uint32_t fields[] = { hello.probe_size, hello.total_time, hello.streams,
+    hello.round_ms, hello.capabilities, hello.batch_depth, hello.interval_us, hello.max_rate };
+
+  write_fields(buffer, fields, sizeof(fields) / sizeof(fields[0]));
+}
+
+
+/**
+ * @brief Parses the parameters of a hello
+ * 
+ * @param buffer received payload
+ * @param length payload length, fields beyond it get their defaults
+ * @param hello output, parameters in host byte order
+ */
+void control_hello_read(const char* buffer, size_t length, control_hello_t& hello)
+{
+  hello = control_hello_t {0, 0, 1, DEFAULT_ROUND_MS, 0, 1, 0, 0};
+
+  uint32_t* const fields[] = { &hello.probe_size, &hello.total_time, &hello.streams,
+    &hello.round_ms, &hello.capabilities, &hello.batch_depth, &hello.interval_us, &hello.max_rate };
+
+  read_fields(buffer, length, fields, sizeof(fields) / sizeof(fields[0]));
+}
+
+
+/**
+ * @brief Serializes the parameters the reflector agreed to
+ * 
+ * @param buffer output, CONTROL_ACK_SIZE bytes
+ * @param ack parameters in host byte order
+ */
+void control_ack_write(char* buffer, const control_ack_t& ack)
+{
+  const uint32_t fields[] = { ack.capabilities, ack.streams, ack.round_ms, ack.batch_depth, ack.interval_us };
+
+  write_fields(buffer, fields, sizeof(fields) / sizeof(fields[0]));
+}
+
+
+/**
+ * @brief Parses the parameters the reflector agreed to
+ * 
+ * @param buffer received payload
+ * @param length payload length, fields beyond it get their defaults
+ * @param ack output, parameters in host byte order
+ */
+void control_ack_read(const char* buffer, size_t length, control_ack_t& ack)
+{
+  ack = control_ack_t {0, 1, DEFAULT_ROUND_MS, 1, 0};
+
+  uint32_t* const fields[] = { &ack.capabilities, &ack.streams, &ack.round_ms, &ack.batch_depth, &ack.interval_us };
+
+  read_fields(buffer, length, fields, sizeof(fields) / sizeof(fields[0]));
+}
+
+
+/**
+ * @brief Serializes the reason of a reject
+ * 
+ * @param buffer output, CONTROL_REJECT_SIZE bytes
+ * @param reason REJECT_* reason
+ */
+void control_reject_write(char* buffer, uint32_t reason)
+{
+  write_fields(buffer, &reason, 1);
+}
+
+
+/**
+ * @brief Parses the reason of a reject
+ * 
+ * @param buffer received payload
+ * @param length payload length
+ * @return REJECT_* reason, REJECT_PARAMS when the payload is missing
+ */
+uint32_t control_reject_read(const char* buffer, size_t length)
+{
+  uint32_t reason = REJECT_PARAMS;
+  uint32_t* const fields[] = { &reason };
+
+  read_fields(buffer, length, fields, 1);
+  return reason;
+}
+
+
+/**
+ * @brief Serializes the probes asked for in the reverse direction
+ * 
+ * @param buffer output, CONTROL_REVERSE_SIZE bytes
+ * @param reverse rate & port in host byte order
+ */
+void control_reverse_write(char* buffer, const control_reverse_t& reverse)
+{
+  const uint32_t fields[] = { reverse.rate, reverse.port };
+
+  write_fields(buffer, fields, sizeof(fields) / sizeof(fields[0]));
+}
+
+
+/**
+ * @brief Parses the probes asked for in the reverse direction
+ * 
+ * @param buffer received payload
+ * @param length payload length, fields beyond it are 0
+ * @param reverse output, rate & port in host byte order
+ */
+void control_reverse_read(const char* buffer, size_t length, control_reverse_t& reverse)
+{
+  reverse = control_reverse_t {0, 0};
+
+  uint32_t* const fields[] = { &reverse.rate, &reverse.port };
+
+  read_fields(buffer, length, fields, sizeof(fields) / sizeof(fields[0]));
+}
+
+
+/**
+ * @brief Lists the capability bits as text
+ * 
+ * @param capabilities CAP_* bits
+ * @return names separated by commas, "none" when no bit is set
+ */
+std::string capability_names(uint32_t capabilities)
+{
+  static const std::pair<uint32_t, const char*> names[] = {
+    {CAP_MULTI_STREAM, "multi-stream"}, {CAP_BATCHING, "batching"}, {CAP_TIMESTAMPS, "timestamps"},
+    {CAP_GRO, "gro"}, {CAP_ROUND_LENGTH, "round-length"}, {CAP_DISPERSION, "dispersion"},
+    {CAP_TIMELINE, "timeline"}, {CAP_HOST_DROPS, "host-drops"}, {CAP_REVERSE, "reverse"},
+    {CAP_ECHO, "echo"} };
+
+  std::string result;
+  for (const auto& name : names)
+  {
+    if (capabilities & name.first)
+      result += (result.empty() ? "" : ",") + std::string(name.second);
+  }
+
+  return result.empty() ? "none" : result;
+}
+
+
+/*****************************************************************************/
+
+/**
+ * @brief Request/reply with retransmission
+ * 
+ * @desc The request is sent again whenever the reply does not come within
+ * the timeout, which doubles with every attempt. Messages of other sessions,
+ * rounds or types (replies to earlier attempts) are skipped.
+ * @param type CONTROL_* type of the request
+ * @param round round the request refers to
+ * @param payload serialized request payload
+ * @param length request payload size
+ * @param reply_type expected CONTROL_* type of the reply
+ * @param reply output, payload of the reply
+ * @param reply_size size of 'reply'
+ * @return length of the reply payload, -1 when rejected or nothing came after CONTROL_RETRIES attempts
+ */
+int ControlChannel::exchange(uint8_t type, uint32_t round, const char* payload, size_t length,
+                             uint8_t reply_type, char* reply, size_t reply_size)
+{
+  char frame[CONTROL_FRAME_MAX];
+  control_header_t header;
+  const char* received_payload;
+
+  reject_reason = 0;
+  int timeout_ms = CONTROL_TIMEOUT_MS;
+
+  for (int attempt = 0; attempt <= CONTROL_RETRIES; attempt++, timeout_ms *= 2)
+  {
+    size_t size = control_write(frame, type, session_id, round, payload, length);
+    socket->send_message(frame, size);
+
+    uint64_t deadline = monotonic_ns() + timeout_ms * NSEC_PER_MSEC;
+    for (uint64_t now = monotonic_ns(); now < deadline; now = monotonic_ns())
+    {
+      if (!socket->wait_readable(static_cast<int>((deadline - now) / NSEC_PER_MSEC) + 1))
+        break;
+
+      ssize_t bytes_recv = socket->recv_message(frame, sizeof(frame));
+      if (bytes_recv < 0 || !control_read(frame, bytes_recv, header, &received_payload) || header.session_id != session_id)
+        continue;
+
+      peer_version = header.version;
+
+      if (header.type == CONTROL_REJECT)
+      {
+        // the layout of the payload is known only for our version
+        reject_reason = header.version == CONTROL_VERSION ? control_reject_read(received_payload, header.length) : REJECT_VERSION;
+        return -1;
+      }
+
+      if (header.version != CONTROL_VERSION || header.type != reply_type || header.round != round)
+        continue;
+
+      size_t copied = std::min<size_t>(header.length, reply_size);
+      if (copied > 0)
+        std::memcpy(reply, received_payload, copied);
+      return header.length;
+    }
+  }
+
+  return -1;
+}
+
+
+/**
+ * @brief Races the addresses of the reflector against each other
+ * 
+ * @desc Every address gets a socket of its own and a ping, the first one
+ * right away, every next one HAPPY_EYEBALLS_DELAY_MS later unless an answer
+ * came before. The pings are repeated every CONTROL_TIMEOUT_MS, all
+ * addresses started are waited for at once. A reject (other protocol
+ * version) is an answer as well, the hello tells the reason later. Pings
+ * open no session, the race leaves nothing behind on the reflector.
+ * @param addresses control port at every address of the reflector, in the order of preference
+ * @param wait_all go on until every address answered (or the timeout), to know all reachable ones
+ * @param results output, the answer of every address
+ * @return index of the first address to answer, -1 when none did
+ */
+int control_race(const std::vector<struct sockaddr_storage>& addresses, bool wait_all, std::vector<race_result_t>& results)
+{
+  uint32_t token = std::random_device{}();
+  std::vector<std::unique_ptr<SocketEntity>> sockets;
+  std::vector<uint64_t> sent_at(addresses.size(), 0);
+  results.assign(addresses.size(), race_result_t {});
+  for (size_t i = 0; i < addresses.size(); i++)
+    results[i].address = addresses[i];
+
+  char frame[CONTROL_FRAME_MAX];
+  size_t ping_size = control_write(frame, CONTROL_PING, token, 0);
+  std::vector<char> ping(frame, frame + ping_size);
+
+  int winner = -1;
+  size_t answered = 0;
+  uint64_t start = monotonic_ns();
+  uint64_t end = start + ((addresses.size() - 1) * HAPPY_EYEBALLS_DELAY_MS + HAPPY_EYEBALLS_TIMEOUT_MS) * NSEC_PER_MSEC;
+
+  for (uint64_t now = start; now < end && answered < addresses.size(); now = monotonic_ns())
+  {
+    if (winner >= 0 && !wait_all)
+      break;
+
+    // the next address joins the race when its turn comes
+    if (sockets.size() < addresses.size() && now >= start + sockets.size() * HAPPY_EYEBALLS_DELAY_MS * NSEC_PER_MSEC)
+    {
+      sockets.emplace_back(new SocketEntity());
+      if (sockets.back()->setup_connection(addresses[sockets.size() - 1]) != EXIT_SUCCESS)
+        sockets.back().reset();
+    }
+
+    // (re)send the pings due
+    std::vector<struct pollfd> fds;
+    std::vector<size_t> owners;
+    for (size_t i = 0; i < sockets.size(); i++)
+    {
+      if (!sockets[i] || results[i].answered)
+        continue;
+      if (now >= sent_at[i] + CONTROL_TIMEOUT_MS * NSEC_PER_MSEC)
+      {
+        sockets[i]->send_message(ping.data(), ping.size());
+        sent_at[i] = now;
+      }
+      fds.push_back({sockets[i]->get_fd(), POLLIN, 0});
+      owners.push_back(i);
+    }
+
+    // until the next ping, the next address or the end
+    uint64_t wake = std::min<uint64_t>(end, now + CONTROL_TIMEOUT_MS * NSEC_PER_MSEC);
+    if (sockets.size() < addresses.size())
+      wake = std::min<uint64_t>(wake, start + sockets.size() * HAPPY_EYEBALLS_DELAY_MS * NSEC_PER_MSEC);
+    int timeout_ms = static_cast<int>((wake > now ? wake - now : 0) / NSEC_PER_MSEC) + 1;
+    if (poll(fds.data(), fds.size(), timeout_ms) <= 0)
+      continue;
+
+    for (size_t f = 0; f < fds.size(); f++)
+    {
+      // an ICMP unreachable is read (and cleared) as an error
+      if (!(fds[f].revents & (POLLIN | POLLERR)))
+        continue;
+
+      size_t i = owners[f];
+      control_header_t header;
+      const char* payload;
+      ssize_t bytes_recv = sockets[i]->recv_message(frame, sizeof(frame));
+      if (bytes_recv < 0 || !control_read(frame, bytes_recv, header, &payload) || header.session_id != token)
+        continue;
+      if (header.type != CONTROL_PONG && header.type != CONTROL_REJECT)
+        continue;
+
+      results[i].answered = true;
+      results[i].rtt_ms = (monotonic_ns() - sent_at[i]) / static_cast<double>(NSEC_PER_MSEC);
+      answered++;
+      if (winner < 0)
+        winner = static_cast<int>(i);
+    }
+  }
+
+  return winner;
+}
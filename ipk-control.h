@@ -0,0 +1,212 @@
+/**
+ *  @file       ipk-control.h
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Control protocol.
+ *  
+ *  @section Description
+ *  
+ *  Meter and reflector agree on a measurement and exchange the round reports
+ *  over a control channel of its own, a separate socket pair next to the probe
+ *  sockets. Every message starts with a packed header in network byte order
+ *  carrying the protocol version, the message type and the session id.
+ *  
+ *  The meter drives the protocol, each request is retransmitted until its reply
+ *  comes (with a growing timeout), the reflector answers repeated requests with
+ *  the same reply. The hello negotiates the features of the measurement, so
+ *  a meter only turns on what the reflector on the other side supports.
+ *  Payloads may grow in later versions, readers take the fields they know and
+ *  use defaults for the missing ones.
+ */
+
+#ifndef IPK_CONTROL_H_
+#define IPK_CONTROL_H_
+
+    #include <stdint.h>
+    #include <stddef.h>
+    #include <memory>
+    #include <string>
+    #include <vector>
+
+    #include "ipk-probe.h"
+    #include "ipk-socket.h"
+
+    // "IPKC", marks a datagram as a control message
+    #define CONTROL_MAGIC 0x49504b43U
+
+    // version of the control protocol, both sides have to speak the same one
+    #define CONTROL_VERSION 1
+
+    // the control channel listens on the probe port + this offset by default
+    #define CONTROL_PORT_OFFSET 1
+
+    // control message types
+    #define CONTROL_HELLO      1 // meter -> reflector, starts a session (control_hello_t payload)
+    #define CONTROL_HELLO_ACK  2 // reflector -> meter, session accepted (control_ack_t payload)
+    #define CONTROL_REJECT     3 // reflector -> meter, session refused (reason payload)
+    #define CONTROL_ROUND_END  4 // meter -> reflector, all probes of the round were sent
+    #define CONTROL_REPORT     5 // reflector -> meter, round report (ROUND_REPORT_SIZE payload, dispersion vector & timeline after it)
+    #define CONTROL_PING       6 // meter -> reflector, is anybody there (no payload, no session is opened)
+    #define CONTROL_PONG       7 // reflector -> meter, answer to a ping
+    #define CONTROL_REVERSE    8 // meter -> reflector, send probes back during the round (control_reverse_t payload)
+    #define CONTROL_REVERSE_ACK 9 // reflector -> meter, the probes of the round are on their way (control_reverse_t payload)
+
+    // reasons of a reject
+    #define REJECT_VERSION 1 // other protocol version, the header carries the one of the reflector
+    #define REJECT_PARAMS  2 // invalid measurement parameters
+    #define REJECT_FULL    3 // no room for another session
+
+    // capabilities, requested by the meter, granted by the reflector
+    #define CAP_MULTI_STREAM 0x0001 // probes of one session come from several sockets
+    #define CAP_BATCHING     0x0002 // probes are received in batches (recvmmsg, io_uring)
+    #define CAP_TIMESTAMPS   0x0004 // reflector delays are based on kernel/NIC RX timestamps
+    #define CAP_GRO          0x0008 // bursts of a flow are received coalesced (UDP GRO)
+    #define CAP_ROUND_LENGTH 0x0010 // rounds of other length than DEFAULT_ROUND_MS
+    #define CAP_DISPERSION   0x0020 // arrival times of train probes are reported back
+    #define CAP_TIMELINE     0x0040 // received probes are reported per interval of their send time
+    #define CAP_HOST_DROPS   0x0080 // datagrams dropped by the reflector host are reported apart from path loss
+    #define CAP_REVERSE      0x0100 // the reflector sends probes to the meter (downstream & bidirectional rounds)
+    #define CAP_ECHO         0x0200 // probes flagged PROBE_ECHO are sent straight back (loaded RTT)
+
+    // length of a round unless both sides agree on another one, and the range a reflector accepts
+    #define DEFAULT_ROUND_MS 1000
+    #define ROUND_MIN_MS 10
+    #define ROUND_MAX_MS 60000
+
+    // retransmission of the requests, the timeout doubles with every attempt
+    #define CONTROL_TIMEOUT_MS 250
+    #define CONTROL_RETRIES 5
+
+    // happy eyeballs: the next address is tried this long after the previous one (RFC 8305),
+    // the race gives up after the last one
+    #define HAPPY_EYEBALLS_DELAY_MS 250
+    #define HAPPY_EYEBALLS_TIMEOUT_MS 2000
+
+    /**
+     * @brief Control message header, as it is laid out on the wire
+     */
+    struct __attribute__((packed)) control_header_t
+    {
+        uint32_t magic;
+        uint8_t version;
+        uint8_t type;
+        uint16_t length;       // payload bytes following the header
+        uint32_t session_id;
+        uint32_t round;        // round the message refers to
+    };
+
+    #define CONTROL_HEADER_SIZE sizeof(control_header_t)
+
+    /**
+     * @brief Parameters the meter asks for, payload of CONTROL_HELLO
+     */
+    struct control_hello_t
+    {
+        uint32_t probe_size;
+        uint32_t total_time;   // number of rounds
+        uint32_t streams;      // meter sender threads (= sockets)
+        uint32_t round_ms;     // length of a round
+        uint32_t capabilities; // CAP_* wanted by the meter
+        uint32_t batch_depth;  // datagrams per send call of the meter
+        uint32_t interval_us;  // timeline interval, 0 = no timeline
+        uint32_t max_rate;     // highest rate the meter may send (packets/second), 0 = unknown ('-R' not given)
+    };
+
+    /**
+     * @brief Parameters the reflector agreed to, payload of CONTROL_HELLO_ACK
+     */
+    struct control_ack_t
+    {
+        uint32_t capabilities; // CAP_* granted, subset of the requested ones
+        uint32_t streams;      // streams the meter may use
+        uint32_t round_ms;     // length of a round
+        uint32_t batch_depth;  // datagrams per receive call of the reflector
+        uint32_t interval_us;  // timeline interval, 0 = no timeline
+    };
+
+    /**
+     * @brief Probes the meter asks for in a round, payload of CONTROL_REVERSE and its ack
+     */
+    struct control_reverse_t
+    {
+        uint32_t rate; // packets/second, the ack carries the rate the reflector paces at
+        uint32_t port; // port the meter receives them on, at the address of its control socket
+    };
+
+    // sizes of the serialized payloads
+    #define CONTROL_HELLO_SIZE  (8 * sizeof(uint32_t))
+    #define CONTROL_ACK_SIZE    (5 * sizeof(uint32_t))
+    #define CONTROL_REJECT_SIZE sizeof(uint32_t)
+    #define CONTROL_REVERSE_SIZE (2 * sizeof(uint32_t))
+
+    // largest control message
+    #define CONTROL_FRAME_MAX (CONTROL_HEADER_SIZE + ROUND_REPORT_MAX_SIZE)
+
+    // writes header & 'length' bytes of 'payload' to 'buffer' (CONTROL_FRAME_MAX bytes), returns the message size
+    size_t control_write(char* buffer, uint8_t type, uint32_t session_id, uint32_t round,
+                         const char* payload = nullptr, size_t length = 0);
+
+    // parses a control message of any version, 'payload' points into 'buffer', false when it is not one
+    bool control_read(const char* buffer, size_t length, control_header_t& header, const char** payload);
+
+    // (de)serialization in network byte order, readers fill fields missing in 'length' bytes with defaults
+    void control_hello_write(char* buffer, const control_hello_t& hello);
+    void control_hello_read(const char* buffer, size_t length, control_hello_t& hello);
+    void control_ack_write(char* buffer, const control_ack_t& ack);
+    void control_ack_read(const char* buffer, size_t length, control_ack_t& ack);
+    void control_reject_write(char* buffer, uint32_t reason);
+    uint32_t control_reject_read(const char* buffer, size_t length);
+    void control_reverse_write(char* buffer, const control_reverse_t& reverse);
+    void control_reverse_read(const char* buffer, size_t length, control_reverse_t& reverse);
+
+    // names of the capability bits, for the output
+    std::string capability_names(uint32_t capabilities);
+
+
+    /**
+     * @brief Meter end of the control channel
+     * 
+     * @desc Wraps a socket connected to the control port of the reflector and
+     * turns request/reply pairs into a single call with retransmission.
+     */
+    class ControlChannel
+    {
+        private:
+            std::shared_ptr<SocketEntity> socket;
+            uint32_t session_id;
+            uint32_t reject_reason;
+            uint8_t peer_version;
+
+        public:
+            ControlChannel(std::shared_ptr<SocketEntity> socket, uint32_t session_id)
+                : socket {socket}, session_id {session_id}, reject_reason {0}, peer_version {CONTROL_VERSION} {}
+
+            // sends the request until a 'reply_type' message of the same round comes, copies its payload
+            // (at most 'reply_size' bytes) to 'reply', returns the payload length, -1 on reject or timeout
+            int exchange(uint8_t type, uint32_t round, const char* payload, size_t length,
+                         uint8_t reply_type, char* reply, size_t reply_size);
+
+            // reason of the last reject, 0 when the reflector did not answer at all
+            inline uint32_t get_reject_reason() const { return reject_reason; }
+            inline uint8_t get_peer_version() const { return peer_version; }
+    };
+
+
+    /**
+     * @brief Answer of one address in the race
+     */
+    struct race_result_t
+    {
+        struct sockaddr_storage address; // control port of the reflector
+        bool answered;
+        double rtt_ms;                   // of the ping that got answered
+    };
+
+    // happy eyeballs (RFC 8305): pings the control port at every address, each HAPPY_EYEBALLS_DELAY_MS after
+    // the previous one, all of them go on in parallel; ends at the first answer or, 'wait_all', once every
+    // address answered, returns the index of the first one to answer, -1 when none did
+    int control_race(const std::vector<struct sockaddr_storage>& addresses, bool wait_all, std::vector<race_result_t>& results);
+
+#endif // IPK_CONTROL_H_
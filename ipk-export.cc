@@ -0,0 +1,317 @@
+/**
+ *  @file       ipk-export.cc
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Result export implementation.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <endian.h>
+
+#include "ipk-export.h"
+
+using std::cerr;
+using std::endl;
+
+
+/**
+ * @brief Creates an exporter, nothing is written before open()
+ * 
+ * @param format format of the file
+ * @param path path of the file
+ */
+Exporter::Exporter(format_t format, const std::string& path)
+  : format {format},
+    path (path),
+    buffer (EXPORT_BUFFER_SIZE),
+    first_round {true},
+    summary_written {false},
+    closing {false}
+{}
+
+
+/**
+ * @brief Opens the file and starts the writer thread
+ * 
+ * @desc JSON & CSV files are rewritten, the binary stream is appended to,
+ * its header goes out only when the file is new (empty).
+ * @return false when the file can not be opened
+ */
+bool Exporter::open()
+{
+  std::ios::openmode mode = std::ios::out | (format == BINARY ? std::ios::app | std::ios::binary : std::ios::trunc);
+
+  // the buffer has to be set before the file is opened
+  out.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+  out.open(path, mode);
+  if (!out)
+  {
+    cerr << "ERROR: can not write " << format_name(format) << " export to '" << path << "'" << endl;
+    return false;
+  }
+
+  switch (format)
+  {
+    case JSON:
+      out << "{\n  \"rounds\": [";
+      break;
+    case CSV:
+      out << "round,timestamp,time_ms,rtt_ms,rate,achieved_rate,next_rate,converged,sent,received,lost,reordered,"
+             "duplicates,late,stale,invalid,speed_mbps,gap_mean_us,gap_jitter_us,queueing_us,owd_variation_us,"
+             "owd_max_us,jitter_us\n";
+      break;
+    case BINARY:
+      if (out.tellp() == 0)
+      {
+        uint32_t magic = htobe32(EXPORT_MAGIC);
+        uint16_t version = htobe16(EXPORT_VERSION);
+        out.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+        out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+      }
+      break;
+  }
+
+  writer = std::thread(&Exporter::run, this);
+  return true;
+}
+
+
+/**
+ * @brief Hands a record over to the writer thread
+ */
+void Exporter::push(const record_t& record)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (closing || !writer.joinable())
+      return;
+    queue.push_back(record);
+  }
+  wake.notify_one();
+}
+
+
+/**
+ * @brief Writer thread, takes the queued records all at once and writes them without the lock
+ */
+void Exporter::run()
+{
+  std::deque<record_t> records;
+  bool done = false;
+
+  while (!done)
+  {
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      wake.wait(guard, [this]() { return closing || !queue.empty(); });
+      records.swap(queue);
+      done = closing;
+    }
+
+    for (const record_t& record : records)
+    {
+      switch (format)
+      {
+        case JSON:   write_json(record); break;
+        case CSV:    write_csv(record); break;
+        case BINARY: write_binary(record); break;
+      }
+    }
+    records.clear();
+
+    // readers of a long run see every batch
+    out.flush();
+  }
+}
+
+
+/**
+ * @brief Writes the queued records and closes the file
+ */
+void Exporter::close()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!writer.joinable())
+      return;
+    closing = true;
+  }
+  wake.notify_one();
+  writer.join();
+
+  if (format == JSON)
+    out << (summary_written ? "" : "\n  ]") << "\n}\n";
+  out.close();
+}
+
+
+/**
+ * @brief One round as an element of the "rounds" array, the summary as the last member of the document
+ */
+void Exporter::write_json(const record_t& record)
+{
+  out << std::fixed << std::setprecision(3);
+
+  if (!record.is_summary)
+  {
+    const export_round_t& r = record.round;
+    out << (first_round ? "\n" : ",\n") << "    {"
+        << "\"round\": " << r.round << ", \"timestamp\": " << r.timestamp << ", \"time_ms\": " << r.time_ms << ", \"rtt_ms\": ";
+    if (r.rtt_ms >= 0)
+      out << r.rtt_ms;
+    else
+      out << "null";
+    out << ", \"rate\": " << r.rate << ", \"achieved_rate\": " << r.achieved_rate << ", \"next_rate\": " << r.next_rate
+        << ", \"converged\": " << (r.converged ? "true" : "false")
+        << ", \"sent\": " << r.sent << ", \"received\": " << r.report.received << ", \"lost\": " << r.report.lost
+        << ", \"reordered\": " << r.report.reordered << ", \"duplicates\": " << r.report.duplicates
+        << ", \"late\": " << r.report.late << ", \"stale\": " << r.report.stale << ", \"invalid\": " << r.report.invalid
+        << ", \"speed_mbps\": " << r.speed << ", \"gap_mean_us\": " << r.gap_mean << ", \"gap_jitter_us\": " << r.gap_jitter
+        << ", \"queueing_us\": " << r.queueing_us << ", \"owd_variation_us\": " << r.report.owd_variation / 1000.0
+        << ", \"owd_max_us\": " << (r.report.owd_max - r.report.owd_min) / 1000.0 << ", \"jitter_us\": " << r.report.jitter / 1000.0
+        << "}";
+    first_round = false;
+    return;
+  }
+
+  // a second summary would break the document
+  if (summary_written)
+    return;
+  summary_written = true;
+
+  const export_summary_t& s = record.summary;
+  out << "\n  ],\n  \"summary\": {\n"
+      << "    \"timestamp\": " << s.timestamp << ", \"probe_size\": " << s.probe_size << ", \"rounds\": " << s.rounds
+      << ", \"round_ms\": " << s.round_ms << ",\n"
+      << "    \"packets\": {\"sent\": " << s.sent << ", \"received\": " << s.received << "},\n"
+      << "    \"speed_mbps\": {\"min\": " << s.speed_min << ", \"max\": " << s.speed_max << ", \"mean\": " << s.speed_mean
+      << ", \"std_dev\": " << s.speed_std_dev << "},\n"
+      << "    \"rtt_ms\": {\"samples\": " << s.rtt_samples << ", \"min\": " << s.rtt_min << ", \"max\": " << s.rtt_max
+      << ", \"mean\": " << s.rtt_mean << ", \"std_dev\": " << s.rtt_std_dev << ", \"p50\": " << s.rtt_p50
+      << ", \"p90\": " << s.rtt_p90 << ", \"p99\": " << s.rtt_p99 << ", \"p99.9\": " << s.rtt_p999 << "},\n"
+      << "    \"rate_search\": {\"algorithm\": \"" << RateStrategy::algorithm_name(s.algorithm) << "\", \"converged\": "
+      << (s.convergence.converged ? "true" : "false");
+  if (s.convergence.converged)
+    out << ", \"time_ms\": " << s.convergence.time_ms << ", \"rounds\": " << s.convergence.rounds
+        << ", \"rate\": " << s.convergence.rate;
+  out << "}\n  }";
+}
+
+
+/**
+ * @brief One line per round, the summary has no place in the table
+ */
+void Exporter::write_csv(const record_t& record)
+{
+  if (record.is_summary)
+    return;
+
+  const export_round_t& r = record.round;
+  out << std::fixed << std::setprecision(3)
+      << r.round << ',' << r.timestamp << ',' << r.time_ms << ',';
+  if (r.rtt_ms >= 0)
+    out << r.rtt_ms;
+  out << ',' << r.rate << ',' << r.achieved_rate << ',' << r.next_rate << ',' << (r.converged ? 1 : 0)
+      << ',' << r.sent << ',' << r.report.received << ',' << r.report.lost << ',' << r.report.reordered
+      << ',' << r.report.duplicates << ',' << r.report.late << ',' << r.report.stale << ',' << r.report.invalid
+      << ',' << r.speed << ',' << r.gap_mean << ',' << r.gap_jitter << ',' << r.queueing_us
+      << ',' << r.report.owd_variation / 1000.0 << ',' << (r.report.owd_max - r.report.owd_min) / 1000.0
+      << ',' << r.report.jitter / 1000.0 << '\n';
+}
+
+
+/**
+ * @brief Fixed size record: type (16 bit), payload length (16 bit), then 64 bit fields
+ * 
+ * @desc Integers are big endian, doubles are their IEEE 754 bits stored the
+ * same way. Fields are only ever appended to a record type, readers skip
+ * what they do not know by the length.
+ */
+void Exporter::write_binary(const record_t& record)
+{
+  std::vector<uint64_t> fields;
+  auto real = [](double value) { uint64_t bits; std::memcpy(&bits, &value, sizeof(bits)); return bits; };
+  uint16_t type;
+
+  if (!record.is_summary)
+  {
+    const export_round_t& r = record.round;
+    const round_report_t& report = r.report;
+    type = EXPORT_RECORD_ROUND;
+    fields = { r.round, r.timestamp, real(r.time_ms), real(r.rtt_ms), static_cast<uint64_t>(r.rate), real(r.achieved_rate),
+               static_cast<uint64_t>(r.next_rate), r.converged, static_cast<uint64_t>(r.sent),
+               static_cast<uint64_t>(report.received), static_cast<uint64_t>(report.lost), static_cast<uint64_t>(report.reordered),
+               static_cast<uint64_t>(report.duplicates), static_cast<uint64_t>(report.late), static_cast<uint64_t>(report.stale),
+               static_cast<uint64_t>(report.invalid), real(r.speed), real(r.gap_mean), real(r.gap_jitter), real(r.queueing_us),
+               static_cast<uint64_t>(report.owd_variation), static_cast<uint64_t>(report.owd_max - report.owd_min),
+               static_cast<uint64_t>(report.jitter) };
+  }
+  else
+  {
+    const export_summary_t& s = record.summary;
+    type = EXPORT_RECORD_SUMMARY;
+    fields = { s.timestamp, static_cast<uint64_t>(s.probe_size), static_cast<uint64_t>(s.rounds), s.round_ms,
+               static_cast<uint64_t>(s.algorithm), static_cast<uint64_t>(s.sent), static_cast<uint64_t>(s.received),
+               real(s.speed_min), real(s.speed_max), real(s.speed_mean), real(s.speed_std_dev), s.rtt_samples,
+               real(s.rtt_min), real(s.rtt_max), real(s.rtt_mean), real(s.rtt_std_dev),
+               real(s.rtt_p50), real(s.rtt_p90), real(s.rtt_p99), real(s.rtt_p999),
+               s.convergence.converged, real(s.convergence.time_ms), static_cast<uint64_t>(s.convergence.rounds),
+               static_cast<uint64_t>(s.convergence.rate) };
+  }
+
+  uint16_t wire_type = htobe16(type);
+  uint16_t wire_length = htobe16(static_cast<uint16_t>(fields.size() * sizeof(uint64_t)));
+  out.write(reinterpret_cast<const char*>(&wire_type), sizeof(wire_type));
+  out.write(reinterpret_cast<const char*>(&wire_length), sizeof(wire_length));
+
+  for (uint64_t field : fields)
+  {
+    uint64_t wire = htobe64(field);
+    out.write(reinterpret_cast<const char*>(&wire), sizeof(wire));
+  }
+}
+
+
+/**
+ * @brief Parses the argument of '-e'
+ * 
+ * @param spec "json:path", "csv:path" or "bin:path"
+ * @param format output
+ * @param path output
+ * @return false on unknown format or missing path
+ */
+bool Exporter::parse(const std::string& spec, format_t& format, std::string& path)
+{
+  size_t colon = spec.find(':');
+  if (colon == std::string::npos || colon + 1 == spec.size())
+    return false;
+
+  std::string name = spec.substr(0, colon);
+  if (name == "json")
+    format = JSON;
+  else if (name == "csv")
+    format = CSV;
+  else if (name == "bin")
+    format = BINARY;
+  else
+    return false;
+
+  path = spec.substr(colon + 1);
+  return true;
+}
+
+
+const char* Exporter::format_name(format_t format)
+{
+  switch (format)
+  {
+    case CSV:    return "csv";
+    case BINARY: return "binary";
+    case JSON:
+    default:     return "json";
+  }
+}
@@ -0,0 +1,160 @@
+/**
+ *  @file       ipk-export.h
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Result export.
+ *  
+ *  @section Description
+ *  
+ *  The terminal output is meant for people, dashboards get the same numbers
+ *  from a file in one of three formats:
+ *  
+ *  * json - one document, the rounds as an array and the summary of the
+ *           measurement (RTT percentiles, convergence) after them
+ *  * csv  - one line per round behind a header line
+ *  * bin  - append-only stream of fixed size records in network byte order,
+ *           a run is its round records closed by a summary record
+ *  
+ *  The meter only queues the records, a writer thread formats them and writes
+ *  them through a large buffer, so the file never stalls a round.
+ */
+
+#ifndef IPK_EXPORT_H_
+#define IPK_EXPORT_H_
+
+    #include <stdint.h>
+    #include <condition_variable>
+    #include <deque>
+    #include <fstream>
+    #include <mutex>
+    #include <string>
+    #include <thread>
+    #include <vector>
+
+    #include "ipk-probe.h"
+    #include "ipk-rate.h"
+
+    // buffer of the output file
+    #define EXPORT_BUFFER_SIZE (64 * 1024)
+
+    // binary stream: header once at the start of the file, then the records
+    #define EXPORT_MAGIC   0x4d545258 // "MTRX"
+    #define EXPORT_VERSION 1
+
+    // types of the binary records
+    #define EXPORT_RECORD_ROUND   1
+    #define EXPORT_RECORD_SUMMARY 2
+
+    /**
+     * @brief Everything known about one round of the rate search
+     */
+    struct export_round_t
+    {
+        uint32_t round;         // from 1
+        uint64_t timestamp;     // CLOCK_REALTIME ns at the end of the round
+        double time_ms;         // end of the round since the start of the measurement
+        double rtt_ms;          // RTT probe of the round, negative when it got lost
+        long long rate;         // requested packets/second
+        double achieved_rate;   // packets/second really sent
+        long long next_rate;    // rate the strategy picked for the next round
+        bool converged;         // the strategy settled
+        long sent;
+        double speed;           // Mb/s received over the length of the round
+        double gap_mean;        // us
+        double gap_jitter;      // us
+        double queueing_us;     // mean one-way delay above the lowest one of the measurement
+        round_report_t report;  // counters & one-way delays of the reflector
+    };
+
+    /**
+     * @brief Results of the whole measurement
+     */
+    struct export_summary_t
+    {
+        uint64_t timestamp;     // CLOCK_REALTIME ns at the end
+        int probe_size;
+        int rounds;
+        unsigned round_ms;
+        RateStrategy::algorithm_t algorithm;
+        long sent;
+        long received;
+        double speed_min;       // Mb/s
+        double speed_max;
+        double speed_mean;
+        double speed_std_dev;
+        uint64_t rtt_samples;
+        double rtt_min;         // ms
+        double rtt_max;
+        double rtt_mean;
+        double rtt_std_dev;
+        double rtt_p50;
+        double rtt_p90;
+        double rtt_p99;
+        double rtt_p999;
+        rate_convergence_t convergence;
+    };
+
+    /**
+     * @brief Buffered writer of the results in one format
+     */
+    class Exporter
+    {
+        public:
+
+            enum format_t
+            {
+                JSON   = 0,
+                CSV    = 1,
+                BINARY = 2
+            };
+
+        private:
+            struct record_t
+            {
+                bool is_summary;
+                export_round_t round;
+                export_summary_t summary;
+            };
+
+            format_t format;
+            std::string path;
+            std::ofstream out;
+            std::vector<char> buffer;
+            bool first_round;     // JSON, no separator in front of it
+            bool summary_written; // JSON, the rounds array is closed
+
+            std::thread writer;
+            std::mutex lock;
+            std::condition_variable wake;
+            std::deque<record_t> queue;
+            bool closing;
+
+            void push(const record_t& record);
+            void run();
+
+            void write_json(const record_t& record);
+            void write_csv(const record_t& record);
+            void write_binary(const record_t& record);
+
+        public:
+            Exporter(format_t format, const std::string& path);
+            ~Exporter() { close(); }
+
+            // opens the file & starts the writer thread, false when the file can not be written
+            bool open();
+
+            // queues a record, returns at once
+            inline void round(const export_round_t& round) { push({false, round, {}}); }
+            inline void summary(const export_summary_t& summary) { push({true, {}, summary}); }
+
+            // writes all queued records, closes the file
+            void close();
+
+            // "json|csv|bin:path" -> format & path, returns false when malformed
+            static bool parse(const std::string& spec, format_t& format, std::string& path);
+            static const char* format_name(format_t format);
+    };
+
+#endif // IPK_EXPORT_H_
@@ -0,0 +1,142 @@
+/**
+ *  @file       ipk-histogram.cc
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Latency histogram implementation.
+ *  
+ *  @section Description
+ *  
+ *  Values below SUB_BUCKETS map 1:1 to the first buckets. Above that, a value
+ *  with its most significant bit at position 'msb' is shifted right until it
+ *  fits into SUB_BUCKET_BITS bits, its upper half of sub-buckets [S/2, S) is
+ *  then indexed within the group of that shift.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "ipk-histogram.h"
+
+
+/**
+ * @brief Forgets all samples
+ */
+void LatencyHistogram::reset()
+{
+  std::memset(counts, 0, sizeof(counts));
+  total = 0;
+  min_value = std::numeric_limits<uint64_t>::max();
+  max_value = 0;
+  sum = 0.0;
+  sum_sq = 0.0;
+}
+
+
+/**
+ * @brief Bucket index of a value
+ */
+unsigned LatencyHistogram::index_of(uint64_t value)
+{
+  if (value < SUB_BUCKETS)
+    return static_cast<unsigned>(value);
+
+  unsigned msb = 63 - __builtin_clzll(value);
+  if (msb >= VALUE_BITS)
+    return BUCKETS - 1;
+
+  unsigned shift = msb - SUB_BUCKET_BITS + 1;
+  unsigned sub = static_cast<unsigned>(value >> shift); // in [S/2, S)
+
+  return SUB_BUCKETS + (shift - 1) * (SUB_BUCKETS / 2) + (sub - SUB_BUCKETS / 2);
+}
+
+
+/**
+ * @brief Largest value that falls into the bucket
+ */
+uint64_t LatencyHistogram::highest_equivalent(unsigned index)
+{
+  if (index < SUB_BUCKETS)
+    return index;
+
+  unsigned group = index - SUB_BUCKETS;
+  unsigned shift = group / (SUB_BUCKETS / 2) + 1;
+  uint64_t sub = group % (SUB_BUCKETS / 2) + SUB_BUCKETS / 2;
+
+  return ((sub + 1) << shift) - 1;
+}
+
+
+/**
+ * @brief Adds all samples of another histogram (e.g. of another thread)
+ */
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+  for (unsigned i = 0; i < BUCKETS; i++)
+    counts[i] += other.counts[i];
+
+  total += other.total;
+  if (other.min_value < min_value) min_value = other.min_value;
+  if (other.max_value > max_value) max_value = other.max_value;
+  sum += other.sum;
+  sum_sq += other.sum_sq;
+}
+
+
+/**
+ * @brief Exact mean of the samples
+ */
+double LatencyHistogram::mean() const
+{
+  return total ? sum / total : 0.0;
+}
+
+
+/**
+ * @brief Exact (population) standard deviation of the samples
+ */
+double LatencyHistogram::std_dev() const
+{
+  if (total == 0)
+    return 0.0;
+
+  double m = mean();
+  return std::sqrt(std::max(0.0, sum_sq / total - m * m));
+}
+
+
+/**
+ * @brief Returns the value at the given percentile
+ * 
+ * @param percent 0 - 100
+ * @return highest value equivalent to the bucket holding the percentile,
+ *         clamped to the exact min/max
+ */
+uint64_t LatencyHistogram::percentile(double percent) const
+{
+  if (total == 0)
+    return 0;
+
+  uint64_t rank = static_cast<uint64_t>(std::ceil(percent / 100.0 * total));
+  if (rank < 1)
+    rank = 1;
+
+  uint64_t seen { 0 };
+  for (unsigned i = 0; i < BUCKETS; i++)
+  {
+    seen += counts[i];
+    if (seen >= rank)
+    {
+      uint64_t value = highest_equivalent(i);
+      if (value < min_value) return min_value;
+      if (value > max_value) return max_value;
+      return value;
+    }
+  }
+
+  return max_value;
+}
@@ -0,0 +1,79 @@
+/**
+ *  @file       ipk-histogram.h
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Latency histogram.
+ *  
+ *  @section Description
+ *  
+ *  HDR-style log-linear histogram of nanosecond values. Every power of two is
+ *  split into the same number of linear sub-buckets, so the relative error is
+ *  bounded (< 0.4 %) over the whole range while the memory stays fixed.
+ *  Recording is a few shifts and an increment, there is no allocation after
+ *  construction, and histograms of different threads can be merged.
+ */
+
+#ifndef IPK_HISTOGRAM_H_
+#define IPK_HISTOGRAM_H_
+
+    #include <stdint.h>
+
+    /**
+     * @brief Fixed-memory log-linear histogram of latencies in ns
+     */
+    class LatencyHistogram
+    {
+        public:
+            // 256 sub-buckets per power of two, values up to 2^40 ns (~18 minutes)
+            static const unsigned SUB_BUCKET_BITS = 8;
+            static const unsigned SUB_BUCKETS = 1U << SUB_BUCKET_BITS;
+            static const unsigned VALUE_BITS = 40;
+            static const unsigned BUCKETS = SUB_BUCKETS + (VALUE_BITS - SUB_BUCKET_BITS) * (SUB_BUCKETS / 2);
+
+        private:
+            uint64_t counts[BUCKETS];
+            uint64_t total;
+            uint64_t min_value;
+            uint64_t max_value;
+            double sum;
+            double sum_sq;
+
+            static unsigned index_of(uint64_t value);
+            static uint64_t highest_equivalent(unsigned index);
+
+        public:
+            LatencyHistogram() { reset(); }
+
+            void reset();
+
+            // adds one sample (ns), values above the range land in the last bucket
+            inline void record(uint64_t value)
+            {
+                counts[index_of(value)]++;
+                total++;
+                if (value < min_value) min_value = value;
+                if (value > max_value) max_value = value;
+                sum += value;
+                sum_sq += static_cast<double>(value) * value;
+            }
+
+            // adds all samples of 'other'
+            void merge(const LatencyHistogram& other);
+
+            inline uint64_t count() const { return total; }
+            inline uint64_t min() const { return total ? min_value : 0; }
+            inline uint64_t max() const { return max_value; }
+            double mean() const;
+            double std_dev() const;
+
+            // value below which 'percent' % of samples lie (exact min/max at 0/100)
+            uint64_t percentile(double percent) const;
+
+            // raw bucket access (exporters)
+            inline uint64_t bucket_count(unsigned index) const { return counts[index]; }
+            static inline uint64_t bucket_upper_bound(unsigned index) { return highest_equivalent(index); }
+    };
+
+#endif // IPK_HISTOGRAM_H_
@@ -0,0 +1,430 @@
+/**
+ *  @file       ipk-metrics.cc
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Metrics endpoint implementation.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <map>
+#include <algorithm>
+#include <unistd.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "ipk-metrics.h"
+
+using std::cerr;
+using std::endl;
+
+
+/**
+ * @brief Creates an empty histogram
+ * 
+ * @param bounds upper bounds of the buckets in seconds, ascending, +Inf is added
+ */
+MetricHistogram::MetricHistogram(const std::vector<double>& bounds)
+  : bounds (bounds),
+    counts {new std::atomic<uint64_t>[bounds.size() + 1]}
+{
+  for (size_t i = 0; i <= bounds.size(); i++)
+    counts[i].store(0, std::memory_order_relaxed);
+}
+
+
+/**
+ * @brief Counts one observation
+ * 
+ * @param value_ns the observed time in nanoseconds
+ */
+void MetricHistogram::record(uint64_t value_ns)
+{
+  double seconds = value_ns / 1e9;
+  size_t bucket = 0;
+  while (bucket < bounds.size() && seconds > bounds[bucket])
+    bucket++;
+
+  counts[bucket].fetch_add(1, std::memory_order_relaxed);
+  sum_ns.fetch_add(value_ns, std::memory_order_relaxed);
+}
+
+
+/**
+ * @brief Appends the histogram in OpenMetrics text, buckets are cumulative
+ * 
+ * @param out output
+ * @param name metric family name
+ * @param help help text of the family
+ */
+void MetricHistogram::render(std::string& out, const std::string& name, const std::string& help) const
+{
+  std::ostringstream text;
+  text << "# TYPE " << name << " histogram\n# UNIT " << name << " seconds\n# HELP " << name << " " << help << "\n";
+
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i <= bounds.size(); i++)
+  {
+    cumulative += counts[i].load(std::memory_order_relaxed);
+    text << name << "_bucket{le=\"";
+    if (i < bounds.size())
+      text << bounds[i];
+    else
+      text << "+Inf";
+    text << "\"} " << cumulative << "\n";
+  }
+
+  text << name << "_sum " << std::fixed << std::setprecision(9) << sum_ns.load(std::memory_order_relaxed) / 1e9 << "\n"
+       << name << "_count " << cumulative << "\n";
+  out += text.str();
+}
+
+
+/**
+ * @brief Reads the UDP counters of the kernel
+ * 
+ * @desc /proc/net/snmp has a line of names and a line of values per protocol,
+ * fields the kernel does not have stay 0.
+ * @param snmp output
+ * @return false when the file or its Udp: lines are missing
+ */
+bool udp_snmp_read(udp_snmp_t& snmp)
+{
+  std::ifstream file("/proc/net/snmp");
+  std::string names, values, line;
+
+  while (std::getline(file, line))
+  {
+    if (line.compare(0, 4, "Udp:") != 0)
+      continue;
+    if (names.empty())
+      names = line;
+    else
+    {
+      values = line;
+      break;
+    }
+  }
+  if (values.empty())
+    return false;
+
+  std::map<std::string, uint64_t> fields;
+  std::istringstream name_stream(names), value_stream(values);
+  std::string name, value;
+  name_stream >> name;
+  value_stream >> value;
+  while (name_stream >> name && value_stream >> value)
+    fields[name] = std::strtoull(value.c_str(), nullptr, 10);
+
+  snmp = {};
+  snmp.in_datagrams = fields["InDatagrams"];
+  snmp.no_ports = fields["NoPorts"];
+  snmp.in_errors = fields["InErrors"];
+  snmp.out_datagrams = fields["OutDatagrams"];
+  snmp.rcvbuf_errors = fields["RcvbufErrors"];
+  snmp.sndbuf_errors = fields["SndbufErrors"];
+  snmp.in_csum_errors = fields["InCsumErrors"];
+  return true;
+}
+
+
+/*****************************************************************************/
+
+/**
+ * @brief Creates the metrics of one run
+ * 
+ * @desc The latency buckets span 50 us to 1 s, the range of both the RTT
+ * and the queueing delay on anything from loopback to a long haul path.
+ * @param mode "reflector", "meter" or "monitor", exported as a label
+ * @param thread_count number of sender/receiver threads
+ */
+Metrics::Metrics(const std::string& mode, unsigned thread_count)
+  : mode (mode),
+    latency ({0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0})
+{
+  for (unsigned i = 0; i < std::max(thread_count, 1U); i++)
+    threads.emplace_back(new thread_metrics_t());
+}
+
+
+/**
+ * @brief Renders everything in the OpenMetrics text format
+ * 
+ * @return the exposition, terminated by "# EOF"
+ */
+std::string Metrics::render() const
+{
+  std::ostringstream text;
+  std::string label = "mode=\"" + mode + "\"";
+
+  text << "# TYPE mtrip info\n# HELP mtrip Mode of the running instance.\n"
+       << "mtrip_info{" << label << "} 1\n";
+
+  // counters per thread, each family with a line for every thread
+  struct family_t
+  {
+    const char* name;
+    const char* help;
+    std::atomic<uint64_t> thread_metrics_t::*counter;
+  };
+  const family_t families[] = {
+    {"mtrip_packets_received", "Datagrams received.", &thread_metrics_t::packets_received},
+    {"mtrip_bytes_received", "Bytes of the datagrams received.", &thread_metrics_t::bytes_received},
+    {"mtrip_packets_sent", "Datagrams sent.", &thread_metrics_t::packets_sent},
+    {"mtrip_bytes_sent", "Bytes of the datagrams sent.", &thread_metrics_t::bytes_sent},
+    {"mtrip_packets_dropped", "Datagrams received but thrown away (malformed or of no session).", &thread_metrics_t::dropped},
+    {"mtrip_recv_syscalls", "Receive system calls.", &thread_metrics_t::recv_syscalls},
+    {"mtrip_send_syscalls", "Send system calls.", &thread_metrics_t::send_syscalls},
+  };
+
+  for (const family_t& family : families)
+  {
+    text << "# TYPE " << family.name << " counter\n# HELP " << family.name << " " << family.help << "\n";
+    for (size_t i = 0; i < threads.size(); i++)
+      text << family.name << "_total{" << label << ",thread=\"" << i << "\"} "
+           << ((*threads[i]).*family.counter).load(std::memory_order_relaxed) << "\n";
+  }
+
+  text << "# TYPE mtrip_sessions gauge\n# HELP mtrip_sessions Measurements open on the reflector.\n"
+       << "mtrip_sessions{" << label << "} " << sessions.load(std::memory_order_relaxed) << "\n"
+       << "# TYPE mtrip_rounds counter\n# HELP mtrip_rounds Rounds completed.\n"
+       << "mtrip_rounds_total{" << label << "} " << rounds.load(std::memory_order_relaxed) << "\n"
+       << "# TYPE mtrip_probes_lost counter\n# HELP mtrip_probes_lost Probes lost in the completed rounds.\n"
+       << "mtrip_probes_lost_total{" << label << "} " << lost.load(std::memory_order_relaxed) << "\n"
+       << "# TYPE mtrip_host_dropped counter\n# HELP mtrip_host_dropped Datagrams dropped on the full receive queue of the reflector probe sockets.\n"
+       << "mtrip_host_dropped_total{" << label << "} " << host_dropped.load(std::memory_order_relaxed) << "\n"
+       << std::fixed << std::setprecision(3)
+       << "# TYPE mtrip_round_throughput_bits_per_second gauge\n# UNIT mtrip_round_throughput_bits_per_second bits_per_second\n"
+       << "# HELP mtrip_round_throughput_bits_per_second Throughput received in the last round.\n"
+       << "mtrip_round_throughput_bits_per_second{" << label << "} " << round_throughput.load(std::memory_order_relaxed) << "\n"
+       << "# TYPE mtrip_round_rate_packets_per_second gauge\n# UNIT mtrip_round_rate_packets_per_second packets_per_second\n"
+       << "# HELP mtrip_round_rate_packets_per_second Sending rate asked for in the last round.\n"
+       << "mtrip_round_rate_packets_per_second{" << label << "} " << round_rate.load(std::memory_order_relaxed) << "\n"
+       << std::setprecision(6)
+       << "# TYPE mtrip_round_loss_ratio gauge\n# UNIT mtrip_round_loss_ratio ratio\n"
+       << "# HELP mtrip_round_loss_ratio Share of the probes of the last round lost.\n"
+       << "mtrip_round_loss_ratio{" << label << "} " << round_loss.load(std::memory_order_relaxed) << "\n";
+
+  std::string out = text.str();
+  latency.render(out, "mtrip_latency_seconds", mode == "reflector"
+                 ? "Queueing delay of the rounds (one-way delay above the lowest one)."
+                 : "Round trip time of the RTT probes.");
+
+  udp_snmp_t snmp;
+  if (udp_snmp_read(snmp))
+  {
+    std::ostringstream kernel;
+    const std::pair<const char*, uint64_t> fields[] = {
+      {"in_datagrams", snmp.in_datagrams}, {"no_ports", snmp.no_ports}, {"in_errors", snmp.in_errors},
+      {"out_datagrams", snmp.out_datagrams}, {"rcvbuf_errors", snmp.rcvbuf_errors},
+      {"sndbuf_errors", snmp.sndbuf_errors}, {"in_csum_errors", snmp.in_csum_errors},
+    };
+
+    kernel << "# TYPE mtrip_kernel_udp counter\n# HELP mtrip_kernel_udp UDP counters of the kernel (/proc/net/snmp), all sockets.\n";
+    for (const auto& field : fields)
+      kernel << "mtrip_kernel_udp_total{counter=\"" << field.first << "\"} " << field.second << "\n";
+    out += kernel.str();
+  }
+
+  out += "# EOF\n";
+  return out;
+}
+
+
+/*****************************************************************************/
+
+/**
+ * @brief Binds the listening socket and starts the server thread
+ * 
+ * @param address IPv4 or IPv6 address to listen on
+ * @param port TCP port to listen on
+ * @return false when the address is invalid or can not be bound
+ */
+bool MetricsServer::start(const std::string& address, unsigned short port)
+{
+  struct sockaddr_storage local {};
+  socklen_t local_length;
+  struct sockaddr_in* in = reinterpret_cast<struct sockaddr_in*>(&local);
+  struct sockaddr_in6* in6 = reinterpret_cast<struct sockaddr_in6*>(&local);
+  if (inet_pton(AF_INET, address.c_str(), &in->sin_addr) == 1)
+  {
+    in->sin_family = AF_INET;
+    in->sin_port = htons(port);
+    local_length = sizeof(*in);
+  }
+  else if (inet_pton(AF_INET6, address.c_str(), &in6->sin6_addr) == 1)
+  {
+    in6->sin6_family = AF_INET6;
+    in6->sin6_port = htons(port);
+    local_length = sizeof(*in6);
+  }
+  else
+  {
+    cerr << "ERROR: invalid metrics address '" << address << "'" << endl;
+    return false;
+  }
+
+  listen_fd = socket(local.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0)
+  {
+    cerr << "ERROR: metrics socket: " << std::strerror(errno) << endl;
+    return false;
+  }
+
+  int reuse = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  if (bind(listen_fd, reinterpret_cast<struct sockaddr*>(&local), local_length) < 0 || listen(listen_fd, 16) < 0)
+  {
+    cerr << "ERROR: metrics endpoint " << address << ":" << port << ": " << std::strerror(errno) << endl;
+    close(listen_fd);
+    listen_fd = -1;
+    return false;
+  }
+
+  stopping.store(false);
+  thread = std::thread(&MetricsServer::run, this);
+  return true;
+}
+
+
+/**
+ * @brief Stops the server thread and closes the socket
+ */
+void MetricsServer::stop()
+{
+  if (!thread.joinable())
+    return;
+
+  stopping.store(true);
+  thread.join();
+  close(listen_fd);
+  listen_fd = -1;
+}
+
+
+/**
+ * @brief Server thread, wakes up every METRICS_TICK_MS to notice stop()
+ */
+void MetricsServer::run()
+{
+  struct pollfd listener {listen_fd, POLLIN, 0};
+
+  while (!stopping.load())
+  {
+    if (poll(&listener, 1, METRICS_TICK_MS) <= 0)
+      continue;
+
+    int client = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client < 0)
+      continue;
+
+    serve(client);
+    close(client);
+  }
+}
+
+
+/**
+ * @brief Answers one request
+ * 
+ * @desc Only the request line matters, GET /metrics gets the exposition,
+ * everything else 404. A client that does not send its request within a
+ * second is dropped, a scraper must not hold up the next one.
+ * @param client connected socket
+ */
+void MetricsServer::serve(int client)
+{
+  struct timeval timeout {1, 0};
+  setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  // read up to the end of the headers
+  std::string request;
+  char buffer[512];
+  while (request.size() < METRICS_MAX_REQUEST && request.find("\r\n\r\n") == std::string::npos
+         && request.find("\n\n") == std::string::npos)
+  {
+    ssize_t length = recv(client, buffer, sizeof(buffer), 0);
+    if (length <= 0)
+      break;
+    request.append(buffer, length);
+  }
+
+  std::istringstream request_line(request.substr(0, request.find('\n')));
+  std::string method, target;
+  request_line >> method >> target;
+
+  std::string status, type, body;
+  if (method != "GET" && method != "HEAD")
+  {
+    status = "405 Method Not Allowed";
+    type = "text/plain; charset=utf-8";
+    body = "only GET /metrics is served\n";
+  }
+  else if (target != "/metrics" && target.compare(0, 9, "/metrics?") != 0)
+  {
+    status = "404 Not Found";
+    type = "text/plain; charset=utf-8";
+    body = "only GET /metrics is served\n";
+  }
+  else
+  {
+    status = "200 OK";
+    type = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+    body = metrics.render();
+  }
+
+  std::ostringstream response;
+  response << "HTTP/1.0 " << status << "\r\nContent-Type: " << type << "\r\nContent-Length: " << body.size()
+           << "\r\nConnection: close\r\n\r\n";
+  if (method != "HEAD")
+    response << body;
+
+  std::string data = response.str();
+  size_t sent = 0;
+  while (sent < data.size())
+  {
+    ssize_t length = send(client, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (length <= 0)
+      break;
+    sent += length;
+  }
+}
+
+
+/**
+ * @brief Parses the argument of '-M'
+ * 
+ * @param spec "port" or "address:port"
+ * @param address output, METRICS_DEFAULT_ADDRESS when not given
+ * @param port output
+ * @return false on a missing or invalid port
+ */
+bool metrics_parse_endpoint(const std::string& spec, std::string& address, unsigned short& port)
+{
+  size_t colon = spec.rfind(':');
+  address = colon == std::string::npos ? METRICS_DEFAULT_ADDRESS : spec.substr(0, colon);
+  std::string port_text = colon == std::string::npos ? spec : spec.substr(colon + 1);
+
+  // "[::1]:9100"
+  if (address.size() > 2 && address.front() == '[' && address.back() == ']')
+    address = address.substr(1, address.size() - 2);
+
+  char* end = nullptr;
+  unsigned long value = std::strtoul(port_text.c_str(), &end, 10);
+  if (port_text.empty() || *end != '\0' || value == 0 || value > 65535 || address.empty())
+    return false;
+
+  port = static_cast<unsigned short>(value);
+  return true;
+}
@@ -0,0 +1,159 @@
+/**
+ *  @file       ipk-metrics.h
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Metrics endpoint.
+ *  
+ *  @section Description
+ *  
+ *  Both modes count what they do in plain atomics: every sender/receiver
+ *  thread owns a cache line of counters nobody else writes, the rest are
+ *  gauges and histograms updated once per round. An embedded HTTP server
+ *  ('-M [address:]port') serves them as OpenMetrics text on /metrics, along
+ *  with the UDP counters of the kernel (/proc/net/snmp).
+ *  
+ *  The server only loads the atomics, so a scrape never waits for the packet
+ *  path and the packet path never waits for a scrape.
+ */
+
+#ifndef IPK_METRICS_H_
+#define IPK_METRICS_H_
+
+    #include <stdint.h>
+    #include <atomic>
+    #include <memory>
+    #include <string>
+    #include <thread>
+    #include <vector>
+
+    // address the endpoint listens on unless '-M' gives one
+    #define METRICS_DEFAULT_ADDRESS "127.0.0.1"
+
+    // longest request read, the rest of it is ignored
+    #define METRICS_MAX_REQUEST 2048
+
+    // accept timeout, the server checks for the end at least this often
+    #define METRICS_TICK_MS 100
+
+    /**
+     * @brief Counters of one sender/receiver thread
+     * 
+     * @desc Written by the owning thread only, so an increment is a relaxed
+     * load & store, no read-modify-write. Padded to two cache lines, the
+     * counters of two threads (allocated one by one) never share a line.
+     */
+    struct thread_metrics_t
+    {
+        std::atomic<uint64_t> packets_received {0};
+        std::atomic<uint64_t> bytes_received {0};
+        std::atomic<uint64_t> packets_sent {0};
+        std::atomic<uint64_t> bytes_sent {0};
+        std::atomic<uint64_t> dropped {0};       // foreign datagrams & probes of unknown sessions
+        std::atomic<uint64_t> recv_syscalls {0};
+        std::atomic<uint64_t> send_syscalls {0};
+        char padding[128 - 7 * sizeof(std::atomic<uint64_t>)];
+    };
+
+    // adds to a counter of the own thread
+    inline void metric_add(std::atomic<uint64_t>& counter, uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Histogram with fixed bucket bounds (seconds), any thread may record
+     */
+    class MetricHistogram
+    {
+        private:
+            std::vector<double> bounds;
+            std::unique_ptr<std::atomic<uint64_t>[]> counts; // per bucket, the last one is +Inf
+            std::atomic<uint64_t> sum_ns {0};
+
+        public:
+            // 'bounds' upper bounds of the buckets in seconds, ascending
+            explicit MetricHistogram(const std::vector<double>& bounds);
+
+            void record(uint64_t value_ns);
+
+            // OpenMetrics lines of the histogram 'name'
+            void render(std::string& out, const std::string& name, const std::string& help) const;
+    };
+
+    /**
+     * @brief UDP counters of the kernel (/proc/net/snmp)
+     */
+    struct udp_snmp_t
+    {
+        uint64_t in_datagrams;
+        uint64_t no_ports;
+        uint64_t in_errors;
+        uint64_t out_datagrams;
+        uint64_t rcvbuf_errors; // datagrams dropped, the receive buffer was full
+        uint64_t sndbuf_errors; // datagrams dropped, the send buffer was full
+        uint64_t in_csum_errors;
+    };
+
+    // reads the Udp: lines of /proc/net/snmp, false when they are not there
+    bool udp_snmp_read(udp_snmp_t& snmp);
+
+    /**
+     * @brief Everything the endpoint exports
+     */
+    class Metrics
+    {
+        private:
+            std::string mode;
+            std::vector<std::unique_ptr<thread_metrics_t>> threads;
+
+        public:
+            // gauges & counters of the rounds, written by the thread running them
+            std::atomic<int64_t> sessions {0};        // reflector: measurements open
+            std::atomic<uint64_t> rounds {0};         // rounds reported / measured
+            std::atomic<uint64_t> lost {0};           // probes lost in all rounds
+            std::atomic<uint64_t> host_dropped {0};   // of them dropped by the receiving host (full socket queue)
+            std::atomic<double> round_throughput {0}; // bits/second received in the last round
+            std::atomic<double> round_rate {0};       // meter: packets/second asked for in the last round
+            std::atomic<double> round_loss {0};       // share of the last round lost (0..1)
+
+            // meter: RTT, reflector: queueing delay of the rounds (one-way delay above the minimum)
+            MetricHistogram latency;
+
+            // 'mode' "reflector" / "meter" / "monitor", one counter set per thread
+            Metrics(const std::string& mode, unsigned thread_count);
+
+            inline thread_metrics_t& thread(unsigned index) { return *threads[index % threads.size()]; }
+
+            // OpenMetrics exposition of everything, ends with "# EOF"
+            std::string render() const;
+    };
+
+    /**
+     * @brief Minimal HTTP/1.0 server of GET /metrics, one thread, one request per connection
+     */
+    class MetricsServer
+    {
+        private:
+            const Metrics& metrics;
+            int listen_fd;
+            std::thread thread;
+            std::atomic<bool> stopping;
+
+            void run();
+            void serve(int client);
+
+        public:
+            explicit MetricsServer(const Metrics& metrics) : metrics (metrics), listen_fd {-1}, stopping {false} {}
+            ~MetricsServer() { stop(); }
+
+            // listens on 'address':'port' and starts serving, false when the port can not be bound
+            bool start(const std::string& address, unsigned short port);
+            void stop();
+    };
+
+    // "[address:]port" of '-M' -> address & port, returns false when malformed
+    bool metrics_parse_endpoint(const std::string& spec, std::string& address, unsigned short& port);
+
+#endif // IPK_METRICS_H_
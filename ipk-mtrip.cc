@@ -23,8 +23,56 @@
  * 
  *  @section Usage
  *  
- *  * ./ipk-mtrip reflect -p port 
- *  * ./ipk-mtrip meter -h vzdáleny_host -p vzdálený_port - s velikost_sondy -t doba_mereni
+ *  * ./ipk-mtrip reflect -p port [options]
+ *  * ./ipk-mtrip meter -h vzdáleny_host -p vzdálený_port - s velikost_sondy -t doba_mereni [options] [-m busy|hybrid|burst]
+ *  * ./ipk-mtrip monitor -h vzdáleny_host -p vzdálený_port - s velikost_sondy [-D duty] [meter options]
+ *  
+ *  Options of both modes:
+ *  * -b batch_depth      datagrams per sendmmsg/recvmmsg call (1 = plain send/recv)
+ *  * -j threads          sender/receiver threads, one socket each
+ *  * -T sw|hw[:iface]    kernel (or NIC) packet timestamps
+ *  * -G                  UDP segmentation offload on the meter, receive offload on the reflector
+ *  * -I blocking|uring   I/O backend of the probe sockets (io_uring falls back to blocking)
+ *  * -C control_port     port of the control channel (default port + 1)
+ *  * -M [address:]port   serves the counters as OpenMetrics on http://address:port/metrics
+ *                        (default address 127.0.0.1, IPv6 ones in brackets: [::1]:port)
+ *  * -A role=cores       pins the send, recv or control threads to the cores ("2,4-7", round robin),
+ *                        senders & receivers default to the core of their index
+ *  * -Y usec             busy polling receives (SO_BUSY_POLL & SO_PREFER_BUSY_POLL)
+ *  * -F priority         SCHED_FIFO send/recv/control threads (1 - 99, needs CAP_SYS_NICE or RLIMIT_RTPRIO)
+ *  * -L                  locks the process in memory (mlockall)
+ *  * -f 4|6|any          address family, 'any' (default) binds the reflector dual-stack and makes
+ *                        the meter race all addresses of the host (happy eyeballs, RFC 8305)
+ *  
+ *  Meter only:
+ *  * -Z                  MSG_ZEROCOPY sends
+ *  * -a bisect|exp|train|pid  rate search (bisection, exponential + binary search,
+ *                        packet train dispersion, loss-threshold PID)
+ *  * -R max_rate         ceiling of the rate search in packets/second (default 40 000 000)
+ *  * -P train|chirp[:n]  one train of n back-to-back probes (or a chirp) per round instead of
+ *                        the rate search, estimates capacity & available bandwidth from its dispersion
+ *  * -l round_ms         length of a round (10 - 60000 ms, default 1000), -t stays in seconds
+ *  * -i interval_us      per-interval timeline of every round (sent, received, lost, throughput),
+ *                        the reflector widens it to fit the round into 512 intervals
+ *  * -e json|csv|bin:path  writes the rounds & results to 'path' as well (JSON document,
+ *                        CSV table of rounds or an appended binary record stream)
+ *  * -K                  paces a local loop under each scheduling setting first and prints
+ *                        its rate error & gap jitter (what -A, -F and -L buy on this host)
+ *  * -f all              measures every address of the host that answers, one after another,
+ *                        and compares them (IPv4 against IPv6 path), -e gets one file per address
+ *  * -W sizes            finds the path MTU with DF probes, then measures 'sizes' probe sizes up to
+ *                        it (and one just above it) for -t seconds each and reports the size with
+ *                        the best loss-free goodput, -s is not needed, -e gets one file per size
+ *  * -d up|down|both     direction loaded: up (meter -> reflector, default), down (the reflector
+ *                        paces the probes back) or both at once, each with a rate search of its own
+ *  * -E                  the reflector echoes every probe, the RTT of every round is measured
+ *                        under its load (percentiles per rate show bufferbloat)
+ *  
+ *  Monitor only:
+ *  * -D duty             percent of the time spent probing (default 10), one round per cycle
+ *  
+ *  SIGINT / SIGTERM end every mode cleanly (the meter prints the results so far), a second one
+ *  ends it at once. SIGHUP makes the monitor open a new session and reopen its export file.
  *  
  */
 
@@ -44,6 +92,8 @@
 #include <algorithm>
 #include <numeric>
 #include <cmath>
+#include <random>
+#include <sstream>
 
 // commonly used std objects.. really no need to be careful about poluting namespace
 using std::cout;
@@ -57,15 +107,67 @@ using Clock = std::chrono::high_resolution_clock;
 // sockets API + networking libraries
 #include <sys/socket.h>
 #include <netdb.h>              
+#include <arpa/inet.h>
 
 // mtrip configurations + control/argument parse/interrupt handling
 #include "ipk-mtrip.h"
 
+// nanosecond clocks
+#include "ipk-clock.h"
+
 // socket abstraction
 #include "ipk-socket.h"
 
+// batches of frames in the ring of one sender thread, frames are rewritten
+// only after the ones sent in between left the ring
+#define SEND_RING_BATCHES 2
+
+// longest wait for zerocopy completions before frames are reused anyway
+#define ZEROCOPY_TIMEOUT_MS 100
+
+// the RTT probe (or its echo) counts as lost after this long
+#define RTT_TIMEOUT_MS 1000
+
+// a DF probe of the path MTU discovery is sent this many times, each waits this long for its echo
+#define PMTU_ATTEMPTS 3
+#define PMTU_TIMEOUT_MS 300
+
+// smallest probe size of the sweep, and most sizes it measures
+#define SWEEP_MIN_SIZE 64
+#define SWEEP_MAX_SIZES 32
+
+// receive timeout of the reflector workers, round timers are checked at least this often
+#define REFLECT_TICK_MS 10
+
+// the probes of the reflector are received this long past the round (plus the RTT), the receive
+// timeout of the meter checks for the end at least every REVERSE_TICK_MS
+#define REVERSE_GRACE_MS 100
+#define REVERSE_TICK_MS 10
+
+// echoes are received this long after the last probe of the round left ('-E'),
+// the receivers check for the end at least every ECHO_TICK_MS
+#define ECHO_GRACE_MS 100
+#define ECHO_TICK_MS 10
+
+// the monitor sleeps this long at most between checks of the signal flags
+#define MONITOR_TICK_MS 100
+
+// RTT probes between the rounds of the monitor, they keep the session alive (below SESSION_IDLE_TIMEOUT_MS)
+#define MONITOR_KEEPALIVE_MS 2000
+
+// the monitor prints its windows this often, and tries to reach a lost reflector again after this long
+#define MONITOR_STATUS_S 60
+#define MONITOR_RETRY_MS 5000
+
+// flags of the signal handler
+volatile sig_atomic_t shutdown_signal = 0;
+volatile sig_atomic_t reload_signal = 0;
+
 /*****************************************************************************/
 
+// ipk-bench links this file for the round loops & socket setup and brings its own main()
+#ifndef IPK_BENCH
+
 // Simple timer, starts on object creation and ends + outputs on destruction
 struct Timer
 {
@@ -99,8 +201,12 @@ int main(int argc, char **argv)
 {
   Timer debug_timer;
   
-  // function to handle interrupt
-  signal(SIGINT, interrupt_handler);
+  // function to handle interrupt, no SA_RESTART, so blocking calls return and the loops see the flags
+  struct sigaction action {};
+  action.sa_handler = interrupt_handler;
+  sigemptyset(&action.sa_mask);
+  for (int signum : {SIGINT, SIGTERM, SIGHUP})
+    sigaction(signum, &action, nullptr);
   
   // create new runtime mtrip configuration
   std::unique_ptr<MTripConfiguration> mtrip = argument_parser(argc, argv);
@@ -114,137 +220,690 @@ int main(int argc, char **argv)
   return EXIT_SUCCESS;
 }
 
-/*****************************************************************************/
+#endif // IPK_BENCH
 
-#define SAVE_CONNECTION true
+/*****************************************************************************/
 
 /**
  * @brief Main routine of the reflector
  * 
  * @desc Initializes the reflector mode routine 
- * as the active configuration
+ * as the active configuration. Every worker owns one unconnected socket of
+ * the SO_REUSEPORT group, the kernel spreads the flows of all meters over
+ * them. The sockets are never connected, so any number of meters can measure
+ * at the same time, their sessions are told apart by the session table.
+ * Hellos, round ends and reports go over the control socket served by the
+ * calling thread, away from the probe traffic.
  */
 void Reflector::init()
 {
   cout << "UDP BANDWIDTH MEASUREMENT\n" << endl;
   cout << "[REFLECTOR]: " << CL_GREEN << "started\n" << RESET << endl;
 
-  // create new socket object
-  std::shared_ptr<SocketEntity> socket = std::make_shared<SocketEntity>();
+  configure_scheduling(m_options);
 
-  // prepare the server
-  socket->setup_server(m_port);
-  cout << " [INFO]: Socket setup completed." << endl;
+  std::vector<std::shared_ptr<SocketEntity>> sockets;
+  for (unsigned i = 0; i < m_options.threads; i++)
+  {
+    std::shared_ptr<SocketEntity> socket = std::make_shared<SocketEntity>();
+    if (socket->setup_server(m_port, true, m_options.family) != EXIT_SUCCESS)
+      break;
+    configure_socket(socket, m_options);
+    sockets.push_back(socket);
+  }
 
-  /* ------------------------------------------ */
-      // WAIT FOR REQUEST
-  /* ------------------------------------------ */
+  if (sockets.empty())
+    return;
+
+  // receive buffers grow with the rates of the meters, the drop counters tell host drops from path loss
+  bool drop_counting = true;
+  for (std::shared_ptr<SocketEntity>& socket : sockets)
+  {
+    socket->grow_recv_buffer(SOCKET_BUFFER_MIN);
+    socket->grow_send_buffer(SOCKET_BUFFER_MIN); // echoes leave through the receiving sockets
+    drop_counting = socket->enable_drop_counter() && drop_counting;
+  }
+  if (!drop_counting)
+    cerr << "SO_RXQ_OVFL not available, socket drops are counted by the host UDP counters only" << endl;
+  m_sockets = sockets;
+
+  unsigned short control_port = m_options.control_port ? m_options.control_port : m_port + CONTROL_PORT_OFFSET;
+  std::shared_ptr<SocketEntity> control = std::make_shared<SocketEntity>();
+  if (control->setup_server(control_port, false, m_options.family) != EXIT_SUCCESS)
+    return;
+  cout << " [INFO]: Socket setup completed." << endl;
 
-  int probe_size { 0 };
-  int total_time { 0 };
-  int bytes_recv;
+  // features offered to the meters
+  m_capabilities = CAP_MULTI_STREAM | CAP_ROUND_LENGTH | CAP_DISPERSION | CAP_TIMELINE | CAP_HOST_DROPS | CAP_REVERSE | CAP_ECHO;
+  if (sockets[0]->get_batch_depth() > 1 || sockets[0]->get_io_backend() == SocketEntity::URING_IO)
+    m_capabilities |= CAP_BATCHING;
+  if (sockets[0]->get_timestamping() != SocketEntity::NO_TIMESTAMPING)
+    m_capabilities |= CAP_TIMESTAMPS;
+  if (m_options.offload)
+    m_capabilities |= CAP_GRO;
+
+  m_sessions.reset(new SessionTable(sockets.size()));
+
+  // the workers own a counter set each, the reverse senders of all sessions share the last one
+  m_metrics.reset(new Metrics("reflector", sockets.size() + 1));
+  if (!start_metrics_server(m_metrics_server, *m_metrics, m_options))
+    return;
+
+  // one receive batch per worker, the probe size differs from meter to meter
+  // (and GRO coalesces probes of a flow), so every frame takes the largest datagram
+  unsigned depth = sockets[0]->get_batch_depth();
+  BufferArena arena(MAX_DATAGRAM_SIZE, sockets.size() * depth);
+  if (!arena.valid())
+    return;
+
+  std::vector<FrameRing> rings;
+  for (size_t i = 0; i < sockets.size(); i++)
+    rings.emplace_back(arena, i * depth, depth);
+
+  cout << "\t" << BOLD << "recv_threads" << RESET << "= " << sockets.size() << endl;
+  cout << "\t" << BOLD << "io_backend" << RESET << "= " << (sockets[0]->get_io_backend() == SocketEntity::URING_IO ? "io_uring" : "blocking") << endl;
+  cout << "\t" << BOLD << "control_port" << RESET << "= " << control_port << endl;
+  cout << "\t" << BOLD << "address_family" << RESET << "= " << (sockets[0]->get_family() == AF_INET ? "IPv4"
+                                                           : m_options.family == AF_INET6 ? "IPv6" : "IPv6 & IPv4 (dual-stack)") << endl;
+  cout << "\t" << BOLD << "recv_buffer" << RESET << "= " << sockets[0]->get_recv_buffer() / 1024 << " KiB" << endl;
+  cout << "\t" << BOLD << "capabilities" << RESET << "= " << capability_names(m_capabilities) << endl;
+  cout << "\t" << BOLD << "scheduling" << RESET << "= " << scheduling_name(m_options) << endl;
+  if (m_metrics_server)
+  {
+    bool ipv6 = m_options.metrics_address.find(':') != string::npos;
+    cout << "\t" << BOLD << "metrics" << RESET << "= http://" << (ipv6 ? "[" : "") << m_options.metrics_address << (ipv6 ? "]" : "")
+         << ":" << m_options.metrics_port << "/metrics" << endl;
+  }
+  cout << " waiting for meters... " << endl;
 
-  while (true)
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < sockets.size(); i++)
   {
+    threads.emplace_back([this, &sockets, &rings, i]() { serve(i, sockets[i], rings[i]); });
+    configure_thread(threads.back().native_handle(), RECV_THREAD, i, m_options);
+  }
 
-    cout << " waiting for meter... "<< endl;
+  configure_thread(pthread_self(), CONTROL_THREAD, 0, m_options);
+  serve_control(control);
 
-    // RECEIVE -> probe size
-    bytes_recv = socket->recv_message(reinterpret_cast<char*>(&probe_size), sizeof(probe_size), SAVE_CONNECTION);
-    if (bytes_recv == -1) { cerr << "ERROR: ." << endl; continue;}
-    if (probe_size <= 0) { cerr << "ERROR: probe size is less than 0. " << endl; continue; }
+  for (std::thread& thread : threads)
+    thread.join();
 
-    // RECEIVE -> total time
-    bytes_recv = socket->recv_message(reinterpret_cast<char*>(&total_time), sizeof(total_time));
-    if (bytes_recv == -1) { cerr << "ERROR: ." << endl; continue;}
+  cout << "\n[REFLECTOR]: stopped (signal " << shutdown_signal << ", " << m_sessions->size() << " measurements open)" << endl;
 
-    cout << "-------------------------------------"<< endl;
-    cout << "[INFO] new measurement initiated"<< endl;
-    cout << "\t" << BOLD << "probe_size" << RESET << "= " << probe_size << endl;
-    cout << "\t" << BOLD << "total_time" << RESET << "= " << total_time << endl;
-    cout << "-------------------------------------"<< endl;
-    // from now on, recv should be used with 'probe_size' value
-    char probe_buffer[probe_size];
-    long packets_recv { 0 };
-    int current_round { 0 };
-    
-    // send RESPONSE
-    probe_buffer[0] = 'O';
-    probe_buffer[1] = 'K';
-    socket->send_message(probe_buffer, probe_size);
+  // the sessions wait for their reverse senders, those still count into the metrics
+  m_sessions.reset();
+}
+
+/**
+ * @brief Receive loop of one worker
+ * 
+ * @desc Datagrams of every session are dispatched as they come, a GRO
+ * coalesced buffer is split back into its probes. Probes to be echoed are
+ * sent back out of the receive buffers once the whole batch is dispatched,
+ * before the next receive reuses them. The receive timeout keeps
+ * the loop turning while the line is quiet, so closed sessions are dropped
+ * from the cache.
+ * @param worker index of the worker, its slot in the sessions
+ * @param socket socket of the worker
+ * @param frames receive frames of the worker
+ */
+void Reflector::serve(unsigned worker, std::shared_ptr<SocketEntity> socket, FrameRing& frames)
+{
+  SessionCache cache(*m_sessions);
+  thread_metrics_t& counters = m_metrics->thread(worker);
+  socket->set_recv_timeout(REFLECT_TICK_MS);
+
+  if (m_options.offload)
+    socket->set_gro(true);
+
+  // one receive frame per datagram of the batch
+  unsigned depth = std::min(socket->get_batch_depth(), frames.size());
+  char* const* buffers = frames.window();
+  std::vector<const char*> payloads(buffers, buffers + depth);
+  std::vector<size_t> lengths(depth);
+  std::vector<size_t> segment_sizes(depth);
+  std::vector<uint64_t> rx_timestamps(depth);
+  std::vector<struct sockaddr_storage> sources(depth);
+
+  // echoes of the batch, a coalesced buffer holds more probes than the batch has datagrams
+  std::vector<char*> echoes;
+  std::vector<size_t> echo_lengths;
+  std::vector<const struct sockaddr_storage*> echo_destinations;
+
+  // io_uring: datagrams land in the provided buffers of the socket instead
+  unsigned uring_buffers = 64;
+  while (uring_buffers < 4 * depth)
+    uring_buffers *= 2;
+
+  bool borrowed = socket->get_io_backend() == SocketEntity::URING_IO && socket->start_receiving(MAX_DATAGRAM_SIZE, uring_buffers);
+
+  uint64_t next_tick = monotonic_ns();
+  while (!shutdown_signal)
+  {
+    int received = borrowed
+      ? socket->recv_borrowed(payloads.data(), depth, lengths.data(), rx_timestamps.data(), segment_sizes.data(), REFLECT_TICK_MS, sources.data())
+      : socket->recv_batch(buffers, MAX_DATAGRAM_SIZE, depth, lengths.data(), rx_timestamps.data(), segment_sizes.data(), sources.data());
+    uint64_t now = monotonic_ns();
+
+    metric_add(counters.recv_syscalls, 1);
+    for (int i = 0; i < received; i++)
+      metric_add(counters.bytes_received, lengths[i]);
+
+    for (int i = 0; i < received; i++)
+    {
+      size_t segment = segment_sizes[i] > 0 ? segment_sizes[i] : lengths[i];
+      for (size_t offset = 0; offset < lengths[i] || offset == 0; offset += segment)
+      {
+        const char* probe = payloads[i] + offset;
+        size_t length = std::min(segment, lengths[i] - offset);
+        if (dispatch(worker, *socket, cache, probe, length, rx_timestamps[i], sources[i], now))
+        {
+          // the frame (or provided buffer) is ours until the next receive
+          echoes.push_back(const_cast<char*>(probe));
+          echo_lengths.push_back(length);
+          echo_destinations.push_back(&sources[i]);
+        }
+
+        if (segment == 0)
+          break;
+      }
+    }
+
+    if (!echoes.empty())
+      send_echoes(worker, *socket, echoes, echo_lengths, echo_destinations);
 
-    /* ------------------------------------------ */
-      // MEASUREMENT ROUNDS
-    /* ------------------------------------------ */
-    while (current_round < total_time)
+    if (now >= next_tick)
     {
-      // first RTT, just reflect
-      socket->recv_message(probe_buffer, probe_size);
-      socket->send_message(probe_buffer, probe_size);
+      cache.prune();
+      next_tick = now + REFLECT_TICK_MS * NSEC_PER_MSEC;
+    }
+  }
+}
+
+/**
+ * @brief Sends the echoed probes of a receive batch back
+ * 
+ * @desc Only the flags of a probe are rewritten (PROBE_REPLY), the TX
+ * timestamp of the meter goes back untouched, so the meter gets the RTT of
+ * every probe without keeping its send times. The lists are emptied.
+ * @param worker index of the worker, its counters
+ * @param socket socket the probes came on
+ * @param echoes probes to be sent back, in their receive buffers
+ * @param lengths length of every probe
+ * @param destinations sender of every probe
+ */
+void Reflector::send_echoes(unsigned worker, SocketEntity& socket, std::vector<char*>& echoes, std::vector<size_t>& lengths,
+                            std::vector<const struct sockaddr_storage*>& destinations)
+{
+  thread_metrics_t& counters = m_metrics->thread(worker);
 
-      // then Bandwidth, collect/count then respond with number that arrived
-      packets_recv = recv_packet_group(socket, probe_size);
-      cout << " ~ Packets received: " << packets_recv << endl;
-      // respond
-      socket->send_message(reinterpret_cast<char*>(&packets_recv), sizeof(packets_recv));
-      
-      // no packet received or connection interrupted
-      if (packets_recv <= 0) { break; }
+  for (char* echo : echoes)
+    probe_set_flags(echo, PROBE_DATA | PROBE_REPLY);
 
-      current_round++;
+  unsigned depth = socket.get_batch_depth();
+  for (size_t first = 0; first < echoes.size(); first += depth)
+  {
+    unsigned count = std::min<size_t>(depth, echoes.size() - first);
+    int sent = socket.send_batch_to(&echoes[first], &lengths[first], &destinations[first], count);
+    metric_add(counters.send_syscalls, 1);
+
+    for (int i = 0; i < sent; i++)
+    {
+      metric_add(counters.packets_sent, 1);
+      metric_add(counters.bytes_sent, lengths[first + i]);
     }
-    cout << "[INFO] measurement ended"<< endl;
   }
 
+  echoes.clear();
+  lengths.clear();
+  destinations.clear();
+}
+
+/**
+ * @brief Control loop of the reflector
+ * 
+ * @desc Answers the control messages of all meters and, at least every
+ * REFLECT_TICK_MS, sends the round reports that are due and expires idle sessions.
+ * @param socket control socket
+ */
+void Reflector::serve_control(std::shared_ptr<SocketEntity> socket)
+{
+  char frame[CONTROL_FRAME_MAX];
+  struct sockaddr_storage source;
+  control_header_t header;
+  const char* payload;
+
+  socket->set_recv_timeout(REFLECT_TICK_MS);
+
+  uint64_t next_tick = monotonic_ns();
+  while (!shutdown_signal)
+  {
+    ssize_t bytes_recv = socket->recv_from(frame, sizeof(frame), source);
+    uint64_t now = monotonic_ns();
+
+    if (bytes_recv > 0 && control_read(frame, bytes_recv, header, &payload))
+      handle_control(*socket, header, payload, source, now);
+
+    if (now >= next_tick)
+    {
+      maintain_sessions(*socket, now);
+      next_tick = now + REFLECT_TICK_MS * NSEC_PER_MSEC;
+    }
+  }
 }
 
-// receive packets of fixed size for 1 second and count them
-long Reflector::recv_packet_group(std::shared_ptr<SocketEntity> socket, int probe_size)
+/**
+ * @brief Handles one received probe
+ * 
+ * @desc RTT probes are reflected right away, data probes are tracked in the
+ * slot of this worker, those flagged PROBE_ECHO are left to the caller to
+ * send back with the rest of the batch. Probes of unknown sessions
+ * (stragglers of ended measurements), replies and foreign datagrams are ignored.
+ * @param worker index of the receiving worker
+ * @param socket socket the datagram came on, replies leave through it
+ * @param cache session cache of the worker
+ * @param datagram received datagram
+ * @param length datagram length
+ * @param rx_timestamp receive time (CLOCK_REALTIME ns)
+ * @param source sender of the datagram
+ * @param now CLOCK_MONOTONIC time of the receive
+ * @return true when the probe is to be echoed
+ */
+bool Reflector::dispatch(unsigned worker, SocketEntity& socket, SessionCache& cache, const char* datagram, size_t length,
+                         uint64_t rx_timestamp, const struct sockaddr_storage& source, uint64_t now)
 {
-  // timeout when stuck.. 
-  struct timeval timeout;
-  timeout.tv_sec = 0;
-  timeout.tv_usec = 50000;
-  setsockopt(socket->get_fd(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  probe_header_t probe;
+  thread_metrics_t& counters = m_metrics->thread(worker);
 
-  char probe_buffer[probe_size];
+  // GRO coalesced probes are counted one by one
+  metric_add(counters.packets_received, 1);
 
-  long packets_recv { 0 };
-  int bytes_recv {0};
-  
-  if ( socket->recv_message(probe_buffer, probe_size) > 0 )
-    packets_recv++;
-  else
-    return -1;
+  // a reply coming back in means a loop, it is not echoed again
+  if (!probe_read(datagram, length, probe) || (probe.flags & PROBE_REPLY))
+  {
+    metric_add(counters.dropped, 1);
+    return false;
+  }
 
-  auto t1 = Clock::now();
-  auto t2 = Clock::now();
+  Session* session = cache.find(Session::make_key(source, probe.session_id));
+  if (session == nullptr)
+  {
+    metric_add(counters.dropped, 1);
+    return false;
+  }
 
-  // receive & count packets for 1 second
-  while (std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() < 1000)
+  if (probe.flags & PROBE_RTT)
   {
-    bytes_recv = socket->recv_message(probe_buffer, probe_size);
+    session->touch(now);
+    if (socket.send_to(datagram, length, source) > 0)
+    {
+      metric_add(counters.packets_sent, 1);
+      metric_add(counters.bytes_sent, length);
+    }
+    metric_add(counters.send_syscalls, 1);
+    return false;
+  }
+
+  session->track(worker, probe, length, rx_timestamp, now);
+  return (probe.flags & PROBE_ECHO) != 0;
+}
 
-    if (bytes_recv == probe_size)
-      packets_recv++;
+/**
+ * @brief Handles a control message of a meter
+ * 
+ * @desc A hello opens the session with the features both sides support (a
+ * repeated one is acknowledged again), a round end starts the grace timer of
+ * the round, a ping is answered without any state. When the round was reported already, the report got lost and is
+ * sent once more. Meters speaking another protocol version are rejected.
+ * @param socket control socket
+ * @param header parsed header
+ * @param payload message payload
+ * @param source sender of the message (control socket of the meter)
+ * @param now CLOCK_MONOTONIC time of the receive
+ */
+void Reflector::handle_control(SocketEntity& socket, const control_header_t& header, const char* payload,
+                               const struct sockaddr_storage& source, uint64_t now)
+{
+  char frame[CONTROL_FRAME_MAX];
+  char reply[CONTROL_ACK_SIZE];
+  size_t size;
 
-    t2 = Clock::now();
+  if (header.version != CONTROL_VERSION)
+  {
+    control_reject_write(reply, REJECT_VERSION);
+    size = control_write(frame, CONTROL_REJECT, header.session_id, header.round, reply, CONTROL_REJECT_SIZE);
+    socket.send_to(frame, size, source);
+    return;
   }
-  
-  // catching still arriving packets out of interval
-  while (true)
+
+  switch (header.type)
   {
-    bytes_recv = socket->recv_message(probe_buffer, probe_size);
-    if (bytes_recv < probe_size)
+    case CONTROL_HELLO:
+    {
+      control_hello_t hello;
+      control_hello_read(payload, header.length, hello);
+
+      // grant what was asked for and is offered here
+      control_ack_t ack;
+      ack.capabilities = hello.capabilities & m_capabilities;
+      ack.streams = (ack.capabilities & CAP_MULTI_STREAM) ? hello.streams : 1;
+      ack.round_ms = (ack.capabilities & CAP_ROUND_LENGTH) ? std::min<uint32_t>(std::max<uint32_t>(hello.round_ms, ROUND_MIN_MS), ROUND_MAX_MS)
+                                                          : DEFAULT_ROUND_MS;
+      ack.batch_depth = m_options.batch_depth;
+
+      // the whole round has to fit TIMELINE_MAX_BINS (two spare for bins cut by the round start & end)
+      ack.interval_us = 0;
+      if ((ack.capabilities & CAP_TIMELINE) && hello.interval_us > 0)
+      {
+        uint32_t shortest = (ack.round_ms * 1000 + TIMELINE_MAX_BINS - 3) / (TIMELINE_MAX_BINS - 2);
+        ack.interval_us = std::max({hello.interval_us, static_cast<uint32_t>(TIMELINE_MIN_US), shortest});
+      }
+      else
+        ack.capabilities &= ~CAP_TIMELINE;
+
+      // the reverse counters follow the host drops in the report
+      if (!(ack.capabilities & CAP_HOST_DROPS))
+        ack.capabilities &= ~CAP_REVERSE;
+
+      bool created = false;
+      std::shared_ptr<Session> session;
+      uint32_t reason = REJECT_PARAMS;
+      if (hello.probe_size >= PROBE_HEADER_SIZE && hello.probe_size <= MAX_DATAGRAM_SIZE
+          && hello.streams > 0 && hello.streams <= 0xffff && hello.total_time > 0)
+      {
+        session = m_sessions->open(source, header.session_id, hello, ack, created);
+        reason = REJECT_FULL;
+      }
+
+      if (session)
+      {
+        control_ack_write(reply, session->get_agreement());
+        size = control_write(frame, CONTROL_HELLO_ACK, header.session_id, 0, reply, CONTROL_ACK_SIZE);
+      }
+      else
+      {
+        control_reject_write(reply, reason);
+        size = control_write(frame, CONTROL_REJECT, header.session_id, 0, reply, CONTROL_REJECT_SIZE);
+      }
+      socket.send_to(frame, size, source);
+
+      string address = address_name(source);
+
+      if (!session)
+        cerr << "ERROR: measurement of " << address << " rejected (invalid parameters or " << MAX_SESSIONS << " sessions served)" << endl;
+      else if (created)
+      {
+        session->start_drop_count(host_drops());
+        size_buffers(hello, ack);
+
+        cout << "-------------------------------------"<< endl;
+        cout << "[INFO] new measurement initiated"<< endl;
+        cout << "\t" << BOLD << "meter" << RESET << "= " << address << " (" << address_family_name(source) << ")" << endl;
+        cout << "\t" << BOLD << "session_id" << RESET << "= " << std::hex << header.session_id << std::dec << endl;
+        cout << "\t" << BOLD << "probe_size" << RESET << "= " << hello.probe_size << endl;
+        cout << "\t" << BOLD << "rounds" << RESET << "= " << hello.total_time << endl;
+        cout << "\t" << BOLD << "meter_threads" << RESET << "= " << ack.streams << endl;
+        cout << "\t" << BOLD << "round_length" << RESET << "= " << ack.round_ms << " ms" << endl;
+        if (ack.interval_us > 0)
+          cout << "\t" << BOLD << "timeline" << RESET << "= " << ack.interval_us << " us" << endl;
+        cout << "\t" << BOLD << "capabilities" << RESET << "= " << capability_names(ack.capabilities) << endl;
+        cout << "\t" << BOLD << "recv_buffer" << RESET << "= " << m_sockets[0]->get_recv_buffer() / 1024 << " KiB" << endl;
+        cout << "\t" << BOLD << "sessions" << RESET << "= " << m_sessions->size() << endl;
+        cout << "-------------------------------------"<< endl;
+      }
+      break;
+    }
+    case CONTROL_PING:
+      size = control_write(frame, CONTROL_PONG, header.session_id, header.round);
+      socket.send_to(frame, size, source);
+      break;
+    case CONTROL_REVERSE:
+    {
+      std::shared_ptr<Session> session = m_sessions->find(Session::make_key(source, header.session_id));
+      control_reverse_t reverse;
+      control_reverse_read(payload, header.length, reverse);
+
+      if (!session || !(session->get_agreement().capabilities & CAP_REVERSE) || reverse.port == 0 || reverse.port > 0xffff)
+        break;
+
+      // never faster than the meter said it would measure
+      uint32_t max_rate = session->get_params().max_rate;
+      reverse.rate = std::max<uint32_t>(max_rate > 0 ? std::min(reverse.rate, max_rate) : reverse.rate, 1);
+
+      // the probes go to the host of the control socket, at the port the meter receives them on
+      Session* target = session.get();
+      uint32_t round = header.round;
+      uint32_t rate = reverse.rate;
+      struct sockaddr_storage destination = address_with_port(source, static_cast<unsigned short>(reverse.port));
+      if (session->start_reverse(round, [this, target, round, rate, destination]() { send_reverse(*target, round, rate, destination); }))
+      {
+        control_reverse_write(reply, reverse);
+        size = control_write(frame, CONTROL_REVERSE_ACK, header.session_id, header.round, reply, CONTROL_REVERSE_SIZE);
+        socket.send_to(frame, size, source);
+      }
+      break;
+    }
+    case CONTROL_ROUND_END:
+    {
+      std::shared_ptr<Session> session = m_sessions->find(Session::make_key(source, header.session_id));
+      session_report_t report;
+
+      if (session && !session->end_round(header.round, now) && session->get_report(header.round, report))
+        send_report(socket, *session, header.round, report);
+      break;
+    }
+    default:
       break;
   }
+}
+
+/**
+ * @brief Reports rounds past their grace period, expires idle sessions
+ * 
+ * @param socket socket the reports leave through
+ * @param now CLOCK_MONOTONIC time
+ */
+void Reflector::maintain_sessions(SocketEntity& socket, uint64_t now)
+{
+  // read once per tick, the UDP counters come from /proc
+  bool drops_known = false;
+  host_drops_t drops {};
+
+  for (std::shared_ptr<Session>& session : m_sessions->snapshot())
+  {
+    if (!session->report_due(now))
+      continue;
+
+    if (!drops_known)
+    {
+      drops = host_drops();
+      drops_known = true;
+    }
+
+    uint32_t round;
+    session_report_t collected = session->collect(round, drops);
+    send_report(socket, *session, round, collected);
+
+    const round_report_t& report = collected.counters;
+    uint32_t round_ms = session->get_agreement().round_ms;
+    m_metrics->rounds.fetch_add(1, std::memory_order_relaxed);
+    m_metrics->lost.fetch_add(report.lost, std::memory_order_relaxed);
+    m_metrics->round_throughput.store(report.received * session->get_params().probe_size * 8.0 * 1000 / std::max<uint32_t>(round_ms, 1));
+    m_metrics->round_loss.store(report.received + report.lost > 0 ? report.lost / static_cast<double>(report.received + report.lost) : 0.0);
+    if (report.delay_samples > 0)
+      m_metrics->latency.record(report.owd_variation);
+
+    cout << " ~ [" << std::hex << session->get_session_id() << std::dec << "] round " << round + 1
+         << ": received " << report.received
+         << " (lost " << report.lost << ", reordered " << report.reordered << ", duplicates " << report.duplicates
+         << ", late " << report.late << ", stale " << report.stale << ", invalid " << report.invalid << ")"
+         << ", delay variation " << report.owd_variation / 1000.0 << " us, jitter " << report.jitter / 1000.0 << " us" << endl;
+    if (collected.reverse.sent > 0)
+      cout << "   sent back " << collected.reverse.sent << " at " << collected.reverse.achieved_rate << " packets/second" << endl;
+    if (collected.drops.socket_overflow > 0 || collected.drops.rcvbuf_errors > 0)
+      cout << "   " << CL_YELLOW << "host drops: " << collected.drops.socket_overflow << " on the probe sockets, "
+           << collected.drops.rcvbuf_errors << " UDP RcvbufErrors" << RESET << endl;
+
+    if (session->finished())
+      cout << "[INFO] measurement " << std::hex << session->get_session_id() << std::dec << " ended" << endl;
+  }
+
+  for (std::shared_ptr<Session>& session : m_sessions->expire(now))
+  {
+    if (!session->finished())
+      cout << "[INFO] measurement " << std::hex << session->get_session_id() << std::dec << " timed out" << endl;
+  }
+
+  m_metrics->sessions.store(m_sessions->size(), std::memory_order_relaxed);
+  if (drops_known)
+    m_metrics->host_dropped.store(drops.socket_overflow, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Sends a round report to the control socket of the meter
+ * 
+ * @param socket socket the report leaves through
+ * @param session session of the report
+ * @param round round the report belongs to
+ * @desc The counters come first, the arrival times of the train probes
+ * follow when there are any, the timeline (when agreed to) after them, with
+ * an empty dispersion vector in front of it when the round had no train.
+ * @param report the report
+ */
+void Reflector::send_report(SocketEntity& socket, const Session& session, uint32_t round, const session_report_t& report)
+{
+  char payload[ROUND_REPORT_MAX_SIZE];
+  char frame[CONTROL_FRAME_MAX];
+  bool drops = session.get_agreement().capabilities & CAP_HOST_DROPS;
+
+  round_report_write(payload, report.counters);
+  size_t length = ROUND_REPORT_SIZE;
+  if (!report.arrivals.empty() || report.timeline.enabled() || drops)
+    length += dispersion_write(payload + length, report.arrivals);
+  if (report.timeline.enabled() || drops)
+    length += timeline_write(payload + length, report.timeline);
+  if (drops)
+  {
+    host_drops_write(payload + length, report.drops);
+    length += HOST_DROPS_SIZE;
+  }
+  if (drops && (session.get_agreement().capabilities & CAP_REVERSE))
+  {
+    reverse_stats_write(payload + length, report.reverse);
+    length += REVERSE_STATS_SIZE;
+  }
+
+  size_t size = control_write(frame, CONTROL_REPORT, session.get_session_id(), round, payload, length);
+  socket.send_to(frame, size, session.get_address());
+}
+
+/**
+ * @brief Sends the probes of one round back to a meter
+ * 
+ * @desc Runs in a thread of the session, with the same pacer and frame ring
+ * as a sender thread of the meter. The probes leave a socket of their own,
+ * connected to the receive socket of the meter, so they never land in the
+ * SO_REUSEPORT group of the workers. What was sent goes into the report of
+ * the round.
+ * @param session session of the meter
+ * @param round round the probes belong to
+ * @param rate packets/second
+ * @param destination receive socket of the meter
+ */
+void Reflector::send_reverse(Session& session, uint32_t round, uint32_t rate, const struct sockaddr_storage& destination)
+{
+  const control_hello_t& params = session.get_params();
+  uint64_t round_end = monotonic_ns() + session.get_agreement().round_ms * NSEC_PER_MSEC;
+  reverse_stats_t stats {};
+
+  configure_thread(pthread_self(), SEND_THREAD, 0, m_options);
+
+  // a socket per round, io_uring would cost more to set up than it saves here
+  mtrip_options_t options = m_options;
+  options.io_backend = SocketEntity::BLOCKING_IO;
+  std::shared_ptr<SocketEntity> socket = std::make_shared<SocketEntity>();
+
+  if (socket->setup_connection(destination) == EXIT_SUCCESS)
+  {
+    configure_socket(socket, options);
+    socket->grow_send_buffer(SocketEntity::buffer_size_for(rate, params.probe_size, session.get_agreement().round_ms));
+
+    unsigned ring_frames = SEND_RING_BATCHES * socket->get_batch_depth();
+    BufferArena arena(params.probe_size, ring_frames);
+    if (arena.valid())
+    {
+      FrameRing frames(arena, 0, ring_frames);
+      probe_header_t header {PROBE_MAGIC, session.get_session_id(), round, 0, PROBE_DATA, 0, 0};
+      for (unsigned i = 0; i < ring_frames; i++)
+        probe_format(frames.at(i), params.probe_size, header);
+
+      thread_metrics_t counters;
+      pacer_stats_t pacing;
+      Timeline timeline;
+      stats.sent = send_paced(socket, frames, rate, params.probe_size, round, round_end, 0, m_options.pacing_mode,
+                              counters, pacing, timeline);
+      stats.achieved_rate = static_cast<int64_t>(pacing.achieved_rate);
+      stats.gap_jitter = static_cast<int64_t>(pacing.gap_jitter * NSEC_PER_USEC);
+
+      // the counter set is shared by the senders of all sessions
+      thread_metrics_t& shared = m_metrics->thread(m_sockets.size());
+      shared.packets_sent.fetch_add(counters.packets_sent.load(), std::memory_order_relaxed);
+      shared.bytes_sent.fetch_add(counters.bytes_sent.load(), std::memory_order_relaxed);
+      shared.send_syscalls.fetch_add(counters.send_syscalls.load(), std::memory_order_relaxed);
+    }
+  }
+
+  session.finish_reverse(round, stats);
+}
+
+/**
+ * @brief Drop counters of the reflector host
+ * 
+ * @desc The SO_RXQ_OVFL counters of all probe sockets (last seen by their
+ * workers) and the UDP counters of the host from /proc/net/snmp.
+ * @return cumulative counters, a round gets their difference
+ */
+host_drops_t Reflector::host_drops()
+{
+  host_drops_t drops {};
+  for (std::shared_ptr<SocketEntity>& socket : m_sockets)
+    drops.socket_overflow += socket->get_rx_dropped();
+
+  udp_snmp_t snmp;
+  if (udp_snmp_read(snmp))
+  {
+    drops.rcvbuf_errors = snmp.rcvbuf_errors;
+    drops.sndbuf_errors = snmp.sndbuf_errors;
+    drops.in_errors = snmp.in_errors;
+  }
+  return drops;
+}
+
+/**
+ * @brief Grows the receive buffers for a new measurement
+ * 
+ * @desc The kernel spreads the streams over the workers, a socket gets the
+ * rate of all streams over the number of sockets they can land on. The
+ * buffers never shrink, they stay fit for the fastest meter seen.
+ * @param hello parameters of the meter, 'max_rate' is its peak rate (0 = unknown, '-R' not given)
+ * @param ack parameters agreed to
+ */
+void Reflector::size_buffers(const control_hello_t& hello, const control_ack_t& ack)
+{
+  if (hello.max_rate == 0)
+    return;
 
-  // set timeout back to default
-  timeout.tv_sec = 0;
-  timeout.tv_usec = 0;
-  setsockopt(socket->get_fd(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  size_t sockets = std::max<size_t>(std::min<size_t>(ack.streams, m_sockets.size()), 1);
+  size_t wanted = SocketEntity::buffer_size_for(hello.max_rate / static_cast<double>(sockets), hello.probe_size, ack.round_ms);
 
-  return packets_recv;
+  size_t granted = wanted;
+  for (std::shared_ptr<SocketEntity>& socket : m_sockets)
+    granted = std::min(granted, socket->grow_recv_buffer(wanted));
+
+  if (granted < wanted)
+    cerr << "Receive buffers hold " << granted / 1024 << " KiB, " << wanted / 1024
+         << " KiB wanted (raise net.core.rmem_max or run with CAP_NET_ADMIN)" << endl;
 }
 
 
@@ -262,14 +921,36 @@ void Meter::init()
   cout << "UDP BANDWIDTH MEASUREMENT\n" << endl;
   cout << "[METER]: " << CL_GREEN << "started\n" << RESET << endl;
 
-  // create new socket object
-  std::shared_ptr<SocketEntity> socket = std::make_shared<SocketEntity>();
-  
-  // prepare the remote address
-  socket->setup_connection(m_host_name.c_str(), m_port);
-  cout << "\t[INFO]: Socket setup completed.\n" << endl;
+  // the calibration compares against normal scheduling, so it runs before any of it is applied
+  if (m_options.calibrate)
+    calibrate_scheduling(m_options);
+  configure_scheduling(m_options);
+
+  if (m_options.all_addresses)
+  {
+    measure_addresses();
+    return;
+  }
+  if (m_options.sweep_sizes > 0)
+  {
+    sweep_sizes();
+    return;
+  }
+
+  std::vector<std::shared_ptr<SocketEntity>> sockets = open_sockets();
+  std::shared_ptr<SocketEntity> socket = sockets[0];
 
-  print_start_info(m_host_name, m_port, m_measurment_time, m_probe_size);
+  // the measurement time is filled by rounds of the asked for length
+  m_round_ms = m_options.round_ms;
+  m_rounds = std::max(1, static_cast<int>(m_measurment_time * 1000LL / m_round_ms));
+
+  control_ack_t ack;
+  if (!open_session(sockets, m_rounds, ack))
+    exit(EXIT_FAILURE);
+  // otherwise ok.. measurement can start
+
+  print_start_info(m_host_name, m_port, m_measurment_time, m_probe_size, m_options, m_round_ms, m_rounds, m_interval_us,
+                   ack.capabilities);
 
   /* ------------------------------------------ */
       // PREPARE MEASUREMENT
@@ -277,26 +958,34 @@ void Meter::init()
 
   long total_packets_sent { 0 };
   long total_packets_recv { 0 };
-  std::vector<double> speed_list, rtt_list;
+  std::vector<double> speed_list;
+  LatencyHistogram rtt_histogram;
 
   long packets_recv { 0 };
   long packets_sent { 0 };
 
-  char probe_buffer[m_probe_size];
-  
-  socket->send_message(reinterpret_cast<char*>(&m_probe_size), sizeof(m_probe_size));
-  std::this_thread::sleep_for(1ms);
+  prepare_frames(sockets.size(), socket->get_batch_depth());
 
-  socket->send_message(reinterpret_cast<char*>(&m_measurment_time), sizeof(m_measurment_time));
+  // the rate search is exported, trains have their own results, downstream rounds are not exported
+  if (m_options.exporting && m_options.direction == DOWNSTREAM)
+    cerr << "Downstream rounds are not exported, ignoring -e" << endl;
+  else if (m_options.exporting && !m_options.trains)
+  {
+    m_exporter.reset(new Exporter(m_options.export_format, m_options.export_path));
+    if (!m_exporter->open())
+      exit(EXIT_FAILURE);
+  }
+  else if (m_options.exporting)
+    cerr << "Train mode is not exported, ignoring -e" << endl;
 
-  socket->recv_message(probe_buffer, m_probe_size);
+  // RTT probes & round reports, the sender threads of the rounds inherit its class
+  configure_thread(pthread_self(), CONTROL_THREAD, 0, m_options);
 
-  if (probe_buffer[0] != 'O' || probe_buffer[1] != 'K')
+  if (m_options.trains)
   {
-    cerr << "Reflector disagrees" << endl;
-    exit(EXIT_FAILURE);
+    measure_trains(socket);
+    return;
   }
-  // otherwise ok.. measurement can start
 
 
   /* ------------------------------------------ */
@@ -305,72 +994,277 @@ void Meter::init()
 
 
   int current_round {0};
-  long long packet_rate {0}; // 1s = 1 000 000 us ... -> packet send gap will be 1 000 000 / packet_rate us 
-  long long min = {1000}; // init -> 10 000
-  long long cur = {3000}; // init -> 20 000
-  long long max = {5000}; // init -> 50 000
 
-  packet_rate = cur;
+  // the rate search, the first round goes out at its initial rate
+  std::unique_ptr<RateStrategy> strategy = RateStrategy::create(m_options.rate_algorithm, m_options.max_rate);
+  long long packet_rate = strategy->get_rate(); // 1s = 1 000 000 us ... -> packet send gap will be 1 000 000 / packet_rate us 
+  rate_convergence_t convergence {false, 0.0, 0, 0};
+  uint64_t measurement_start = monotonic_ns();
 
   double rtt {0.0};
-
-  while (current_round < m_measurment_time)
+  pacer_stats_t pacing;
+  RunningStats rate_error; // |achieved - asked for| rate of the rounds in percent
+  RunningStats gap_jitter; // us
+  char report_buffer[ROUND_REPORT_MAX_SIZE];
+  round_report_t report;
+  host_drops_t drops;
+  udp_snmp_t snmp_before {}, snmp_after {};
+
+  // probes per interval of their send time, sent by us & received by the reflector
+  Timeline sent_timeline(m_interval_us * NSEC_PER_USEC, TIMELINE_MAX_BINS);
+  Timeline recv_timeline(m_interval_us * NSEC_PER_USEC, TIMELINE_MAX_BINS);
+  std::vector<dispersion_sample_t> arrivals;
+
+  // smallest transit seen during the whole measurement, queueing delay is measured above it
+  int64_t base_owd { 0 };
+  bool base_owd_known { false };
+
+  // the reverse direction has a search of its own, both run at the same time in '-d both'
+  bool upstream = m_options.direction != DOWNSTREAM;
+  bool downstream = m_options.direction != UPSTREAM;
+  std::unique_ptr<RateStrategy> down_strategy = RateStrategy::create(m_options.rate_algorithm, m_options.max_rate);
+  long long down_rate = down_strategy->get_rate();
+  rate_convergence_t down_convergence {false, 0.0, 0, 0};
+  std::vector<double> down_speed_list;
+  long down_total_sent { 0 };
+  long down_total_recv { 0 };
+  int64_t down_base_owd { 0 };
+  bool down_base_owd_known { false };
+
+  // '-E': echoes of the current round, the RTT under load of every round for the results
+  std::unique_ptr<echo_round_t> echo(m_options.echo ? new echo_round_t() : nullptr);
+  std::vector<loaded_rtt_t> loaded_rounds;
+
+  // a shutdown signal ends the measurement after the current round, with the results so far
+  while (current_round < m_rounds && !shutdown_signal)
   {
     cout << "\n[" << BOLD << current_round+1 << ". round" << RESET << "]\n" << endl;
     
     // calculate RTT
-    rtt = RTT(socket, m_probe_size);
-    rtt_list.push_back(rtt);
-    cout << std::setw(20) << " [RTT]: " << rtt << "ms" << endl;
+    rtt = RTT(socket, m_probe_size, current_round);
+    if (rtt >= 0.0)
+    {
+      rtt_histogram.record(static_cast<uint64_t>(rtt * NSEC_PER_MSEC));
+      cout << std::setw(20) << " [RTT]: " << rtt << "ms" << endl;
+    }
+    else
+      cout << std::setw(20) << " [RTT]: " << CL_RED << "lost" << RESET << endl;
+
+    // the probes of the reflector are received while ours go out, until the round is over on both ends
+    round_report_t down_report {};
+    long down_recv { 0 };
+    std::thread receiver;
+    if (downstream)
+    {
+      uint64_t reverse_end = monotonic_ns() + (m_round_ms + REVERSE_GRACE_MS) * NSEC_PER_MSEC
+                           + static_cast<uint64_t>(std::max(rtt, 0.0) * NSEC_PER_MSEC);
+      receiver = std::thread([this, current_round, reverse_end, &down_report, &down_recv]() {
+        down_recv = receive_reverse(current_round, reverse_end, down_report);
+      });
+      configure_thread(receiver.native_handle(), RECV_THREAD, m_reverse_stream, m_options);
+
+      if (!request_reverse(current_round, down_rate))
+      {
+        cerr << "Reflector stopped responding" << endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    // send group @ rate (or a train of the given length), the UDP counters of this host around it
+    long train_length = strategy->train_length();
+    bool snmp_known = udp_snmp_read(snmp_before);
+    pacing = pacer_stats_t {};
+    if (echo)
+      *echo = echo_round_t {};
+    packets_sent = upstream ? send_round(sockets, packet_rate, m_probe_size, current_round, train_length, pacing, sent_timeline, echo.get()) : 0;
+    if (receiver.joinable())
+      receiver.join();
+
+    // get response how many were received, late ones count (they were not lost),
+    // stale ones from earlier rounds do not
+    // (the report is sent again when our round end or the report itself got lost)
+    int report_length = m_control->exchange(CONTROL_ROUND_END, current_round, nullptr, 0,
+                                            CONTROL_REPORT, report_buffer, sizeof(report_buffer));
+    if (report_length < static_cast<int>(ROUND_REPORT_SIZE))
+    {
+      cerr << (report_length < 0 ? "Reflector stopped responding" : "Reflector sent invalid round report") << endl;
+      exit(EXIT_FAILURE);
+    }
+    round_report_read(report_buffer, report);
+    packets_recv = report.received;
+    bool drops_known = report_host_drops(report_buffer, std::min<size_t>(report_length, sizeof(report_buffer)), drops);
+    snmp_known = snmp_known && udp_snmp_read(snmp_after);
 
-    // send group @ rate
-    packets_sent = send_packet_group(socket, packet_rate, m_probe_size);
+    // the timeline follows the (empty) dispersion vector
+    if (sent_timeline.enabled())
+    {
+      size_t length = std::min<size_t>(report_length, sizeof(report_buffer)) - ROUND_REPORT_SIZE;
+      size_t consumed = dispersion_read(report_buffer + ROUND_REPORT_SIZE, length, arrivals);
+      timeline_read(report_buffer + ROUND_REPORT_SIZE + consumed, length - consumed, recv_timeline);
+    }
 
-    // get response how many were received
-    socket->recv_message(reinterpret_cast<char*>(&packets_recv), sizeof(packets_recv));
+    if (upstream)
+    {
+      cout << std::setw(20) << " [Packets]: " << packets_recv << "/" << packets_sent << " (recv/sent)" << endl;
+      cout << std::setw(20) << " [Probes]: " << report.reordered << " reordered, " << report.duplicates << " duplicate, "
+      << report.late << " late, " << report.stale << " stale" << endl;
 
-    cout << std::setw(20) << " [Packets]: " << packets_recv << "/" << packets_sent << " (recv/sent)" << endl;
-    cout << std::setw(20) << " [Loss]: " << std::setprecision(2) << std::fixed << 100 - (packets_recv/(double long)packets_sent*100) << "%" << endl;
+      if (report.delay_samples > 0)
+      {
+        if (!base_owd_known || report.owd_min < base_owd)
+          base_owd = report.owd_min;
+        base_owd_known = true;
+
+        cout << std::setw(20) << " [Delay]: " << std::setprecision(3) << std::fixed
+        << "queueing +" << (report.owd_mean - base_owd) / 1000.0 << " us"
+        << " (in-round variation " << report.owd_variation / 1000.0 << " us, max +" << (report.owd_max - base_owd) / 1000.0 << " us)" << endl;
+        cout << std::setw(20) << " [Jitter]: " << report.jitter / 1000.0 << " us (RFC 3550)" << endl;
+      }
+      cout << std::setw(20) << " [Loss]: " << std::setprecision(2) << std::fixed << (packets_sent > 0 ? 100 - (packets_recv/(double long)packets_sent*100) : 0) << "%" << endl;
+      print_host_drops(drops_known ? &drops : nullptr,
+                       snmp_known ? static_cast<int64_t>(snmp_after.sndbuf_errors - snmp_before.sndbuf_errors) : -1,
+                       packets_sent, packets_recv);
     
     
-    // calculate the speed in Mbits
-    double speed = packets_recv * m_probe_size * 8 / (double)1000 / (double)1000;
-    speed_list.push_back(speed);
-
-    cout << std::setw(20) << " [Upload speed]: " << std::setprecision(6) << std::fixed << speed << " Mb/s" << endl;
+      // calculate the speed in Mbits over the real length of the round (none when nothing was sent)
+      double speed = pacing.duration > 0 ? packets_recv * m_probe_size * 8 / pacing.duration / (double)1000 / (double)1000 : 0.0;
+      speed_list.push_back(speed);
+      count_round(packet_rate, packets_sent, report, speed);
+      if (drops_known)
+        m_metrics->host_dropped.fetch_add(drops.socket_overflow, std::memory_order_relaxed);
+
+      cout << std::setw(20) << " [Upload speed]: " << std::setprecision(6) << std::fixed << speed << " Mb/s" << endl;
     
-    cout << std::setw(20) << " [Current rate]: " << packet_rate << " packets/second" << endl;
+      cout << std::setw(20) << " [Current rate]: " << packet_rate << " packets/second" << endl;
+      cout << std::setw(20) << " [Achieved rate]: " << std::setprecision(0) << pacing.achieved_rate << " packets/second"
+      << " (" << std::setprecision(2) << (pacing.target_rate > 0 ? (pacing.achieved_rate / pacing.target_rate * 100) - 100.0 : 0.0) << "%)" << endl;
+      cout << std::setw(20) << " [Packet gap]: " << std::setprecision(3) << pacing.gap_mean << " us"
+      << " (jitter " << pacing.gap_jitter << " us)" << endl;
+      if (echo)
+      {
+        auto ms = [](double ns) { return ns / NSEC_PER_MSEC; };
+        loaded_rtt_t loaded {pacing.achieved_rate, packets_sent, echo->echoed, ms(echo->rtt.min()), ms(echo->rtt.percentile(50.0)),
+                             ms(echo->rtt.percentile(90.0)), ms(echo->rtt.percentile(99.0)), ms(echo->rtt.max())};
+        loaded_rounds.push_back(loaded);
+
+        cout << std::setw(20) << " [Echoes]: " << echo->echoed << "/" << packets_sent << " (echoed/sent), "
+        << echo->duplicates << " duplicate, " << echo->stale << " stale" << endl;
+        if (echo->rtt.count() > 0)
+        {
+          cout << std::setw(20) << " [Loaded RTT]: " << std::setprecision(3) << "p50 " << loaded.p50 << " / p90 " << loaded.p90
+          << " / p99 " << loaded.p99 << " / max " << loaded.max << " ms";
+          cout << " (min " << loaded.min << " ms)" << endl;
+        }
+      }
+      if (pacing.target_rate > 0)
+        rate_error.add(std::fabs(pacing.achieved_rate / pacing.target_rate - 1.0) * 100.0);
+      if (packets_sent > 0 && packets_recv >= packets_sent)
+        m_outcome.lossless_rate = std::max(m_outcome.lossless_rate, pacing.achieved_rate);
+      gap_jitter.add(pacing.gap_jitter);
+      if (sent_timeline.enabled())
+        print_timeline(sent_timeline, recv_timeline, m_probe_size);
+
+      // dispersion of the round, rate the probes arrived at on the reflector
+      double arrival_rate { 0.0 };
+      if (report.delay_samples > 1 && report.rx_last > report.rx_first)
+        arrival_rate = (report.delay_samples - 1) / ((report.rx_last - report.rx_first) / static_cast<double>(NSEC_PER_SEC));
+      if (train_length > 0)
+        cout << std::setw(20) << " [Train]: " << train_length << " probes/stream, arrived at " << std::setprecision(0)
+        << arrival_rate << " packets/second" << endl;
     
-    /* ------------ */
-    // adjust rate
-    /* ------------ */
+      /* ------------ */
+      // adjust rate
+      /* ------------ */
 
-    // packets were lost
-    if (packets_recv < packets_sent * 0.990)  // accept small packet loss
-    {
-      max = cur;
-      cur = (min + cur) / 2;
+      rate_feedback_t feedback {packet_rate, pacing.achieved_rate, pacing.duration, packets_sent, packets_recv, arrival_rate};
+      long long previous_rate = packet_rate;
+      packet_rate = strategy->next(feedback);
 
-      min = min * (packets_recv/(double long)packets_sent); // percentage of loss
+      const char* color = packet_rate < previous_rate ? CL_RED : CL_GREEN;
+      cout << std::setw(20) << " [New rate]: " << color << packet_rate << RESET << " packets/second"
+      << "[ " << (packet_rate < previous_rate ? "" : "+") << color << std::setprecision(2) << std::fixed << std::setw(4)
+      << (packet_rate / (double)previous_rate * 100) - 100.0 << "%" << RESET << " ]" << endl;
+
+      // the first time the search settles is its convergence time
+      if (strategy->converged() && !convergence.converged)
+      {
+        convergence = {true, (monotonic_ns() - measurement_start) / static_cast<double>(NSEC_PER_MSEC), current_round + 1, packet_rate};
+        cout << std::setw(20) << " [Converged]: " << CL_GREEN << "after " << std::setprecision(1) << convergence.time_ms
+        << " ms (" << convergence.rounds << " rounds)" << RESET << endl;
+      }
+      cout << endl;
 
-      packet_rate = cur;
-      cout << std::setw(20) << " [New rate]: " << CL_RED << packet_rate << RESET << " packets/second"
-      << "[ -" << CL_RED << std::setprecision(2) << std::fixed << std::setw(4) << 100 - (packet_rate/(double)max*100) << "%" << RESET << " ]\n" << endl;
+      if (m_exporter)
+      {
+        export_round_t record {};
+        record.round = current_round + 1;
+        record.timestamp = realtime_ns();
+        record.time_ms = (monotonic_ns() - measurement_start) / static_cast<double>(NSEC_PER_MSEC);
+        record.rtt_ms = rtt;
+        record.rate = previous_rate;
+        record.achieved_rate = pacing.achieved_rate;
+        record.next_rate = packet_rate;
+        record.converged = strategy->converged();
+        record.sent = packets_sent;
+        record.speed = speed;
+        record.gap_mean = pacing.gap_mean;
+        record.gap_jitter = pacing.gap_jitter;
+        record.queueing_us = report.delay_samples > 0 ? (report.owd_mean - base_owd) / 1000.0 : 0.0;
+        record.report = report;
+        m_exporter->round(record);
+      }
     }
-    else // no packets lost, increase the rate
+
+    if (downstream)
     {
-      min = cur;
-      cur = (cur + max) / 2;
-      
-      if (max < 40'000'000) // limit for localhost, as rate keeps going up but speed does not anymore
-        max = max * 1.618; //:) 
-      else
-        max = 40'000'000;
+      // the reflector tells what it sent, the meter what arrived
+      reverse_stats_t reverse {};
+      report_reverse_stats(report_buffer, std::min<size_t>(report_length, sizeof(report_buffer)), reverse);
+      double down_duration = reverse.achieved_rate > 0 ? reverse.sent / static_cast<double>(reverse.achieved_rate) : m_round_ms / 1000.0;
+      double down_speed = down_recv * m_probe_size * 8 / down_duration / (double)1000 / (double)1000;
+      down_speed_list.push_back(down_speed);
+
+      cout << std::setw(20) << " [Down packets]: " << down_recv << "/" << reverse.sent << " (recv/sent)" << endl;
+      cout << std::setw(20) << " [Down probes]: " << down_report.reordered << " reordered, " << down_report.duplicates << " duplicate, "
+      << down_report.stale << " stale, " << down_report.invalid << " invalid" << endl;
+      if (down_report.delay_samples > 0)
+      {
+        if (!down_base_owd_known || down_report.owd_min < down_base_owd)
+          down_base_owd = down_report.owd_min;
+        down_base_owd_known = true;
 
-      packet_rate = cur;
-      cout << std::setw(20) << " [New rate]: " << CL_GREEN << packet_rate << RESET << " packets/second"
-      << "[ +" << CL_GREEN << std::setprecision(2) << std::fixed << std::setw(4)<< (packet_rate/(double)min*100) - 100.0 << "%" << RESET << " ]\n" << endl;
-    
+        cout << std::setw(20) << " [Down delay]: " << std::setprecision(3) << std::fixed
+        << "queueing +" << (down_report.owd_mean - down_base_owd) / 1000.0 << " us"
+        << " (jitter " << down_report.jitter / 1000.0 << " us)" << endl;
+      }
+      cout << std::setw(20) << " [Down loss]: " << std::setprecision(2) << std::fixed
+      << (reverse.sent > 0 ? 100.0 - 100.0 * down_recv / reverse.sent : 0.0) << "%" << endl;
+      cout << std::setw(20) << " [Download speed]: " << std::setprecision(6) << down_speed << " Mb/s" << endl;
+      cout << std::setw(20) << " [Down rate]: " << down_rate << " packets/second, achieved " << reverse.achieved_rate
+      << " (gap jitter " << std::setprecision(3) << reverse.gap_jitter / 1000.0 << " us)" << endl;
+
+      if (!upstream && reverse.sent > 0 && down_recv >= reverse.sent)
+        m_outcome.lossless_rate = std::max<double>(m_outcome.lossless_rate, reverse.achieved_rate);
+
+      rate_feedback_t feedback {down_rate, static_cast<double>(reverse.achieved_rate), down_duration, static_cast<long>(reverse.sent), down_recv, 0.0};
+      long long previous_rate = down_rate;
+      down_rate = down_strategy->next(feedback);
+
+      const char* color = down_rate < previous_rate ? CL_RED : CL_GREEN;
+      cout << std::setw(20) << " [Down new rate]: " << color << down_rate << RESET << " packets/second"
+      << "[ " << (down_rate < previous_rate ? "" : "+") << color << std::setprecision(2) << std::fixed << std::setw(4)
+      << (down_rate / (double)previous_rate * 100) - 100.0 << "%" << RESET << " ]" << endl;
+
+      if (down_strategy->converged() && !down_convergence.converged)
+      {
+        down_convergence = {true, (monotonic_ns() - measurement_start) / static_cast<double>(NSEC_PER_MSEC), current_round + 1, down_rate};
+        cout << std::setw(20) << " [Down converged]: " << CL_GREEN << "after " << std::setprecision(1) << down_convergence.time_ms
+        << " ms (" << down_convergence.rounds << " rounds)" << RESET << endl;
+      }
+      cout << endl;
+
+      down_total_sent += reverse.sent;
+      down_total_recv += down_recv;
     }
 
     total_packets_sent += packets_sent;
@@ -383,129 +1277,1979 @@ void Meter::init()
       // RESULTS
   /* ------------------------------------------ */
 
-  print_result_info(m_probe_size, m_measurment_time, total_packets_sent, total_packets_recv, speed_list, rtt_list);
-}
+  if (shutdown_signal)
+    cout << "\n\n[!!!] Caught signal(" << shutdown_signal << "). Ending the measurement." << endl;
 
+  if (upstream ? speed_list.empty() : down_speed_list.empty())
+  {
+    cout << "\n[METER]: stopped before the first round ended" << endl;
+    return;
+  }
 
+  if (upstream)
+    print_result_info(m_probe_size, m_measurment_time, total_packets_sent, total_packets_recv, speed_list, rtt_histogram,
+                      m_options.rate_algorithm, convergence, rate_error, gap_jitter, m_options);
+  if (!loaded_rounds.empty())
+    print_loaded_rtt(loaded_rounds, rtt_histogram);
+  if (downstream)
+    print_downstream_info(m_probe_size, m_measurment_time, down_total_sent, down_total_recv, down_speed_list, down_convergence,
+                          upstream ? nullptr : &rtt_histogram);
+
+  // the outcome compared by '-f all' & '-W' is the upstream one, downstream without it
+  const std::vector<double>& outcome_speeds = upstream ? speed_list : down_speed_list;
+  m_outcome.measured = true;
+  m_outcome.packets_sent = upstream ? total_packets_sent : down_total_sent;
+  m_outcome.packets_recv = upstream ? total_packets_recv : down_total_recv;
+  m_outcome.speed_mean = std::accumulate(outcome_speeds.begin(), outcome_speeds.end(), 0.0) / outcome_speeds.size();
+  m_outcome.speed_max = *std::max_element(outcome_speeds.begin(), outcome_speeds.end());
+  m_outcome.rtt_p50 = rtt_histogram.count() > 0 ? static_cast<double>(rtt_histogram.percentile(50.0)) / NSEC_PER_MSEC : -1.0;
+
+  if (m_exporter)
+  {
+    auto ms = [](double ns) { return ns / NSEC_PER_MSEC; };
+    double speed_mean = std::accumulate(speed_list.begin(), speed_list.end(), 0.0) / speed_list.size();
+    double speed_sum_sq = 0.0;
+    for (double speed : speed_list)
+      speed_sum_sq += (speed - speed_mean) * (speed - speed_mean);
+
+    export_summary_t summary {};
+    summary.timestamp = realtime_ns();
+    summary.probe_size = m_probe_size;
+    summary.rounds = m_rounds;
+    summary.round_ms = m_round_ms;
+    summary.algorithm = m_options.rate_algorithm;
+    summary.sent = total_packets_sent;
+    summary.received = total_packets_recv;
+    summary.speed_min = *std::min_element(speed_list.begin(), speed_list.end());
+    summary.speed_max = *std::max_element(speed_list.begin(), speed_list.end());
+    summary.speed_mean = speed_mean;
+    summary.speed_std_dev = std::sqrt(speed_sum_sq / speed_list.size());
+    summary.rtt_samples = rtt_histogram.count();
+    summary.rtt_min = ms(rtt_histogram.min());
+    summary.rtt_max = ms(rtt_histogram.max());
+    summary.rtt_mean = ms(rtt_histogram.mean());
+    summary.rtt_std_dev = ms(rtt_histogram.std_dev());
+    summary.rtt_p50 = ms(rtt_histogram.percentile(50.0));
+    summary.rtt_p90 = ms(rtt_histogram.percentile(90.0));
+    summary.rtt_p99 = ms(rtt_histogram.percentile(99.0));
+    summary.rtt_p999 = ms(rtt_histogram.percentile(99.9));
+    summary.convergence = convergence;
+
+    m_exporter->summary(summary);
+    m_exporter->close();
+    cout << "~ Results exported to " << BOLD << m_options.export_path << RESET << " (" << Exporter::format_name(m_options.export_format) << ")" << endl;
+  }
+}
 
-// send group of packets at a 'packet_rate' for 1 second
-long Meter::send_packet_group(std::shared_ptr<SocketEntity> socket, long long packet_rate, int probe_size)
-{
-  char probe_buffer[probe_size];
 
-  long packets_sent { 0 };
-  auto send_gap = std::chrono::microseconds(1'000'000 / packet_rate);
-  
-  auto t1 = Clock::now();
-  auto t2 = Clock::now();
 
-  while (std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() < 1000)
+/**
+ * @brief Picks the address of the reflector to measure
+ * 
+ * @desc All addresses of the host (of the '-f' family) race against each
+ * other, the first whose control port answers a ping is measured. A host
+ * with a single address skips the race. When no address answers, the first
+ * one is kept, the hello then tells what is wrong.
+ */
+void Meter::choose_address()
+{
+  std::vector<struct sockaddr_storage> addresses = SocketEntity::resolve(m_host_name.c_str(), m_port, m_options.family);
+  if (addresses.empty())
+  {
+    cerr << "[ERROR]: No such host as " << m_host_name << (m_options.family == AF_INET ? " (IPv4)" : m_options.family == AF_INET6 ? " (IPv6)" : "") << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  m_address = addresses[0];
+  if (addresses.size() == 1)
+    return;
+
+  std::vector<struct sockaddr_storage> control_addresses;
+  for (const struct sockaddr_storage& address : addresses)
+    control_addresses.push_back(address_with_port(address, control_port()));
+
+  std::vector<race_result_t> race;
+  int winner = control_race(control_addresses, false, race);
+  if (winner >= 0)
+    m_address = addresses[winner];
+
+  cout << "\t[INFO]: " << addresses.size() << " addresses, " << address_name(m_address) << " (" << address_family_name(m_address) << ")";
+  if (winner >= 0)
+    cout << " answered first in " << std::setprecision(3) << std::fixed << race[winner].rtt_ms << " ms" << endl;
+  else
+    cout << " taken, none answered" << endl;
+}
+
+/**
+ * @brief Measures every address of the host
+ * 
+ * @desc The addresses are pinged in parallel first, then every one that
+ * answered gets a whole measurement of its own, one after another. Running
+ * them at the same time would make the IPv4 and the IPv6 probes share the
+ * bottleneck and each would see only a part of it.
+ */
+void Meter::measure_addresses()
+{
+  std::vector<struct sockaddr_storage> addresses = SocketEntity::resolve(m_host_name.c_str(), m_port, AF_UNSPEC);
+  if (addresses.empty())
+  {
+    cerr << "[ERROR]: No such host as " << m_host_name << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  std::vector<struct sockaddr_storage> control_addresses;
+  for (const struct sockaddr_storage& address : addresses)
+    control_addresses.push_back(address_with_port(address, control_port()));
+
+  std::vector<race_result_t> race;
+  control_race(control_addresses, true, race);
+
+  cout << "~ Addresses of " << BOLD << m_host_name << RESET << ":" << endl;
+  for (const race_result_t& result : race)
+  {
+    cout << "\t" << std::left << std::setw(44) << address_name(result.address, false) << std::right << address_family_name(result.address) << "  ";
+    if (result.answered)
+      cout << CL_GREEN << "answered" << RESET << " in " << std::setprecision(3) << std::fixed << result.rtt_ms << " ms" << endl;
+    else
+      cout << CL_RED << "no answer" << RESET << endl;
+  }
+
+  std::vector<meter_outcome_t> outcomes(addresses.size());
+  for (size_t i = 0; i < addresses.size() && !shutdown_signal; i++)
+  {
+    if (!race[i].answered)
+      continue;
+
+    cout << "\n\n[" << BOLD << "ADDRESS " << i + 1 << "/" << addresses.size() << RESET << "]: " << address_name(addresses[i])
+         << " (" << address_family_name(addresses[i]) << ")\n" << endl;
+
+    // every address exports to a file of its own
+    mtrip_options_t options = m_options;
+    options.all_addresses = false;
+    options.calibrate = false;
+    if (options.exporting)
+      options.export_path += "." + std::to_string(i + 1);
+
+    Meter meter(m_host_name, m_port, m_probe_size, m_measurment_time, options);
+    meter.m_address = addresses[i];
+    meter.init();
+    outcomes[i] = meter.m_outcome;
+  }
+
+  print_address_comparison(race, outcomes);
+}
+
+/**
+ * @brief Finds the path MTU and measures probe sizes up to it
+ * 
+ * @desc The path MTU is looked for first, by DF probes echoed within a
+ * session of its own. Then every size gets a whole measurement of its own,
+ * one after another, from SWEEP_MIN_SIZE up to the largest probe that fits
+ * the path, plus one byte above it: those probes leave in two fragments and
+ * either fragment lost costs the whole probe.
+ */
+void Meter::sweep_sizes()
+{
+  std::vector<std::shared_ptr<SocketEntity>> sockets = open_sockets();
+  control_ack_t ack;
+  if (!open_session(sockets, 1, ack))
+    exit(EXIT_FAILURE);
+
+  size_t headers = sockets[0]->get_header_size();
+  size_t path_payload = discover_path_mtu(sockets[0]);
+  if (path_payload == 0)
+  {
+    cerr << "[ERROR]: Reflector does not echo the probes, the path MTU is not known" << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // the measurements open sockets & metrics endpoint of their own
+  sockets.clear();
+  m_metrics_server.reset();
+
+  std::vector<size_t> sizes;
+  size_t smallest = std::min<size_t>(SWEEP_MIN_SIZE, path_payload);
+  for (unsigned i = 0; i < m_options.sweep_sizes; i++)
+  {
+    size_t size = smallest + (path_payload - smallest) * i / (m_options.sweep_sizes - 1);
+    if (sizes.empty() || size != sizes.back())
+      sizes.push_back(size);
+  }
+  if (path_payload < MAX_DATAGRAM_SIZE)
+    sizes.push_back(path_payload + 1);
+
+  std::vector<meter_outcome_t> outcomes(sizes.size());
+  for (size_t i = 0; i < sizes.size() && !shutdown_signal; i++)
+  {
+    cout << "\n\n[" << BOLD << "PROBE SIZE " << i + 1 << "/" << sizes.size() << RESET << "]: " << sizes[i] << " B"
+         << (sizes[i] > path_payload ? " (fragmented)" : "") << "\n" << endl;
+
+    // every size exports to a file of its own
+    mtrip_options_t options = m_options;
+    options.sweep_sizes = 0;
+    options.calibrate = false;
+    if (options.exporting)
+      options.export_path += "." + std::to_string(sizes[i]);
+
+    Meter meter(m_host_name, m_port, sizes[i], m_measurment_time, options);
+    meter.m_address = m_address;
+    meter.init();
+    outcomes[i] = meter.m_outcome;
+  }
+
+  print_size_sweep(sizes, outcomes, path_payload, headers);
+}
+
+/**
+ * @brief Looks for the largest probe that gets through unfragmented
+ * 
+ * @desc The probes go out with DF set whatever the kernel knows about the
+ * path, so one that does not fit some hop is dropped there instead of being
+ * fragmented. The ICMP "fragmentation needed" is often filtered (tunnels,
+ * overlays), so a missing echo is what tells, not the ICMP. The interface
+ * MTU is tried first, then the sizes between are bisected.
+ * @param socket connected data socket of an open session
+ * @return largest echoed probe in bytes (UDP payload), 0 when none was echoed
+ */
+size_t Meter::discover_path_mtu(std::shared_ptr<SocketEntity> socket)
+{
+  if (!socket->set_mtu_probing())
+    cerr << "Kernel does not send DF probes (IP_PMTUDISC_PROBE), the probes may be fragmented on this host" << endl;
+
+  int mtu = socket->get_mtu();
+  size_t headers = socket->get_header_size();
+  size_t low = PROBE_HEADER_SIZE;
+  size_t high = mtu > static_cast<int>(headers + low) ? std::min<size_t>(mtu - headers, MAX_DATAGRAM_SIZE) : MAX_DATAGRAM_SIZE;
+  std::vector<char> buffer(high);
+  uint64_t sequence = 0;
+
+  cout << "\t[PMTU]: interface MTU " << mtu << " B, DF probes of " << low << " - " << high << " B" << endl;
+
+  if (!echo_probe(socket, buffer.data(), low, sequence++))
+    return 0;
+
+  // the interface MTU usually is the path MTU as well, one probe tells
+  if (echo_probe(socket, buffer.data(), high, sequence++))
+    low = high;
+
+  // 'low' got through, 'high' did not
+  while (high - low > 1 && !shutdown_signal)
+  {
+    size_t middle = low + (high - low) / 2;
+    bool echoed = echo_probe(socket, buffer.data(), middle, sequence++);
+    cout << "\t[PMTU]: " << std::setw(6) << middle << " B " << (echoed ? CL_GREEN "echoed" : CL_RED "lost") << RESET << endl;
+    (echoed ? low : high) = middle;
+  }
+
+  cout << "\t[PMTU]: path MTU " << BOLD << low + headers << " B" << RESET << " (probes up to " << low << " B)" << endl;
+  return low;
+}
+
+/**
+ * @brief Sends one probe of the path MTU discovery
+ * 
+ * @desc The probe is an RTT probe, the reflector echoes it whatever its
+ * size. It is sent up to PMTU_ATTEMPTS times, so a single loss does not make
+ * the size look too big.
+ * @param socket connected data socket with DF probing
+ * @param buffer at least 'size' bytes
+ * @param size probe size (UDP payload)
+ * @param sequence identifies the echo
+ * @return true when the probe came back
+ */
+bool Meter::echo_probe(std::shared_ptr<SocketEntity> socket, char* buffer, size_t size, uint64_t sequence)
+{
+  for (unsigned attempt = 0; attempt < PMTU_ATTEMPTS && !shutdown_signal; attempt++)
+  {
+    probe_header_t header {PROBE_MAGIC, m_session_id, 0, 0, PROBE_RTT, sequence, realtime_ns()};
+    probe_format(buffer, size, header);
+
+    // bigger than the interface takes (EMSGSIZE), no need to wait for anything
+    if (socket->send_message(buffer, size) < 0)
+      return false;
+
+    // a late echo of an earlier attempt counts as well, other echoes are skipped
+    ssize_t bytes_recv;
+    while (socket->wait_readable(PMTU_TIMEOUT_MS) && (bytes_recv = socket->recv_message(buffer, size)) >= 0)
+    {
+      if (probe_read(buffer, bytes_recv, header) && (header.flags & PROBE_RTT) && header.sequence == sequence)
+        return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Creates the data sockets of the meter and the control socket
+ * 
+ * @desc The first socket also carries the RTT probes, every other sender
+ * thread gets a socket of its own (own source port -> own flow). Options
+ * the sockets do not support here are turned off in 'm_options'.
+ * @return the data sockets
+ */
+std::vector<std::shared_ptr<SocketEntity>> Meter::open_sockets()
+{
+  if (m_address.ss_family == AF_UNSPEC)
+    choose_address();
+
+  // create new socket object
+  std::shared_ptr<SocketEntity> socket = std::make_shared<SocketEntity>();
+  
+  // prepare the remote address
+  if (socket->setup_connection(m_address) != EXIT_SUCCESS)
+    exit(EXIT_FAILURE);
+  configure_socket(socket, m_options);
+  m_options.timestamping = socket->get_timestamping(); // what really works here
+
+  // a train has to leave back-to-back, so it comes from a single socket
+  if (m_options.trains && m_options.threads > 1)
+  {
+    cerr << "Trains are sent by a single thread, ignoring -j " << m_options.threads << endl;
+    m_options.threads = 1;
+  }
+
+  std::vector<std::shared_ptr<SocketEntity>> sockets { socket };
+  for (unsigned i = 1; i < m_options.threads; i++)
+  {
+    std::shared_ptr<SocketEntity> data_socket = std::make_shared<SocketEntity>();
+    if (data_socket->setup_connection(m_address) != EXIT_SUCCESS)
+      exit(EXIT_FAILURE);
+    configure_socket(data_socket, m_options);
+    sockets.push_back(data_socket);
+  }
+
+  // the control channel, a socket of its own, so the control messages never queue behind probes
+  m_control_socket = std::make_shared<SocketEntity>();
+  if (m_control_socket->setup_connection(address_with_port(m_address, control_port())) != EXIT_SUCCESS)
+    exit(EXIT_FAILURE);
+
+  // the probes of the reflector come to an unconnected socket of their own, from a port the reflector picks
+  if (m_options.direction != UPSTREAM)
+  {
+    mtrip_options_t options = m_options;
+    options.zerocopy = false;
+    options.io_backend = SocketEntity::BLOCKING_IO;
+
+    m_reverse_socket = std::make_shared<SocketEntity>();
+    if (m_reverse_socket->setup_server(0, false, m_address.ss_family) != EXIT_SUCCESS)
+      exit(EXIT_FAILURE);
+    configure_socket(m_reverse_socket, options);
+    m_reverse_socket->set_recv_timeout(REVERSE_TICK_MS);
+  }
+
+  // GSO works only for probes that fit the MTU, otherwise they stay one datagram per send
+  if (m_options.offload)
+  {
+    for (std::shared_ptr<SocketEntity>& s : sockets)
+      if (s->enable_gso(m_probe_size) == 0)
+        m_options.offload = false;
+
+    if (!m_options.offload)
+      cerr << "UDP GSO not available for " << m_probe_size << "B probes, sending datagrams one by one" << endl;
+  }
+  m_options.zerocopy = m_options.zerocopy && socket->get_zerocopy();
+  m_options.io_backend = socket->get_io_backend();
+
+  // the reverse receiver counts into a set of its own after those of the senders, the echo receivers follow
+  m_reverse_stream = sockets.size();
+  m_echo_stream = m_reverse_stream + (m_reverse_socket ? 1 : 0);
+  m_metrics.reset(new Metrics(mode == MONITOR_MODE ? "monitor" : "meter", m_echo_stream + (m_options.echo ? sockets.size() : 0)));
+  if (!start_metrics_server(m_metrics_server, *m_metrics, m_options))
+    exit(EXIT_FAILURE);
+  cout << "\t[INFO]: Socket setup completed.\n" << endl;
+
+  return sockets;
+}
+
+/**
+ * @brief Opens a measurement session on the reflector
+ * 
+ * @desc Every session gets a new random id, the reflector uses it to tell
+ * our probes from stragglers. The round length & timeline interval agreed
+ * to are taken over, sender threads beyond what the reflector accepts are
+ * dropped from 'sockets'.
+ * @param sockets data sockets, one stream each
+ * @param rounds number of rounds of the session
+ * @param ack output, what the reflector agreed to
+ * @return false when the reflector refused or did not respond
+ */
+bool Meter::open_session(std::vector<std::shared_ptr<SocketEntity>>& sockets, uint32_t rounds, control_ack_t& ack)
+{
+  m_session_id = std::random_device{}();
+  m_control.reset(new ControlChannel(m_control_socket, m_session_id));
+  m_round_ms = m_options.round_ms;
+
+  // the reflector opens a session for the (host, session id) pair, with the features both sides support
+  control_hello_t hello;
+  hello.probe_size = m_probe_size;
+  hello.total_time = rounds;
+  hello.streams = sockets.size();
+  hello.round_ms = m_round_ms;
+  hello.batch_depth = m_options.batch_depth;
+  hello.interval_us = m_options.interval_us;
+  hello.capabilities = (sockets.size() > 1 ? CAP_MULTI_STREAM : 0) | (m_options.batch_depth > 1 ? CAP_BATCHING : 0)
+                     | (m_options.timestamping != SocketEntity::NO_TIMESTAMPING ? CAP_TIMESTAMPS : 0)
+                     | (m_options.offload ? CAP_GRO : 0) | (m_round_ms != DEFAULT_ROUND_MS ? CAP_ROUND_LENGTH : 0)
+                     | (m_options.trains ? CAP_DISPERSION : 0) | (m_options.interval_us > 0 ? CAP_TIMELINE : 0)
+                     | CAP_HOST_DROPS | (m_options.direction != UPSTREAM ? CAP_REVERSE : 0) | (m_options.echo ? CAP_ECHO : 0);
+  // the default ceiling is no rate anyone measures at, the reflector would size its buffers for it
+  hello.max_rate = m_options.max_rate != DEFAULT_MAX_RATE ? static_cast<uint32_t>(std::min<long long>(m_options.max_rate, UINT32_MAX)) : 0;
+
+  char hello_payload[CONTROL_HELLO_SIZE];
+  char ack_payload[CONTROL_ACK_SIZE];
+  control_hello_write(hello_payload, hello);
+
+  int ack_length = m_control->exchange(CONTROL_HELLO, 0, hello_payload, CONTROL_HELLO_SIZE,
+                                       CONTROL_HELLO_ACK, ack_payload, sizeof(ack_payload));
+  if (ack_length < 0)
+  {
+    if (m_control->get_reject_reason() == REJECT_VERSION)
+      cerr << "Reflector speaks control protocol version " << static_cast<int>(m_control->get_peer_version())
+           << ", this meter version " << CONTROL_VERSION << endl;
+    else if (m_control->get_reject_reason() != 0)
+      cerr << "Reflector disagrees" << (m_control->get_reject_reason() == REJECT_FULL ? " (too many measurements)" : "") << endl;
+    else
+      cerr << "Reflector does not respond on control port " << control_port() << endl;
+    return false;
+  }
+
+  control_ack_read(ack_payload, ack_length, ack);
+  m_round_ms = ack.round_ms;
+  m_interval_us = (ack.capabilities & CAP_TIMELINE) ? ack.interval_us : 0;
+
+  // the number of rounds was announced already, they just take another time
+  if (m_round_ms != m_options.round_ms)
+    cerr << "Reflector runs " << m_round_ms << " ms rounds, not " << m_options.round_ms << " ms" << endl;
+  if (m_options.interval_us > 0 && m_interval_us == 0)
+    cerr << "Reflector does not report timelines, rounds are reported as a whole" << endl;
+  else if (m_interval_us != m_options.interval_us)
+    cerr << "Reflector reports timelines in " << m_interval_us << " us intervals (" << TIMELINE_MAX_BINS << " per round at most)" << endl;
+
+  if (ack.streams < sockets.size())
+  {
+    cerr << "Reflector accepts " << ack.streams << " sender threads only" << endl;
+    sockets.resize(std::max<uint32_t>(ack.streams, 1));
+    m_options.threads = sockets.size();
+  }
+  if (m_options.trains && !(ack.capabilities & CAP_DISPERSION))
+  {
+    cerr << "Reflector does not report arrival times, trains need them" << endl;
+    return false;
+  }
+  if ((hello.capabilities & CAP_TIMESTAMPS) && !(ack.capabilities & CAP_TIMESTAMPS))
+    cerr << "Reflector has no kernel timestamps, one-way delays are timestamped in user space there" << endl;
+  if (m_options.direction != UPSTREAM && !(ack.capabilities & CAP_REVERSE))
+  {
+    cerr << "Reflector does not send probes back, measuring upstream only" << endl;
+    m_options.direction = UPSTREAM;
+  }
+  if (m_options.echo && !(ack.capabilities & CAP_ECHO))
+  {
+    cerr << "Reflector does not echo probes, the RTT is measured unloaded only" << endl;
+    m_options.echo = false;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Asks the reflector for the probes of a round
+ * 
+ * @desc The request is repeated like any other control request, a repeated
+ * one does not make the reflector send the round twice.
+ * @param round round the probes belong to
+ * @param packet_rate rate of the reflector in packets/second
+ * @return false when the reflector did not acknowledge
+ */
+bool Meter::request_reverse(uint32_t round, long long packet_rate)
+{
+  control_reverse_t reverse {static_cast<uint32_t>(std::min<long long>(packet_rate, UINT32_MAX)), m_reverse_socket->get_local_port()};
+  char payload[CONTROL_REVERSE_SIZE];
+  control_reverse_write(payload, reverse);
+
+  return m_control->exchange(CONTROL_REVERSE, round, payload, CONTROL_REVERSE_SIZE,
+                             CONTROL_REVERSE_ACK, payload, sizeof(payload)) >= 0;
+}
+
+/**
+ * @brief Receives the probes the reflector sends in one round
+ * 
+ * @desc The meter end of the reverse direction does what a reflector worker
+ * does: tracks the sequence numbers (loss, reordering, duplicates) and the
+ * one-way delays of the probes of the round, probes of other rounds count
+ * as stale.
+ * @param round round being received
+ * @param deadline CLOCK_MONOTONIC time the receiving ends
+ * @param report output, counters & delays of the round
+ * @return probes of the round received
+ */
+long Meter::receive_reverse(uint32_t round, uint64_t deadline, round_report_t& report)
+{
+  SequenceTracker tracker;
+  DelayEstimator delay;
+  thread_metrics_t& counters = m_metrics->thread(m_reverse_stream);
+  report = round_report_t {};
+
+  // one byte over the probe size, so longer datagrams show up as invalid
+  unsigned depth = m_reverse_socket->get_batch_depth();
+  size_t frame_size = m_probe_size + 1;
+  std::vector<char> frames(depth * frame_size);
+  std::vector<char*> buffers(depth);
+  for (unsigned i = 0; i < depth; i++)
+    buffers[i] = &frames[i * frame_size];
+  std::vector<size_t> lengths(depth);
+  std::vector<uint64_t> rx_timestamps(depth);
+
+  probe_header_t header;
+  while (monotonic_ns() < deadline)
+  {
+    int received = m_reverse_socket->recv_batch(buffers.data(), frame_size, depth, lengths.data(), rx_timestamps.data());
+    metric_add(counters.recv_syscalls, 1);
+
+    for (int i = 0; i < received; i++)
+    {
+      metric_add(counters.packets_received, 1);
+      metric_add(counters.bytes_received, lengths[i]);
+
+      if (lengths[i] != static_cast<size_t>(m_probe_size) || !probe_read(buffers[i], lengths[i], header) || header.session_id != m_session_id)
+        report.invalid++;
+      else if (header.round != round || header.flags != PROBE_DATA)
+        report.stale++;
+      else
+      {
+        tracker.track(header.sequence, false);
+        delay.add(header.tx_timestamp, rx_timestamps[i]);
+      }
+    }
+  }
+
+  tracker.report(report);
+  round_report_add_delay(report, delay);
+  return report.received;
+}
+
+/**
+ * @brief Receives the echoes of one sender stream
+ * 
+ * @desc Runs next to the sender of the socket. The reflector sends every
+ * probe back with the TX timestamp it left with, so the RTT of a probe is
+ * its receive time less that timestamp. The receive time is the kernel/NIC
+ * one with '-T', so the wake-up of this thread under load does not count,
+ * it is read in user space otherwise. Echoes are matched by the sequence
+ * number, only the first echo of a probe counts.
+ * @param socket data socket of the stream, its echoes come back to it
+ * @param round round being sent
+ * @param stream stream of the socket
+ * @param deadline CLOCK_MONOTONIC time the receiving ends, set once the sender is done
+ * @param echo output, echoes & their RTTs
+ * @return unique echoes received
+ */
+long Meter::receive_echoes(std::shared_ptr<SocketEntity> socket, uint32_t round, uint16_t stream,
+                           const std::atomic<uint64_t>& deadline, echo_round_t& echo)
+{
+  SequenceTracker tracker;
+  thread_metrics_t& counters = m_metrics->thread(m_echo_stream + stream);
+
+  unsigned depth = socket->get_batch_depth();
+  size_t frame_size = m_probe_size + 1;
+  std::vector<char> frames(depth * frame_size);
+  std::vector<char*> buffers(depth);
+  for (unsigned i = 0; i < depth; i++)
+    buffers[i] = &frames[i * frame_size];
+  std::vector<size_t> lengths(depth);
+  std::vector<uint64_t> rx_timestamps(depth);
+  bool kernel_timestamps = m_options.timestamping != SocketEntity::NO_TIMESTAMPING;
+
+  probe_header_t header;
+  while (monotonic_ns() < deadline.load(std::memory_order_relaxed))
+  {
+    if (!socket->wait_readable(ECHO_TICK_MS))
+      continue;
+
+    // the sender thread is in send_batch() on this socket, recv_batch() keeps to headers of its own
+    int received = socket->recv_batch(buffers.data(), frame_size, depth, lengths.data(),
+                                      kernel_timestamps ? rx_timestamps.data() : nullptr);
+    uint64_t now = realtime_ns();
+    metric_add(counters.recv_syscalls, 1);
+
+    for (int i = 0; i < received; i++)
+    {
+      metric_add(counters.packets_received, 1);
+      metric_add(counters.bytes_received, lengths[i]);
+
+      if (lengths[i] != static_cast<size_t>(m_probe_size) || !probe_read(buffers[i], lengths[i], header)
+          || header.session_id != m_session_id || !(header.flags & PROBE_REPLY) || header.round != round || header.stream != stream)
+        echo.stale++;
+      else if (!tracker.track(header.sequence, false))
+        echo.duplicates++;
+      else
+      {
+        echo.echoed++;
+        uint64_t rx_timestamp = kernel_timestamps ? rx_timestamps[i] : now;
+        if (rx_timestamp > header.tx_timestamp)
+          echo.rtt.record(rx_timestamp - header.tx_timestamp);
+      }
+    }
+  }
+
+  return echo.echoed;
+}
+
+/**
+ * @brief Adds the echoes of another stream
+ */
+void echo_round_t::merge(const echo_round_t& other)
+{
+  echoed += other.echoed;
+  duplicates += other.duplicates;
+  stale += other.stale;
+  rtt.merge(other.rtt);
+}
+
+/**
+ * @brief Sends one round from all sockets in parallel
+ * 
+ * @desc The rate is split evenly, every socket is driven by its own
+ * sender thread with its own pacer, pinned to its own core ('-A send=').
+ * With echoes every socket gets a receiver thread as well, it keeps
+ * receiving for ECHO_GRACE_MS after the senders are done.
+ * @param sockets control socket followed by the data sockets
+ * @param packet_rate total rate in packets/second
+ * @param probe_size size of the probes
+ * @param round current round, stamped into the probes
+ * @param train_length probes per socket, 0 = send for the whole round
+ * @param pacing output, merged pacing statistics of all threads
+ * @param timeline output, sent probes of all threads per interval (left alone when not enabled)
+ * @param echo output, echoes of all streams, null when the probes are not echoed
+ * @return total packets sent
+ */
+long Meter::send_round(std::vector<std::shared_ptr<SocketEntity>>& sockets, long long packet_rate, int probe_size,
+                       uint32_t round, long train_length, pacer_stats_t& pacing, Timeline& timeline, echo_round_t* echo)
+{
+  size_t count = sockets.size();
+  std::vector<long> sent(count, 0);
+  std::vector<pacer_stats_t> stats(count);
+  std::vector<Timeline> timelines(count, Timeline(timeline.interval(), TIMELINE_MAX_BINS));
+  std::vector<std::thread> threads;
+
+  // the receivers start first, the first echoes come back one RTT after the first probe
+  std::atomic<uint64_t> echo_deadline {UINT64_MAX};
+  std::vector<std::unique_ptr<echo_round_t>> echoes;
+  std::vector<std::thread> receivers;
+  for (size_t i = 0; echo && i < count; i++)
+  {
+    echoes.emplace_back(new echo_round_t());
+    receivers.emplace_back([this, &sockets, &echoes, &echo_deadline, i, round]() {
+      receive_echoes(sockets[i], round, static_cast<uint16_t>(i), echo_deadline, *echoes[i]);
+    });
+    // indexed past the senders & the reverse receiver, by default each gets a core of its own
+    configure_thread(receivers.back().native_handle(), RECV_THREAD, m_echo_stream + i, m_options);
+  }
+
+  for (size_t i = 0; i < count; i++)
+  {
+    // remainder of the division goes to the first threads
+    long long thread_rate = packet_rate / count + (static_cast<long long>(i) < packet_rate % static_cast<long long>(count) ? 1 : 0);
+    if (thread_rate < 1)
+      thread_rate = 1;
+
+    // room for the bursts of the pacer, the buffer grows with the rate of the search
+    sockets[i]->grow_send_buffer(SocketEntity::buffer_size_for(thread_rate, probe_size, m_round_ms));
+    if (echo)
+      sockets[i]->grow_recv_buffer(SocketEntity::buffer_size_for(thread_rate, probe_size, m_round_ms));
+
+    threads.emplace_back([this, &sockets, &sent, &stats, &timelines, i, thread_rate, probe_size, round, train_length]() {
+      sent[i] = send_packet_group(sockets[i], m_rings[i], thread_rate, probe_size, round, i, train_length, stats[i], timelines[i]);
+    });
+    configure_thread(threads.back().native_handle(), SEND_THREAD, i, m_options);
+  }
+
+  for (std::thread& thread : threads)
+    thread.join();
+
+  echo_deadline.store(monotonic_ns() + ECHO_GRACE_MS * NSEC_PER_MSEC);
+  for (size_t i = 0; i < receivers.size(); i++)
+  {
+    receivers[i].join();
+    echo->merge(*echoes[i]);
+  }
+
+  pacing = merge_pacer_stats(stats);
+
+  timeline.reset();
+  for (const Timeline& thread_timeline : timelines)
+    timeline.merge(thread_timeline);
+
+  long packets_sent { 0 };
+  for (long s : sent)
+    packets_sent += s;
+
+  return packets_sent;
+}
+
+/**
+ * @brief Maps the probe arena of the session and preformats its frames
+ * 
+ * @desc Frame 0 is the RTT frame, it is followed
+ * by a ring of SEND_RING_BATCHES batches for every sender stream. The data
+ * frames get their full header & padding here, the send path only patches
+ * round, sequence number and timestamp.
+ * @param streams number of sender threads
+ * @param depth batch depth of the sockets
+ */
+void Meter::prepare_frames(unsigned streams, unsigned depth)
+{
+  unsigned ring_frames = SEND_RING_BATCHES * depth;
+
+  m_arena.reset(new BufferArena(m_probe_size, 1 + streams * ring_frames));
+  if (!m_arena->valid())
+    exit(EXIT_FAILURE);
+
+  m_rings.clear();
+  for (unsigned stream = 0; stream < streams; stream++)
+  {
+    m_rings.emplace_back(*m_arena, 1 + stream * ring_frames, ring_frames);
+
+    uint16_t flags = m_options.trains ? PROBE_TRAIN : m_options.echo ? PROBE_DATA | PROBE_ECHO : PROBE_DATA;
+    probe_header_t header {PROBE_MAGIC, m_session_id, 0, static_cast<uint16_t>(stream), flags, 0, 0};
+    for (unsigned i = 0; i < ring_frames; i++)
+      probe_format(m_rings.back().at(i), m_probe_size, header);
+  }
+}
+
+/**
+ * @brief Publishes the results of a round on the metrics endpoint
+ * 
+ * @param packet_rate rate the round was sent at (packets/second, 0 for a train)
+ * @param packets_sent probes sent in the round
+ * @param report report of the reflector
+ * @param speed received throughput of the round in Mb/s
+ */
+void Meter::count_round(long long packet_rate, long packets_sent, const round_report_t& report, double speed)
+{
+  m_metrics->rounds.fetch_add(1, std::memory_order_relaxed);
+  m_metrics->lost.fetch_add(std::max<long>(packets_sent - report.received, 0), std::memory_order_relaxed);
+  m_metrics->round_throughput.store(speed * 1000 * 1000);
+  m_metrics->round_rate.store(packet_rate);
+  m_metrics->round_loss.store(packets_sent > 0 ? std::max(0.0, 1.0 - report.received / static_cast<double>(packets_sent)) : 0.0);
+}
+
+// send group of packets at a 'packet_rate' for one round, a train ends after 'train_length' probes
+long Meter::send_packet_group(std::shared_ptr<SocketEntity> socket, FrameRing& frames, long long packet_rate, int probe_size,
+                              uint32_t round, uint16_t stream, long train_length, pacer_stats_t& pacing, Timeline& timeline)
+{
+  uint64_t round_end = monotonic_ns() + m_round_ms * NSEC_PER_MSEC;
+  return send_paced(socket, frames, packet_rate, probe_size, round, round_end, train_length, m_options.pacing_mode,
+                    m_metrics->thread(stream), pacing, timeline);
+}
+
+
+/**
+ * @brief Paced sender of the meter rounds and of the reverse probes of the reflector
+ * 
+ * @desc The pacer releases one batch at a time, the frames of the ring are
+ * preformatted, only round, sequence number & timestamp are patched in.
+ * @param socket connected socket the probes leave through
+ * @param frames ring of preformatted frames of the sending thread
+ * @param packet_rate packets/second
+ * @param probe_size size of the probes
+ * @param round round stamped into the probes
+ * @param round_end CLOCK_MONOTONIC time the sending stops
+ * @param train_length probes to send, 0 = send until 'round_end'
+ * @param mode pacing mode
+ * @param counters metrics of the sending thread
+ * @param pacing output, achieved rate & gap jitter
+ * @param timeline output, the sent probes per interval (when enabled)
+ * @return probes sent
+ */
+long send_paced(std::shared_ptr<SocketEntity> socket, FrameRing& frames, long long packet_rate, int probe_size, uint32_t round,
+                uint64_t round_end, long train_length, Pacer::pacing_mode_t mode, thread_metrics_t& counters,
+                pacer_stats_t& pacing, Timeline& timeline)
+{
+  // the pacer releases at most one batch at a time, frames of the ring are preformatted
+  unsigned depth = std::min(socket->get_batch_depth(), frames.size());
+
+  // zerocopy sends are read by the kernel after send_batch returned, the frames
+  // of a burst are patched again only after its completion was reaped
+  bool zerocopy = socket->get_zerocopy();
+  std::vector<std::pair<unsigned, uint32_t>> in_flight(zerocopy ? frames.size() : 0); // frames, sends after the burst
+  unsigned oldest_burst { 0 };
+  unsigned bursts_in_flight { 0 };
+  unsigned frames_in_flight { 0 };
+
+  Pacer pacer(packet_rate, depth, mode);
+
+  // send times of the current burst, only the probes that made it out count in the timeline
+  std::vector<uint64_t> stamps(depth);
+
+  long packets_sent { 0 };
+
+  pacer.start();
+  while (monotonic_ns() < round_end && (train_length == 0 || packets_sent < train_length))
+  {
+    unsigned burst = pacer.acquire(train_length == 0 ? depth : std::min<long>(depth, train_length - packets_sent));
+
+    while (zerocopy && bursts_in_flight > 0 && frames_in_flight + burst > frames.size())
+    {
+      socket->wait_zerocopy(in_flight[oldest_burst].second, ZEROCOPY_TIMEOUT_MS);
+      frames_in_flight -= in_flight[oldest_burst].first;
+      oldest_burst = (oldest_burst + 1) % in_flight.size();
+      bursts_in_flight--;
+    }
+
+    for (unsigned i = 0; i < burst; i++)
+    {
+      stamps[i] = realtime_ns();
+      probe_patch(frames.at(i), round, packets_sent + i, stamps[i]);
+    }
+
+    // sequence numbers of probes that did not make it out are reused
+    int sent = socket->send_batch(frames.window(), probe_size, burst);
+    frames.advance(burst);
+    metric_add(counters.send_syscalls, 1);
+
+    if (timeline.enabled())
+      for (int i = 0; i < sent; i++)
+        timeline.add(stamps[i]);
+
+    if (zerocopy && burst > 0)
+    {
+      in_flight[(oldest_burst + bursts_in_flight) % in_flight.size()] = {burst, socket->get_zerocopy_sent()};
+      bursts_in_flight++;
+      frames_in_flight += burst;
+    }
+    if (sent > 0)
+    {
+      packets_sent += sent;
+      pacer.record(sent);
+      metric_add(counters.packets_sent, sent);
+      metric_add(counters.bytes_sent, static_cast<uint64_t>(sent) * probe_size);
+    }
+  }
+
+  pacing = pacer.report();
+
+  // the next round patches the frames again, the kernel has to let go of them first
+  if (zerocopy)
+    socket->wait_zerocopy(socket->get_zerocopy_sent(), ZEROCOPY_TIMEOUT_MS);
+
+  return packets_sent;
+}
+
+
+/**
+ * @brief Train mode of the meter
+ * 
+ * @desc Every round sends a single train (or chirp) and estimates the path
+ * from its dispersion, the rest of the round the line stays quiet. The load
+ * is a few dozen probes per round instead of a saturated second.
+ * @param socket the data socket, trains leave through it only
+ */
+void Meter::measure_trains(std::shared_ptr<SocketEntity> socket)
+{
+  ProbeTrain train(m_options.train_pattern, m_options.train_probes, m_probe_size, m_options.max_rate);
+  std::vector<uint64_t> tx_times(train.schedule().size());
+  std::vector<train_estimate_t> estimates;
+  LatencyHistogram rtt_histogram;
+
+  char report_buffer[ROUND_REPORT_MAX_SIZE];
+  round_report_t report;
+  std::vector<dispersion_sample_t> arrivals;
+
+  long total_packets_sent { 0 };
+  long total_packets_recv { 0 };
+
+  for (int current_round = 0; current_round < m_rounds && !shutdown_signal; current_round++)
+  {
+    uint64_t round_start = monotonic_ns();
+    cout << "\n[" << BOLD << current_round+1 << ". round" << RESET << "]\n" << endl;
+
+    double rtt = RTT(socket, m_probe_size, current_round);
+    if (rtt >= 0.0)
+    {
+      rtt_histogram.record(static_cast<uint64_t>(rtt * NSEC_PER_MSEC));
+      cout << std::setw(20) << " [RTT]: " << rtt << "ms" << endl;
+    }
+    else
+      cout << std::setw(20) << " [RTT]: " << CL_RED << "lost" << RESET << endl;
+
+    long packets_sent = send_train(socket, m_rings[0], train, current_round, tx_times);
+
+    // the report carries the arrival times of the train behind the counters
+    int report_length = m_control->exchange(CONTROL_ROUND_END, current_round, nullptr, 0,
+                                            CONTROL_REPORT, report_buffer, sizeof(report_buffer));
+    if (report_length < static_cast<int>(ROUND_REPORT_SIZE))
+    {
+      cerr << (report_length < 0 ? "Reflector stopped responding" : "Reflector sent invalid round report") << endl;
+      exit(EXIT_FAILURE);
+    }
+    round_report_read(report_buffer, report);
+    dispersion_read(report_buffer + ROUND_REPORT_SIZE, std::min<size_t>(report_length, sizeof(report_buffer)) - ROUND_REPORT_SIZE, arrivals);
+
+    train_estimate_t estimate = train.estimate(tx_times, arrivals);
+    estimates.push_back(estimate);
+    count_round(0, packets_sent, report, estimate.dispersion_rate / 1000 / 1000);
+
+    auto mbps = [](double bps) { return bps / 1000 / 1000; };
+    cout << std::setw(20) << " [Packets]: " << report.received << "/" << packets_sent << " (recv/sent), "
+    << arrivals.size() << " arrival times" << endl;
+    cout << std::setw(20) << " [Dispersion]: " << std::setprecision(3) << std::fixed << mbps(estimate.input_rate) << " Mb/s sent, "
+    << mbps(estimate.dispersion_rate) << " Mb/s arrived" << endl;
+    if (estimate.dispersion_rate <= 0)
+      cout << std::setw(20) << " [Available]: " << CL_RED << "unknown" << RESET
+      << " (too few probes, or all received at once: try kernel timestamps)" << endl;
+    else
+    {
+      if (train.get_pattern() == ProbeTrain::TRAIN)
+        cout << std::setw(20) << " [Capacity]: " << mbps(estimate.capacity) << " Mb/s"
+        << (estimate.sender_limited ? CL_YELLOW " (sender limited)" RESET : "") << endl;
+      cout << std::setw(20) << " [Available]: " << (estimate.available_bound ? ">= " : "") << CL_GREEN << mbps(estimate.available)
+      << RESET << " Mb/s" << endl;
+    }
+
+    total_packets_sent += packets_sent;
+    total_packets_recv += report.received;
+
+    // one train per round, the line is left alone for the rest of it
+    uint64_t round_end = round_start + m_round_ms * NSEC_PER_MSEC;
+    uint64_t now = monotonic_ns();
+    if (now < round_end && current_round + 1 < m_rounds)
+      std::this_thread::sleep_for(std::chrono::nanoseconds(round_end - now));
+  }
+
+  print_train_info(m_probe_size, estimates.size(), m_options, total_packets_sent, total_packets_recv, estimates, rtt_histogram);
+}
+
+
+/**
+ * @brief Sends one train or chirp
+ * 
+ * @desc Probes are sent when their offset in the schedule comes (spinning
+ * on the clock, the gaps of a chirp are microseconds), probes already due
+ * go out together in one batch. Every probe is stamped right before it is
+ * handed to the kernel and the stamp is kept for the estimation.
+ * @param socket data socket
+ * @param frames preformatted frames of the socket
+ * @param train schedule of the probes
+ * @param round current round, stamped into the probes
+ * @param tx_times output, CLOCK_REALTIME send time of every probe, 0 when it could not be sent
+ * @return number of probes sent
+ */
+long Meter::send_train(std::shared_ptr<SocketEntity> socket, FrameRing& frames, const ProbeTrain& train, uint32_t round,
+                       std::vector<uint64_t>& tx_times)
+{
+  const std::vector<uint64_t>& schedule = train.schedule();
+  unsigned depth = std::min(socket->get_batch_depth(), frames.size());
+  bool zerocopy = socket->get_zerocopy();
+  unsigned frames_used { 0 };
+
+  std::fill(tx_times.begin(), tx_times.end(), 0);
+
+  long packets_sent { 0 };
+  size_t next { 0 };
+  thread_metrics_t& counters = m_metrics->thread(0);
+  uint64_t start = monotonic_ns();
+
+  while (next < schedule.size())
+  {
+    while (monotonic_ns() < start + schedule[next])
+      ;
+
+    uint64_t now = monotonic_ns();
+    unsigned burst { 0 };
+    while (burst < depth && next + burst < schedule.size() && start + schedule[next + burst] <= now)
+      burst++;
+
+    // zerocopy frames are patched again only after the kernel let go of them
+    if (zerocopy && frames_used + burst > frames.size())
+    {
+      socket->wait_zerocopy(socket->get_zerocopy_sent(), ZEROCOPY_TIMEOUT_MS);
+      frames_used = 0;
+    }
+
+    for (unsigned i = 0; i < burst; i++)
+    {
+      tx_times[next + i] = realtime_ns();
+      probe_patch(frames.at(i), round, next + i, tx_times[next + i]);
+    }
+
+    int sent = socket->send_batch(frames.window(), m_probe_size, burst);
+    frames.advance(burst);
+    frames_used += burst;
+    metric_add(counters.send_syscalls, 1);
+
+    // probes that did not make it out are holes in the train
+    for (unsigned i = std::max(sent, 0); i < burst; i++)
+      tx_times[next + i] = 0;
+
+    packets_sent += std::max(sent, 0);
+    next += burst;
+  }
+
+  metric_add(counters.packets_sent, packets_sent);
+  metric_add(counters.bytes_sent, static_cast<uint64_t>(packets_sent) * m_probe_size);
+
+  if (zerocopy)
+    socket->wait_zerocopy(socket->get_zerocopy_sent(), ZEROCOPY_TIMEOUT_MS);
+
+  return packets_sent;
+}
+
+
+/**
+ * @brief Print startup informations
+ * 
+ */
+void print_start_info(string host_name, unsigned short port, int measurment_time, int probe_size, const mtrip_options_t& options,
+                      unsigned round_ms, int rounds, unsigned interval_us, uint32_t capabilities)
+{
+  cout << "-----------------------------------" << endl;
+  cout << "~ Host: "<< BOLD << host_name << RESET << endl;
+  cout << "~ Port: " << BOLD << port << RESET << endl;
+  cout << "~ Measurement time: " << BOLD << measurment_time << " seconds" << RESET << endl;
+  cout << "~ Probe packet size: " << BOLD << probe_size << " Bytes" << RESET << endl;
+  cout << "~ Batch depth: " << BOLD << options.batch_depth << " packets/syscall" << RESET << endl;
+  cout << "~ Pacing: " << BOLD << Pacer::mode_name(options.pacing_mode) << RESET << endl;
+  cout << "~ Sender threads: " << BOLD << options.threads << RESET << endl;
+  cout << "~ Timestamps: " << BOLD << (options.timestamping == SocketEntity::HARDWARE_TIMESTAMPING ? "NIC"
+                                     : options.timestamping == SocketEntity::SOFTWARE_TIMESTAMPING ? "kernel" : "user space") << RESET << endl;
+  cout << "~ I/O: " << BOLD << (options.io_backend == SocketEntity::URING_IO ? "io_uring" : "blocking") << RESET << endl;
+  cout << "~ Offload: " << BOLD << (options.offload ? "UDP GSO" : "none") << (options.zerocopy ? ", MSG_ZEROCOPY" : "") << RESET << endl;
+  cout << "~ Round length: " << BOLD << round_ms << " ms" << RESET << " (" << rounds << " rounds)" << endl;
+  cout << "~ Direction: " << BOLD << direction_name(options.direction)
+       << (options.direction == UPSTREAM ? " (meter -> reflector)" : options.direction == DOWNSTREAM ? " (reflector -> meter)" : " (full duplex)")
+       << RESET << endl;
+  if (interval_us > 0)
+    cout << "~ Timeline: " << BOLD << interval_us << " us intervals" << RESET << endl;
+  if (options.trains)
+    cout << "~ Probing: " << BOLD << ProbeTrain::pattern_name(options.train_pattern) << " of " << options.train_probes
+         << " probes per round" << (options.train_pattern == ProbeTrain::CHIRP ? " (up to " + std::to_string(options.max_rate) + " packets/second)" : "")
+         << RESET << endl;
+  else
+    cout << "~ Rate search: " << BOLD << RateStrategy::algorithm_name(options.rate_algorithm)
+         << " (up to " << options.max_rate << " packets/second)" << RESET << endl;
+  cout << "~ Reflector: " << BOLD << capability_names(capabilities) << RESET << endl;
+  cout << "~ Scheduling: " << BOLD << scheduling_name(options) << RESET << endl;
+  cout << "-----------------------------------" << endl;
+}
+
+/**
+ * @brief Prints the time series of one round
+ * 
+ * @desc One line per interval of the send time, the reflector bins the probes
+ * by the timestamp they carry, so the same interval on both sides holds the
+ * same probes and the difference is what got lost. Intervals before the
+ * first sent probe (probes of other rounds) are left out.
+ * @param sent probes sent by the meter
+ * @param received probes received by the reflector
+ * @param probe_size size of the probes in bytes
+ */
+void print_timeline(const Timeline& sent, const Timeline& received, int probe_size)
+{
+  if (sent.size() == 0)
+    return;
+
+  double interval_ms = sent.interval() / static_cast<double>(NSEC_PER_MSEC);
+  uint64_t last = std::max(sent.first_bin() + sent.size(), received.first_bin() + received.size());
+
+  cout << std::setw(20) << " [Timeline]: " << sent.interval() / NSEC_PER_USEC << " us intervals"
+  << (received.get_dropped() > 0 ? " (" + std::to_string(received.get_dropped()) + " probes out of range)" : "") << endl;
+  cout << std::setw(20) << "" << std::setw(10) << "t (ms)" << std::setw(10) << "sent" << std::setw(10) << "recv"
+  << std::setw(10) << "lost" << std::setw(14) << "Mb/s" << endl;
+
+  for (uint64_t bin = sent.first_bin(); bin < last; bin++)
+  {
+    long probes_sent = sent.at(bin);
+    long probes_recv = received.at(bin);
+    double speed = probes_recv * probe_size * 8 / interval_ms / 1000.0;
+
+    cout << std::setw(20) << "" << std::setprecision(3) << std::fixed << std::setw(10) << (bin - sent.first_bin()) * interval_ms
+    << std::setw(10) << probes_sent << std::setw(10) << probes_recv
+    << (probes_recv < probes_sent ? CL_RED : "") << std::setw(10) << std::max(0L, probes_sent - probes_recv) << RESET
+    << std::setw(14) << speed << endl;
+  }
+}
+
+/**
+ * @brief Prints the drops of both hosts of a round
+ * 
+ * @desc Probes the reflector host dropped on its full socket queues never
+ * left a trace on the path, the loss beyond them is what the path lost.
+ * Both the socket and the UDP counters of the reflector are shared by all
+ * its measurements.
+ * @param reflector drops of the reflector host, nullptr when it does not report them
+ * @param meter_sndbuf_errors UDP SndbufErrors of this host during the round, -1 when unknown
+ * @param packets_sent probes sent in the round
+ * @param packets_recv probes the reflector received
+ */
+void print_host_drops(const host_drops_t* reflector, int64_t meter_sndbuf_errors, long packets_sent, long packets_recv)
+{
+  if (reflector == nullptr && meter_sndbuf_errors <= 0)
+    return;
+
+  cout << std::setw(20) << " [Host drops]: ";
+  if (reflector)
+    cout << (reflector->socket_overflow > 0 ? CL_YELLOW : "") << "reflector " << reflector->socket_overflow << RESET
+    << " on full socket queues (" << reflector->rcvbuf_errors << " UDP RcvbufErrors), ";
+  else
+    cout << "reflector unknown, ";
+  cout << "meter ";
+  if (meter_sndbuf_errors >= 0)
+    cout << meter_sndbuf_errors << " UDP SndbufErrors" << endl;
+  else
+    cout << "unknown" << endl;
+
+  if (reflector && packets_sent > 0)
+  {
+    long path_lost = std::max(0L, packets_sent - packets_recv - static_cast<long>(reflector->socket_overflow));
+    cout << std::setw(20) << " [Path loss]: " << std::setprecision(2) << std::fixed << path_lost * 100.0 / packets_sent << "%" << endl;
+  }
+}
+
+/**
+ * @brief Prints the RTT percentiles of the results
+ * 
+ */
+static void print_rtt_info(const LatencyHistogram& rtt_histogram)
+{
+  cout << "   " << CL_RED << "RTT\n " << RESET << endl;
+  // histogram values are in ns
+  auto ms = [](double ns) { return ns / NSEC_PER_MSEC; };
+  auto precision = cout.precision(4);
+
+  cout << "\tSAMPLES: " << rtt_histogram.count() << endl;
+  cout << "\tMAX RTT: "<< ms(rtt_histogram.max()) << " ms" << endl;
+  cout << "\tMIN RTT: "<< ms(rtt_histogram.min()) << " ms" << endl;
+  cout << "\tAVG RTT: "<< ms(rtt_histogram.mean()) << " ms" << endl;
+  cout << "\tSTD DEV: "<< ms(rtt_histogram.std_dev()) << " ms" << endl;
+  cout << "\tPERCENTILES: p50 " << ms(rtt_histogram.percentile(50.0))
+       << " / p90 " << ms(rtt_histogram.percentile(90.0))
+       << " / p99 " << ms(rtt_histogram.percentile(99.0))
+       << " / p99.9 " << ms(rtt_histogram.percentile(99.9))
+       << " / max " << ms(rtt_histogram.max()) << " ms\n" << endl;
+  cout.precision(precision);
+}
+
+/**
+ * @brief Print results information
+ * 
+ */
+void print_result_info(int probe_size, int measurement_time, long packets_sent, long packets_recv, const std::vector<double>& speed_list, const LatencyHistogram& rtt_histogram,
+                       RateStrategy::algorithm_t algorithm, const rate_convergence_t& convergence,
+                       const RunningStats& rate_error, const RunningStats& gap_jitter, const mtrip_options_t& options)
+{
+  cout << "\n\n--------------------------------------------------------------------------------" << endl;
+  cout << "  " << BOLD << "FINAL RESULTS" << RESET << " (for " << probe_size << "B probe packets & " << measurement_time << "s measurement test)" << endl;
+  cout << "--------------------------------------------------------------------------------\n" << endl;
+
+  cout << "   " << CL_BLUE << "PACKETS & DATA\n" << RESET << endl;
+  cout << "\tPACKETS TRANSFERRED: " << packets_recv << "/" << packets_sent << " (received/sent)" << endl;
+  cout << "\tPACKETS LOST: ~ " << (packets_sent > 0 ? 100 - (static_cast<long double>(packets_recv)/packets_sent) * 100 : 0) << "% loss" << endl;
+  cout << "\tDATA TRANSFERED: " << packets_sent * probe_size / 1000 / 1000 << " MB SENT / " << packets_recv * probe_size / 1000 / 1000 << " MB RECEIVED\n" << endl;
+  
+  print_rtt_info(rtt_histogram);
+
+  cout << "   " << CL_GREEN<< "AVAILABLE BANDWIDTH\n " << RESET << endl;
+  cout << "\tMAX SPEED: "<< *std::max_element(speed_list.begin(), speed_list.end()) << " Mb/s" << endl;
+  cout << "\tMIN SPEED: "<< *std::min_element(speed_list.begin(), speed_list.end()) << " Mb/s" << endl;
+
+  // avg rtt and standard deviation
+  double speed_sum = std::accumulate(speed_list.begin(), speed_list.end(), 0.0);
+  double speed_mean = speed_sum / speed_list.size();
+  
+  cout << "\tAVG SPEED: "<< speed_mean << " Mb/s" << endl;
+
+  std::vector<double> speed_diff(speed_list.size());
+  std::transform(speed_list.begin(), speed_list.end(), speed_diff.begin(), [speed_mean](double d) { return d - speed_mean;});
+
+  double speed_sum_sq = std::inner_product(speed_diff.begin(), speed_diff.end(), speed_diff.begin(), 0.0);
+  double speed_std_dev = std::sqrt(speed_sum_sq / speed_list.size());
+
+  cout << "\tSTD DEV: "<< speed_std_dev << " Mb/s\n" << endl;
+
+  cout << "   " << CL_YELLOW << "RATE SEARCH\n " << RESET << endl;
+  cout << "\tALGORITHM: " << RateStrategy::algorithm_name(algorithm) << endl;
+  if (convergence.converged)
+    cout << "\tCONVERGED: after " << std::setprecision(1) << convergence.time_ms << " ms (" << convergence.rounds
+         << " rounds) at " << convergence.rate << " packets/second\n" << endl;
+  else
+    cout << "\tCONVERGED: " << CL_RED << "no" << RESET << " (" << speed_list.size() << " rounds)\n" << endl;
+
+  cout << "   " << CL_MAGENTA << "PACING\n " << RESET << endl;
+  cout << "\tSCHEDULING: " << scheduling_name(options) << endl;
+  cout << "\tRATE ERROR: " << std::setprecision(3) << rate_error.mean() << "% mean, " << rate_error.max() << "% worst round" << endl;
+  cout << "\tGAP JITTER: " << gap_jitter.mean() << " us mean, " << gap_jitter.max() << " us worst round\n\n" << endl;
+}
+
+
+/**
+ * @brief Print results of the reverse direction (reflector -> meter)
+ * 
+ * @desc The reflector paced the probes, so the pacing of this side says
+ * nothing about them, what it achieved is in the round lines above.
+ * @param rtt_histogram RTT of the measurement, null when the upstream results printed it already
+ */
+void print_downstream_info(int probe_size, int measurement_time, long packets_sent, long packets_recv,
+                           const std::vector<double>& speed_list, const rate_convergence_t& convergence,
+                           const LatencyHistogram* rtt_histogram)
+{
+  cout << "\n\n--------------------------------------------------------------------------------" << endl;
+  cout << "  " << BOLD << "DOWNSTREAM RESULTS" << RESET << " (reflector -> meter, " << probe_size << "B probe packets & "
+       << measurement_time << "s measurement test)" << endl;
+  cout << "--------------------------------------------------------------------------------\n" << endl;
+
+  cout << "   " << CL_BLUE << "PACKETS & DATA\n" << RESET << endl;
+  cout << "\tPACKETS TRANSFERRED: " << packets_recv << "/" << packets_sent << " (received/sent)" << endl;
+  cout << "\tPACKETS LOST: ~ " << (packets_sent > 0 ? 100 - (static_cast<long double>(packets_recv)/packets_sent) * 100 : 0) << "% loss" << endl;
+  cout << "\tDATA TRANSFERED: " << packets_sent * probe_size / 1000 / 1000 << " MB SENT / " << packets_recv * probe_size / 1000 / 1000 << " MB RECEIVED\n" << endl;
+
+  if (rtt_histogram)
+    print_rtt_info(*rtt_histogram);
+
+  double speed_mean = std::accumulate(speed_list.begin(), speed_list.end(), 0.0) / speed_list.size();
+
+  cout << "   " << CL_GREEN<< "AVAILABLE BANDWIDTH\n " << RESET << endl;
+  cout << "\tMAX SPEED: "<< *std::max_element(speed_list.begin(), speed_list.end()) << " Mb/s" << endl;
+  cout << "\tMIN SPEED: "<< *std::min_element(speed_list.begin(), speed_list.end()) << " Mb/s" << endl;
+  cout << "\tAVG SPEED: "<< speed_mean << " Mb/s\n" << endl;
+
+  cout << "   " << CL_YELLOW << "RATE SEARCH\n " << RESET << endl;
+  if (convergence.converged)
+    cout << "\tCONVERGED: after " << std::setprecision(1) << convergence.time_ms << " ms (" << convergence.rounds
+         << " rounds) at " << convergence.rate << " packets/second\n\n" << endl;
+  else
+    cout << "\tCONVERGED: " << CL_RED << "no" << RESET << " (" << speed_list.size() << " rounds)\n\n" << endl;
+}
+
+
+/**
+ * @brief Name of a direction as '-d' takes it
+ */
+const char* direction_name(direction_t direction)
+{
+  switch (direction)
+  {
+    case UPSTREAM:
+      return "up";
+    case DOWNSTREAM:
+      return "down";
+    case BIDIRECTIONAL:
+      return "both";
+    default:
+      return "unknown";
+  }
+}
+
+
+/**
+ * @brief Print the measurements of all addresses of the host side by side
+ * 
+ * @param race answers of the addresses to the pings
+ * @param outcomes results of the measurement of every address, in the same order
+ */
+void print_address_comparison(const std::vector<race_result_t>& race, const std::vector<meter_outcome_t>& outcomes)
+{
+  cout << "\n\n--------------------------------------------------------------------------------" << endl;
+  cout << "  " << BOLD << "ADDRESS COMPARISON" << RESET << endl;
+  cout << "--------------------------------------------------------------------------------\n" << endl;
+
+  cout << "\t" << std::left << std::setw(40) << "address" << std::setw(6) << "family" << std::right
+       << std::setw(12) << "avg Mb/s" << std::setw(12) << "max Mb/s" << std::setw(9) << "loss" << std::setw(12) << "RTT p50" << endl;
+
+  for (size_t i = 0; i < race.size(); i++)
+  {
+    const meter_outcome_t& outcome = outcomes[i];
+    cout << "\t" << std::left << std::setw(40) << address_name(race[i].address, false) << std::setw(6)
+         << address_family_name(race[i].address) << std::right;
+
+    if (!outcome.measured)
+    {
+      cout << std::setw(12) << (race[i].answered ? "not measured" : "no answer") << endl;
+      continue;
+    }
+
+    double loss = outcome.packets_sent > 0 ? 100.0 - 100.0 * outcome.packets_recv / outcome.packets_sent : 0.0;
+    cout << std::setprecision(2) << std::fixed << std::setw(12) << outcome.speed_mean << std::setw(12) << outcome.speed_max
+         << std::setw(8) << loss << "%";
+    if (outcome.rtt_p50 >= 0.0)
+      cout << std::setprecision(3) << std::setw(9) << outcome.rtt_p50 << " ms" << endl;
+    else
+      cout << std::setw(12) << "-" << endl;
+  }
+  cout << endl;
+}
+
+
+/**
+ * @brief Print the RTT under load of every round, by the rate it was sent at
+ * 
+ * @desc A queue building up along the path (bufferbloat) shows as the RTT
+ * growing with the rate long before probes get lost. The baseline is the
+ * smallest RTT seen, of the idle probes (one before every round) or of the
+ * echoes, whichever got through the empty path faster.
+ * @param rounds RTT percentiles of the echoes of every round
+ * @param idle_rtt RTT of the unloaded probes (ns)
+ */
+void print_loaded_rtt(std::vector<loaded_rtt_t> rounds, const LatencyHistogram& idle_rtt)
+{
+  std::sort(rounds.begin(), rounds.end(), [](const loaded_rtt_t& a, const loaded_rtt_t& b) { return a.achieved_rate < b.achieved_rate; });
+
+  double base = idle_rtt.count() > 0 ? idle_rtt.min() / static_cast<double>(NSEC_PER_MSEC) : -1.0;
+  for (const loaded_rtt_t& round : rounds)
+    if (round.echoed > 0 && (base < 0.0 || round.min < base))
+      base = round.min;
+
+  cout << "   " << CL_CYAN << "RTT UNDER LOAD\n " << RESET << endl;
+  cout << "\tBASE RTT: " << std::setprecision(3) << std::fixed << base << " ms (smallest seen)\n" << endl;
+
+  cout << "\t" << std::setw(12) << "packets/s" << std::setw(10) << "echoed" << std::setw(10) << "p50 ms" << std::setw(10) << "p90 ms"
+       << std::setw(10) << "p99 ms" << std::setw(10) << "max ms" << std::setw(12) << "p50 - base" << endl;
+  for (const loaded_rtt_t& round : rounds)
+  {
+    double echoed = round.sent > 0 ? 100.0 * round.echoed / round.sent : 0.0;
+    cout << "\t" << std::setprecision(0) << std::fixed << std::setw(12) << round.achieved_rate
+         << std::setprecision(1) << std::setw(9) << echoed << "%" << std::setprecision(3);
+    if (round.echoed == 0)
+    {
+      cout << std::setw(10) << "-" << endl;
+      continue;
+    }
+    cout << std::setw(10) << round.p50 << std::setw(10) << round.p90 << std::setw(10) << round.p99 << std::setw(10) << round.max
+         << std::setw(12) << round.p50 - base << endl;
+  }
+  cout << "\n" << endl;
+}
+
+
+/**
+ * @brief Print the measurements of all probe sizes of the sweep and the best one
+ * 
+ * @desc Goodput is what the probes carry (UDP payload) at the highest rate
+ * a round went through without loss, the headers and the rounds with loss
+ * do not count.
+ * @param sizes probe sizes measured
+ * @param outcomes results of the measurement of every size, in the same order
+ * @param path_payload largest probe that gets through unfragmented
+ * @param headers IP + UDP headers of every datagram
+ */
+void print_size_sweep(const std::vector<size_t>& sizes, const std::vector<meter_outcome_t>& outcomes, size_t path_payload,
+                      size_t headers)
+{
+  cout << "\n\n--------------------------------------------------------------------------------" << endl;
+  cout << "  " << BOLD << "PROBE SIZE SWEEP" << RESET << endl;
+  cout << "--------------------------------------------------------------------------------\n" << endl;
+
+  // fragments carry multiples of 8 bytes of the UDP datagram, the IP header is in every one
+  size_t ip_header = headers - 8;
+  size_t fragment_payload = (path_payload + headers - ip_header) & ~static_cast<size_t>(7);
+
+  int best = -1;
+  for (size_t i = 0; i < sizes.size(); i++)
+    if (outcomes[i].lossless_rate > 0.0 && (best < 0 || outcomes[i].lossless_rate * sizes[i] > outcomes[best].lossless_rate * sizes[best]))
+      best = i;
+
+  cout << "\tPATH MTU: " << path_payload + headers << " B (probes up to " << path_payload << " B unfragmented)\n" << endl;
+  cout << "\t" << std::setw(8) << "size B" << std::setw(7) << "frags" << std::setw(12) << "avg Mb/s" << std::setw(12) << "max Mb/s"
+       << std::setw(9) << "loss" << std::setw(16) << "loss-free pps" << std::setw(14) << "goodput Gb/s" << endl;
+
+  for (size_t i = 0; i < sizes.size(); i++)
+  {
+    const meter_outcome_t& outcome = outcomes[i];
+    size_t fragments = sizes[i] <= path_payload ? 1 : (sizes[i] + headers - ip_header + fragment_payload - 1) / fragment_payload;
+    cout << "\t" << std::setw(8) << sizes[i] << std::setw(7) << fragments;
+
+    if (!outcome.measured)
+    {
+      cout << std::setw(14) << "not measured" << endl;
+      continue;
+    }
+
+    double loss = outcome.packets_sent > 0 ? 100.0 - 100.0 * outcome.packets_recv / outcome.packets_sent : 0.0;
+    cout << std::setprecision(2) << std::fixed << std::setw(12) << outcome.speed_mean << std::setw(12) << outcome.speed_max
+         << std::setw(8) << loss << "%";
+    if (outcome.lossless_rate > 0.0)
+      cout << std::setprecision(0) << std::setw(16) << outcome.lossless_rate << std::setprecision(3) << std::setw(14)
+           << outcome.lossless_rate * sizes[i] * 8 / 1e9;
+    else
+      cout << std::setw(16) << "-" << std::setw(14) << "-";
+    cout << (static_cast<int>(i) == best ? CL_GREEN "  <" RESET : "") << endl;
+  }
+
+  if (best >= 0)
+    cout << "\n\tBEST SIZE: " << CL_GREEN << sizes[best] << " B" << RESET << ", " << std::setprecision(0)
+         << outcomes[best].lossless_rate << " packets/second, " << std::setprecision(3)
+         << outcomes[best].lossless_rate * sizes[best] * 8 / 1e9 << " Gb/s without loss\n" << endl;
+  else
+    cout << "\n\tBEST SIZE: " << CL_RED << "none" << RESET << ", every round of every size lost probes\n" << endl;
+}
+
+
+/**
+ * @brief Print results of the train mode
+ * 
+ */
+void print_train_info(int probe_size, int rounds, const mtrip_options_t& options, long packets_sent, long packets_recv,
+                      const std::vector<train_estimate_t>& estimates, const LatencyHistogram& rtt_histogram)
+{
+  cout << "\n\n--------------------------------------------------------------------------------" << endl;
+  cout << "  " << BOLD << "FINAL RESULTS" << RESET << " (" << rounds << " " << ProbeTrain::pattern_name(options.train_pattern)
+       << "s of " << options.train_probes << " " << probe_size << "B probes)" << endl;
+  cout << "--------------------------------------------------------------------------------\n" << endl;
+
+  cout << "   " << CL_BLUE << "PACKETS & DATA\n" << RESET << endl;
+  cout << "\tPACKETS TRANSFERRED: " << packets_recv << "/" << packets_sent << " (received/sent)" << endl;
+  cout << "\tDATA TRANSFERED: " << packets_sent * probe_size / 1000 << " kB SENT\n" << endl;
+
+  print_rtt_info(rtt_histogram);
+
+  // rounds without an estimate (train lost) do not count
+  std::vector<double> capacity, available;
+  bool bound = false;
+  for (const train_estimate_t& estimate : estimates)
+  {
+    if (estimate.dispersion_rate <= 0)
+      continue;
+    capacity.push_back(estimate.capacity / 1000 / 1000);
+    available.push_back(estimate.available / 1000 / 1000);
+    bound = bound || estimate.available_bound;
+  }
+
+  cout << "   " << CL_GREEN<< "AVAILABLE BANDWIDTH\n " << RESET << endl;
+  cout << "\tESTIMATES: " << available.size() << "/" << estimates.size() << endl;
+  if (options.train_pattern == ProbeTrain::TRAIN)
+    cout << "\tCAPACITY: " << median(capacity) << " Mb/s (median)" << endl;
+  cout << "\tAVAILABLE: " << (bound ? ">= " : "") << median(available) << " Mb/s (median)" << endl;
+  if (!available.empty())
+    cout << "\tRANGE: " << *std::min_element(available.begin(), available.end()) << " - "
+         << *std::max_element(available.begin(), available.end()) << " Mb/s\n\n" << endl;
+}
+
+
+/**
+ * @brief Round trip time calculation
+ * 
+ * @desc Calculates roundtrip time (Single test)
+ * For average value, function needs to be called multiple times
+ * @param socket socket to be used for RTT calc.
+ * @param buffer buffer to be used for sending/
+ * @param round current round, stamped into the probe
+ * @return RTT in ms, -1 when the echo did not come within RTT_TIMEOUT_MS
+ */
+double Meter::RTT(std::shared_ptr<SocketEntity> socket, size_t buffer_size, uint32_t round)
+{ 
+  // the RTT frame, first one of the arena
+  char* buffer = m_arena->frame(0);
+
+  probe_header_t header {PROBE_MAGIC, m_session_id, round, 0, PROBE_RTT, 0, realtime_ns()};
+  probe_write(buffer, header);
+
+  // kernel/NIC timestamps when enabled, so the scheduling noise is left out
+  uint64_t start, end;
+  thread_metrics_t& counters = m_metrics->thread(0);
+  if (socket->send_message_ts(buffer, buffer_size, start) > 0)
+  {
+    metric_add(counters.packets_sent, 1);
+    metric_add(counters.bytes_sent, buffer_size);
+  }
+  metric_add(counters.send_syscalls, 1);
+
+  // a lost probe or echo must not block the meter, late echoes of earlier rounds are skipped
+  ssize_t bytes_recv;
+  do
+  {
+    if (!socket->wait_readable(RTT_TIMEOUT_MS) || (bytes_recv = socket->recv_message_ts(buffer, buffer_size, end)) < 0)
+      return -1.0;
+  }
+  while (!(probe_read(buffer, bytes_recv, header) && (header.flags & PROBE_RTT) && header.round == round));
+
+  metric_add(counters.recv_syscalls, 1);
+  metric_add(counters.packets_received, 1);
+  metric_add(counters.bytes_received, bytes_recv);
+  if (end > start)
+    m_metrics->latency.record(end - start);
+  
+  return (static_cast<int64_t>(end - start)) / static_cast<double>(NSEC_PER_MSEC); // in ms
+}
+
+
+
+/*****************************************************************************/
+
+/**
+ * @brief Local wall clock time for the log lines of the monitor
+ */
+static string clock_time()
+{
+  char text[16];
+  time_t now = time(nullptr);
+  struct tm local;
+  strftime(text, sizeof(text), "%H:%M:%S", localtime_r(&now, &local));
+  return text;
+}
+
+/**
+ * @brief Creates the monitor
+ * 
+ * @param host_name reflector host
+ * @param port reflector port
+ * @param probe_size size of the probes
+ * @param options settings passed on the command line
+ */
+Monitor::Monitor(std::string host_name, unsigned short port, int probe_size, const mtrip_options_t& options)
+  : Meter(host_name, port, probe_size, 0, options),
+    m_minute(60 * NSEC_PER_SEC, 60),
+    m_hour(3600 * NSEC_PER_SEC, 60),
+    m_day(24 * 3600 * NSEC_PER_SEC, 144)
+{
+  mode = MONITOR_MODE;
+}
+
+/**
+ * @brief Main routine of the monitor
+ * 
+ * @desc Every cycle sends one round at the rate of the search and spends the
+ * rest of the cycle idle, apart from the keepalive RTT probes. A lost
+ * reflector is looked for again every MONITOR_RETRY_MS with a new session.
+ * Nothing grows with the uptime: the windows are fixed rings, the results
+ * of the rounds are printed (and exported) and forgotten.
+ */
+void Monitor::init()
+{
+  cout << "UDP BANDWIDTH MEASUREMENT\n" << endl;
+  cout << "[MONITOR]: " << CL_GREEN << "started\n" << RESET << endl;
+
+  configure_scheduling(m_options);
+
+  if (m_options.trains)
+  {
+    cerr << "The monitor runs the rate search, ignoring -P" << endl;
+    m_options.trains = false;
+  }
+
+  std::vector<std::shared_ptr<SocketEntity>> sockets = open_sockets();
+  std::shared_ptr<SocketEntity> socket = sockets[0];
+  std::unique_ptr<RateStrategy> strategy;
+  bool connected = false;
+
+  if (m_options.exporting)
+  {
+    m_exporter.reset(new Exporter(m_options.export_format, m_options.export_path));
+    if (!m_exporter->open())
+      exit(EXIT_FAILURE);
+  }
+
+  configure_thread(pthread_self(), CONTROL_THREAD, 0, m_options);
+
+  uint32_t round {0};
+  char report_buffer[ROUND_REPORT_MAX_SIZE];
+  round_report_t report;
+  Timeline sent_timeline; // the monitor keeps no timelines
+  int64_t base_owd {0};
+  bool base_owd_known {false};
+
+  uint64_t monitor_start = monotonic_ns();
+  uint64_t next_status = monitor_start + MONITOR_STATUS_S * NSEC_PER_SEC;
+
+  while (!shutdown_signal)
   {
-    socket->send_message(probe_buffer, probe_size);
-    packets_sent++;
-    std::this_thread::sleep_for(send_gap);
-    t2 = Clock::now();
+    uint64_t cycle_start = monotonic_ns();
+
+    // new session & rate search, the export file is reopened (it may have been rotated)
+    if (reload_signal)
+    {
+      reload_signal = 0;
+      cout << "[" << clock_time() << "] " << CL_YELLOW << "reload" << RESET << endl;
+      print_windows(cycle_start);
+
+      if (m_exporter)
+      {
+        m_exporter.reset(new Exporter(m_options.export_format, m_options.export_path));
+        if (!m_exporter->open())
+          m_exporter.reset();
+      }
+      connected = false;
+    }
+
+    if (!connected)
+    {
+      connected = restart(sockets, strategy);
+      round = 0;
+      base_owd_known = false;
+    }
+
+    // one round of the cycle
+    pacer_stats_t pacing;
+    double rtt = -1.0;
+    long long packet_rate = connected ? strategy->get_rate() : 0;
+    int report_length = -1;
+    long packets_sent {0};
+
+    if (connected)
+    {
+      rtt = RTT(socket, m_probe_size, round);
+      packets_sent = send_round(sockets, packet_rate, m_probe_size, round, strategy->train_length(), pacing, sent_timeline);
+      report_length = m_control->exchange(CONTROL_ROUND_END, round, nullptr, 0, CONTROL_REPORT, report_buffer, sizeof(report_buffer));
+    }
+
+    if (connected && report_length < static_cast<int>(ROUND_REPORT_SIZE))
+    {
+      cerr << "[" << clock_time() << "] reflector lost, looking for it every " << MONITOR_RETRY_MS << " ms" << endl;
+      connected = false;
+    }
+    else if (connected)
+    {
+      round_report_read(report_buffer, report);
+
+      // the lowest transit of the session, queueing is measured above it
+      if (report.delay_samples > 0 && (!base_owd_known || report.owd_min < base_owd))
+      {
+        base_owd = report.owd_min;
+        base_owd_known = true;
+      }
+
+      host_drops_t drops {};
+      report_host_drops(report_buffer, std::min<size_t>(report_length, sizeof(report_buffer)), drops);
+
+      double speed = pacing.duration > 0 ? report.received * m_probe_size * 8 / pacing.duration / 1000.0 / 1000.0 : 0.0;
+      double loss = packets_sent > 0 ? std::max(0.0, 1.0 - report.received / static_cast<double>(packets_sent)) : 0.0;
+      double queueing = report.delay_samples > 0 ? (report.owd_mean - base_owd) / 1000.0 : 0.0;
+      double arrival_rate = report.delay_samples > 1 && report.rx_last > report.rx_first
+                          ? (report.delay_samples - 1) / ((report.rx_last - report.rx_first) / static_cast<double>(NSEC_PER_SEC)) : 0.0;
+
+      rate_feedback_t feedback {packet_rate, pacing.achieved_rate, pacing.duration, packets_sent, report.received, arrival_rate};
+      long long next_rate = strategy->next(feedback);
+      count_round(packet_rate, packets_sent, report, speed);
+      m_metrics->host_dropped.fetch_add(drops.socket_overflow, std::memory_order_relaxed);
+
+      uint64_t now = monotonic_ns();
+      for (RollingWindow* window : {&m_minute, &m_hour, &m_day})
+      {
+        window->add_round(now, speed, packets_sent, report.received, queueing, report.jitter / 1000.0);
+        if (rtt >= 0.0)
+          window->add_rtt(now, rtt);
+      }
+
+      cout << "[" << clock_time() << "] round " << round + 1 << ": " << std::setprecision(3) << std::fixed << speed << " Mb/s"
+      << ", loss " << std::setprecision(2) << loss * 100 << "%";
+      if (drops.socket_overflow > 0)
+        cout << CL_YELLOW << " (" << drops.socket_overflow << " dropped by the reflector host)" << RESET;
+      cout << ", rtt ";
+      if (rtt >= 0.0)
+        cout << std::setprecision(3) << rtt << " ms";
+      else
+        cout << CL_RED << "lost" << RESET;
+      cout << ", queueing +" << std::setprecision(1) << queueing << " us, rate " << packet_rate << " -> " << next_rate
+      << " packets/second" << (strategy->converged() ? "" : " (searching)") << endl;
+
+      if (m_exporter)
+      {
+        export_round_t record {};
+        record.round = round + 1;
+        record.timestamp = realtime_ns();
+        record.time_ms = (now - monitor_start) / static_cast<double>(NSEC_PER_MSEC);
+        record.rtt_ms = rtt;
+        record.rate = packet_rate;
+        record.achieved_rate = pacing.achieved_rate;
+        record.next_rate = next_rate;
+        record.converged = strategy->converged();
+        record.sent = packets_sent;
+        record.speed = speed;
+        record.gap_mean = pacing.gap_mean;
+        record.gap_jitter = pacing.gap_jitter;
+        record.queueing_us = queueing;
+        record.report = report;
+        m_exporter->round(record);
+      }
+      round++;
+    }
+
+    // the rest of the cycle, RTT probes keep the session open
+    uint64_t cycle_end = cycle_start + (connected ? m_round_ms * NSEC_PER_MSEC * 100 / m_options.duty : MONITOR_RETRY_MS * NSEC_PER_MSEC);
+    uint64_t next_keepalive = monotonic_ns() + MONITOR_KEEPALIVE_MS * NSEC_PER_MSEC;
+    for (uint64_t now = monotonic_ns(); now < cycle_end && !shutdown_signal && !reload_signal; now = monotonic_ns())
+    {
+      if (now >= next_status)
+      {
+        print_windows(now);
+        next_status = now + MONITOR_STATUS_S * NSEC_PER_SEC;
+      }
+
+      if (connected && now >= next_keepalive)
+      {
+        double keepalive_rtt = RTT(socket, m_probe_size, round);
+        if (keepalive_rtt >= 0.0)
+        {
+          now = monotonic_ns();
+          for (RollingWindow* window : {&m_minute, &m_hour, &m_day})
+            window->add_rtt(now, keepalive_rtt);
+        }
+        next_keepalive = monotonic_ns() + MONITOR_KEEPALIVE_MS * NSEC_PER_MSEC;
+        continue;
+      }
+
+      uint64_t wake = std::min({cycle_end, next_status, connected ? next_keepalive : cycle_end});
+      std::this_thread::sleep_for(std::chrono::nanoseconds(std::min<uint64_t>(wake - now, MONITOR_TICK_MS * NSEC_PER_MSEC)));
+    }
   }
 
-  return packets_sent;
-}
+  cout << "\n[" << clock_time() << "] " << "[MONITOR]: stopped (signal " << shutdown_signal << ") after "
+  << (monotonic_ns() - monitor_start) / NSEC_PER_SEC << " s" << endl;
+  print_windows(monotonic_ns());
 
+  if (m_exporter)
+    m_exporter->close();
+}
 
 /**
- * @brief Print startup informations
+ * @brief Opens a new session on the reflector and starts the rate search over
  * 
+ * @param sockets data sockets of the monitor
+ * @param strategy output, the new rate search
+ * @return false when the reflector refused or is not there
  */
-void print_start_info(string host_name, unsigned short port, int measurment_time, int probe_size)
+bool Monitor::restart(std::vector<std::shared_ptr<SocketEntity>>& sockets, std::unique_ptr<RateStrategy>& strategy)
 {
-  cout << "-----------------------------------" << endl;
-  cout << "~ Host: "<< BOLD << host_name << RESET << endl;
-  cout << "~ Port: " << BOLD << port << RESET << endl;
-  cout << "~ Measurement time: " << BOLD << measurment_time << " seconds" << RESET << endl;
-  cout << "~ Probe packet size: " << BOLD << probe_size << " Bytes" << RESET << endl;
-  cout << "-----------------------------------" << endl;
+  // the rounds never run out, the session ends by the idle timeout of the reflector
+  control_ack_t ack;
+  if (!open_session(sockets, UINT32_MAX, ack))
+    return false;
+
+  prepare_frames(sockets.size(), sockets[0]->get_batch_depth());
+  strategy = RateStrategy::create(m_options.rate_algorithm, m_options.max_rate);
+
+  cout << "[" << clock_time() << "] session " << std::hex << m_session_id << std::dec << ": " << m_probe_size << "B probes, "
+  << m_round_ms << " ms round every " << m_round_ms * 100 / m_options.duty << " ms, "
+  << RateStrategy::algorithm_name(m_options.rate_algorithm) << " rate search, reflector " << capability_names(ack.capabilities) << endl;
+  return true;
 }
 
 /**
- * @brief Print results information
+ * @brief Prints the rolling windows
  * 
+ * @param now CLOCK_MONOTONIC time, end of the windows
  */
-void print_result_info(int probe_size, int measurement_time, long packets_sent, long packets_recv, std::vector<double> speed_list, std::vector<double> rtt_list)
+void Monitor::print_windows(uint64_t now)
 {
-  cout << "\n\n--------------------------------------------------------------------------------" << endl;
-  cout << "  " << BOLD << "FINAL RESULTS" << RESET << " (for " << probe_size << "B probe packets & " << measurement_time << "s measurement test)" << endl;
-  cout << "--------------------------------------------------------------------------------\n" << endl;
+  const std::pair<const char*, const RollingWindow*> windows[] = {
+    {"minute", &m_minute}, {"hour", &m_hour}, {"day", &m_day}
+  };
 
-  cout << "   " << CL_BLUE << "PACKETS & DATA\n" << RESET << endl;
-  cout << "\tPACKETS TRANSFERRED: " << packets_recv << "/" << packets_sent << " (received/sent)" << endl;
-  cout << "\tPACKETS LOST: ~ " << 100 - (static_cast<long double>(packets_recv)/packets_sent) * 100 << "% loss" << endl;
-  cout << "\tDATA TRANSFERED: " << packets_sent * probe_size / 1000 / 1000 << " MB SENT / " << packets_recv * probe_size / 1000 / 1000 << " MB RECEIVED\n" << endl;
-  
-  cout << "   " << CL_RED << "RTT\n " << RESET << endl;
-  cout << "\tMAX RTT: "<< *std::max_element(rtt_list.begin(), rtt_list.end()) << " ms" << endl;
-  cout << "\tMIN RTT: "<< *std::min_element(rtt_list.begin(), rtt_list.end()) << " ms" << endl;
+  cout << std::setw(20) << " [Windows]: " << std::setw(8) << "rounds" << std::setw(30) << "speed min/avg/max (Mb/s)"
+  << std::setw(9) << "loss" << std::setw(26) << "rtt min/avg/max (ms)" << std::setw(16) << "queueing (us)" << endl;
 
-  // avg rtt and standard deviation
-  double rtt_sum = std::accumulate(rtt_list.begin(), rtt_list.end(), 0.0);
-  double rtt_mean = rtt_sum / rtt_list.size();
-  
-  cout << "\tAVG RTT: "<< rtt_mean << " ms" << endl;
+  for (const auto& window : windows)
+  {
+    window_stats_t stats = window.second->stats(now);
+    cout << std::setw(20) << (string("last ") + window.first) << std::setw(8) << stats.rounds << std::fixed;
 
-  std::vector<double> rtt_diff(rtt_list.size());
-  std::transform(rtt_list.begin(), rtt_list.end(), rtt_diff.begin(), [rtt_mean](double d) { return d - rtt_mean;});
+    if (stats.rounds > 0)
+    {
+      std::ostringstream speed;
+      speed << std::fixed << std::setprecision(2) << stats.speed_min << "/" << stats.speed_sum / stats.rounds << "/" << stats.speed_max;
+      double loss = stats.sent > 0 ? std::max(0.0, 1.0 - stats.received / static_cast<double>(stats.sent)) : 0.0;
+      cout << std::setw(30) << speed.str() << std::setw(8) << std::setprecision(2) << loss * 100 << "%";
+    }
+    else
+      cout << std::setw(30) << "-" << std::setw(9) << "-";
 
-  double rtt_sum_sq = std::inner_product(rtt_diff.begin(), rtt_diff.end(), rtt_diff.begin(), 0.0);
-  double rtt_std_dev = std::sqrt(rtt_sum_sq / rtt_list.size());
+    if (stats.rtt_samples > 0)
+    {
+      std::ostringstream rtt;
+      rtt << std::fixed << std::setprecision(3) << stats.rtt_min << "/" << stats.rtt_sum / stats.rtt_samples << "/" << stats.rtt_max;
+      cout << std::setw(26) << rtt.str();
+    }
+    else
+      cout << std::setw(26) << "-";
 
-  cout << "\tSTD DEV: "<< rtt_std_dev << " ms\n" << endl;
+    if (stats.rounds > 0)
+      cout << std::setw(16) << std::setprecision(1) << stats.queueing_sum / stats.rounds;
+    else
+      cout << std::setw(16) << "-";
+    cout << endl;
+  }
+}
 
-  cout << "   " << CL_GREEN<< "AVAILABLE BANDWIDTH\n " << RESET << endl;
-  cout << "\tMAX SPEED: "<< *std::max_element(speed_list.begin(), speed_list.end()) << " Mb/s" << endl;
-  cout << "\tMIN SPEED: "<< *std::min_element(speed_list.begin(), speed_list.end()) << " Mb/s" << endl;
 
-  // avg rtt and standard deviation
-  double speed_sum = std::accumulate(speed_list.begin(), speed_list.end(), 0.0);
-  double speed_mean = speed_sum / speed_list.size();
-  
-  cout << "\tAVG SPEED: "<< speed_mean << " Mb/s" << endl;
 
-  std::vector<double> speed_diff(speed_list.size());
-  std::transform(speed_list.begin(), speed_list.end(), speed_diff.begin(), [speed_mean](double d) { return d - speed_mean;});
 
-  double speed_sum_sq = std::inner_product(speed_diff.begin(), speed_diff.end(), speed_diff.begin(), 0.0);
-  double speed_std_dev = std::sqrt(speed_sum_sq / speed_list.size());
+/*****************************************************************************/
+
+/**
+ *  @brief Applies socket related options (batch depth, timestamping, zerocopy, I/O backend, busy polling) to a socket
+ *  
+ *  @param socket socket to be configured
+ *  @param options settings passed on the command line
+ */
+void configure_socket(std::shared_ptr<SocketEntity> socket, const mtrip_options_t& options)
+{
+  socket->set_batch_depth(options.batch_depth);
+
+  if (options.timestamping != SocketEntity::NO_TIMESTAMPING)
+    socket->enable_timestamping(options.timestamping, options.timestamp_interface);
+
+  if (options.zerocopy && !socket->enable_zerocopy())
+    cerr << "MSG_ZEROCOPY not available, probes are copied" << endl;
 
-  cout << "\tSTD DEV: "<< speed_std_dev << " Mb/s\n\n" << endl;
+  if (options.io_backend == SocketEntity::URING_IO && !socket->enable_uring())
+    cerr << "io_uring not available, using blocking I/O" << endl;
 
+  if (options.busy_poll_us > 0 && !socket->enable_busy_poll(options.busy_poll_us))
+    cerr << "SO_BUSY_POLL not permitted (CAP_NET_ADMIN above net.core.busy_read), receives wait for interrupts" << endl;
 }
 
 
 /**
- * @brief Round trip time calculation
- * 
- * @desc Calculates roundtrip time (Single test)
- * For average value, function needs to be called multiple times
- * @param socket socket to be used for RTT calc.
- * @param buffer buffer to be used for sending/
+ *  @brief Applies the process wide scheduling options
+ *  
+ *  @desc Whether SCHED_FIFO is permitted is tried on the calling thread, which
+ *  goes back to normal scheduling right away, so the threads it starts before
+ *  configure_thread() do not inherit the real-time class.
+ *  @param options settings passed on the command line, not permitted ones are turned off
  */
-double Meter::RTT(std::shared_ptr<SocketEntity> socket, size_t buffer_size)
-{ 
-  char buffer[buffer_size];
-  memset(buffer, 'R', buffer_size);
+void configure_scheduling(mtrip_options_t& options)
+{
+  if (options.lock_memory && !lock_memory())
+  {
+    cerr << "mlockall not permitted (RLIMIT_MEMLOCK), memory stays swappable" << endl;
+    options.lock_memory = false;
+  }
 
-  auto start = std::chrono::system_clock::now();
-  socket->send_message(buffer, buffer_size);
-  socket->recv_message(buffer, buffer_size);
-  auto end = std::chrono::system_clock::now();
-  
-  std::chrono::duration<double> duration = end - start;
+  if (options.fifo_priority > 0)
+  {
+    int policy;
+    struct sched_param param;
+    pthread_getschedparam(pthread_self(), &policy, &param);
 
-  return duration.count() * 1000.0; // in ms
+    if (set_fifo_priority(pthread_self(), options.fifo_priority))
+      pthread_setschedparam(pthread_self(), policy, &param);
+    else
+    {
+      cerr << "SCHED_FIFO not permitted (CAP_SYS_NICE / RLIMIT_RTPRIO), threads keep normal scheduling" << endl;
+      options.fifo_priority = 0;
+    }
+  }
 }
 
 
+/**
+ *  @brief Places a thread on the cores of its role and in its scheduling class
+ *  
+ *  @param thread thread to be configured
+ *  @param role what the thread does
+ *  @param index index of the thread within its role
+ *  @param options settings passed on the command line
+ */
+void configure_thread(pthread_t thread, thread_role_t role, unsigned index, const mtrip_options_t& options)
+{
+  const std::vector<unsigned>& cores = options.cores.of(role);
+  if (role != CONTROL_THREAD || !cores.empty())
+    pin_thread(thread, cores, index);
+
+  if (options.fifo_priority > 0)
+    set_fifo_priority(thread, options.fifo_priority);
+}
 
 
-/*****************************************************************************/
+/**
+ *  @brief Paces a local loop under each scheduling setting and prints the rate error & gap jitter
+ *  
+ *  @desc Every option runs alone against normal scheduling, then all the
+ *  options passed together. FIFO and memory locking are tried even when not
+ *  passed (priority SCHED_DEFAULT_PRIORITY), so the table shows what they
+ *  would buy. Busy polling only shortens receives, its effect shows in the RTT
+ *  and the one-way delay jitter of the rounds, not here.
+ *  @param options settings passed on the command line
+ */
+void calibrate_scheduling(const mtrip_options_t& options)
+{
+  double rate = std::min<long long>(options.max_rate, CALIBRATION_MAX_RATE);
+  const std::vector<unsigned>& send_cores = options.cores.of(SEND_THREAD);
+  int core = send_cores.empty() ? 0 : send_cores[0];
+  int priority = options.fifo_priority > 0 ? options.fifo_priority : SCHED_DEFAULT_PRIORITY;
+
+  std::vector<sched_setting_t> settings {
+    {"normal", -1, 0, false},
+    {"core " + std::to_string(core), core, 0, false},
+    {"SCHED_FIFO " + std::to_string(priority), -1, priority, false},
+    {"mlockall", -1, 0, true}
+  };
+  if (options.fifo_priority > 0 || options.lock_memory || !send_cores.empty())
+    settings.push_back({"all passed", core, options.fifo_priority, options.lock_memory});
+
+  cout << "~ Calibration: " << BOLD << std::setprecision(0) << std::fixed << rate << " packets/second, "
+       << Pacer::mode_name(options.pacing_mode) << " pacing, " << CALIBRATION_MS << " ms per setting" << RESET
+       << " (nothing is sent)" << endl;
+  cout << "	" << std::left << std::setw(16) << "setting" << std::right << std::setw(12) << "rate error"
+       << std::setw(14) << "gap jitter" << endl;
+
+  for (const sched_setting_t& setting : settings)
+  {
+    calibration_t result = sched_calibrate(setting, rate, std::max(1u, options.batch_depth), options.pacing_mode, CALIBRATION_MS);
+    cout << "	" << std::left << std::setw(16) << setting.name << std::right;
+    if (!result.applied)
+    {
+      cout << CL_RED << "not permitted" << RESET << endl;
+      continue;
+    }
+    double error = (result.pacing.achieved_rate / result.pacing.target_rate - 1.0) * 100.0;
+    cout << std::setw(11) << std::setprecision(3) << error << "%" << std::setw(11) << result.pacing.gap_jitter << " us" << endl;
+  }
+  if (options.busy_poll_us > 0)
+    cout << "	" << std::left << std::setw(16) << "busy poll" << std::right << "receive path, see the RTT & delay jitter" << endl;
+  cout << endl;
+}
+
+
+/**
+ *  @brief Scheduling options in effect, for printing
+ *  
+ *  @param options settings passed on the command line
+ *  @return e.g. "send=2,3 control=1, SCHED_FIFO 50, mlockall"
+ */
+std::string scheduling_name(const mtrip_options_t& options)
+{
+  string name;
+  for (int i = 0; i < THREAD_ROLES; i++)
+  {
+    thread_role_t role = static_cast<thread_role_t>(i);
+    if (!options.cores.of(role).empty())
+      name += (name.empty() ? "" : " ") + string(thread_role_name(role)) + "=" + sched_cores_name(options.cores.of(role));
+  }
+  if (name.empty())
+    name = "core per thread";
+
+  if (options.fifo_priority > 0)
+    name += ", SCHED_FIFO " + std::to_string(options.fifo_priority);
+  if (options.lock_memory)
+    name += ", mlockall";
+  if (options.busy_poll_us > 0)
+    name += ", busy poll " + std::to_string(options.busy_poll_us) + " us";
+  return name;
+}
+
+
+/**
+ *  @brief Starts the OpenMetrics endpoint when '-M' asked for it
+ *  
+ *  @param server output, the running server, left null without '-M'
+ *  @param metrics metrics to be served
+ *  @param options settings passed on the command line
+ *  @return false when the endpoint can not be opened
+ */
+bool start_metrics_server(std::unique_ptr<MetricsServer>& server, const Metrics& metrics, const mtrip_options_t& options)
+{
+  if (!options.metrics)
+    return true;
+
+  server.reset(new MetricsServer(metrics));
+  if (!server->start(options.metrics_address, options.metrics_port))
+  {
+    server.reset();
+    return false;
+  }
+  return true;
+}
+
 
 /**
  *  @brief Properly handles interrupt, such as CTRL+C
@@ -514,8 +3258,148 @@ double Meter::RTT(std::shared_ptr<SocketEntity> socket, size_t buffer_size)
  */
 void interrupt_handler(int signum)
 {
-  cout << "\n\n[!!!] Caught signal(" << signum << "). Ending the program." << endl;
-  exit(EXIT_SUCCESS);
+  if (signum == SIGHUP)
+  {
+    reload_signal = 1;
+    return;
+  }
+
+  // the loops did not end after the first one
+  if (shutdown_signal)
+  {
+    const char message[] = "\n\n[!!!] Caught signal again. Ending the program.\n";
+    ssize_t ignored = write(STDERR_FILENO, message, sizeof(message) - 1);
+    (void) ignored;
+    _exit(EXIT_FAILURE);
+  }
+
+  shutdown_signal = signum;
+}
+
+
+// options of both modes, appended to the getopt() string of each mode
+#define COMMON_OPTIONS "b:j:T:GI:C:M:A:Y:F:Lf:"
+
+/**
+ *  @brief Parses an option shared by both modes
+ * 
+ *  @param c option character
+ *  @param value option argument
+ *  @param options output, settings to be updated
+ *  @return false when 'c' is not a common option
+ */
+bool parse_common_option(char c, const char* value, mtrip_options_t& options)
+{
+  switch (c)
+  {
+    case 'b':
+      options.batch_depth = static_cast<unsigned>(std::max(1, atoi(value)));
+      break;
+    case 'j':
+      options.threads = static_cast<unsigned>(std::max(1, atoi(value)));
+      break;
+    case 'T':
+    {
+      string source = value;
+      string interface;
+      size_t colon = source.find(':');
+      if (colon != string::npos)
+      {
+        interface = source.substr(colon + 1);
+        source = source.substr(0, colon);
+      }
+
+      if (source == "sw")
+        options.timestamping = SocketEntity::SOFTWARE_TIMESTAMPING;
+      else if (source == "hw")
+        options.timestamping = SocketEntity::HARDWARE_TIMESTAMPING;
+      else
+      {
+        cerr << "Unknown timestamping '" << value << "' (sw|hw[:interface])" << endl;
+        exit(1);
+      }
+      options.timestamp_interface = interface;
+      break;
+    }
+    case 'G':
+      options.offload = true;
+      break;
+    case 'C':
+      options.control_port = static_cast<unsigned short>(atoi(value));
+      break;
+    case 'M':
+      if (!metrics_parse_endpoint(value, options.metrics_address, options.metrics_port))
+      {
+        cerr << "Invalid metrics endpoint '" << value << "' ([address:]port)" << endl;
+        exit(1);
+      }
+      options.metrics = true;
+      break;
+    case 'A':
+      if (!sched_parse_affinity(value, options.cores))
+      {
+        cerr << "Invalid thread placement '" << value << "' (send|recv|control=cores)" << endl;
+        exit(1);
+      }
+      break;
+    case 'Y':
+      options.busy_poll_us = static_cast<unsigned>(std::max(0, atoi(value)));
+      break;
+    case 'F':
+      options.fifo_priority = std::min(99, std::max(1, atoi(value)));
+      break;
+    case 'L':
+      options.lock_memory = true;
+      break;
+    case 'f':
+      if (string(value) == "4")
+        options.family = AF_INET;
+      else if (string(value) == "6")
+        options.family = AF_INET6;
+      else if (string(value) == "any" || string(value) == "all")
+      {
+        options.family = AF_UNSPEC;
+        options.all_addresses = string(value) == "all";
+      }
+      else
+      {
+        cerr << "Unknown address family '" << value << "' (4|6|any|all)" << endl;
+        exit(1);
+      }
+      break;
+    case 'I':
+      if (string(value) == "blocking")
+        options.io_backend = SocketEntity::BLOCKING_IO;
+      else if (string(value) == "uring")
+        options.io_backend = SocketEntity::URING_IO;
+      else
+      {
+        cerr << "Unknown I/O backend '" << value << "' (blocking|uring)" << endl;
+        exit(1);
+      }
+      break;
+    default:
+      return false;
+  }
+
+  return true;
+}
+
+
+/**
+ *  @brief Reports getopt() error and ends the program
+ * 
+ *  @param optstring option string of the current mode
+ */
+void option_error(const char* optstring)
+{
+  if (optopt && strchr(optstring, optopt))
+      cerr << "Option -" << static_cast<char>(optopt) << " requires an argument." << endl;
+  else if (isprint(optopt))
+      cerr << "Uknown option '-" << static_cast<char>(optopt) << "'" << endl;
+  else
+      cerr << "Unknown option character. " << endl;
+  exit(1);
 }
 
 
@@ -537,9 +3421,10 @@ std::unique_ptr<MTripConfiguration> argument_parser(int argc, char **argv)
   char c; // help
   opterr = 0; // turn off getopt errors
 
-  // METER MODE
-  if (string(argv[optind]) == "meter")
+  // METER MODE (and the monitor, a meter that never ends)
+  if (string(argv[optind]) == "meter" || string(argv[optind]) == "monitor")
   {
+    bool monitor = string(argv[optind]) == "monitor";
     optind++;
 
     // argument options
@@ -547,11 +3432,13 @@ std::unique_ptr<MTripConfiguration> argument_parser(int argc, char **argv)
     
     // argument values
     string host_name;
-    unsigned short port;
-    size_t probe_size;
-    float measurment_time;
+    unsigned short port = 0;
+    size_t probe_size {0};
+    float measurment_time {0};
+    mtrip_options_t options;
+    const char* optstring = "h:p:s:t:m:Za:R:P:l:i:e:D:KW:d:E" COMMON_OPTIONS;
 
-    while ((c = getopt(argc, argv, "h:p:s:t:")) != -1)
+    while ((c = getopt(argc, argv, optstring)) != -1)
     {
       switch (c)
       {
@@ -571,25 +3458,170 @@ std::unique_ptr<MTripConfiguration> argument_parser(int argc, char **argv)
           t_flag = true;
           measurment_time = atoi(optarg);
           break;
-        case '?':
-          if (optopt == 'h' || optopt == 'p' || optopt == 's' || optopt == 't')
-              cerr << "Option -" << static_cast<char>(optopt) << " requires an argument." << endl;
-          else if (isprint(optopt))
-              cerr << "Uknown option '-" << static_cast<char>(optopt) << "'" << endl;
+        case 'm':
+          if (!Pacer::parse_mode(optarg, options.pacing_mode))
+          {
+            cerr << "Unknown pacing mode '" << optarg << "' (busy|hybrid|burst)" << endl;
+            exit(1);
+          }
+          break;
+        case 'Z':
+          options.zerocopy = true;
+          break;
+        case 'a':
+          if (!RateStrategy::parse_algorithm(optarg, options.rate_algorithm))
+          {
+            cerr << "Unknown rate search '" << optarg << "' (bisect|exp|train|pid)" << endl;
+            exit(1);
+          }
+          break;
+        case 'R':
+          options.max_rate = std::max(MIN_RATE, atoll(optarg));
+          break;
+        case 'l':
+          options.round_ms = static_cast<unsigned>(atoi(optarg));
+          if (options.round_ms < ROUND_MIN_MS || options.round_ms > ROUND_MAX_MS)
+          {
+            cerr << "Round length has to be " << ROUND_MIN_MS << " - " << ROUND_MAX_MS << " ms" << endl;
+            exit(1);
+          }
+          break;
+        case 'i':
+          options.interval_us = static_cast<unsigned>(std::max(0, atoi(optarg)));
+          break;
+        case 'e':
+          if (!Exporter::parse(optarg, options.export_format, options.export_path))
+          {
+            cerr << "Unknown export '" << optarg << "' (json|csv|bin:path)" << endl;
+            exit(1);
+          }
+          options.exporting = true;
+          break;
+        case 'D':
+          options.duty = static_cast<unsigned>(atoi(optarg));
+          if (options.duty < 1 || options.duty > 100)
+          {
+            cerr << "Duty cycle has to be 1 - 100 %" << endl;
+            exit(1);
+          }
+          break;
+        case 'K':
+          options.calibrate = true;
+          break;
+        case 'W':
+          options.sweep_sizes = static_cast<unsigned>(atoi(optarg));
+          if (options.sweep_sizes < 2 || options.sweep_sizes > SWEEP_MAX_SIZES)
+          {
+            cerr << "Sweep has to measure 2 - " << SWEEP_MAX_SIZES << " probe sizes" << endl;
+            exit(1);
+          }
+          break;
+        case 'E':
+          options.echo = true;
+          break;
+        case 'd':
+          if (string(optarg) == "up")
+            options.direction = UPSTREAM;
+          else if (string(optarg) == "down")
+            options.direction = DOWNSTREAM;
+          else if (string(optarg) == "both")
+            options.direction = BIDIRECTIONAL;
           else
-              cerr << "Unknown option character. " << endl;
-          exit(1);
+          {
+            cerr << "Unknown direction '" << optarg << "' (up|down|both)" << endl;
+            exit(1);
+          }
+          break;
+        case 'P':
+        {
+          string pattern = optarg;
+          size_t colon = pattern.find(':');
+          if (colon != string::npos)
+          {
+            options.train_probes = static_cast<unsigned>(std::max(2, atoi(pattern.substr(colon + 1).c_str())));
+            pattern = pattern.substr(0, colon);
+          }
+
+          if (!ProbeTrain::parse_pattern(pattern, options.train_pattern))
+          {
+            cerr << "Unknown probing pattern '" << optarg << "' (train|chirp[:probes])" << endl;
+            exit(1);
+          }
+          options.trains = true;
+          if (options.train_probes == 0)
+            options.train_probes = options.train_pattern == ProbeTrain::CHIRP ? CHIRP_DEFAULT_PROBES : TRAIN_DEFAULT_PROBES;
+          break;
+        }
+        case '?':
+          option_error(optstring);
+          break;
         default:
+          if (parse_common_option(c, optarg, options))
+            break;
           cerr << "uknown getopt() error" << endl;
           exit(1);
           break;
       }
     }
 
+    if (s_flag && probe_size < PROBE_HEADER_SIZE)
+    {
+      cerr << "Probe size has to be at least " << PROBE_HEADER_SIZE << " bytes (probe header)." << endl;
+      return nullptr;
+    }
+
+    if (monitor && options.all_addresses)
+    {
+      cerr << "The monitor follows one address, '-f all' works as '-f any'" << endl;
+      options.all_addresses = false;
+    }
+    if (monitor && options.sweep_sizes > 0)
+    {
+      cerr << "The monitor keeps its probe size, ignoring -W" << endl;
+      options.sweep_sizes = 0;
+    }
+    if (monitor && options.echo)
+    {
+      cerr << "The monitor measures the idle RTT only, ignoring -E" << endl;
+      options.echo = false;
+    }
+    if (options.echo && (options.trains || options.direction == DOWNSTREAM))
+    {
+      cerr << "Echoes load the path by the rounds of the rate search, -E can not be combined with -P or '-d down'" << endl;
+      return nullptr;
+    }
+    if (monitor && options.direction != UPSTREAM)
+    {
+      cerr << "The monitor probes upstream only, ignoring -d" << endl;
+      options.direction = UPSTREAM;
+    }
+    // trains are timed by the reflector on arrival, there is nobody timing them on the way back
+    if (options.direction != UPSTREAM && (options.trains || options.rate_algorithm == RateStrategy::PACKET_TRAIN))
+    {
+      cerr << "The reverse direction is measured by rounds, '-d down|both' can not be combined with -P or '-a train'" << endl;
+      return nullptr;
+    }
+    if (options.sweep_sizes > 0 && (options.trains || options.all_addresses))
+    {
+      cerr << "The size sweep runs the rate search on one address, it can not be combined with -P or '-f all'" << endl;
+      return nullptr;
+    }
+
+    // the sweep picks the sizes itself
+    if (options.sweep_sizes > 0 && !s_flag)
+    {
+      s_flag = true;
+      probe_size = SWEEP_MIN_SIZE;
+    }
+
     // everything OK -> create new configuration
-    if (h_flag && p_flag && s_flag && t_flag)
+    if (monitor && h_flag && p_flag && s_flag)
     {
-      return std::make_unique<Meter>(host_name, port, probe_size, measurment_time);
+      return std::make_unique<Monitor>(host_name, port, probe_size, options);
+    }
+    else if (h_flag && p_flag && s_flag && t_flag)
+    {
+      return std::make_unique<Meter>(host_name, port, probe_size, measurment_time, options);
     }
     else
     {
@@ -605,9 +3637,11 @@ std::unique_ptr<MTripConfiguration> argument_parser(int argc, char **argv)
 
     // argument option + value
     bool p_flag = false;
-    unsigned int port;
+    unsigned int port = 0;
+    mtrip_options_t options;
+    const char* optstring = "p:" COMMON_OPTIONS;
 
-    while ((c = getopt(argc, argv, "p:")) != -1)
+    while ((c = getopt(argc, argv, optstring)) != -1)
     {
       switch (c)
       {
@@ -616,24 +3650,27 @@ std::unique_ptr<MTripConfiguration> argument_parser(int argc, char **argv)
           port = static_cast<unsigned int>(atoi(optarg));
           break;
         case '?':
-          if (optopt == 'p')
-              cerr << "Option -p requires an argument." << endl;
-          else if (isprint(optopt))
-              cerr << "Uknown option '-" << static_cast<char>(optopt) << "'" << endl;
-          else
-              cerr << "Unknown option character. " << endl;
-          exit(1);
+          option_error(optstring);
+          break;
         default:
+          if (parse_common_option(c, optarg, options))
+            break;
           cerr << "uknown getopt() error" << endl;
           exit(1);
           break;
       }
     }
     
+    if (options.all_addresses)
+    {
+      cerr << "The reflector listens on all addresses, '-f all' works as '-f any'" << endl;
+      options.all_addresses = false;
+    }
+
     // everything OK -> create new configuration
     if (p_flag)
     {
-      return std::make_unique<Reflector>(port);
+      return std::make_unique<Reflector>(port, options);
     }
     else
     {
@@ -22,7 +22,10 @@
   #include <memory>
   #include <string>
   #include <vector>
+  #include <atomic>
+  #include <thread>
   #include <iostream>
+  #include <csignal>
   using std::cout;
   using std::cerr;
   using std::endl;
@@ -30,6 +33,39 @@
   // socket abstraction
   #include "ipk-socket.h"
 
+  // packet pacing
+  #include "ipk-pacer.h"
+
+  // probe wire format & sequence tracking
+  #include "ipk-probe.h"
+
+  // latency percentiles
+  #include "ipk-histogram.h"
+
+  // preallocated probe frames
+  #include "ipk-buffer.h"
+
+  // control messages
+  #include "ipk-control.h"
+
+  // reflector session table
+  #include "ipk-session.h"
+
+  // rate search strategies
+  #include "ipk-rate.h"
+
+  // packet trains & chirps
+  #include "ipk-train.h"
+
+  // JSON / CSV / binary result export
+  #include "ipk-export.h"
+
+  // OpenMetrics endpoint
+  #include "ipk-metrics.h"
+
+  // core pinning, real-time scheduling & memory locking
+  #include "ipk-sched.h"
+
 
   // terminal output ANSI colors
   #define CL_RED     "\x1b[31m"
@@ -41,6 +77,111 @@
   #define BOLD       "\033[4;1m"
   #define RESET      "\x1b[0m"
 
+  // share of the time the monitor spends probing unless '-D' says otherwise (percent)
+  #define MONITOR_DEFAULT_DUTY 10
+
+
+  /**
+   *  @brief Directions the meter loads ('-d')
+   */
+  enum direction_t
+  {
+    UPSTREAM      = 0, // meter -> reflector
+    DOWNSTREAM    = 1, // reflector -> meter
+    BIDIRECTIONAL = 2  // both at the same time
+  };
+
+
+  /**
+   *  @brief Optional settings shared by both runtime modes
+   *  
+   *  @desc Filled by the argument parser, defaults are used for options not passed in.
+   */
+  struct mtrip_options_t
+  {
+    unsigned batch_depth = DEFAULT_BATCH_DEPTH;                // '-b' datagrams per syscall
+    Pacer::pacing_mode_t pacing_mode = Pacer::HYBRID_PACING;  // '-m' (meter only)
+    unsigned threads = 1;                                      // '-j' sender/receiver threads
+    SocketEntity::timestamping_t timestamping = SocketEntity::NO_TIMESTAMPING; // '-T sw|hw[:interface]'
+    std::string timestamp_interface;
+    bool offload = false;                                      // '-G' UDP GSO (meter) / GRO (reflector)
+    bool zerocopy = false;                                     // '-Z' MSG_ZEROCOPY sends (meter only)
+    SocketEntity::io_backend_t io_backend = SocketEntity::BLOCKING_IO; // '-I blocking|uring'
+    unsigned short control_port = 0;                           // '-C' control channel port (0 = port + CONTROL_PORT_OFFSET)
+    RateStrategy::algorithm_t rate_algorithm = RateStrategy::BISECTION; // '-a bisect|exp|train|pid' (meter only)
+    long long max_rate = DEFAULT_MAX_RATE;                     // '-R' ceiling of the rate search, top of a chirp (meter only)
+    bool trains = false;                                       // '-P train|chirp[:probes]' one train per round (meter only)
+    ProbeTrain::pattern_t train_pattern = ProbeTrain::TRAIN;
+    unsigned train_probes = 0;                                 // 0 = default of the pattern
+    unsigned round_ms = DEFAULT_ROUND_MS;                      // '-l' length of a round (meter only)
+    unsigned interval_us = 0;                                  // '-i' timeline interval, 0 = no timeline (meter only)
+    bool exporting = false;                                    // '-e json|csv|bin:path' result export (meter only)
+    Exporter::format_t export_format = Exporter::JSON;
+    std::string export_path;
+    unsigned duty = MONITOR_DEFAULT_DUTY;                      // '-D' percent of the time spent probing (monitor only)
+    bool metrics = false;                                      // '-M [address:]port' OpenMetrics endpoint
+    std::string metrics_address = METRICS_DEFAULT_ADDRESS;
+    unsigned short metrics_port = 0;
+    thread_cores_t cores;                                      // '-A send|recv|control=cores' thread placement
+    unsigned busy_poll_us = 0;                                 // '-Y usec' busy polling receives, 0 = interrupts
+    int fifo_priority = 0;                                     // '-F priority' SCHED_FIFO threads, 0 = normal scheduling
+    bool lock_memory = false;                                  // '-L' mlockall
+    bool calibrate = false;                                    // '-K' pacing under each scheduling setting first (meter only)
+    int family = AF_UNSPEC;                                    // '-f 4|6|any' address family, any = dual-stack / happy eyeballs
+    bool all_addresses = false;                                // '-f all' measures every address of the host (meter only)
+    unsigned sweep_sizes = 0;                                  // '-W sizes' path MTU discovery & probe size sweep, 0 = off (meter only)
+    direction_t direction = UPSTREAM;                          // '-d up|down|both' directions loaded (meter only)
+    bool echo = false;                                         // '-E' every probe echoed, RTT under load (meter only)
+  };
+
+
+  /**
+   *  @brief Echoes of the probes of one round ('-E')
+   */
+  struct echo_round_t
+  {
+    long echoed = 0;       // unique probes that came back
+    long duplicates = 0;
+    long stale = 0;        // echoes of earlier rounds & other datagrams
+    LatencyHistogram rtt;  // ns, one sample per unique echo
+
+    // adds the echoes of another stream
+    void merge(const echo_round_t& other);
+  };
+
+
+  /**
+   *  @brief RTT under load of one round, for the table of the results
+   */
+  struct loaded_rtt_t
+  {
+    double achieved_rate;  // packets/second
+    long sent;
+    long echoed;
+    double min, p50, p90, p99, max; // ms
+  };
+
+
+  /**
+   *  @brief What one measurement came to, compared across the addresses of a host by '-f all'
+   *  and across the probe sizes by '-W'
+   */
+  struct meter_outcome_t
+  {
+    bool measured = false;
+    long packets_sent = 0;
+    long packets_recv = 0;
+    double speed_mean = 0.0; // Mb/s
+    double speed_max = 0.0;
+    double rtt_p50 = -1.0;   // ms, negative without RTT samples
+    double lossless_rate = 0.0; // packets/second, highest achieved rate of a round without loss (0 = none)
+  };
+
+
+  // set by the signal handler, polled by the loops of all modes
+  extern volatile sig_atomic_t shutdown_signal; // signal that asked for the end, 0 while running
+  extern volatile sig_atomic_t reload_signal;   // SIGHUP came since the last reload
+
 
   /**
    *  @brief Abstract MTrip runtime configuration
@@ -54,7 +195,8 @@
       enum mtrip_mode_t 
       {
         REFLECT_MODE = 0,
-        METER_MODE   = 1
+        METER_MODE   = 1,
+        MONITOR_MODE = 2
       };
 
       virtual mtrip_mode_t get_mode() = 0; // return the mode
@@ -67,21 +209,64 @@
   /**
    *  @brief Specialized Reflector mode configuration
    *  
-   *  @desc Reflector responds to incoming probe packets.
-   *  It is used as './ipk-mtrip reflect -p port ' and only needs 1 value stored.
+   *  @desc Reflector responds to incoming probe packets of any number of meters at once.
+   *  It is used as './ipk-mtrip reflect -p port [options]'.
    */
   class Reflector : public MTripConfiguration
   {
     private:
       mtrip_mode_t mode;
       unsigned short m_port;
+      mtrip_options_t m_options;
+      std::unique_ptr<SessionTable> m_sessions; // every measurement in progress
+      std::vector<std::shared_ptr<SocketEntity>> m_sockets; // probe sockets, one per worker
+      uint32_t m_capabilities;                  // CAP_* offered to the meters
+      std::unique_ptr<Metrics> m_metrics;       // counters of the workers & sessions
+      std::unique_ptr<MetricsServer> m_metrics_server; // '-M', null when not serving
+
+      // receive loop of one worker, serves all sessions whose flows land on 'socket'
+      void serve(unsigned worker, std::shared_ptr<SocketEntity> socket, FrameRing& frames);
+
+      // handles one received datagram: data probe, RTT probe or control message, true when it is to be echoed
+      bool dispatch(unsigned worker, SocketEntity& socket, SessionCache& cache, const char* datagram, size_t length,
+                    uint64_t rx_timestamp, const struct sockaddr_storage& source, uint64_t now);
+
+      // sends the echoed probes of a receive batch back, their flags rewritten in place
+      void send_echoes(unsigned worker, SocketEntity& socket, std::vector<char*>& echoes, std::vector<size_t>& lengths,
+                       std::vector<const struct sockaddr_storage*>& destinations);
+
+      // control loop, answers the meters and keeps the round timers & session expiry
+      void serve_control(std::shared_ptr<SocketEntity> socket);
+
+      // hello & round end of the meters
+      void handle_control(SocketEntity& socket, const control_header_t& header, const char* payload,
+                          const struct sockaddr_storage& source, uint64_t now);
+
+      // sends the reports of rounds past their grace period, drops idle sessions
+      void maintain_sessions(SocketEntity& socket, uint64_t now);
+
+      // sends the probes of 'round' back to the meter of 'session' at 'rate' (packets/second)
+      void send_reverse(Session& session, uint32_t round, uint32_t rate, const struct sockaddr_storage& destination);
+
+      // sends one round report (with the train arrivals & the timeline) to the meter of 'session'
+      void send_report(SocketEntity& socket, const Session& session, uint32_t round, const session_report_t& report);
+
+      // drops of the probe sockets & the UDP drop counters of the host now
+      host_drops_t host_drops();
+
+      // grows the receive buffers for the peak rate of a new measurement
+      void size_buffers(const control_hello_t& hello, const control_ack_t& ack);
     
     public:
       // constructor
       Reflector() : mode {REFLECT_MODE} {}
 
       // usual constructor
-      Reflector(unsigned short port) : m_port {port} {}
+      Reflector(unsigned short port, const mtrip_options_t& options = mtrip_options_t())
+        : mode {REFLECT_MODE},
+          m_port {port},
+          m_options {options}
+      {}
 
       // virtual destructor
       ~Reflector() override {};
@@ -89,9 +274,6 @@
       // initializes the reflecting mode routine 
       void init() override;
 
-      // receive packets of fixed size for 1 second and count them
-      long recv_packet_group(std::shared_ptr<SocketEntity> socket, int probe_size);
-
       // request mode of the current program runtime
       inline mtrip_mode_t get_mode() override { return mode; }
   };
@@ -103,16 +285,83 @@
    *  @desc Meter sends probe packets to reflector and measures the maximum bandwidth.
    *  It is used as:
    *  './ipk-mtrip meter -h vzdáleny_host -p vzdálený_port - s velikost_sondy -t doba_mereni' 
-   *  and needs to store 4 values.
+   *  and needs to store 4 values (+ optional settings, see mtrip_options_t).
    */
   class Meter : public MTripConfiguration
   {
-    private:
+    protected:
       mtrip_mode_t mode;
       std::string m_host_name;
       unsigned short m_port;
       int m_probe_size;
-      int m_measurment_time;
+      int m_measurment_time;                     // seconds
+      int m_rounds {0};                          // rounds filling the measurement time
+      mtrip_options_t m_options;
+      uint32_t m_session_id;
+      unsigned m_round_ms {DEFAULT_ROUND_MS};    // agreed with the reflector
+      unsigned m_interval_us {0};                // timeline interval agreed with the reflector, 0 = none
+      std::shared_ptr<SocketEntity> m_control_socket;
+      std::unique_ptr<ControlChannel> m_control; // hello & round reports
+      std::unique_ptr<Exporter> m_exporter;      // '-e', null when not exporting
+      std::unique_ptr<Metrics> m_metrics;        // counters of the sender threads & rounds
+      std::unique_ptr<MetricsServer> m_metrics_server; // '-M', null when not serving
+      std::unique_ptr<BufferArena> m_arena; // RTT frame, then the frames of every sender thread
+      std::vector<FrameRing> m_rings;       // one per sender thread
+      struct sockaddr_storage m_address {}; // probe port of the reflector address in use, AF_UNSPEC until chosen
+      meter_outcome_t m_outcome;            // results of init()
+      std::shared_ptr<SocketEntity> m_reverse_socket; // receives the probes of the reflector ('-d down|both'), null otherwise
+      unsigned m_reverse_stream {0};                  // metrics counters of the reverse receiver
+      unsigned m_echo_stream {0};                     // metrics counters of the first echo receiver ('-E'), one per sender
+
+      inline unsigned short control_port() const { return m_options.control_port ? m_options.control_port : m_port + CONTROL_PORT_OFFSET; }
+
+      // resolves the host, races its addresses (happy eyeballs) and keeps the first to answer in 'm_address'
+      void choose_address();
+
+      // '-f all', one measurement per address of the host that answers, then their comparison
+      void measure_addresses();
+
+      // '-W', the path MTU by DF probes, then one measurement per probe size and their comparison
+      void sweep_sizes();
+
+      // largest probe (UDP payload) echoed with DF set, between PROBE_HEADER_SIZE and the interface MTU,
+      // 0 when not even the smallest one came back
+      size_t discover_path_mtu(std::shared_ptr<SocketEntity> socket);
+
+      // one DF probe of 'size' bytes out of 'buffer', true when it was echoed
+      bool echo_probe(std::shared_ptr<SocketEntity> socket, char* buffer, size_t size, uint64_t sequence);
+
+      // data sockets (one per sender thread) & the control socket
+      std::vector<std::shared_ptr<SocketEntity>> open_sockets();
+
+      // hello to the reflector, a session of 'rounds' rounds with a new id, false when refused
+      bool open_session(std::vector<std::shared_ptr<SocketEntity>>& sockets, uint32_t rounds, control_ack_t& ack);
+
+      // asks the reflector to send the probes of 'round' at 'packet_rate', false when it does not answer
+      bool request_reverse(uint32_t round, long long packet_rate);
+
+      // receives the probes of the reflector in 'round' until 'deadline' (CLOCK_MONOTONIC),
+      // 'report' gets their counters & delays, returns the probes received
+      long receive_reverse(uint32_t round, uint64_t deadline, round_report_t& report);
+
+      // receives the echoes of the probes of 'stream' in 'round' until 'deadline' (CLOCK_MONOTONIC, it may
+      // move while receiving), returns the unique echoes
+      long receive_echoes(std::shared_ptr<SocketEntity> socket, uint32_t round, uint16_t stream,
+                          const std::atomic<uint64_t>& deadline, echo_round_t& echo);
+
+      // publishes the results of a round on the metrics endpoint
+      void count_round(long long packet_rate, long packets_sent, const round_report_t& report, double speed);
+
+      // maps the arena and preformats all probe frames of the session
+      void prepare_frames(unsigned streams, unsigned depth);
+
+      // train mode, one train or chirp per round instead of the rate search
+      void measure_trains(std::shared_ptr<SocketEntity> socket);
+
+      // sends the probes of 'train' on its schedule, 'tx_times' get their send times
+      long send_train(std::shared_ptr<SocketEntity> socket, FrameRing& frames, const ProbeTrain& train, uint32_t round,
+                      std::vector<uint64_t>& tx_times);
+
 
     public:
 
@@ -120,12 +369,14 @@
       Meter() : mode {METER_MODE} {}
 
       // usual constructor
-      Meter(std::string host_name, unsigned short port, int probe_size, int measurment_time)
+      Meter(std::string host_name, unsigned short port, int probe_size, int measurment_time,
+            const mtrip_options_t& options = mtrip_options_t())
         : mode {METER_MODE}, 
           m_host_name{ host_name }, 
           m_port {port}, 
           m_probe_size {probe_size}, 
-          m_measurment_time {measurment_time}
+          m_measurment_time {measurment_time},
+          m_options {options}
       {}
 
       // virtual destructor
@@ -135,19 +386,131 @@
       void init() override;
 
       // get RoundTripTime 
-      double RTT(std::shared_ptr<SocketEntity> socket, size_t buffer_size);
+      double RTT(std::shared_ptr<SocketEntity> socket, size_t buffer_size, uint32_t round);
       
-      // send group of packets at a 'packet_rate' for 1 second
-      long send_packet_group(std::shared_ptr<SocketEntity> socket, long long packet_rate, int probe_size);
+      // send group of packets out of 'frames' at a 'packet_rate' for one round (or 'train_length' probes when not 0),
+      // 'pacing' gets the achieved rate & jitter, 'timeline' the sent probes per interval
+      long send_packet_group(std::shared_ptr<SocketEntity> socket, FrameRing& frames, long long packet_rate, int probe_size,
+                             uint32_t round, uint16_t stream, long train_length, pacer_stats_t& pacing, Timeline& timeline);
+
+      // split 'packet_rate' over one pinned sender thread per socket, sum the results,
+      // 'echo' gets the echoes of the round when not null
+      long send_round(std::vector<std::shared_ptr<SocketEntity>>& sockets, long long packet_rate, int probe_size,
+                      uint32_t round, long train_length, pacer_stats_t& pacing, Timeline& timeline,
+                      echo_round_t* echo = nullptr);
 
       // request mode of the current program runtime
       inline mtrip_mode_t get_mode() override { return mode;}
   };
 
 
+  /**
+   *  @brief Long-running link monitor
+   *  
+   *  @desc Probes the path for one round every cycle, '-D' percent of the time,
+   *  and keeps the session alive by RTT probes in between. Every round is
+   *  folded into rolling windows of the last minute, hour and day, the memory
+   *  stays the same for weeks. Runs until SIGINT / SIGTERM, SIGHUP opens a new
+   *  session, restarts the rate search and reopens the export file (rotation).
+   *  It is used as './ipk-mtrip monitor -h host -p port -s probe_size [-D duty] [options]'.
+   */
+  class Monitor : public Meter
+  {
+    private:
+      RollingWindow m_minute;
+      RollingWindow m_hour;
+      RollingWindow m_day;
+
+      // opens a new session & rate search, false when the reflector is not there
+      bool restart(std::vector<std::shared_ptr<SocketEntity>>& sockets, std::unique_ptr<RateStrategy>& strategy);
+
+      // one line per window
+      void print_windows(uint64_t now);
+
+    public:
+      Monitor(std::string host_name, unsigned short port, int probe_size, const mtrip_options_t& options = mtrip_options_t());
+
+      // runs the monitor until a shutdown signal
+      void init() override;
+  };
+
+
+  /**
+   *  @brief Applies socket related options (batch depth, timestamping, zerocopy, I/O backend) to a socket
+   * 
+   *  @param socket socket to be configured
+   *  @param options settings passed on the command line
+   */
+  void configure_socket(std::shared_ptr<SocketEntity> socket, const mtrip_options_t& options);
+
+
+  /**
+   *  @brief Sends paced probes out of a ring of preformatted frames until 'round_end' (CLOCK_MONOTONIC)
+   * 
+   *  @desc The sender of the meter rounds, and of the probes the reflector sends back.
+   *  @return probes sent, 'pacing' gets the achieved rate & jitter, 'timeline' the sent probes per interval
+   */
+  long send_paced(std::shared_ptr<SocketEntity> socket, FrameRing& frames, long long packet_rate, int probe_size, uint32_t round,
+                  uint64_t round_end, long train_length, Pacer::pacing_mode_t mode, thread_metrics_t& counters,
+                  pacer_stats_t& pacing, Timeline& timeline);
+
+
+  /**
+   *  @brief Applies the process wide scheduling options (memory locking, permission of SCHED_FIFO)
+   * 
+   *  @desc Options not permitted are turned off in 'options' with a warning.
+   *  @param options settings passed on the command line
+   */
+  void configure_scheduling(mtrip_options_t& options);
+
+
+  /**
+   *  @brief Places a thread on the cores of its role and in its scheduling class
+   * 
+   *  @desc Senders & receivers default to the core of their index, the control
+   *  thread is only pinned when '-A control=' says so. Threads it starts later
+   *  inherit its scheduling class.
+   *  @param thread thread to be configured
+   *  @param role what the thread does
+   *  @param index index of the thread within its role
+   *  @param options settings passed on the command line
+   */
+  void configure_thread(pthread_t thread, thread_role_t role, unsigned index, const mtrip_options_t& options);
+
+
+  /**
+   *  @brief Paces a local loop under each scheduling setting and prints the rate error & gap jitter
+   * 
+   *  @param options settings passed on the command line
+   */
+  void calibrate_scheduling(const mtrip_options_t& options);
+
+
+  /**
+   *  @brief Scheduling options in effect, for printing
+   * 
+   *  @param options settings passed on the command line
+   *  @return e.g. "send=2,3 control=1, SCHED_FIFO 50, mlockall"
+   */
+  std::string scheduling_name(const mtrip_options_t& options);
+
+
+  /**
+   *  @brief Starts the OpenMetrics endpoint when '-M' asked for it
+   * 
+   *  @param server output, the running server, left null without '-M'
+   *  @param metrics metrics to be served
+   *  @param options settings passed on the command line
+   *  @return false when the endpoint can not be opened
+   */
+  bool start_metrics_server(std::unique_ptr<MetricsServer>& server, const Metrics& metrics, const mtrip_options_t& options);
+
+
   /**
    *  @brief Properly handles interrupt, such as CTRL+C
    * 
+   *  @desc Only sets 'shutdown_signal' / 'reload_signal', the loops end on their own.
+   *  A second shutdown signal ends the program at once.
    *  @param signum number of the signal caught
    *  @return void
    */
@@ -167,14 +530,77 @@
    * @brief Print startup informations
    * 
    */
-  void print_start_info(string host_name, unsigned short port, int measurment_time, int probe_size);
+  void print_start_info(string host_name, unsigned short port, int measurment_time, int probe_size, const mtrip_options_t& options,
+                        unsigned round_ms, int rounds, unsigned interval_us, uint32_t capabilities);
+
+
+  /**
+   * @brief Print the per-interval time series of a round
+   * 
+   */
+  void print_timeline(const Timeline& sent, const Timeline& received, int probe_size);
+
+
+  /**
+   * @brief Print the drops of both hosts and the loss left for the path
+   * 
+   */
+  void print_host_drops(const host_drops_t* reflector, int64_t meter_sndbuf_errors, long packets_sent, long packets_recv);
+
+
+  /**
+   * @brief Print results of the reverse direction (reflector -> meter)
+   * 
+   */
+  void print_downstream_info(int probe_size, int measurement_time, long packets_sent, long packets_recv,
+                             const std::vector<double>& speed_list, const rate_convergence_t& convergence,
+                             const LatencyHistogram* rtt_histogram);
+
+
+  /**
+   * @brief Name of a direction as '-d' takes it
+   * 
+   */
+  const char* direction_name(direction_t direction);
+
+
+  /**
+   * @brief Print the measurements of all addresses of the host side by side
+   * 
+   */
+  void print_address_comparison(const std::vector<race_result_t>& race, const std::vector<meter_outcome_t>& outcomes);
+
+
+  /**
+   * @brief Print the RTT under load of every round, by the rate it was sent at
+   * 
+   */
+  void print_loaded_rtt(std::vector<loaded_rtt_t> rounds, const LatencyHistogram& idle_rtt);
+
+
+  /**
+   * @brief Print the measurements of all probe sizes of the sweep and the best one
+   * 
+   */
+  void print_size_sweep(const std::vector<size_t>& sizes, const std::vector<meter_outcome_t>& outcomes, size_t path_payload,
+                        size_t headers);
+
+
+  /**
+   * @brief Print results of the train mode
+   * 
+   */
+  void print_train_info(int probe_size, int rounds, const mtrip_options_t& options, long packets_sent, long packets_recv,
+                        const std::vector<train_estimate_t>& estimates, const LatencyHistogram& rtt_histogram);
 
 
   /**
    * @brief Print results information
    * 
    */
-  void print_result_info(int probe_size, int measurement_time, long packets_sent, long packets_recv, std::vector<double> speed_list, std::vector<double> rtt_list);
+  void print_result_info(int probe_size, int measurement_time, long packets_sent, long packets_recv, const std::vector<double>& speed_list, const LatencyHistogram& rtt_histogram,
+                         RateStrategy::algorithm_t algorithm, const rate_convergence_t& convergence,
+                         const RunningStats& rate_error, const RunningStats& gap_jitter, const mtrip_options_t& options);
 
 
 #endif // IPK_MTRIP_H
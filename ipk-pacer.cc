@@ -0,0 +1,234 @@
+/**
+ *  @file       ipk-pacer.cc
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Packet pacer implementation.
+ *  
+ *  @section Description
+ *  
+ *  Replaces the sleep_for(1'000'000 / packet_rate us) gap, which rounded to 0 above
+ *  1 Mpps and overslept by the scheduler wakeup latency below it. The bucket keeps
+ *  fractional tokens, so any rate is reachable on average, and the gap statistics
+ *  show how evenly the packets really left.
+ */
+
+#include <cmath>
+#include <algorithm>
+
+#include "ipk-clock.h"
+#include "ipk-pacer.h"
+
+// hint to the CPU that we are spinning
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+
+/**
+ * @brief Creates a pacer for the given rate
+ * 
+ * @param packet_rate target rate in packets/second
+ * @param max_burst bucket depth, the most packets released at once
+ * @param pacing_mode how to wait for the tokens
+ */
+Pacer::Pacer(double packet_rate, unsigned max_burst, pacing_mode_t pacing_mode)
+  : mode {pacing_mode},
+    rate {packet_rate / NSEC_PER_SEC},
+    capacity {static_cast<double>(std::max(1u, max_burst))}
+{
+  start();
+}
+
+
+/**
+ * @brief Resets the bucket and statistics, pacing starts now
+ */
+void Pacer::start()
+{
+  tokens = 0.0;
+  start_time = last_refill = last_send = monotonic_ns();
+
+  gaps.reset();
+}
+
+
+/**
+ * @brief Adds tokens for the time elapsed since the last refill
+ */
+void Pacer::refill(uint64_t now)
+{
+  tokens = std::min(capacity, tokens + (now - last_refill) * rate);
+  last_refill = now;
+}
+
+
+/**
+ * @brief Waits until the deadline (CLOCK_MONOTONIC ns) according to the mode
+ */
+void Pacer::wait_until(uint64_t deadline)
+{
+  if (mode != BUSY_POLL_PACING)
+  {
+    uint64_t wake = deadline;
+    if (mode == HYBRID_PACING)
+      wake = deadline > HYBRID_SPIN_NS ? deadline - HYBRID_SPIN_NS : 0;
+
+    if (wake > monotonic_ns())
+    {
+      struct timespec ts = ns_to_timespec(wake);
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+    }
+
+    if (mode == BURST_PACING)
+      return;
+  }
+
+  while (monotonic_ns() < deadline)
+    cpu_relax();
+}
+
+
+/**
+ * @brief Waits for enough tokens and takes them
+ * 
+ * @desc In busy/hybrid mode a single token is enough, at high rates more
+ * of them accumulate during the syscall and leave in one batch.
+ * In burst mode the pacer waits for a full burst.
+ * @param max_packets maximum packets the caller is able to send at once
+ * @return number of packets that may be sent now
+ */
+unsigned Pacer::acquire(unsigned max_packets)
+{
+  double needed = 1.0;
+  if (mode == BURST_PACING)
+    needed = std::min<double>(capacity, max_packets);
+
+  uint64_t now = monotonic_ns();
+  refill(now);
+
+  if (tokens < needed)
+  {
+    wait_until(now + static_cast<uint64_t>(std::ceil((needed - tokens) / rate)));
+    refill(monotonic_ns());
+  }
+
+  unsigned granted = std::max(1u, std::min(max_packets, static_cast<unsigned>(tokens)));
+  tokens -= granted;
+
+  return granted;
+}
+
+
+/**
+ * @brief Accounts packets sent, packets of one batch leave back-to-back (gap 0)
+ * 
+ * @param packets_sent number of packets the socket really accepted
+ */
+void Pacer::record(unsigned packets_sent)
+{
+  if (packets_sent == 0)
+    return;
+
+  uint64_t now = monotonic_ns();
+  double gap = (now - last_send) / static_cast<double>(NSEC_PER_USEC);
+  last_send = now;
+
+  for (unsigned i = 0; i < packets_sent; i++)
+  {
+    gaps.add(gap);
+    gap = 0.0;
+  }
+}
+
+
+/**
+ * @brief Returns pacing statistics since start()
+ */
+pacer_stats_t Pacer::report()
+{
+  pacer_stats_t stats;
+
+  stats.duration = (monotonic_ns() - start_time) / static_cast<double>(NSEC_PER_SEC);
+  stats.target_rate = rate * NSEC_PER_SEC;
+  stats.achieved_rate = stats.duration > 0.0 ? gaps.count() / stats.duration : 0.0;
+  stats.gap_mean = gaps.mean();
+  stats.gap_jitter = gaps.std_dev();
+  stats.packets = gaps.count();
+
+  return stats;
+}
+
+
+/**
+ * @brief Translates pacing mode name from the command line
+ * 
+ * @param name "busy", "hybrid" or "burst"
+ * @param mode output, the mode
+ * @return false when the name is not known
+ */
+bool Pacer::parse_mode(const std::string& name, pacing_mode_t& mode)
+{
+  if (name == "busy")
+    mode = BUSY_POLL_PACING;
+  else if (name == "hybrid")
+    mode = HYBRID_PACING;
+  else if (name == "burst")
+    mode = BURST_PACING;
+  else
+    return false;
+
+  return true;
+}
+
+
+/**
+ * @brief Returns printable name of the pacing mode
+ */
+const char* Pacer::mode_name(pacing_mode_t mode)
+{
+  switch (mode)
+  {
+    case BUSY_POLL_PACING: return "busy";
+    case HYBRID_PACING:    return "hybrid";
+    case BURST_PACING:     return "burst";
+  }
+  return "unknown";
+}
+
+
+/**
+ * @brief Combines statistics of pacers running in parallel
+ * 
+ * @desc Rates add up, the gap statistics are pooled (weighted by packets),
+ * so they describe an average stream, not the aggregate.
+ * @param stats statistics of every pacer
+ * @return merged statistics
+ */
+pacer_stats_t merge_pacer_stats(const std::vector<pacer_stats_t>& stats)
+{
+  pacer_stats_t merged {0.0, 0.0, 0.0, 0.0, 0.0, 0};
+  double gap_sq_sum { 0.0 };
+
+  for (const pacer_stats_t& s : stats)
+  {
+    merged.target_rate += s.target_rate;
+    merged.achieved_rate += s.achieved_rate;
+    merged.duration = std::max(merged.duration, s.duration);
+    merged.gap_mean += s.gap_mean * s.packets;
+    gap_sq_sum += (s.gap_jitter * s.gap_jitter + s.gap_mean * s.gap_mean) * s.packets;
+    merged.packets += s.packets;
+  }
+
+  if (merged.packets > 0)
+  {
+    merged.gap_mean /= merged.packets;
+    merged.gap_jitter = std::sqrt(std::max(0.0, gap_sq_sum / merged.packets - merged.gap_mean * merged.gap_mean));
+  }
+
+  return merged;
+}
@@ -0,0 +1,94 @@
+/**
+ *  @file       ipk-pacer.h
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Packet pacer.
+ *  
+ *  @section Description
+ *  
+ *  Token bucket driven by CLOCK_MONOTONIC. Tokens (= packets) are refilled at
+ *  the target rate, the sender asks the pacer how many packets it may send
+ *  right now and the pacer waits until at least one (or one whole burst) is
+ *  available. How the waiting is done depends on the pacing mode.
+ */
+
+#ifndef IPK_PACER_H_
+#define IPK_PACER_H_
+
+    #include <stdint.h>
+    #include <string>
+    #include <vector>
+
+    #include "ipk-stats.h"
+
+    // hybrid mode sleeps until this close to the deadline, then spins
+    #define HYBRID_SPIN_NS 60000ULL
+
+    /**
+     * @brief Pacing statistics of one sending round
+     */
+    struct pacer_stats_t
+    {
+        double target_rate;   // requested packets/second
+        double achieved_rate; // packets/second really handed to the socket
+        double duration;      // seconds from start() to report()
+        double gap_mean;      // mean inter-packet gap in microseconds
+        double gap_jitter;    // standard deviation of the gap in microseconds
+        long packets;         // packets accounted by record()
+    };
+
+    /**
+     * @brief Token bucket packet pacer
+     */
+    class Pacer
+    {
+        public:
+
+            enum pacing_mode_t
+            {
+                BUSY_POLL_PACING = 0, // spin on the clock, most precise, burns a core
+                HYBRID_PACING    = 1, // sleep until close to the deadline, then spin
+                BURST_PACING     = 2  // sleep, then send a whole burst back-to-back
+            };
+
+        private:
+            pacing_mode_t mode;
+            double rate;          // tokens per nanosecond
+            double capacity;      // bucket depth (= max burst) in tokens
+            double tokens;
+            uint64_t last_refill;
+
+            // inter-packet gap in microseconds
+            uint64_t start_time;
+            uint64_t last_send;
+            RunningStats gaps;
+
+            void refill(uint64_t now);
+            void wait_until(uint64_t deadline);
+
+        public:
+            Pacer(double packet_rate, unsigned max_burst, pacing_mode_t pacing_mode);
+
+            // starts the pacing interval with an empty bucket
+            void start();
+
+            // waits for tokens, returns how many packets may be sent now (1..max_packets)
+            unsigned acquire(unsigned max_packets);
+
+            // accounts packets really sent after the last acquire()
+            void record(unsigned packets_sent);
+
+            // statistics since start()
+            pacer_stats_t report();
+
+            // "busy" / "hybrid" / "burst" -> mode, returns false on unknown name
+            static bool parse_mode(const std::string& name, pacing_mode_t& mode);
+            static const char* mode_name(pacing_mode_t mode);
+    };
+
+    // combines statistics of pacers running in parallel (rates add up)
+    pacer_stats_t merge_pacer_stats(const std::vector<pacer_stats_t>& stats);
+
+#endif // IPK_PACER_H_
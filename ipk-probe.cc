@@ -0,0 +1,611 @@
+/**
+ *  @file       ipk-probe.cc
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Probe wire format implementation.
+ */
+
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <endian.h>
+
+#include "ipk-probe.h"
+
+
+/**
+ * @brief Writes the probe header in network byte order
+ * 
+ * @param buffer start of the probe, at least PROBE_HEADER_SIZE bytes
+ * @param header header in host byte order
+ */
+void probe_write(char* buffer, const probe_header_t& header)
+{
+  probe_header_t wire;
+
+  wire.magic = htobe32(header.magic);
+  wire.session_id = htobe32(header.session_id);
+  wire.round = htobe32(header.round);
+  wire.stream = htobe16(header.stream);
+  wire.flags = htobe16(header.flags);
+  wire.sequence = htobe64(header.sequence);
+  wire.tx_timestamp = htobe64(header.tx_timestamp);
+
+  std::memcpy(buffer, &wire, sizeof(wire));
+}
+
+
+/**
+ * @brief Prepares a probe frame once, before it is sent many times
+ * 
+ * @param frame buffer of at least 'size' bytes
+ * @param size probe size
+ * @param header header to be written to the start of the frame
+ */
+void probe_format(char* frame, size_t size, const probe_header_t& header)
+{
+  probe_write(frame, header);
+
+  if (size > PROBE_HEADER_SIZE)
+    std::memset(frame + PROBE_HEADER_SIZE, 'P', size - PROBE_HEADER_SIZE);
+}
+
+
+/**
+ * @brief Patches the fields changing from probe to probe in place
+ * 
+ * @param frame frame formatted by probe_format
+ * @param round current round
+ * @param sequence sequence number of the probe
+ * @param tx_timestamp CLOCK_REALTIME ns
+ */
+void probe_patch(char* frame, uint32_t round, uint64_t sequence, uint64_t tx_timestamp)
+{
+  uint32_t wire_round = htobe32(round);
+  uint64_t wire_sequence = htobe64(sequence);
+  uint64_t wire_timestamp = htobe64(tx_timestamp);
+
+  std::memcpy(frame + offsetof(probe_header_t, round), &wire_round, sizeof(wire_round));
+  std::memcpy(frame + offsetof(probe_header_t, sequence), &wire_sequence, sizeof(wire_sequence));
+  std::memcpy(frame + offsetof(probe_header_t, tx_timestamp), &wire_timestamp, sizeof(wire_timestamp));
+}
+
+
+/**
+ * @brief Rewrites the flags of a probe in place
+ * 
+ * @desc The reflector turns an echoed probe into its reply without copying
+ * it, everything else (the TX timestamp of the meter above all) stays.
+ * @param frame received probe, at least PROBE_HEADER_SIZE bytes
+ * @param flags new flags
+ */
+void probe_set_flags(char* frame, uint16_t flags)
+{
+  uint16_t wire_flags = htobe16(flags);
+  std::memcpy(frame + offsetof(probe_header_t, flags), &wire_flags, sizeof(wire_flags));
+}
+
+
+/**
+ * @brief Parses the probe header
+ * 
+ * @param buffer received datagram
+ * @param length length of the datagram
+ * @param header output, header in host byte order
+ * @return false when the datagram is too short or does not carry the magic
+ */
+bool probe_read(const char* buffer, size_t length, probe_header_t& header)
+{
+  if (length < PROBE_HEADER_SIZE)
+    return false;
+
+  probe_header_t wire;
+  std::memcpy(&wire, buffer, sizeof(wire));
+
+  header.magic = be32toh(wire.magic);
+  if (header.magic != PROBE_MAGIC)
+    return false;
+
+  header.session_id = be32toh(wire.session_id);
+  header.round = be32toh(wire.round);
+  header.stream = be16toh(wire.stream);
+  header.flags = be16toh(wire.flags);
+  header.sequence = be64toh(wire.sequence);
+  header.tx_timestamp = be64toh(wire.tx_timestamp);
+
+  return true;
+}
+
+
+/**
+ * @brief Adds counters of 'other' to 'report'
+ */
+void round_report_merge(round_report_t& report, const round_report_t& other)
+{
+  report.received += other.received;
+  report.lost += other.lost;
+  report.reordered += other.reordered;
+  report.duplicates += other.duplicates;
+  report.late += other.late;
+  report.stale += other.stale;
+  report.invalid += other.invalid;
+
+  if (other.delay_samples == 0)
+    return;
+
+  if (report.delay_samples == 0)
+  {
+    report.owd_min = other.owd_min;
+    report.owd_max = other.owd_max;
+    report.rx_first = other.rx_first;
+    report.rx_last = other.rx_last;
+  }
+  else
+  {
+    report.owd_min = std::min(report.owd_min, other.owd_min);
+    report.owd_max = std::max(report.owd_max, other.owd_max);
+    report.rx_first = std::min(report.rx_first, other.rx_first);
+    report.rx_last = std::max(report.rx_last, other.rx_last);
+  }
+
+  // weighted means
+  double total = report.delay_samples + other.delay_samples;
+  double weight = other.delay_samples / total;
+  report.owd_mean += std::llround((other.owd_mean - report.owd_mean) * weight);
+  report.owd_variation += std::llround((other.owd_variation - report.owd_variation) * weight);
+  report.jitter += std::llround((other.jitter - report.jitter) * weight);
+  report.delay_samples += other.delay_samples;
+}
+
+
+/**
+ * @brief Merges delay estimate of one stream into the report
+ */
+void round_report_add_delay(round_report_t& report, const DelayEstimator& delay)
+{
+  if (delay.samples() == 0)
+    return;
+
+  round_report_t stream {};
+  stream.delay_samples = delay.samples();
+  stream.owd_min = std::llround(delay.min_transit());
+  stream.owd_mean = std::llround(delay.mean_transit());
+  stream.owd_max = std::llround(delay.max_transit());
+  stream.owd_variation = std::llround(delay.variation());
+  stream.jitter = std::llround(delay.jitter());
+  stream.rx_first = static_cast<int64_t>(delay.first_arrival());
+  stream.rx_last = static_cast<int64_t>(delay.last_arrival());
+
+  round_report_merge(report, stream);
+}
+
+
+/**
+ * @brief Serializes the round report in network byte order
+ * 
+ * @param buffer output, ROUND_REPORT_SIZE bytes
+ * @param report report to be sent
+ */
+void round_report_write(char* buffer, const round_report_t& report)
+{
+  const int64_t fields[] = { report.received, report.lost, report.reordered,
+    report.duplicates, report.late, report.stale, report.invalid,
+    report.delay_samples, report.owd_min, report.owd_mean, report.owd_max,
+    report.owd_variation, report.jitter, report.rx_first, report.rx_last };
+
+  for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+  {
+    uint64_t wire = htobe64(static_cast<uint64_t>(fields[i]));
+    std::memcpy(buffer + i * sizeof(wire), &wire, sizeof(wire));
+  }
+}
+
+
+/**
+ * @brief Parses the round report
+ * 
+ * @param buffer received report, ROUND_REPORT_SIZE bytes
+ * @param report output, report in host byte order
+ */
+void round_report_read(const char* buffer, round_report_t& report)
+{
+  int64_t* fields[] = { &report.received, &report.lost, &report.reordered,
+    &report.duplicates, &report.late, &report.stale, &report.invalid,
+    &report.delay_samples, &report.owd_min, &report.owd_mean, &report.owd_max,
+    &report.owd_variation, &report.jitter, &report.rx_first, &report.rx_last };
+
+  for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+  {
+    uint64_t wire;
+    std::memcpy(&wire, buffer + i * sizeof(wire), sizeof(wire));
+    *fields[i] = static_cast<int64_t>(be64toh(wire));
+  }
+}
+
+
+/**
+ * @brief Serializes the arrival times of a train
+ * 
+ * @desc Offsets from the first arrival fit 32 bits for trains shorter than 4 s,
+ * longer gaps are saturated.
+ * @param buffer output, DISPERSION_MAX_SIZE bytes
+ * @param samples arrivals in any order
+ * @return size of the vector
+ */
+size_t dispersion_write(char* buffer, const std::vector<dispersion_sample_t>& samples)
+{
+  uint32_t count = std::min<size_t>(samples.size(), DISPERSION_MAX_PROBES);
+
+  uint64_t first = UINT64_MAX;
+  for (uint32_t i = 0; i < count; i++)
+    first = std::min(first, samples[i].rx_timestamp);
+
+  uint32_t wire = htobe32(count);
+  std::memcpy(buffer, &wire, sizeof(wire));
+
+  char* position = buffer + sizeof(wire);
+  for (uint32_t i = 0; i < count; i++)
+  {
+    uint32_t fields[] = { samples[i].sequence, static_cast<uint32_t>(std::min<uint64_t>(samples[i].rx_timestamp - first, UINT32_MAX)) };
+    for (uint32_t field : fields)
+    {
+      wire = htobe32(field);
+      std::memcpy(position, &wire, sizeof(wire));
+      position += sizeof(wire);
+    }
+  }
+
+  return position - buffer;
+}
+
+
+/**
+ * @brief Parses the arrival times of a train
+ * 
+ * @param buffer received vector
+ * @param length bytes available, samples beyond are dropped
+ * @param samples output, arrival offsets sorted by sequence
+ * @return size of the vector
+ */
+size_t dispersion_read(const char* buffer, size_t length, std::vector<dispersion_sample_t>& samples)
+{
+  samples.clear();
+  if (length < sizeof(uint32_t))
+    return 0;
+
+  uint32_t wire;
+  std::memcpy(&wire, buffer, sizeof(wire));
+  size_t count = std::min<size_t>(be32toh(wire), (length - sizeof(wire)) / DISPERSION_SAMPLE_SIZE);
+
+  const char* position = buffer + sizeof(wire);
+  for (size_t i = 0; i < count; i++, position += DISPERSION_SAMPLE_SIZE)
+  {
+    uint32_t sequence, offset;
+    std::memcpy(&sequence, position, sizeof(sequence));
+    std::memcpy(&offset, position + sizeof(sequence), sizeof(offset));
+    samples.push_back({be32toh(sequence), be32toh(offset)});
+  }
+
+  std::sort(samples.begin(), samples.end(),
+            [](const dispersion_sample_t& a, const dispersion_sample_t& b) { return a.sequence < b.sequence; });
+
+  return position - buffer;
+}
+
+
+/**
+ * @brief Serializes the bins of a timeline
+ * 
+ * @param buffer output, TIMELINE_MAX_SIZE bytes
+ * @param timeline bins to be written
+ * @return size of the timeline
+ */
+size_t timeline_write(char* buffer, const Timeline& timeline)
+{
+  uint32_t count = std::min<size_t>(timeline.size(), TIMELINE_MAX_BINS);
+
+  uint64_t wire_first = htobe64(timeline.first_bin());
+  uint32_t wire_count = htobe32(count);
+  std::memcpy(buffer, &wire_first, sizeof(wire_first));
+  std::memcpy(buffer + sizeof(wire_first), &wire_count, sizeof(wire_count));
+
+  char* position = buffer + sizeof(wire_first) + sizeof(wire_count);
+  for (uint32_t i = 0; i < count; i++, position += sizeof(uint32_t))
+  {
+    uint32_t wire = htobe32(timeline.at(timeline.first_bin() + i));
+    std::memcpy(position, &wire, sizeof(wire));
+  }
+
+  return position - buffer;
+}
+
+
+/**
+ * @brief Parses the bins of a timeline
+ * 
+ * @param buffer received timeline
+ * @param length bytes available, bins beyond are dropped
+ * @param timeline output, gets the received bins
+ */
+void timeline_read(const char* buffer, size_t length, Timeline& timeline)
+{
+  uint64_t wire_first;
+  uint32_t wire_count;
+  std::vector<uint32_t> bins;
+
+  if (length < sizeof(wire_first) + sizeof(wire_count))
+  {
+    timeline.reset();
+    return;
+  }
+
+  std::memcpy(&wire_first, buffer, sizeof(wire_first));
+  std::memcpy(&wire_count, buffer + sizeof(wire_first), sizeof(wire_count));
+
+  const char* position = buffer + sizeof(wire_first) + sizeof(wire_count);
+  size_t count = std::min<size_t>(be32toh(wire_count), (length - sizeof(wire_first) - sizeof(wire_count)) / sizeof(uint32_t));
+  for (size_t i = 0; i < count; i++, position += sizeof(uint32_t))
+  {
+    uint32_t wire;
+    std::memcpy(&wire, position, sizeof(wire));
+    bins.push_back(be32toh(wire));
+  }
+
+  timeline.assign(be64toh(wire_first), bins);
+}
+
+
+host_drops_t host_drops_delta(const host_drops_t& after, const host_drops_t& before)
+{
+  return host_drops_t { after.socket_overflow - before.socket_overflow, after.rcvbuf_errors - before.rcvbuf_errors,
+                        after.sndbuf_errors - before.sndbuf_errors, after.in_errors - before.in_errors };
+}
+
+
+/**
+ * @brief Serializes the host drops in network byte order
+ * 
+ * @param buffer output, HOST_DROPS_SIZE bytes
+ * @param drops drops to be sent
+ */
+void host_drops_write(char* buffer, const host_drops_t& drops)
+{
+  const int64_t fields[] = { drops.socket_overflow, drops.rcvbuf_errors, drops.sndbuf_errors, drops.in_errors };
+
+  for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+  {
+    uint64_t wire = htobe64(static_cast<uint64_t>(fields[i]));
+    std::memcpy(buffer + i * sizeof(wire), &wire, sizeof(wire));
+  }
+}
+
+
+/**
+ * @brief Parses the host drops
+ * 
+ * @param buffer received drops, HOST_DROPS_SIZE bytes
+ * @param drops output, drops in host byte order
+ */
+void host_drops_read(const char* buffer, host_drops_t& drops)
+{
+  int64_t* fields[] = { &drops.socket_overflow, &drops.rcvbuf_errors, &drops.sndbuf_errors, &drops.in_errors };
+
+  for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+  {
+    uint64_t wire;
+    std::memcpy(&wire, buffer + i * sizeof(wire), sizeof(wire));
+    *fields[i] = static_cast<int64_t>(be64toh(wire));
+  }
+}
+
+
+/**
+ * @brief Skips the dispersion vector & timeline of a round report
+ * 
+ * @param buffer whole report payload
+ * @param length payload length
+ * @param offset output, where the host drops start
+ * @return false when the report ends before them
+ */
+static bool host_drops_offset(const char* buffer, size_t length, size_t& offset)
+{
+  offset = ROUND_REPORT_SIZE;
+  uint32_t wire;
+
+  if (length < offset + sizeof(wire))
+    return false;
+  std::memcpy(&wire, buffer + offset, sizeof(wire));
+  offset += sizeof(wire) + std::min<size_t>(be32toh(wire), DISPERSION_MAX_PROBES) * DISPERSION_SAMPLE_SIZE;
+
+  if (length < offset + sizeof(uint64_t) + sizeof(wire))
+    return false;
+  std::memcpy(&wire, buffer + offset + sizeof(uint64_t), sizeof(wire));
+  offset += sizeof(uint64_t) + sizeof(wire) + std::min<size_t>(be32toh(wire), TIMELINE_MAX_BINS) * sizeof(uint32_t);
+  return true;
+}
+
+
+/**
+ * @brief Finds the host drops at the end of a round report
+ * 
+ * @desc A reflector that agreed to CAP_HOST_DROPS always sends the dispersion
+ * vector and the timeline (empty ones when there is nothing to report), the
+ * drops follow them. Only the counts of the blocks are read to skip them.
+ * @param buffer whole report payload
+ * @param length payload length
+ * @param drops output
+ * @return false when the report ends before the drops
+ */
+bool report_host_drops(const char* buffer, size_t length, host_drops_t& drops)
+{
+  size_t offset;
+  if (!host_drops_offset(buffer, length, offset) || length < offset + HOST_DROPS_SIZE)
+    return false;
+  host_drops_read(buffer + offset, drops);
+  return true;
+}
+
+
+/**
+ * @brief Serializes the reverse counters
+ * 
+ * @param buffer output, REVERSE_STATS_SIZE bytes
+ * @param stats counters in host byte order
+ */
+void reverse_stats_write(char* buffer, const reverse_stats_t& stats)
+{
+  const int64_t fields[] = { stats.sent, stats.achieved_rate, stats.gap_jitter };
+
+  for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+  {
+    uint64_t wire = htobe64(static_cast<uint64_t>(fields[i]));
+    std::memcpy(buffer + i * sizeof(wire), &wire, sizeof(wire));
+  }
+}
+
+
+/**
+ * @brief Parses the reverse counters
+ * 
+ * @param buffer received counters, REVERSE_STATS_SIZE bytes
+ * @param stats output, counters in host byte order
+ */
+void reverse_stats_read(const char* buffer, reverse_stats_t& stats)
+{
+  int64_t* fields[] = { &stats.sent, &stats.achieved_rate, &stats.gap_jitter };
+
+  for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+  {
+    uint64_t wire;
+    std::memcpy(&wire, buffer + i * sizeof(wire), sizeof(wire));
+    *fields[i] = static_cast<int64_t>(be64toh(wire));
+  }
+}
+
+
+/**
+ * @brief Finds the reverse counters at the end of a round report
+ * 
+ * @param buffer whole report payload
+ * @param length payload length
+ * @param stats output
+ * @return false when the report ends before the counters
+ */
+bool report_reverse_stats(const char* buffer, size_t length, reverse_stats_t& stats)
+{
+  size_t offset;
+  if (!host_drops_offset(buffer, length, offset) || length < offset + HOST_DROPS_SIZE + REVERSE_STATS_SIZE)
+    return false;
+  reverse_stats_read(buffer + offset + HOST_DROPS_SIZE, stats);
+  return true;
+}
+
+
+/*****************************************************************************/
+
+/**
+ * @brief Clears the window and counters
+ */
+void SequenceTracker::reset()
+{
+  std::memset(window, 0, sizeof(window));
+  highest = 0;
+  started = false;
+
+  received = 0;
+  reordered = 0;
+  duplicates = 0;
+  late = 0;
+}
+
+
+/**
+ * @brief Marks sequence number as seen, returns whether it already was
+ */
+inline bool SequenceTracker::test_and_set(uint64_t sequence)
+{
+  uint64_t& word = window[(sequence / 64) % WINDOW_WORDS];
+  uint64_t bit = 1ULL << (sequence % 64);
+
+  bool seen = word & bit;
+  word |= bit;
+
+  return seen;
+}
+
+
+/**
+ * @brief Clears the sequence number slot (reused as the window slides)
+ */
+inline void SequenceTracker::clear(uint64_t sequence)
+{
+  window[(sequence / 64) % WINDOW_WORDS] &= ~(1ULL << (sequence % 64));
+}
+
+
+/**
+ * @brief Accounts one probe of the stream
+ * 
+ * @param sequence sequence number from the probe header
+ * @param is_late probe arrived after the round window closed
+ * @return false for a duplicate
+ */
+bool SequenceTracker::track(uint64_t sequence, bool is_late)
+{
+  if (!started || sequence > highest)
+  {
+    // slide the window, slots between the old and new highest become free
+    uint64_t from = started ? highest + 1 : sequence;
+    if (sequence - from >= WINDOW_BITS)
+      std::memset(window, 0, sizeof(window));
+    else
+      for (uint64_t s = from; s < sequence; s++)
+        clear(s);
+
+    clear(sequence);
+    test_and_set(sequence);
+    highest = sequence;
+    started = true;
+  }
+  else if (highest - sequence < WINDOW_BITS)
+  {
+    if (test_and_set(sequence))
+    {
+      duplicates++;
+      return false;
+    }
+    reordered++;
+  }
+  else
+  {
+    // too old for the window, can not tell a duplicate anymore
+    reordered++;
+  }
+
+  received++;
+  if (is_late)
+    late++;
+  return true;
+}
+
+
+/**
+ * @brief Adds counters of this stream to the report
+ * 
+ * @desc Sequence numbers start at 0 every round, so everything below the
+ * highest one seen that did not arrive is lost (loss at the very end of the
+ * round is only visible to the meter, which knows how many were sent).
+ */
+void SequenceTracker::report(round_report_t& report)
+{
+  if (!started)
+    return;
+
+  report.received += received;
+  report.lost += std::max<int64_t>(0, static_cast<int64_t>(highest + 1) - received);
+  report.reordered += reordered;
+  report.duplicates += duplicates;
+  report.late += late;
+}
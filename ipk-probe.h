@@ -0,0 +1,242 @@
+/**
+ *  @file       ipk-probe.h
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Probe wire format.
+ *  
+ *  @section Description
+ *  
+ *  Every probe starts with a packed header (network byte order) identifying the
+ *  measurement session, round, sender stream and sequence number, plus the TX
+ *  timestamp. The rest of the probe is padding up to the probe size.
+ *  
+ *  The reflector tracks sequence numbers of every stream in a sliding bitmap,
+ *  so it can tell loss, reordering, duplication and late delivery apart, and
+ *  returns them as a structured round report instead of a bare count.
+ */
+
+#ifndef IPK_PROBE_H_
+#define IPK_PROBE_H_
+
+    #include <stdint.h>
+    #include <stddef.h>
+    #include <vector>
+
+    #include "ipk-stats.h"
+
+    // "IPKP", marks a datagram as a probe
+    #define PROBE_MAGIC 0x49504b50U
+
+    // probe flags
+    #define PROBE_DATA 0x0000 // counted bandwidth probe
+    #define PROBE_RTT  0x0001 // echoed back by the reflector
+    #define PROBE_TRAIN 0x0002 // counted like a data probe, its arrival time is reported back
+    #define PROBE_ECHO  0x0004 // with PROBE_DATA, counted and sent straight back ('-E')
+    #define PROBE_REPLY 0x0008 // sent back by the reflector, never echoed again
+
+    /**
+     * @brief Probe header, as it is laid out on the wire
+     */
+    struct __attribute__((packed)) probe_header_t
+    {
+        uint32_t magic;
+        uint32_t session_id;   // random id chosen by the meter
+        uint32_t round;        // measurement round
+        uint16_t stream;       // sender thread of the meter
+        uint16_t flags;
+        uint64_t sequence;     // per stream & round, starting at 0
+        uint64_t tx_timestamp; // CLOCK_REALTIME ns when the probe was sent
+    };
+
+    // smallest usable probe size
+    #define PROBE_HEADER_SIZE sizeof(probe_header_t)
+
+    // writes the header to the start of 'buffer' in network byte order
+    void probe_write(char* buffer, const probe_header_t& header);
+
+    // writes the header and fills the rest of a 'size' bytes frame with padding
+    void probe_format(char* frame, size_t size, const probe_header_t& header);
+
+    // rewrites only the per-probe fields of a formatted frame
+    void probe_patch(char* frame, uint32_t round, uint64_t sequence, uint64_t tx_timestamp);
+
+    // rewrites the flags of a received probe in place (echo replies)
+    void probe_set_flags(char* frame, uint16_t flags);
+
+    // parses header from 'buffer', false when it is not a probe
+    bool probe_read(const char* buffer, size_t length, probe_header_t& header);
+
+
+    /**
+     * @brief Per-round results the reflector sends back to the meter
+     */
+    struct round_report_t
+    {
+        int64_t received;   // unique probes of the round (including late ones)
+        int64_t lost;       // holes in the sequence space seen by the reflector
+        int64_t reordered;  // probes that arrived after a higher sequence number
+        int64_t duplicates; // probes received more than once
+        int64_t late;       // unique probes that arrived after the round window closed
+        int64_t stale;      // probes of older rounds or other sessions, ignored
+        int64_t invalid;    // datagrams of wrong size or without probe header
+
+        // one-way delay, all in ns, the absolute values carry the clock offset of the hosts
+        int64_t delay_samples;
+        int64_t owd_min;
+        int64_t owd_mean;
+        int64_t owd_max;
+        int64_t owd_variation; // mean transit above the minimal one (queueing delay)
+        int64_t jitter;        // RFC 3550 interarrival jitter
+
+        // CLOCK_REALTIME of the reflector when the first/last probe of the round arrived,
+        // the span is the dispersion of the round (0 without delay samples)
+        int64_t rx_first;
+        int64_t rx_last;
+    };
+
+    // size of the serialized round report
+    #define ROUND_REPORT_SIZE (15 * sizeof(int64_t))
+
+    // adds counters of 'other' to 'report', delay values are weighted by their samples
+    void round_report_merge(round_report_t& report, const round_report_t& other);
+
+    // merges delay estimate of one stream into 'report'
+    void round_report_add_delay(round_report_t& report, const DelayEstimator& delay);
+
+    // (de)serialization in network byte order, 'buffer' holds ROUND_REPORT_SIZE bytes
+    void round_report_write(char* buffer, const round_report_t& report);
+    void round_report_read(const char* buffer, round_report_t& report);
+
+
+    /**
+     * @brief Arrival of one train probe at the reflector
+     */
+    struct dispersion_sample_t
+    {
+        uint32_t sequence;
+        uint64_t rx_timestamp; // CLOCK_REALTIME ns on the reflector, relative to the first arrival once read
+    };
+
+    // arrivals the reflector keeps (and reports) per round, the rest of a longer train is only counted
+    #define DISPERSION_MAX_PROBES 256
+
+    // serialized dispersion vector: count, then sequence & arrival offset (ns) of every sample, 32 bit each
+    #define DISPERSION_SAMPLE_SIZE (2 * sizeof(uint32_t))
+    #define DISPERSION_MAX_SIZE (sizeof(uint32_t) + DISPERSION_MAX_PROBES * DISPERSION_SAMPLE_SIZE)
+
+    // writes the arrivals (at most DISPERSION_MAX_PROBES) relative to the earliest one, returns the bytes written
+    size_t dispersion_write(char* buffer, const std::vector<dispersion_sample_t>& samples);
+
+    // parses a dispersion vector of 'length' bytes, 'samples' get the arrival offsets in ns sorted by sequence,
+    // returns the bytes read
+    size_t dispersion_read(const char* buffer, size_t length, std::vector<dispersion_sample_t>& samples);
+
+
+    // bins of a round timeline, and the shortest interval
+    #define TIMELINE_MAX_BINS 512
+    #define TIMELINE_MIN_US 100
+
+    // serialized timeline: first bin (64 bit), count (32 bit), then the counts of the bins (32 bit each)
+    #define TIMELINE_MAX_SIZE (sizeof(uint64_t) + sizeof(uint32_t) + TIMELINE_MAX_BINS * sizeof(uint32_t))
+
+    // writes the bins of 'timeline' (at most TIMELINE_MAX_BINS), returns the bytes written
+    size_t timeline_write(char* buffer, const Timeline& timeline);
+
+    // parses a timeline of 'length' bytes into 'timeline' (its interval is kept)
+    void timeline_read(const char* buffer, size_t length, Timeline& timeline);
+
+
+    /**
+     * @brief Datagrams the reflector host dropped during a round
+     * 
+     * @desc The receiving sockets and the UDP counters are shared by all
+     * sessions, so drops of other measurements running at the same time show
+     * up here as well.
+     */
+    struct host_drops_t
+    {
+        int64_t socket_overflow; // SO_RXQ_OVFL, full receive queue of the probe sockets
+        int64_t rcvbuf_errors;   // UDP RcvbufErrors of the host
+        int64_t sndbuf_errors;   // UDP SndbufErrors of the host
+        int64_t in_errors;       // UDP InErrors of the host (includes RcvbufErrors)
+    };
+
+    // serialized drops, the last block of a report when CAP_HOST_DROPS was agreed
+    #define HOST_DROPS_SIZE (4 * sizeof(int64_t))
+
+    /**
+     * @brief Probes the reflector sent to the meter during a round (reverse direction)
+     */
+    struct reverse_stats_t
+    {
+        int64_t sent;          // probes that left the reflector
+        int64_t achieved_rate; // packets/second its pacer achieved
+        int64_t gap_jitter;    // ns, standard deviation of the gaps between the sends
+    };
+
+    // serialized reverse counters, they follow the host drops when CAP_REVERSE was agreed
+    #define REVERSE_STATS_SIZE (3 * sizeof(int64_t))
+
+    // largest round report: counters, dispersion vector, timeline, host drops & reverse counters
+    #define ROUND_REPORT_MAX_SIZE (ROUND_REPORT_SIZE + DISPERSION_MAX_SIZE + TIMELINE_MAX_SIZE + HOST_DROPS_SIZE + REVERSE_STATS_SIZE)
+
+    // counters of 'after' less those of 'before'
+    host_drops_t host_drops_delta(const host_drops_t& after, const host_drops_t& before);
+
+    // (de)serialization in network byte order, 'buffer' holds HOST_DROPS_SIZE bytes
+    void host_drops_write(char* buffer, const host_drops_t& drops);
+    void host_drops_read(const char* buffer, host_drops_t& drops);
+
+    // finds the host drops behind the dispersion vector & timeline of a report of 'length' bytes,
+    // false when the report has none
+    bool report_host_drops(const char* buffer, size_t length, host_drops_t& drops);
+
+    // (de)serialization in network byte order, 'buffer' holds REVERSE_STATS_SIZE bytes
+    void reverse_stats_write(char* buffer, const reverse_stats_t& stats);
+    void reverse_stats_read(const char* buffer, reverse_stats_t& stats);
+
+    // finds the reverse counters behind the host drops of a report of 'length' bytes, false when it has none
+    bool report_reverse_stats(const char* buffer, size_t length, reverse_stats_t& stats);
+
+
+    /**
+     * @brief Sliding bitmap of sequence numbers seen in one stream
+     * 
+     * @desc The window follows the highest sequence number seen, probes older
+     * than the window can not be checked for duplicates anymore and are counted
+     * as reordered.
+     */
+    class SequenceTracker
+    {
+        private:
+            static const unsigned WINDOW_BITS = 8192;
+            static const unsigned WINDOW_WORDS = WINDOW_BITS / 64;
+
+            uint64_t window[WINDOW_WORDS];
+            uint64_t highest;
+            bool started;
+
+            int64_t received;
+            int64_t reordered;
+            int64_t duplicates;
+            int64_t late;
+
+            inline bool test_and_set(uint64_t sequence);
+            inline void clear(uint64_t sequence);
+
+        public:
+            SequenceTracker() { reset(); }
+
+            // forget everything, new round begins
+            void reset();
+
+            // account one probe, 'late' when it arrived after the round window, false for a duplicate
+            bool track(uint64_t sequence, bool is_late);
+
+            // adds counters of this stream to the report
+            void report(round_report_t& report);
+    };
+
+#endif // IPK_PROBE_H_
@@ -0,0 +1,379 @@
+/**
+ *  @file       ipk-rate.cc
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Rate search strategies implementation.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "ipk-rate.h"
+
+// gains of the PID controller, the error is the loss distance from the target normalized to -1..1
+#define PID_KP 0.5
+#define PID_KI 0.1
+#define PID_KD 0.1
+
+// bound of the integral term (anti-windup)
+#define PID_INTEGRAL_MAX 5.0
+
+// the PID rate changes at most by these factors per round
+#define PID_FACTOR_MIN 0.5
+#define PID_FACTOR_MAX 2.0
+
+// every overshoot (the error changes sign) halves the gains, down to this share
+#define PID_GAIN_MIN 0.05
+
+// rounds the PID rate has to stay within RATE_TOLERANCE to count as converged
+#define PID_SETTLED_ROUNDS 2
+
+
+/**
+ * @brief Creates a strategy starting at 'initial_rate'
+ * 
+ * @param max_rate highest rate the strategy may ask for
+ * @param initial_rate rate of the first round
+ */
+RateStrategy::RateStrategy(long long max_rate, long long initial_rate)
+  : max_rate {std::max(max_rate, MIN_RATE)},
+    rate {0},
+    best_rate {0},
+    is_converged {false}
+{
+  rate = clamp(initial_rate);
+}
+
+
+/**
+ * @brief Takes the outcome of a round and picks the rate of the next one
+ * 
+ * @param feedback what was sent & received in the round
+ * @return rate of the next round (packets/second)
+ */
+long long RateStrategy::next(const rate_feedback_t& feedback)
+{
+  if (feedback.sent > 0 && loss(feedback) <= LOSS_THRESHOLD)
+    best_rate = std::max(best_rate, std::min(feedback.rate, static_cast<long long>(feedback.achieved_rate)));
+
+  rate = search(feedback);
+  return rate;
+}
+
+
+/**
+ * @brief Share of the probes of the round that did not make it (0..1)
+ */
+double RateStrategy::loss(const rate_feedback_t& feedback)
+{
+  if (feedback.sent <= 0)
+    return 0.0;
+
+  return std::max(0.0, 1.0 - feedback.received / static_cast<double>(feedback.sent));
+}
+
+
+/**
+ * @brief Whether the sender fell behind the requested rate
+ * 
+ * @desc The strategies have to work with the rate that was really on the
+ * wire, going above what the sender manages tells nothing about the path.
+ */
+bool RateStrategy::sender_limited(const rate_feedback_t& feedback)
+{
+  return feedback.achieved_rate < SENDER_LIMIT_RATIO * feedback.rate;
+}
+
+
+/**
+ * @brief Rounds 'value' into MIN_RATE..max_rate
+ */
+long long RateStrategy::clamp(double value) const
+{
+  return std::min(max_rate, std::max(MIN_RATE, std::llround(value)));
+}
+
+
+/**
+ * @brief Creates a strategy
+ * 
+ * @param algorithm algorithm of the search
+ * @param max_rate highest rate the search may ask for
+ * @return new strategy
+ */
+std::unique_ptr<RateStrategy> RateStrategy::create(algorithm_t algorithm, long long max_rate)
+{
+  switch (algorithm)
+  {
+    case EXPONENTIAL:
+      return std::unique_ptr<RateStrategy>(new ExponentialStrategy(max_rate));
+    case PACKET_TRAIN:
+      return std::unique_ptr<RateStrategy>(new PacketTrainStrategy(max_rate));
+    case PID:
+      return std::unique_ptr<RateStrategy>(new PidStrategy(max_rate));
+    case BISECTION:
+    default:
+      return std::unique_ptr<RateStrategy>(new BisectionStrategy(max_rate));
+  }
+}
+
+
+/**
+ * @brief Parses the name of an algorithm
+ * 
+ * @param name "bisect", "exp", "train" or "pid"
+ * @param algorithm output
+ * @return false on unknown name
+ */
+bool RateStrategy::parse_algorithm(const std::string& name, algorithm_t& algorithm)
+{
+  if (name == "bisect")
+    algorithm = BISECTION;
+  else if (name == "exp")
+    algorithm = EXPONENTIAL;
+  else if (name == "train")
+    algorithm = PACKET_TRAIN;
+  else if (name == "pid")
+    algorithm = PID;
+  else
+    return false;
+
+  return true;
+}
+
+
+const char* RateStrategy::algorithm_name(algorithm_t algorithm)
+{
+  switch (algorithm)
+  {
+    case EXPONENTIAL:  return "exponential + binary search";
+    case PACKET_TRAIN: return "packet train dispersion";
+    case PID:          return "loss-threshold PID";
+    case BISECTION:
+    default:           return "bisection";
+  }
+}
+
+
+/*****************************************************************************/
+
+BisectionStrategy::BisectionStrategy(long long max_rate)
+  : RateStrategy(max_rate, INITIAL_RATE),
+    min {1000},
+    cur {INITIAL_RATE},
+    max {5000}
+{}
+
+
+/**
+ * @brief The original controller of the meter
+ * 
+ * @desc Lossless rounds move 'min' up to the current rate and let 'max' grow
+ * by the golden ratio, a loss moves 'max' down and 'min' by the loss ratio.
+ * Converged once 'min' and 'max' are RATE_TOLERANCE apart.
+ */
+long long BisectionStrategy::search(const rate_feedback_t& feedback)
+{
+  // continue from the achieved rate when the sender could not keep up
+  if (feedback.achieved_rate < cur)
+    cur = std::max(min, static_cast<long long>(feedback.achieved_rate));
+
+  if (loss(feedback) > LOSS_THRESHOLD)
+  {
+    max = cur;
+    cur = (min + cur) / 2;
+
+    min = std::max(MIN_RATE, static_cast<long long>(min * (1.0 - loss(feedback)))); // percentage of loss
+  }
+  else // no packets lost, increase the rate
+  {
+    min = cur;
+    cur = (cur + max) / 2;
+
+    if (sender_limited(feedback)) // no point in going further above what the sender managed
+      max = std::max(min, feedback.rate);
+    else
+      max = std::min(max_rate, static_cast<long long>(max * 1.618)); //:)
+
+    cur = std::min(cur, max);
+  }
+
+  is_converged = max - min <= RATE_TOLERANCE * max;
+  return clamp(cur);
+}
+
+
+/*****************************************************************************/
+
+ExponentialStrategy::ExponentialStrategy(long long max_rate)
+  : RateStrategy(max_rate, INITIAL_RATE),
+    probing {true},
+    low {MIN_RATE},
+    high {max_rate}
+{}
+
+
+/**
+ * @brief Doubling, then binary search
+ * 
+ * @desc Once converged the rate stays at the highest lossless one, a loss
+ * there halves the lower bound and the binary search goes on.
+ */
+long long ExponentialStrategy::search(const rate_feedback_t& feedback)
+{
+  bool lost = loss(feedback) > LOSS_THRESHOLD;
+  bool limited = sender_limited(feedback);
+  long long on_wire = limited ? clamp(feedback.achieved_rate) : feedback.rate;
+
+  if (probing)
+  {
+    if (!lost && !limited && feedback.rate < max_rate)
+    {
+      low = feedback.rate;
+      return clamp(feedback.rate * 2.0);
+    }
+
+    // the step that failed brackets the search (the sender or the ceiling when nothing was lost)
+    probing = false;
+    if (lost)
+      high = feedback.rate;
+    else
+      low = high = on_wire;
+  }
+  else if (lost)
+  {
+    if (feedback.rate <= low) // the path got worse
+      low = clamp(feedback.rate / 2.0);
+    high = std::max(low, feedback.rate);
+  }
+  else
+  {
+    low = std::max(low, on_wire);
+    high = std::max(high, low);
+  }
+
+  is_converged = high - low <= RATE_TOLERANCE * high;
+  return clamp(is_converged ? low : (low + high) / 2.0);
+}
+
+
+/*****************************************************************************/
+
+PacketTrainStrategy::PacketTrainStrategy(long long max_rate)
+  : RateStrategy(max_rate, max_rate),
+    phase {TRAIN},
+    estimate {0}
+{}
+
+
+/**
+ * @brief The train goes out at the full rate, the verification paced, tracking for whole rounds
+ */
+long PacketTrainStrategy::train_length() const
+{
+  switch (phase)
+  {
+    case TRAIN:  return TRAIN_PROBES;
+    case VERIFY: return VERIFY_PROBES;
+    default:     return 0;
+  }
+}
+
+
+/**
+ * @brief Estimate from the train, verification, tracking
+ */
+long long PacketTrainStrategy::search(const rate_feedback_t& feedback)
+{
+  switch (phase)
+  {
+    case TRAIN:
+      // the arrival rate can not be above what was sent, without it (train lost) start at half of that
+      if (feedback.arrival_rate > 0.0)
+        estimate = clamp(std::min(feedback.arrival_rate, feedback.achieved_rate));
+      else
+        estimate = clamp(feedback.achieved_rate / 2.0);
+
+      phase = VERIFY;
+      return clamp(estimate * (1.0 - RATE_TOLERANCE));
+
+    case VERIFY:
+      if (loss(feedback) <= LOSS_THRESHOLD)
+      {
+        phase = TRACK;
+        is_converged = true;
+        return feedback.rate;
+      }
+
+      // shrink by what did not make it through
+      return clamp(feedback.rate * (1.0 - loss(feedback)) * (1.0 - RATE_TOLERANCE));
+
+    case TRACK:
+    default:
+      if (loss(feedback) <= LOSS_THRESHOLD)
+        return feedback.rate;
+
+      // the path changed, estimate again
+      phase = TRAIN;
+      is_converged = false;
+      return max_rate;
+  }
+}
+
+
+/*****************************************************************************/
+
+PidStrategy::PidStrategy(long long max_rate)
+  : RateStrategy(max_rate, INITIAL_RATE),
+    integral {0.0},
+    last_error {0.0},
+    gain {1.0},
+    settled_rounds {0}
+{}
+
+
+/**
+ * @brief One step of the controller
+ * 
+ * @desc Loss is close to a yes/no signal, so the full gains would swing
+ * around the threshold for ever. Every overshoot halves them and clears the
+ * integral, the steps get finer the closer the rate is. A sender limited round
+ * without loss holds the rate at the achieved one and does not wind the
+ * integral up, the path was not the limit there.
+ */
+long long PidStrategy::search(const rate_feedback_t& feedback)
+{
+  const double target = LOSS_THRESHOLD / 2;
+
+  double error = std::max(-1.0, std::min(1.0, (target - loss(feedback)) / target));
+  bool limited = sender_limited(feedback) && error > 0.0;
+
+  if (error * last_error < 0.0)
+  {
+    gain = std::max(PID_GAIN_MIN, gain / 2);
+    integral = 0.0;
+  }
+
+  if (!limited)
+    integral = std::max(-PID_INTEGRAL_MAX, std::min(PID_INTEGRAL_MAX, integral + error));
+
+  double derivative = error - last_error;
+  last_error = error;
+
+  double factor = 1.0;
+  if (!limited)
+    factor = std::max(PID_FACTOR_MIN, std::min(PID_FACTOR_MAX, 1.0 + gain * (PID_KP * error + PID_KI * integral + PID_KD * derivative)));
+
+  double base = limited ? feedback.achieved_rate : feedback.rate;
+  long long next_rate = clamp(base * factor);
+
+  if (std::abs(next_rate - feedback.rate) <= RATE_TOLERANCE * feedback.rate)
+    settled_rounds++;
+  else
+    settled_rounds = 0;
+
+  is_converged = settled_rounds >= PID_SETTLED_ROUNDS;
+  return next_rate;
+}
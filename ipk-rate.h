@@ -0,0 +1,213 @@
+/**
+ *  @file       ipk-rate.h
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Rate search strategies.
+ *  
+ *  @section Description
+ *  
+ *  The meter looks for the highest rate the path carries without (noticeable)
+ *  loss. After every round the strategy gets what was sent, what the reflector
+ *  received and how fast it arrived, and picks the rate of the next round.
+ *  
+ *  * bisect - the original min/cur/max bisection with golden-ratio expansion
+ *  * exp    - doubles the rate until loss, then binary search in the last step
+ *  * train  - estimates the available bandwidth from the dispersion of one
+ *             back-to-back train (pathload/pathChirp style), then verifies it
+ *  * pid    - keeps the loss at a target with a PID controller
+ *  
+ *  A strategy is converged once its search settled on a rate, the meter
+ *  reports how long that took.
+ */
+
+#ifndef IPK_RATE_H_
+#define IPK_RATE_H_
+
+    #include <stdint.h>
+    #include <memory>
+    #include <string>
+
+    // ceiling of every search unless '-R' says otherwise (localhost keeps going up while the speed does not)
+    #define DEFAULT_MAX_RATE 40000000LL
+
+    // lowest rate a strategy goes down to (packets/second)
+    #define MIN_RATE 100LL
+
+    // rate of the first round
+    #define INITIAL_RATE 3000LL
+
+    // loss accepted as "no loss"
+    #define LOSS_THRESHOLD 0.01
+
+    // searches stop once the bounds are this close (relative to the upper one)
+    #define RATE_TOLERANCE 0.05
+
+    // the round counts as sender limited below this share of the requested rate
+    #define SENDER_LIMIT_RATIO 0.9
+
+    // probes per stream in one dispersion train, and in the paced train verifying its estimate
+    #define TRAIN_PROBES 256
+    #define VERIFY_PROBES 1024
+
+    /**
+     * @brief Outcome of one round, input of the strategies
+     */
+    struct rate_feedback_t
+    {
+        long long rate;       // requested packets/second
+        double achieved_rate; // packets/second really sent
+        double duration;      // seconds the round was sending
+        long sent;
+        long received;        // including late probes
+        double arrival_rate;  // packets/second at the reflector (dispersion), 0 when unknown
+    };
+
+    /**
+     * @brief When and where a search settled
+     */
+    struct rate_convergence_t
+    {
+        bool converged;
+        double time_ms; // from the start of the measurement
+        int rounds;
+        long long rate;
+    };
+
+    /**
+     * @brief Rate search algorithm, base of all strategies
+     */
+    class RateStrategy
+    {
+        public:
+
+            enum algorithm_t
+            {
+                BISECTION    = 0, // min/cur/max bisection
+                EXPONENTIAL  = 1, // exponential probing, then binary search
+                PACKET_TRAIN = 2, // dispersion of a back-to-back train
+                PID          = 3  // loss-threshold PID controller
+            };
+
+        protected:
+            long long max_rate;
+            long long rate;       // rate of the next round
+            long long best_rate;  // highest rate that went through without loss
+            bool is_converged;
+
+            // picks the rate of the next round, sets 'is_converged'
+            virtual long long search(const rate_feedback_t& feedback) = 0;
+
+            // share of the probes lost in the round
+            static double loss(const rate_feedback_t& feedback);
+
+            // the sender could not reach the requested rate
+            static bool sender_limited(const rate_feedback_t& feedback);
+
+            // 'value' within MIN_RATE..max_rate
+            long long clamp(double value) const;
+
+        public:
+            RateStrategy(long long max_rate, long long initial_rate);
+            virtual ~RateStrategy() {}
+
+            // takes the outcome of the last round, returns the rate of the next one
+            long long next(const rate_feedback_t& feedback);
+
+            // probes per stream of the next round, 0 = send for the whole round
+            virtual long train_length() const { return 0; }
+
+            inline long long get_rate() const { return rate; }
+            inline long long get_best_rate() const { return best_rate; }
+            inline bool converged() const { return is_converged; }
+
+            // new strategy of the given algorithm, searching up to 'max_rate'
+            static std::unique_ptr<RateStrategy> create(algorithm_t algorithm, long long max_rate);
+
+            // "bisect" / "exp" / "train" / "pid" -> algorithm, returns false on unknown name
+            static bool parse_algorithm(const std::string& name, algorithm_t& algorithm);
+            static const char* algorithm_name(algorithm_t algorithm);
+    };
+
+
+    /**
+     * @brief The original controller: bisection between min & max, max grows by the golden ratio
+     */
+    class BisectionStrategy : public RateStrategy
+    {
+        private:
+            long long min;
+            long long cur;
+            long long max;
+
+        protected:
+            long long search(const rate_feedback_t& feedback) override;
+
+        public:
+            explicit BisectionStrategy(long long max_rate);
+    };
+
+
+    /**
+     * @brief Doubles the rate until loss (or the sender limit), then binary search between the last two rates
+     */
+    class ExponentialStrategy : public RateStrategy
+    {
+        private:
+            bool probing; // still doubling
+            long long low;  // highest rate without loss
+            long long high; // lowest rate with loss
+
+        protected:
+            long long search(const rate_feedback_t& feedback) override;
+
+        public:
+            explicit ExponentialStrategy(long long max_rate);
+    };
+
+
+    /**
+     * @brief Available bandwidth from the dispersion of a back-to-back train
+     * 
+     * @desc The train leaves at the line rate of the sender, the bottleneck
+     * spreads it out, so the rate it arrives at the reflector is the most
+     * the path passes. The estimate is verified by a paced train at a little
+     * less than that, every loss shrinks it. A converged search keeps sending
+     * whole rounds at the found rate, loss there starts a new train.
+     */
+    class PacketTrainStrategy : public RateStrategy
+    {
+        private:
+            enum phase_t { TRAIN, VERIFY, TRACK };
+            phase_t phase;
+            long long estimate;
+
+        protected:
+            long long search(const rate_feedback_t& feedback) override;
+
+        public:
+            explicit PacketTrainStrategy(long long max_rate);
+            long train_length() const override;
+    };
+
+
+    /**
+     * @brief Keeps the loss at LOSS_THRESHOLD / 2, the rate changes by a factor given by a PID controller
+     */
+    class PidStrategy : public RateStrategy
+    {
+        private:
+            double integral;
+            double last_error;
+            double gain;        // scales the PID terms, halved on overshoot
+            int settled_rounds; // consecutive rounds with a factor close to 1
+
+        protected:
+            long long search(const rate_feedback_t& feedback) override;
+
+        public:
+            explicit PidStrategy(long long max_rate);
+    };
+
+#endif // IPK_RATE_H_
@@ -0,0 +1,253 @@
+/**
+ *  @file       ipk-sched.cc
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Thread placement & scheduling implementation.
+ */
+
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "ipk-clock.h"
+#include "ipk-probe.h"
+#include "ipk-sched.h"
+
+
+/**
+ * @brief Pins a thread to one CPU core (modulo number of cores)
+ * 
+ * @param thread thread to be pinned
+ * @param core index of the core
+ * @return true when the affinity was set
+ */
+bool pin_thread_to_core(pthread_t thread, unsigned core)
+{
+  unsigned cores = std::thread::hardware_concurrency();
+  if (cores == 0)
+    return false;
+
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(core % cores, &cpu_set);
+
+  return pthread_setaffinity_np(thread, sizeof(cpu_set), &cpu_set) == 0;
+}
+
+
+/**
+ * @brief Pins one thread of a role
+ * 
+ * @param thread thread to be pinned
+ * @param cores cores of the role, the threads take them round robin
+ * @param index index of the thread within its role
+ * @return true when the affinity was set
+ */
+bool pin_thread(pthread_t thread, const std::vector<unsigned>& cores, unsigned index)
+{
+  return pin_thread_to_core(thread, cores.empty() ? index : cores[index % cores.size()]);
+}
+
+
+/**
+ * @brief Moves a thread to the real-time FIFO class
+ * 
+ * @desc A FIFO thread runs until it blocks or yields, nothing of normal
+ * priority preempts it on its core. The kernel still leaves the other tasks
+ * a share of the time (sched_rt_runtime_us), so a spinning sender can not
+ * lock the machine up.
+ * @param thread thread to be scheduled
+ * @param priority 1 (lowest) .. 99
+ * @return false when not permitted
+ */
+bool set_fifo_priority(pthread_t thread, int priority)
+{
+  struct sched_param param {};
+  param.sched_priority = priority;
+  return pthread_setschedparam(thread, SCHED_FIFO, &param) == 0;
+}
+
+
+/**
+ * @brief Locks all pages of the process in memory
+ * 
+ * @desc Pages mapped later (the frame arena of a session, new thread stacks)
+ * are locked as they are faulted in, so the packet path never waits for a
+ * page to come back from swap.
+ * @return false when not permitted
+ */
+bool lock_memory()
+{
+  return mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+}
+
+
+/**
+ * @brief Parses a list of cores
+ * 
+ * @param spec comma separated cores and ranges, e.g. "2,4-7"
+ * @param cores output, the cores in the given order
+ * @return false when malformed
+ */
+bool sched_parse_cores(const std::string& spec, std::vector<unsigned>& cores)
+{
+  cores.clear();
+
+  size_t start = 0;
+  while (start <= spec.size())
+  {
+    size_t end = spec.find(',', start);
+    if (end == std::string::npos)
+      end = spec.size();
+    std::string item = spec.substr(start, end - start);
+
+    const char* text = item.c_str();
+    char* rest = nullptr;
+    long first = std::strtol(text, &rest, 10);
+    if (rest == text || first < 0)
+      return false;
+
+    long last = first;
+    if (*rest == '-')
+    {
+      const char* range = rest + 1;
+      last = std::strtol(range, &rest, 10);
+      if (rest == range || last < first)
+        return false;
+    }
+    if (*rest != '\0')
+      return false;
+
+    for (long core = first; core <= last; core++)
+      cores.push_back(static_cast<unsigned>(core));
+
+    start = end + 1;
+  }
+
+  return !cores.empty();
+}
+
+
+/**
+ * @brief Parses one '-A' option
+ * 
+ * @param spec "role=cores", role send, recv or control
+ * @param cores output, the cores of the role are replaced
+ * @return false when malformed
+ */
+bool sched_parse_affinity(const std::string& spec, thread_cores_t& cores)
+{
+  size_t equals = spec.find('=');
+  if (equals == std::string::npos)
+    return false;
+
+  std::string role = spec.substr(0, equals);
+  for (int i = 0; i < THREAD_ROLES; i++)
+  {
+    if (role == thread_role_name(static_cast<thread_role_t>(i)))
+      return sched_parse_cores(spec.substr(equals + 1), cores.roles[i]);
+  }
+  return false;
+}
+
+
+/**
+ * @brief Cores for printing
+ */
+std::string sched_cores_name(const std::vector<unsigned>& cores)
+{
+  if (cores.empty())
+    return "-";
+
+  std::string name;
+  for (unsigned core : cores)
+    name += (name.empty() ? "" : ",") + std::to_string(core);
+  return name;
+}
+
+
+/**
+ * @brief Name of a role as '-A' takes it
+ */
+const char* thread_role_name(thread_role_t role)
+{
+  switch (role)
+  {
+    case SEND_THREAD:
+      return "send";
+    case RECV_THREAD:
+      return "recv";
+    case CONTROL_THREAD:
+      return "control";
+    default:
+      return "unknown";
+  }
+}
+
+
+/**
+ * @brief Paces a local loop under one scheduling setting
+ * 
+ * @desc The loop does what a sender thread does between its syscalls: waits
+ * for the pacer, stamps the frames of the batch and accounts them. Without
+ * the sends the remaining rate error and gap jitter are those of the clock,
+ * the scheduler and the memory, i.e. what the setting can improve.
+ * @param setting core, priority & memory locking of the run
+ * @param packet_rate paced rate in packets/second
+ * @param batch frames stamped per pacer release
+ * @param mode pacing mode of the run
+ * @param duration_ms length of the run
+ * @return the pacing achieved, 'applied' false when the setting was not permitted
+ */
+calibration_t sched_calibrate(const sched_setting_t& setting, double packet_rate, unsigned batch,
+                              Pacer::pacing_mode_t mode, unsigned duration_ms)
+{
+  calibration_t result {setting, true, {}};
+
+  if (setting.lock_memory && !lock_memory())
+    result.applied = false;
+
+  std::vector<char> frames(batch * PROBE_HEADER_SIZE);
+  probe_header_t header {PROBE_MAGIC, 0, 0, 0, PROBE_DATA, 0, 0};
+  for (unsigned i = 0; i < batch; i++)
+    probe_format(&frames[i * PROBE_HEADER_SIZE], PROBE_HEADER_SIZE, header);
+
+  // set up before the thread starts pacing, it waits for the go
+  std::atomic<bool> go {false};
+  std::thread thread([&]() {
+    while (!go.load())
+      std::this_thread::yield();
+
+    Pacer pacer(packet_rate, batch, mode);
+    uint64_t end = monotonic_ns() + duration_ms * NSEC_PER_MSEC;
+    uint64_t sequence = 0;
+
+    pacer.start();
+    while (monotonic_ns() < end)
+    {
+      unsigned count = pacer.acquire(batch);
+      uint64_t now = realtime_ns();
+      for (unsigned i = 0; i < count; i++)
+        probe_patch(&frames[i * PROBE_HEADER_SIZE], 0, sequence++, now);
+      pacer.record(count);
+    }
+    result.pacing = pacer.report();
+  });
+
+  if (setting.core >= 0 && !pin_thread_to_core(thread.native_handle(), setting.core))
+    result.applied = false;
+  if (setting.fifo_priority > 0 && !set_fifo_priority(thread.native_handle(), setting.fifo_priority))
+    result.applied = false;
+
+  go.store(true);
+  thread.join();
+
+  if (setting.lock_memory)
+    munlockall();
+
+  return result;
+}
@@ -0,0 +1,109 @@
+/**
+ *  @file       ipk-sched.h
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Thread placement & scheduling.
+ *  
+ *  @section Description
+ *  
+ *  The pacer can only be as even as the thread running it. A sender thread
+ *  migrated to another core, preempted by a batch job or stalled on a page
+ *  fault sends the probes it owes in a burst afterwards, which shows up as
+ *  rate error and gap jitter of the round (and as queueing on the path).
+ *  
+ *  The send, receive and control threads can be pinned to given cores
+ *  ('-A role=cores'), run as SCHED_FIFO ('-F priority') and the whole process
+ *  locked in memory ('-L'). The calibration ('-K') paces a local loop without
+ *  sending under each of the settings, so their effect on the pacing can be
+ *  told apart from what the network does.
+ */
+
+#ifndef IPK_SCHED_H_
+#define IPK_SCHED_H_
+
+    #include <pthread.h>
+    #include <string>
+    #include <vector>
+
+    #include "ipk-pacer.h"
+
+    // FIFO priority the calibration tries when '-F' was not passed
+    #define SCHED_DEFAULT_PRIORITY 50
+
+    // highest rate and length of one calibration run
+    #define CALIBRATION_MAX_RATE 100000
+    #define CALIBRATION_MS 250
+
+    /**
+     * @brief Threads that may be placed on their own cores
+     */
+    enum thread_role_t
+    {
+        SEND_THREAD    = 0, // meter senders
+        RECV_THREAD    = 1, // reflector workers
+        CONTROL_THREAD = 2, // RTT probes & control channel of the meter, control loop of the reflector
+        THREAD_ROLES   = 3
+    };
+
+    /**
+     * @brief Cores given for every role by '-A', empty when not given
+     */
+    struct thread_cores_t
+    {
+        std::vector<unsigned> roles[THREAD_ROLES];
+
+        inline const std::vector<unsigned>& of(thread_role_t role) const { return roles[role]; }
+    };
+
+    /**
+     * @brief Scheduling of one calibration run
+     */
+    struct sched_setting_t
+    {
+        std::string name;
+        int core;          // -1 = not pinned
+        int fifo_priority; // 0 = normal scheduling
+        bool lock_memory;
+    };
+
+    /**
+     * @brief Pacing achieved under one setting
+     */
+    struct calibration_t
+    {
+        sched_setting_t setting;
+        bool applied;          // false when the setting was not permitted
+        pacer_stats_t pacing;
+    };
+
+    // pins a thread to one CPU core (modulo number of cores), true when the affinity was set
+    bool pin_thread_to_core(pthread_t thread, unsigned core);
+
+    // pins the 'index'-th thread of a role to its core out of 'cores' (round robin),
+    // an empty list pins it to core 'index'
+    bool pin_thread(pthread_t thread, const std::vector<unsigned>& cores, unsigned index);
+
+    // SCHED_FIFO at 'priority' (1..99), false when not permitted (no CAP_SYS_NICE / RLIMIT_RTPRIO)
+    bool set_fifo_priority(pthread_t thread, int priority);
+
+    // mlockall() of the current and future pages, false when not permitted (RLIMIT_MEMLOCK)
+    bool lock_memory();
+
+    // "2,4-7" -> cores, false when malformed
+    bool sched_parse_cores(const std::string& spec, std::vector<unsigned>& cores);
+
+    // "send|recv|control=cores" of '-A' -> 'cores', false when malformed
+    bool sched_parse_affinity(const std::string& spec, thread_cores_t& cores);
+
+    // "2,4,5" for printing, "-" when empty
+    std::string sched_cores_name(const std::vector<unsigned>& cores);
+    const char* thread_role_name(thread_role_t role);
+
+    // paces a local loop (frames are stamped, nothing is sent) at 'packet_rate' for 'duration_ms'
+    // in a new thread scheduled by 'setting', the process stays unlocked afterwards
+    calibration_t sched_calibrate(const sched_setting_t& setting, double packet_rate, unsigned batch,
+                                  Pacer::pacing_mode_t mode, unsigned duration_ms);
+
+#endif // IPK_SCHED_H_
@@ -0,0 +1,504 @@
+/**
+ *  @file       ipk-session.cc
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Reflector sessions implementation.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "ipk-session.h"
+#include "ipk-clock.h"
+
+
+/**
+ * @brief Creates the state of a new measurement
+ * 
+ * @param source address of the meter control socket (sender of the hello)
+ * @param id session id chosen by the meter
+ * @param hello parameters asked for by the meter
+ * @param ack parameters agreed to, the number of streams is taken from here
+ * @param workers number of receive workers, each gets its own slot
+ */
+Session::Session(const struct sockaddr_storage& source, uint32_t id, const control_hello_t& hello, const control_ack_t& ack,
+                 unsigned workers)
+  : key {make_key(source, id)},
+    address (source),
+    session_id {id},
+    params (hello),
+    agreement (ack),
+    round {0},
+    ending {false},
+    last_seen_ns {monotonic_ns()},
+    last_probe_ns {0},
+    closed {false},
+    round_end_ns {0},
+    reported {false},
+    report_round {0},
+    last_report {},
+    drops_baseline {},
+    reverse_started {false},
+    reverse_round {0},
+    reverse_running {false},
+    reverse_stats {}
+{
+  Timeline timeline(agreement.interval_us * NSEC_PER_USEC, TIMELINE_MAX_BINS);
+  last_report.timeline = timeline;
+
+  for (unsigned i = 0; i < workers; i++)
+  {
+    slots.emplace_back(new worker_slot_t());
+    slots.back()->trackers.resize(agreement.streams);
+    slots.back()->delays.resize(agreement.streams);
+    slots.back()->timeline = timeline;
+    slots.back()->stale = 0;
+    slots.back()->invalid = 0;
+  }
+}
+
+
+/**
+ * @brief Waits for the reverse sender, it works on the session till the end of its round
+ */
+Session::~Session()
+{
+  if (reverse_sender.joinable())
+    reverse_sender.join();
+}
+
+
+/**
+ * @brief Key of a measurement in the session table
+ * 
+ * @desc The streams of one meter come from different source ports, so only
+ * the host address takes part, the session id tells measurements of the same
+ * host apart.
+ * @param source address the datagram came from (IPv4 or IPv6)
+ * @param id session id of the datagram
+ * @return the key
+ */
+session_key_t Session::make_key(const struct sockaddr_storage& source, uint32_t id)
+{
+  session_key_t key {};
+  key.id = id;
+
+  if (source.ss_family == AF_INET6)
+    std::memcpy(key.address, &reinterpret_cast<const struct sockaddr_in6*>(&source)->sin6_addr, sizeof(key.address));
+  else
+  {
+    // ::ffff:a.b.c.d
+    key.address[10] = key.address[11] = 0xff;
+    std::memcpy(key.address + 12, &reinterpret_cast<const struct sockaddr_in*>(&source)->sin_addr, 4);
+  }
+  return key;
+}
+
+
+/**
+ * @brief Compares host address & session id
+ */
+bool session_key_t::operator==(const session_key_t& other) const
+{
+  return id == other.id && std::memcmp(address, other.address, sizeof(address)) == 0;
+}
+
+
+/**
+ * @brief FNV-1a of the key, the per-probe lookups hash it
+ */
+size_t session_key_hash::operator()(const session_key_t& key) const
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (uint8_t byte : key.address)
+    hash = (hash ^ byte) * 1099511628211ULL;
+  for (int shift = 0; shift < 32; shift += 8)
+    hash = (hash ^ ((key.id >> shift) & 0xff)) * 1099511628211ULL;
+  return hash;
+}
+
+
+/**
+ * @brief Tracks one data probe
+ * 
+ * @desc Only the slot of 'worker' is locked, nobody else takes that lock
+ * during the round, so it is never contended on the per-probe path.
+ * @param worker index of the receiving worker
+ * @param header parsed probe header
+ * @param length datagram length
+ * @param rx_timestamp receive time (CLOCK_REALTIME ns)
+ * @param now_ns CLOCK_MONOTONIC time of the receive
+ */
+void Session::track(unsigned worker, const probe_header_t& header, size_t length, uint64_t rx_timestamp, uint64_t now_ns)
+{
+  worker_slot_t& slot = *slots[worker % slots.size()];
+  std::lock_guard<std::mutex> guard(slot.lock);
+
+  touch(now_ns);
+
+  // 'ending' first, a round reported in between then shows up as stale, not as a current one
+  bool is_late = ending.load(std::memory_order_relaxed);
+  uint32_t current = round.load(std::memory_order_relaxed);
+
+  if (length != params.probe_size || header.stream >= agreement.streams)
+    slot.invalid++;
+  else if (header.round != current || ((header.flags & ~PROBE_ECHO) != PROBE_DATA && header.flags != PROBE_TRAIN))
+    slot.stale++;
+  else
+  {
+    slot.trackers[header.stream].track(header.sequence, is_late);
+    slot.delays[header.stream].add(header.tx_timestamp, rx_timestamp);
+    slot.timeline.add(header.tx_timestamp);
+    last_probe_ns.store(now_ns, std::memory_order_relaxed);
+
+    // trains come from a single stream, arrivals of the first DISPERSION_MAX_PROBES are kept
+    if (header.flags == PROBE_TRAIN && slot.arrivals.size() < DISPERSION_MAX_PROBES)
+      slot.arrivals.push_back({static_cast<uint32_t>(header.sequence), rx_timestamp});
+  }
+}
+
+
+/**
+ * @brief The meter finished sending a round
+ * 
+ * @desc Probes of the round arriving from now on are counted as late, the
+ * report is built once the line stays quiet for SESSION_ROUND_GRACE_MS.
+ * @param ended_round round the meter sent
+ * @param now_ns CLOCK_MONOTONIC time
+ * @return false when 'ended_round' is not the current round
+ */
+bool Session::end_round(uint32_t ended_round, uint64_t now_ns)
+{
+  std::lock_guard<std::mutex> guard(state_lock);
+  touch(now_ns);
+
+  if (ended_round != round.load() || finished())
+    return false;
+
+  if (!ending.load())
+  {
+    round_end_ns = now_ns;
+    ending.store(true);
+  }
+  return true;
+}
+
+
+/**
+ * @brief Report of a round reported before
+ * 
+ * @param reported_round round the meter asks for
+ * @param report output, the report sent back then
+ * @return false when that round was not the last one reported
+ */
+bool Session::get_report(uint32_t reported_round, session_report_t& report)
+{
+  std::lock_guard<std::mutex> guard(state_lock);
+
+  if (!reported || reported_round != report_round)
+    return false;
+
+  report = last_report;
+  return true;
+}
+
+
+/**
+ * @brief Whether the report of the ended round can be built
+ * 
+ * @param now_ns CLOCK_MONOTONIC time
+ */
+bool Session::report_due(uint64_t now_ns)
+{
+  if (!ending.load(std::memory_order_relaxed))
+    return false;
+
+  std::lock_guard<std::mutex> guard(state_lock);
+  uint64_t grace_ms = std::max<uint64_t>(std::min<uint64_t>(SESSION_ROUND_GRACE_MS, agreement.round_ms / 2), SESSION_ROUND_GRACE_MIN_MS);
+  uint64_t grace = grace_ms * NSEC_PER_MSEC;
+  uint64_t quiet_since = std::max(round_end_ns, last_probe_ns.load(std::memory_order_relaxed));
+
+  // the report carries what the reverse sender sent, it runs to the end of its round
+  return ending.load() && now_ns >= quiet_since + grace && !reverse_running.load();
+}
+
+
+/**
+ * @brief Sets the host drop counters the first round is measured from
+ * 
+ * @param drops host drop counters now
+ */
+void Session::start_drop_count(const host_drops_t& drops)
+{
+  std::lock_guard<std::mutex> guard(state_lock);
+  drops_baseline = drops;
+}
+
+
+/**
+ * @brief Starts sending probes back to the meter
+ * 
+ * @desc The thread of the previous round finished long ago (it runs for one
+ * round), it is joined outside of the lock it reports under.
+ * @param requested_round round the meter asked for the probes in
+ * @param sender sends the probes of the round and calls finish_reverse()
+ * @return false when the round is not the current one
+ */
+bool Session::start_reverse(uint32_t requested_round, std::function<void()> sender)
+{
+  std::thread previous;
+  {
+    std::lock_guard<std::mutex> guard(state_lock);
+
+    if (requested_round != round.load() || finished())
+      return false;
+    if (reverse_started && reverse_round == requested_round)
+      return true;
+
+    previous = std::move(reverse_sender);
+    reverse_started = true;
+    reverse_round = requested_round;
+    reverse_running.store(true);
+    reverse_sender = std::thread(sender);
+  }
+
+  if (previous.joinable())
+    previous.join();
+  return true;
+}
+
+
+/**
+ * @brief Keeps the counters of the reverse sender for the report
+ * 
+ * @param sent_round round the probes were sent in
+ * @param stats what was sent
+ */
+void Session::finish_reverse(uint32_t sent_round, const reverse_stats_t& stats)
+{
+  std::lock_guard<std::mutex> guard(state_lock);
+
+  if (sent_round == round.load())
+    reverse_stats = stats;
+  reverse_running.store(false);
+}
+
+
+/**
+ * @brief Closes the ended round and merges the slots of all workers
+ * 
+ * @desc The round number moves on first, so probes racing with the merge are
+ * counted as stale in the next round instead of being lost in a cleared slot.
+ * @param reported_round output, round the report belongs to
+ * @param drops host drop counters now, the report gets what changed since the previous one
+ * @return report of the round
+ */
+session_report_t Session::collect(uint32_t& reported_round, const host_drops_t& drops)
+{
+  std::lock_guard<std::mutex> guard(state_lock);
+
+  reported_round = round.load();
+  round.store(reported_round + 1);
+  ending.store(false);
+
+  session_report_t report {};
+  report.timeline = Timeline(agreement.interval_us * NSEC_PER_USEC, TIMELINE_MAX_BINS);
+  report.drops = host_drops_delta(drops, drops_baseline);
+  drops_baseline = drops;
+  report.reverse = reverse_stats;
+  reverse_stats = reverse_stats_t {};
+
+  for (std::unique_ptr<worker_slot_t>& slot : slots)
+  {
+    std::lock_guard<std::mutex> slot_guard(slot->lock);
+
+    for (SequenceTracker& tracker : slot->trackers)
+    {
+      tracker.report(report.counters);
+      tracker.reset();
+    }
+
+    for (DelayEstimator& delay : slot->delays)
+    {
+      round_report_add_delay(report.counters, delay);
+      delay.reset();
+    }
+
+    size_t room = DISPERSION_MAX_PROBES - std::min<size_t>(report.arrivals.size(), DISPERSION_MAX_PROBES);
+    report.arrivals.insert(report.arrivals.end(), slot->arrivals.begin(), slot->arrivals.begin() + std::min(room, slot->arrivals.size()));
+    slot->arrivals.clear();
+
+    report.timeline.merge(slot->timeline);
+    slot->timeline.reset();
+
+    report.counters.stale += slot->stale;
+    report.counters.invalid += slot->invalid;
+    slot->stale = 0;
+    slot->invalid = 0;
+  }
+
+  reported = true;
+  report_round = reported_round;
+  last_report = report;
+
+  return report;
+}
+
+
+/**
+ * @brief Whether the meter went away
+ * 
+ * @param now_ns CLOCK_MONOTONIC time
+ */
+bool Session::idle(uint64_t now_ns) const
+{
+  uint64_t last = last_seen_ns.load(std::memory_order_relaxed);
+  return now_ns > last && now_ns - last >= SESSION_IDLE_TIMEOUT_MS * NSEC_PER_MSEC;
+}
+
+
+/*****************************************************************************/
+
+/**
+ * @brief Looks a session up
+ * 
+ * @param key key made by Session::make_key()
+ * @return the session, nullptr when there is none
+ */
+std::shared_ptr<Session> SessionTable::find(const session_key_t& key)
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  auto it = sessions.find(key);
+  return it != sessions.end() ? it->second : nullptr;
+}
+
+
+/**
+ * @brief Finds the session of a hello or creates a new one
+ * 
+ * @desc A repeated hello (the acknowledgement got lost) finds the session
+ * created by the first one.
+ * @param source address the hello came from
+ * @param id session id of the hello
+ * @param hello parameters of the measurement
+ * @param ack parameters agreed to, a repeated hello gets those of the first one
+ * @param created output, true when the session is new
+ * @return the session, nullptr when MAX_SESSIONS are served already
+ */
+std::shared_ptr<Session> SessionTable::open(const struct sockaddr_storage& source, uint32_t id, const control_hello_t& hello,
+                                            const control_ack_t& ack, bool& created)
+{
+  session_key_t key = Session::make_key(source, id);
+  std::lock_guard<std::mutex> guard(lock);
+
+  created = false;
+  auto it = sessions.find(key);
+  if (it != sessions.end())
+    return it->second;
+
+  if (sessions.size() >= MAX_SESSIONS)
+    return nullptr;
+
+  created = true;
+  std::shared_ptr<Session> session = std::make_shared<Session>(source, id, hello, ack, workers);
+  sessions.emplace(key, session);
+  return session;
+}
+
+
+/**
+ * @brief Copies the session pointers, so they can be walked without the lock
+ */
+std::vector<std::shared_ptr<Session>> SessionTable::snapshot()
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  std::vector<std::shared_ptr<Session>> result;
+  result.reserve(sessions.size());
+  for (auto& entry : sessions)
+    result.push_back(entry.second);
+
+  return result;
+}
+
+
+/**
+ * @brief Removes sessions nothing came for SESSION_IDLE_TIMEOUT_MS
+ * 
+ * @param now_ns CLOCK_MONOTONIC time
+ * @return the removed (and closed) sessions
+ */
+std::vector<std::shared_ptr<Session>> SessionTable::expire(uint64_t now_ns)
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  std::vector<std::shared_ptr<Session>> expired;
+  for (auto it = sessions.begin(); it != sessions.end();)
+  {
+    if (it->second->idle(now_ns))
+    {
+      it->second->close();
+      expired.push_back(it->second);
+      it = sessions.erase(it);
+    }
+    else
+      it++;
+  }
+
+  return expired;
+}
+
+
+/**
+ * @brief Number of active sessions
+ */
+size_t SessionTable::size()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return sessions.size();
+}
+
+
+/*****************************************************************************/
+
+/**
+ * @brief Looks a session up in the cache, then in the shared table
+ * 
+ * @param key key made by Session::make_key()
+ * @return the session, nullptr when there is none
+ */
+Session* SessionCache::find(const session_key_t& key)
+{
+  auto it = sessions.find(key);
+  if (it != sessions.end())
+  {
+    if (!it->second->is_closed())
+      return it->second.get();
+    sessions.erase(it);
+  }
+
+  std::shared_ptr<Session> session = table.find(key);
+  if (!session)
+    return nullptr;
+
+  sessions.emplace(key, session);
+  return session.get();
+}
+
+
+/**
+ * @brief Drops closed sessions, so their memory can be released
+ */
+void SessionCache::prune()
+{
+  for (auto it = sessions.begin(); it != sessions.end();)
+  {
+    if (it->second->is_closed())
+      it = sessions.erase(it);
+    else
+      it++;
+  }
+}
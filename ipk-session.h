@@ -0,0 +1,237 @@
+/**
+ *  @file       ipk-session.h
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Reflector sessions.
+ *  
+ *  @section Description
+ *  
+ *  The reflector serves every meter from the same unconnected sockets. A
+ *  measurement is identified by the address of the meter host and the session
+ *  id it put into its probes, its state (counters, trackers, round timer) lives
+ *  in a hash table shared by all receive workers.
+ *  
+ *  Every stream of a meter is a single flow, so the kernel hands all its probes
+ *  to one worker. Each worker therefore tracks into its own slot of the session
+ *  and the per-probe path never waits for another worker, the slots are merged
+ *  only when the round report is built.
+ */
+
+#ifndef IPK_SESSION_H_
+#define IPK_SESSION_H_
+
+    #include <stdint.h>
+    #include <atomic>
+    #include <functional>
+    #include <memory>
+    #include <mutex>
+    #include <thread>
+    #include <unordered_map>
+    #include <vector>
+    #include <netinet/in.h>
+    #include <sys/socket.h>
+
+    #include "ipk-probe.h"
+    #include "ipk-control.h"
+
+    // sessions without any datagram for this long are dropped
+    #define SESSION_IDLE_TIMEOUT_MS 10000
+
+    // the round report is built once no probe of the ended round came for this long
+    // (half of the round for rounds shorter than twice that, at least SESSION_ROUND_GRACE_MIN_MS)
+    #define SESSION_ROUND_GRACE_MS 50
+    #define SESSION_ROUND_GRACE_MIN_MS 5
+
+    // most measurements served at the same time
+    #define MAX_SESSIONS 1024
+
+    /**
+     * @brief Hash table key of a measurement, host address of the meter & session id
+     * 
+     * @desc IPv4 addresses are kept IPv4-mapped, the same meter has the same key
+     * whether it came to an IPv4 or a dual-stack socket.
+     */
+    struct session_key_t
+    {
+        uint8_t address[16];
+        uint32_t id;
+
+        bool operator==(const session_key_t& other) const;
+    };
+
+    struct session_key_hash
+    {
+        size_t operator()(const session_key_t& key) const;
+    };
+
+    /**
+     * @brief Everything the reflector sends back about one round
+     */
+    struct session_report_t
+    {
+        round_report_t counters;
+        std::vector<dispersion_sample_t> arrivals; // train probes of the round
+        Timeline timeline;                         // received probes by the interval they were sent in
+        host_drops_t drops;                        // dropped by the reflector host since the previous report
+        reverse_stats_t reverse;                   // probes sent back to the meter during the round
+    };
+
+
+    /**
+     * @brief State of one measurement on the reflector
+     */
+    class Session
+    {
+        private:
+            // probes tracked by one receive worker
+            struct worker_slot_t
+            {
+                std::mutex lock; // taken by the worker per probe, by the reporting thread once per round
+                std::vector<SequenceTracker> trackers;
+                std::vector<DelayEstimator> delays;
+                std::vector<dispersion_sample_t> arrivals; // train probes of the round
+                Timeline timeline;
+                int64_t stale;
+                int64_t invalid;
+            };
+
+            session_key_t key;
+            struct sockaddr_storage address; // control socket of the meter, replies go there
+            uint32_t session_id;
+            control_hello_t params;
+            control_ack_t agreement;
+            std::vector<std::unique_ptr<worker_slot_t>> slots;
+
+            // read on the per-probe path, changed when the round is ended & reported
+            std::atomic<uint32_t> round;
+            std::atomic<bool> ending;
+            std::atomic<uint64_t> last_seen_ns;  // any datagram of the session
+            std::atomic<uint64_t> last_probe_ns; // data probe of the current round
+            std::atomic<bool> closed;            // removed from the table
+
+            // round timer & the last report, resent when the meter asks again
+            std::mutex state_lock;
+            uint64_t round_end_ns;
+            bool reported;
+            uint32_t report_round;
+            session_report_t last_report;
+            host_drops_t drops_baseline; // host drop counters at the previous report
+
+            // sender of the probes going back to the meter, one run per round asked for
+            std::thread reverse_sender;
+            bool reverse_started;              // for 'reverse_round'
+            uint32_t reverse_round;
+            std::atomic<bool> reverse_running;
+            reverse_stats_t reverse_stats;     // of the current round, reported with it
+
+        public:
+            Session(const struct sockaddr_storage& source, uint32_t id, const control_hello_t& hello, const control_ack_t& ack,
+                    unsigned workers);
+
+            // waits for the reverse sender
+            ~Session();
+
+            // hash table key of the measurement
+            static session_key_t make_key(const struct sockaddr_storage& source, uint32_t id);
+
+            inline const session_key_t& get_key() const { return key; }
+            inline const struct sockaddr_storage& get_address() const { return address; }
+            inline uint32_t get_session_id() const { return session_id; }
+            inline const control_hello_t& get_params() const { return params; }
+            inline const control_ack_t& get_agreement() const { return agreement; }
+            inline bool finished() const { return round.load(std::memory_order_relaxed) >= params.total_time; }
+
+            // any datagram of the session came at 'now_ns' (CLOCK_MONOTONIC)
+            inline void touch(uint64_t now_ns) { last_seen_ns.store(now_ns, std::memory_order_relaxed); }
+
+            // accounts one data probe received by 'worker'
+            void track(unsigned worker, const probe_header_t& header, size_t length, uint64_t rx_timestamp, uint64_t now_ns);
+
+            // the meter sent the whole 'round', starts the grace timer, false when the round is already over
+            bool end_round(uint32_t ended_round, uint64_t now_ns);
+
+            // report of an already reported round, false when there is none
+            bool get_report(uint32_t reported_round, session_report_t& report);
+
+            // the grace period of the ended round is over
+            bool report_due(uint64_t now_ns);
+
+            // host drop counters at the start of the measurement
+            void start_drop_count(const host_drops_t& drops);
+
+            // runs 'sender' in a thread of its own during the current round 'requested_round', a repeated
+            // request does not start it again, false when 'requested_round' is not the current round
+            bool start_reverse(uint32_t requested_round, std::function<void()> sender);
+
+            // the reverse sender of 'sent_round' is done, its counters go into the report of the round
+            void finish_reverse(uint32_t sent_round, const reverse_stats_t& stats);
+
+            // merges all worker slots into the report of the ended round, the next round begins,
+            // 'drops' are the host drop counters now
+            session_report_t collect(uint32_t& reported_round, const host_drops_t& drops);
+
+            // nothing came for SESSION_IDLE_TIMEOUT_MS
+            bool idle(uint64_t now_ns) const;
+
+            inline void close() { closed.store(true, std::memory_order_relaxed); }
+            inline bool is_closed() const { return closed.load(std::memory_order_relaxed); }
+    };
+
+
+    /**
+     * @brief Hash table of the active sessions, shared by all receive workers
+     */
+    class SessionTable
+    {
+        private:
+            std::mutex lock;
+            std::unordered_map<session_key_t, std::shared_ptr<Session>, session_key_hash> sessions;
+            unsigned workers;
+
+        public:
+            explicit SessionTable(unsigned workers) : workers {workers} {}
+
+            // session of 'key', nullptr when there is none
+            std::shared_ptr<Session> find(const session_key_t& key);
+
+            // finds or creates the session of a hello with the agreed 'ack', 'created' tells which one,
+            // nullptr when the table is full
+            std::shared_ptr<Session> open(const struct sockaddr_storage& source, uint32_t id, const control_hello_t& hello,
+                                          const control_ack_t& ack, bool& created);
+
+            // all sessions at the moment of the call
+            std::vector<std::shared_ptr<Session>> snapshot();
+
+            // removes idle sessions, returns them
+            std::vector<std::shared_ptr<Session>> expire(uint64_t now_ns);
+
+            size_t size();
+    };
+
+
+    /**
+     * @brief Per-worker cache of the session table
+     * 
+     * @desc Lookups of a worker go to its own map first, the shared table (and
+     * its lock) is touched only for the first probe of a session. Closed
+     * sessions are dropped from the cache when looked up or by prune().
+     */
+    class SessionCache
+    {
+        private:
+            SessionTable& table;
+            std::unordered_map<session_key_t, std::shared_ptr<Session>, session_key_hash> sessions;
+
+        public:
+            explicit SessionCache(SessionTable& table) : table {table} {}
+
+            // session of 'key', nullptr when there is none
+            Session* find(const session_key_t& key);
+
+            // forgets closed sessions
+            void prune();
+    };
+
+#endif // IPK_SESSION_H_
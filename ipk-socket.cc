@@ -19,6 +19,7 @@
 #include <unistd.h>
 #include <stdint.h>
 #include <cstring>
+#include <algorithm>
 
 // commonly used std objects
 using std::cout;
@@ -32,28 +33,104 @@ using std::string;
 #include <netinet/in.h> // AF_INET and AF_INET6
 #include <arpa/inet.h>  // Functions for manipulating numeric IP addresses.
 #include <netdb.h>      // DNS lookup
+#include <poll.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <linux/net_tstamp.h> // SO_TIMESTAMPING flags
+#include <linux/sockios.h>    // SIOCSHWTSTAMP
+#include <linux/errqueue.h>   // scm_timestamping, zerocopy notifications
+#include <netinet/udp.h>      // UDP_SEGMENT, UDP_GRO
+#include <cerrno>
+
+// control message space per datagram
+#define CONTROL_SIZE 128
+
+// how long to wait for the TX timestamp on the error queue
+#define TX_TIMESTAMP_TIMEOUT_MS 10
+
+// IPv4 / IPv6 + UDP header, GSO segments have to fit the MTU with them
+#define UDP_IP_HEADERS 28
+#define UDP_IP6_HEADERS 48
+
+// how long a send stuck on ENOBUFS waits for zerocopy completions
+#define ZEROCOPY_RETRY_MS 1
+
+// pinned pages of one zerocopy send have to fit the skb fragments (MAX_SKB_FRAGS is 17 by default)
+#define ZEROCOPY_MAX_FRAGS 16
+
+// io_uring queue sizes, the completion queue takes bursts of multishot receives
+#define URING_ENTRIES 64
+#define URING_CQ_ENTRIES 4096
+
+// tags of the io_uring requests (user_data)
+#define URING_RECV_TAG    1
+#define URING_TIMEOUT_TAG 2
+#define URING_CANCEL_TAG  3
+#define URING_SEND_TAG    4
+
+// buffer group of the multishot receives
+#define URING_BUFFER_GROUP 0
+
+// how long stop_receiving() waits for the multishot receive to be cancelled
+#define URING_CANCEL_TIMEOUT_MS 100
+
+// older headers, the option number is stable
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
 
 // socket wrapper declarations
 #include "ipk-socket.h"
 #include "ipk-mtrip.h"
+#include "ipk-clock.h"
 
 
 /**
- * @brief Creates new Socket Entity for specified file descriptor
+ * @brief Creates new Socket Entity
  * 
- * @param fd file descriptor for the socket attached
+ * @desc The descriptor is created by setup_server() / setup_connection(),
+ * once the address family is known.
  */
 SocketEntity::SocketEntity()
 {
+  socket_fd = -1;
+  family = AF_UNSPEC;
+  local = sockaddr_storage{};
+  remote = sockaddr_storage{};
   local_length  = sizeof(local);
   remote_length = sizeof(remote);
 
-  if( (socket_fd = socket(AF_INET, SOCK_DGRAM, 0) ) <= 0 )
-  {
-    cerr << "socket creation failed" << endl;
-    return;
-  }
+  timestamping = NO_TIMESTAMPING;
+  gso_segments = 0;
+  gso_size = 0;
+  gro = false;
+  zerocopy = false;
+  zerocopy_sent = 0;
+  zerocopy_completed = 0;
+  zerocopy_copied = 0;
+  drop_counting = false;
+  rx_dropped.store(0);
+  uring_msg = msghdr{};
+  uring_deadline = __kernel_timespec{};
+  uring_receiving = false;
+  uring_rearm = false;
+  uring_deadline_hit = false;
+  set_batch_depth(1);
+}
+
+/**
+ * @brief Creates the descriptor of the socket
+ * 
+ * @param socket_family AF_INET / AF_INET6
+ * @return false when the family is not supported here
+ */
+bool SocketEntity::open_socket(int socket_family)
+{
+  if( (socket_fd = socket(socket_family, SOCK_DGRAM, 0) ) < 0 )
+    return false;
 
+  family = socket_family;
+  return true;
 }
 
 /**
@@ -69,19 +146,50 @@ int SocketEntity::get_fd()
  * @brief Prepares the correct address format and binds the socket
  * 
  * @param port port number to be opened
+ * @param reuse_port join the SO_REUSEPORT group of the port, kernel then spreads
+ *        flows over all unconnected sockets of the group
  * @return exit code
  */
-int SocketEntity::setup_server(unsigned short port)
+int SocketEntity::setup_server(unsigned short port, bool reuse_port, int server_family)
 {
+  // dual-stack unless one family was asked for, IPv4 alone where the host has no IPv6
+  bool dual_stack = server_family == AF_UNSPEC;
+  if (!open_socket(dual_stack ? AF_INET6 : server_family) && !(dual_stack && open_socket(AF_INET)))
+  {
+    cerr << "socket creation failed" << endl;
+    return -1;
+  }
 
   int optval = 1;
   setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const void *>(&optval) , sizeof(int));
 
-  local.sin_family = AF_INET;
-  local.sin_addr.s_addr = htonl(INADDR_ANY);
-  local.sin_port = htons(port);
+  if (reuse_port && setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) < 0)
+  {
+    cerr << "SO_REUSEPORT not available" << endl;
+    return -1;
+  }
+
+  local = sockaddr_storage{};
+  if (family == AF_INET6)
+  {
+    int v6_only = dual_stack ? 0 : 1;
+    setsockopt(socket_fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6_only, sizeof(v6_only));
+
+    struct sockaddr_in6* address = reinterpret_cast<struct sockaddr_in6*>(&local);
+    address->sin6_family = AF_INET6;
+    address->sin6_addr = in6addr_any;
+    address->sin6_port = htons(port);
+  }
+  else
+  {
+    struct sockaddr_in* address = reinterpret_cast<struct sockaddr_in*>(&local);
+    address->sin_family = AF_INET;
+    address->sin_addr.s_addr = htonl(INADDR_ANY);
+    address->sin_port = htons(port);
+  }
+  local_length = address_length(local);
 
-  if ( bind(socket_fd, reinterpret_cast<struct sockaddr*>(&local), sizeof(local)) < 0)
+  if ( bind(socket_fd, reinterpret_cast<struct sockaddr*>(&local), local_length) < 0)
   {
     close(socket_fd);
     cerr << "socket binding failed" << endl;
@@ -92,6 +200,23 @@ int SocketEntity::setup_server(unsigned short port)
 }
 
 
+/**
+ * @brief Port of the local end
+ * 
+ * @return the bound port in host byte order, 0 when not bound
+ */
+unsigned short SocketEntity::get_local_port()
+{
+  struct sockaddr_storage bound {};
+  socklen_t length = sizeof(bound);
+  if (getsockname(socket_fd, reinterpret_cast<struct sockaddr*>(&bound), &length) < 0)
+    return 0;
+
+  return ntohs(bound.ss_family == AF_INET6 ? reinterpret_cast<struct sockaddr_in6*>(&bound)->sin6_port
+                                           : reinterpret_cast<struct sockaddr_in*>(&bound)->sin_port);
+}
+
+
 /**
  * @brief Prepares address of the foreign host.
  * 
@@ -101,18 +226,33 @@ int SocketEntity::setup_server(unsigned short port)
  */
 int SocketEntity::setup_connection(const char* hostname, unsigned short port)
 {
-  // DNS find the host by name, return IP
-  hp = gethostbyname(hostname); 
-  if (!hp)
+  std::vector<struct sockaddr_storage> addresses = resolve(hostname, port);
+  if (addresses.empty())
   {
     std::cerr << "[ERROR]: No such host as " << hostname << std::endl;
     return -1;
   }
 
-  //setup socket address
-  remote.sin_family = AF_INET;
-  std::memcpy(&remote.sin_addr, hp->h_addr, hp->h_length);
-  remote.sin_port = htons(port);
+  return setup_connection(addresses[0]);
+}
+
+
+/**
+ * @brief Connects the socket to one address of the foreign host
+ * 
+ * @param address address & port of the remote host, its family is the one of the socket
+ * @return exit code
+ */
+int SocketEntity::setup_connection(const struct sockaddr_storage& address)
+{
+  if (!open_socket(address.ss_family))
+  {
+    cerr << "socket creation failed (no " << address_family_name(address) << " here)" << endl;
+    return -1;
+  }
+
+  remote = address;
+  remote_length = address_length(remote);
 
   // connect to udp remote socket -> then only use send instead of sendto..
   if ( connect(socket_fd, reinterpret_cast<sockaddr*>(&remote), remote_length) == -1 )
@@ -126,6 +266,51 @@ int SocketEntity::setup_connection(const char* hostname, unsigned short port)
 }
 
 
+/**
+ * @brief Resolves all addresses of a host
+ * 
+ * @desc getaddrinfo() sorts them by the preference of the host (RFC 6724),
+ * so a host with IPv6 connectivity gets the IPv6 addresses first. Duplicates
+ * (one per socket type the resolver may return) are left out.
+ * @param hostname name or numeric address of the host
+ * @param port port to be set in the addresses
+ * @param address_family AF_INET / AF_INET6, AF_UNSPEC for both
+ * @return the addresses, empty when the host does not resolve
+ */
+std::vector<struct sockaddr_storage> SocketEntity::resolve(const char* hostname, unsigned short port, int address_family)
+{
+  std::vector<struct sockaddr_storage> addresses;
+
+  struct addrinfo hints {};
+  hints.ai_family = address_family;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_flags = AI_ADDRCONFIG;
+
+  struct addrinfo* results = nullptr;
+  string service = std::to_string(port);
+  if (getaddrinfo(hostname, service.c_str(), &hints, &results) != 0)
+    return addresses;
+
+  for (struct addrinfo* result = results; result; result = result->ai_next)
+  {
+    if (result->ai_family != AF_INET && result->ai_family != AF_INET6)
+      continue;
+
+    struct sockaddr_storage address {};
+    std::memcpy(&address, result->ai_addr, std::min<size_t>(result->ai_addrlen, sizeof(address)));
+
+    bool known = false;
+    for (const struct sockaddr_storage& other : addresses)
+      known = known || address_name(other) == address_name(address);
+    if (!known)
+      addresses.push_back(address);
+  }
+
+  freeaddrinfo(results);
+  return addresses;
+}
+
+
 /**
  * @brief Sends a message and returns the number of bytes sent
  * 
@@ -155,9 +340,10 @@ ssize_t SocketEntity::recv_message(char* buffer, size_t buf_size, bool save_conn
   {
 
     // clear existing remote address 
-    remote.sin_family = AF_UNSPEC;
+    remote.ss_family = AF_UNSPEC;
     connect(socket_fd, reinterpret_cast<sockaddr*>(&remote), remote_length);
     memset(&remote, 0, sizeof(remote));
+    remote_length = sizeof(remote);
     
     int bytes_received = recvfrom(socket_fd, buffer, buf_size, 0, reinterpret_cast<sockaddr*>(&remote), &remote_length);
 
@@ -173,4 +359,1295 @@ ssize_t SocketEntity::recv_message(char* buffer, size_t buf_size, bool save_conn
   {
     return recv(socket_fd, buffer, buf_size, 0);
   }
-}
\ No newline at end of file
+}
+
+
+/**
+ * @brief Sends a message to the given address
+ * 
+ * @desc Used by the reflector, its sockets stay unconnected so that every
+ * meter can reach them.
+ * @param buffer pointer to the data to send
+ * @param buf_size size being sent
+ * @param destination where the message goes
+ * @return number of bytes sent
+ */
+ssize_t SocketEntity::send_to(const char* buffer, size_t buf_size, const struct sockaddr_storage& destination)
+{
+  return sendto(socket_fd, buffer, buf_size, 0, reinterpret_cast<const sockaddr*>(&destination), address_length(destination));
+}
+
+
+/**
+ * @brief Receives a message on an unconnected socket
+ * 
+ * @param buffer pointer to the receive buffer
+ * @param buf_size size being received
+ * @param source output, sender of the message
+ * @return number of bytes received, -1 on error/timeout
+ */
+ssize_t SocketEntity::recv_from(char* buffer, size_t buf_size, struct sockaddr_storage& source)
+{
+  socklen_t length = sizeof(source);
+  return recvfrom(socket_fd, buffer, buf_size, 0, reinterpret_cast<sockaddr*>(&source), &length);
+}
+
+
+/**
+ * @brief Limits how long the blocking receives wait
+ * 
+ * @param timeout_ms timeout in ms, 0 waits forever
+ */
+void SocketEntity::set_recv_timeout(unsigned timeout_ms)
+{
+  struct timeval timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_usec = (timeout_ms % 1000) * 1000;
+  setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+
+/**
+ * @brief Waits for a datagram without receiving it
+ * 
+ * @param timeout_ms longest wait, -1 waits forever
+ * @return false when nothing came in time
+ */
+bool SocketEntity::wait_readable(int timeout_ms)
+{
+  struct pollfd pfd {socket_fd, POLLIN, 0};
+  return poll(&pfd, 1, timeout_ms) > 0 && (pfd.revents & POLLIN);
+}
+
+
+/**
+ * @brief Sets how many datagrams are moved by a single batched syscall
+ * 
+ * @desc Message headers are preallocated here, so the batched calls itself
+ * do not allocate anything. Depth of 1 falls back to plain send()/recv().
+ * The receive side gets headers & control buffers of its own, the send calls
+ * rewrite theirs (GSO groups) while a receiver thread may be in recvmmsg.
+ * @param depth maximum number of datagrams per sendmmsg/recvmmsg call
+ */
+void SocketEntity::set_batch_depth(unsigned depth)
+{
+  batch_depth = depth > 0 ? depth : 1;
+
+  batch_msgs.assign(batch_depth, mmsghdr{});
+  batch_iovs.assign(batch_depth, iovec{});
+  recv_msgs.assign(batch_depth, mmsghdr{});
+  recv_iovs.assign(batch_depth, iovec{});
+
+  if (control_needed())
+  {
+    batch_control.assign(batch_depth * CONTROL_SIZE, 0);
+    recv_control.assign(batch_depth * CONTROL_SIZE, 0);
+  }
+
+  for (unsigned i = 0; i < batch_depth; i++)
+  {
+    batch_msgs[i].msg_hdr.msg_iov = &batch_iovs[i];
+    batch_msgs[i].msg_hdr.msg_iovlen = 1;
+    recv_msgs[i].msg_hdr.msg_iov = &recv_iovs[i];
+    recv_msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+}
+
+
+/**
+ * @brief Sends a group of datagrams using as few syscalls as possible
+ * 
+ * @param buffers array of 'count' pointers to the data to send
+ * @param buf_size size of every datagram
+ * @param count number of datagrams, at most the batch depth is sent
+ * @return number of datagrams sent, -1 when nothing could be sent
+ */
+int SocketEntity::send_batch(char* const* buffers, size_t buf_size, unsigned count)
+{
+  if (count > batch_depth)
+    count = batch_depth;
+
+  int flags = zerocopy ? MSG_ZEROCOPY : 0;
+
+  if (count == 1 && !zerocopy)
+    return send_message(buffers[0], buf_size) < 0 ? -1 : 1;
+
+  // with GSO every message carries up to 'gso_segments' datagrams, one iovec
+  // each, the kernel cuts the concatenated payload back at 'buf_size'
+  bool segmented = gso_segments > 1 && buf_size == gso_size;
+  unsigned per_message = segmented ? gso_segments : 1;
+  unsigned messages = 0;
+
+  for (unsigned i = 0; i < count; i++)
+  {
+    batch_iovs[i].iov_base = buffers[i];
+    batch_iovs[i].iov_len = buf_size;
+  }
+
+  for (unsigned first = 0; first < count; first += per_message, messages++)
+  {
+    struct msghdr& hdr = batch_msgs[messages].msg_hdr;
+    hdr.msg_iov = &batch_iovs[first];
+    hdr.msg_iovlen = std::min(per_message, count - first);
+    hdr.msg_name = nullptr;
+    hdr.msg_namelen = 0;
+    hdr.msg_control = nullptr;
+    hdr.msg_controllen = 0;
+
+    if (segmented && hdr.msg_iovlen > 1)
+    {
+      uint16_t segment = static_cast<uint16_t>(buf_size);
+      hdr.msg_control = &batch_control[messages * CONTROL_SIZE];
+      hdr.msg_controllen = CMSG_SPACE(sizeof(segment));
+      struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(segment));
+      std::memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+    }
+  }
+
+  // sendmmsg may stop early (full socket buffer), keep pushing the rest,
+  // zerocopy sends fail with ENOBUFS while too many are still in flight
+  unsigned sent = uring ? uring_send(messages, flags) : 0;
+  unsigned sent_datagrams = 0;
+
+  for (unsigned i = 0; uring && i < sent; i++)
+    sent_datagrams += batch_msgs[i].msg_hdr.msg_iovlen;
+  if (uring && zerocopy)
+    zerocopy_sent += sent;
+
+  while (!uring && sent < messages)
+  {
+    int result = sendmmsg(socket_fd, &batch_msgs[sent], messages - sent, flags);
+    if (result <= 0)
+    {
+      // retried only when some sends are really in flight
+      if (zerocopy && errno == ENOBUFS && zerocopy_completed != zerocopy_sent
+          && wait_zerocopy(zerocopy_sent, ZEROCOPY_RETRY_MS))
+        continue;
+      break;
+    }
+
+    for (int i = 0; i < result; i++)
+      sent_datagrams += batch_msgs[sent + i].msg_hdr.msg_iovlen;
+
+    sent += result;
+    if (zerocopy)
+      zerocopy_sent += result;
+  }
+
+  // restore the one datagram per message layout for the other batched calls
+  for (unsigned i = 0; i < messages; i++)
+  {
+    batch_msgs[i].msg_hdr.msg_iov = &batch_iovs[i];
+    batch_msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  return sent_datagrams > 0 ? static_cast<int>(sent_datagrams) : -1;
+}
+
+
+/**
+ * @brief Sends a group of datagrams to different destinations using a single syscall
+ * 
+ * @desc The reflector sends echoed probes back out of the receive buffers they
+ * arrived in. No GSO (the datagrams differ in size and destination) and no
+ * zerocopy (the buffers are received into again right after the call). The
+ * completions of an io_uring send would have to be told apart from those of
+ * the multishot receive, so it is sendmmsg whatever the backend.
+ * @param buffers array of 'count' pointers to the datagrams
+ * @param lengths size of every datagram
+ * @param destinations receiver of every datagram
+ * @param count number of datagrams, at most the batch depth is sent
+ * @return number of datagrams sent, -1 when nothing could be sent
+ */
+int SocketEntity::send_batch_to(char* const* buffers, const size_t* lengths, const struct sockaddr_storage* const* destinations,
+                                unsigned count)
+{
+  if (count > batch_depth)
+    count = batch_depth;
+
+  if (count == 1)
+    return send_to(buffers[0], lengths[0], *destinations[0]) < 0 ? -1 : 1;
+
+  for (unsigned i = 0; i < count; i++)
+  {
+    batch_iovs[i].iov_base = buffers[i];
+    batch_iovs[i].iov_len = lengths[i];
+
+    struct msghdr& hdr = batch_msgs[i].msg_hdr;
+    hdr.msg_name = const_cast<struct sockaddr_storage*>(destinations[i]);
+    hdr.msg_namelen = address_length(*destinations[i]);
+    hdr.msg_control = nullptr;
+    hdr.msg_controllen = 0;
+  }
+
+  // sendmmsg may stop early (full socket buffer), keep pushing the rest
+  unsigned sent = 0;
+  while (sent < count)
+  {
+    int result = sendmmsg(socket_fd, &batch_msgs[sent], count - sent, 0);
+    if (result <= 0)
+      break;
+    sent += result;
+  }
+
+  return sent > 0 ? static_cast<int>(sent) : -1;
+}
+
+
+/**
+ * @brief Receives a group of datagrams using a single syscall
+ * 
+ * @desc Blocks (respecting SO_RCVTIMEO) only until the first datagram arrives,
+ * then takes whatever else is already queued, up to 'count' datagrams.
+ * @param buffers array of 'count' pointers to receive buffers
+ * @param buf_size size of every receive buffer
+ * @param count number of buffers, at most the batch depth is used
+ * @param lengths output, number of bytes received into each buffer
+ * @param timestamps optional output, receive timestamp of each datagram (ns),
+ *        kernel/NIC time when timestamping is enabled
+ * @param segment_sizes optional output, size of the datagrams a GRO coalesced
+ *        buffer consists of (the last one may be shorter), its length otherwise
+ * @param sources optional output, sender address of each datagram
+ * @return number of datagrams received, -1 on error/timeout
+ */
+int SocketEntity::recv_batch(char* const* buffers, size_t buf_size, unsigned count, size_t* lengths,
+                             uint64_t* timestamps, size_t* segment_sizes, struct sockaddr_storage* sources)
+{
+  if (count > batch_depth)
+    count = batch_depth;
+
+  bool kernel_timestamps = timestamps && timestamping != NO_TIMESTAMPING;
+  bool with_control = kernel_timestamps || gro || drop_counting;
+
+  if (count == 1 && !with_control && !sources)
+  {
+    ssize_t bytes_received = recv_message(buffers[0], buf_size);
+    if (bytes_received < 0)
+      return -1;
+    lengths[0] = bytes_received;
+    if (timestamps)
+      timestamps[0] = realtime_ns();
+    if (segment_sizes)
+      segment_sizes[0] = bytes_received;
+    return 1;
+  }
+
+  // recv_* headers only, a sender thread may be rewriting the batch_* ones right now
+  for (unsigned i = 0; i < count; i++)
+  {
+    recv_iovs[i].iov_base = buffers[i];
+    recv_iovs[i].iov_len = buf_size;
+    recv_msgs[i].msg_hdr.msg_control = with_control ? &recv_control[i * CONTROL_SIZE] : nullptr;
+    recv_msgs[i].msg_hdr.msg_controllen = with_control ? CONTROL_SIZE : 0;
+    recv_msgs[i].msg_hdr.msg_name = sources ? &sources[i] : nullptr;
+    recv_msgs[i].msg_hdr.msg_namelen = sources ? sizeof(sources[i]) : 0;
+  }
+
+  int received = recvmmsg(socket_fd, recv_msgs.data(), count, MSG_WAITFORONE, nullptr);
+
+  uint64_t now = timestamps && received > 0 ? realtime_ns() : 0;
+  for (int i = 0; i < received; i++)
+  {
+    struct msghdr* hdr = &recv_msgs[i].msg_hdr;
+    lengths[i] = recv_msgs[i].msg_len;
+
+    if (timestamps && !(kernel_timestamps && timestamp_from_cmsg(hdr, timestamps[i])))
+      timestamps[i] = now;
+
+    if (segment_sizes)
+      segment_sizes[i] = segment_from_cmsg(hdr, lengths[i]);
+  }
+
+  if (drop_counting && received > 0)
+    drops_from_cmsg(&recv_msgs[received - 1].msg_hdr);
+
+  return received;
+}
+
+
+/**
+ * @brief Size of the datagrams a GRO coalesced buffer consists of
+ * 
+ * @param msg received message with control data
+ * @param length number of bytes received
+ * @return UDP_GRO segment size, 'length' for a single datagram
+ */
+size_t SocketEntity::segment_from_cmsg(struct msghdr* msg, size_t length)
+{
+  for (struct cmsghdr* cmsg = gro ? CMSG_FIRSTHDR(msg) : nullptr; cmsg; cmsg = CMSG_NXTHDR(msg, cmsg))
+  {
+    if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+    {
+      int segment;
+      std::memcpy(&segment, CMSG_DATA(cmsg), sizeof(segment));
+      if (segment > 0)
+        return segment;
+    }
+  }
+
+  return length;
+}
+
+
+/**
+ * @brief Switches the batched calls to an io_uring instance of this socket
+ * 
+ * @desc send_batch() then queues one linked SENDMSG request per message and
+ * submits them with a single io_uring_enter(). Receiving goes through
+ * start_receiving()/recv_borrowed()/stop_receiving().
+ * @return false when io_uring is not available, the blocking calls stay in use
+ */
+bool SocketEntity::enable_uring()
+{
+  unsigned entries = URING_ENTRIES;
+  while (entries < batch_depth)
+    entries *= 2;
+
+  std::unique_ptr<IoUring> ring(new IoUring());
+  if (!ring->setup(entries, URING_CQ_ENTRIES))
+    return false;
+
+  uring = std::move(ring);
+  return true;
+}
+
+
+/**
+ * @brief Sends the prepared messages as linked SENDMSG requests
+ * 
+ * @desc The link keeps the order of the datagrams, after a failed send the
+ * rest of the chain is cancelled, like sendmmsg stops at the first error.
+ * @param messages number of prepared messages of batch_msgs
+ * @param flags send flags
+ * @return number of messages sent (from the first one)
+ */
+unsigned SocketEntity::uring_send(unsigned messages, int flags)
+{
+  struct io_uring_sqe* last { nullptr };
+  unsigned queued { 0 };
+
+  for (; queued < messages; queued++)
+  {
+    struct io_uring_sqe* sqe = uring->get_sqe();
+    if (sqe == nullptr)
+      break;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = socket_fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&batch_msgs[queued].msg_hdr);
+    sqe->msg_flags = flags;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = URING_SEND_TAG;
+    last = sqe;
+  }
+
+  if (last == nullptr)
+    return 0;
+  last->flags = 0; // end of the chain
+
+  uring->submit(queued);
+
+  // every request of the chain completes, cancelled ones with -ECANCELED
+  unsigned completed { 0 };
+  unsigned sent { 0 };
+  bool failed { false };
+  while (completed < queued)
+  {
+    struct io_uring_cqe* cqe = uring->peek_cqe();
+    if (cqe == nullptr)
+    {
+      if (uring->submit(1) < 0)
+        break;
+      continue;
+    }
+
+    if (cqe->user_data == URING_SEND_TAG)
+    {
+      completed++;
+      if (cqe->res < 0)
+        failed = true;
+      else if (!failed)
+        sent++;
+    }
+    uring->cqe_seen();
+  }
+
+  return sent;
+}
+
+
+/**
+ * @brief Starts receiving through io_uring (multishot RECVMSG)
+ * 
+ * @desc One request keeps delivering datagrams into the provided buffers until
+ * it is cancelled, each buffer holds the recvmsg header, the sender address,
+ * the control messages (timestamps, GRO segment size) and the payload. The buffers are registered on
+ * the first call and again when bigger datagrams are expected.
+ * @param buf_size largest datagram expected
+ * @param buffers number of provided buffers, power of 2
+ * @return false when the buffers cannot be registered
+ */
+bool SocketEntity::start_receiving(size_t buf_size, unsigned buffers)
+{
+  if (!uring)
+    return false;
+
+  uring_msg = msghdr{};
+  uring_msg.msg_namelen = sizeof(struct sockaddr_storage);
+  uring_msg.msg_controllen = CONTROL_SIZE;
+
+  size_t size = sizeof(struct io_uring_recvmsg_out) + uring_msg.msg_namelen + uring_msg.msg_controllen + buf_size;
+  if (uring->get_buffer_size() < size && !uring->register_buffers(URING_BUFFER_GROUP, buffers, size))
+    return false;
+
+  uring_borrowed.reserve(buffers);
+  uring_borrowed.clear();
+  uring_deadline_hit = false;
+  uring_receiving = true;
+  uring_arm_receive();
+  uring->submit();
+
+  return true;
+}
+
+
+/**
+ * @brief Queues the multishot receive request
+ */
+void SocketEntity::uring_arm_receive()
+{
+  struct io_uring_sqe* sqe = uring->get_sqe();
+  if (sqe == nullptr)
+    return;
+
+  sqe->opcode = IORING_OP_RECVMSG;
+  sqe->fd = socket_fd;
+  sqe->addr = reinterpret_cast<uint64_t>(&uring_msg);
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = uring->get_buffer_group();
+  sqe->user_data = URING_RECV_TAG;
+  uring_rearm = false;
+}
+
+
+/**
+ * @brief Queues a timeout request completing at an absolute time
+ * 
+ * @param deadline_ns CLOCK_MONOTONIC time in ns
+ */
+void SocketEntity::set_deadline(uint64_t deadline_ns)
+{
+  if (!uring)
+    return;
+
+  uring_deadline.tv_sec = deadline_ns / NSEC_PER_SEC;
+  uring_deadline.tv_nsec = deadline_ns % NSEC_PER_SEC;
+  uring_deadline_hit = false;
+
+  struct io_uring_sqe* sqe = uring->get_sqe();
+  if (sqe == nullptr)
+    return;
+
+  sqe->opcode = IORING_OP_TIMEOUT;
+  sqe->addr = reinterpret_cast<uint64_t>(&uring_deadline);
+  sqe->len = 1;
+  sqe->timeout_flags = IORING_TIMEOUT_ABS;
+  sqe->user_data = URING_TIMEOUT_TAG;
+  uring->submit();
+}
+
+
+/**
+ * @brief Takes received datagrams out of the completion queue
+ * 
+ * @desc Buffers lent by the previous call are recycled first. Stops at the
+ * deadline completion, so datagrams completed after it come with the next call.
+ * @param payloads output, 'count' pointers to the received datagrams
+ * @param count most datagrams returned
+ * @param lengths output, datagram lengths
+ * @param timestamps optional output, RX time (ns), kernel/NIC time when timestamping is enabled
+ * @param segment_sizes optional output, see recv_batch()
+ * @param timeout_ms longest wait for the first datagram, -1 waits until the deadline
+ * @param sources optional output, sender address of each datagram
+ * @return number of datagrams, 0 when the deadline passed, -1 on timeout/error
+ */
+int SocketEntity::recv_borrowed(const char** payloads, unsigned count, size_t* lengths, uint64_t* timestamps,
+                                size_t* segment_sizes, int timeout_ms, struct sockaddr_storage* sources)
+{
+  if (!uring || !uring_receiving)
+    return -1;
+
+  for (unsigned short id : uring_borrowed)
+    uring->recycle_buffer(id);
+  uring->commit_buffers();
+  uring_borrowed.clear();
+
+  bool kernel_timestamps = timestamps && timestamping != NO_TIMESTAMPING;
+  size_t buffer_size = uring->get_buffer_size();
+  unsigned received { 0 };
+  bool deadline { false };
+
+  while (true)
+  {
+    struct io_uring_cqe* cqe;
+    while (received < count && !deadline && (cqe = uring->peek_cqe()) != nullptr)
+    {
+      uint64_t tag = cqe->user_data;
+      int result = cqe->res;
+      unsigned flags = cqe->flags;
+      uring->cqe_seen();
+
+      if (tag == URING_TIMEOUT_TAG)
+      {
+        deadline = uring_deadline_hit = true;
+        continue;
+      }
+
+      if (tag != URING_RECV_TAG)
+        continue;
+
+      // the multishot request ended (no free buffer, error), it is queued again
+      if (!(flags & IORING_CQE_F_MORE))
+        uring_rearm = true;
+
+      if (result < 0 || !(flags & IORING_CQE_F_BUFFER))
+        continue;
+
+      unsigned short id = flags >> IORING_CQE_BUFFER_SHIFT;
+      char* buffer = uring->buffer(id);
+      uring_borrowed.push_back(id);
+
+      struct io_uring_recvmsg_out out;
+      std::memcpy(&out, buffer, sizeof(out));
+      char* control = buffer + sizeof(out) + uring_msg.msg_namelen;
+      char* payload = control + uring_msg.msg_controllen;
+
+      struct msghdr parsed {};
+      parsed.msg_control = control;
+      parsed.msg_controllen = out.controllen;
+
+      payloads[received] = payload;
+      lengths[received] = std::min<size_t>(out.payloadlen, buffer_size - (payload - buffer));
+
+      if (sources)
+      {
+        sources[received] = sockaddr_storage{};
+        std::memcpy(&sources[received], buffer + sizeof(out), std::min<size_t>(out.namelen, uring_msg.msg_namelen));
+      }
+
+      if (timestamps && !(kernel_timestamps && timestamp_from_cmsg(&parsed, timestamps[received])))
+        timestamps[received] = realtime_ns();
+      if (segment_sizes)
+        segment_sizes[received] = segment_from_cmsg(&parsed, lengths[received]);
+      if (drop_counting)
+        drops_from_cmsg(&parsed);
+
+      received++;
+    }
+
+    if (uring_rearm)
+    {
+      uring_arm_receive();
+      uring->submit();
+    }
+
+    if (received > 0)
+      return received;
+    if (deadline)
+      return 0;
+
+    int result = uring->submit(1, timeout_ms);
+    if (result == -ETIME && uring->peek_cqe() == nullptr)
+      return -1;
+    if (result < 0 && result != -ETIME && result != -EINTR)
+      return -1;
+  }
+}
+
+
+/**
+ * @brief Cancels the multishot receive and the deadline
+ * 
+ * @desc Datagrams still completed in between are dropped (their buffers
+ * recycled), datagrams arriving later stay in the socket for the blocking calls.
+ */
+void SocketEntity::stop_receiving()
+{
+  if (!uring || !uring_receiving)
+    return;
+
+  struct io_uring_sqe* sqe = uring->get_sqe();
+  if (sqe != nullptr)
+  {
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = URING_RECV_TAG;
+    sqe->user_data = URING_CANCEL_TAG;
+  }
+
+  if (!uring_deadline_hit && (sqe = uring->get_sqe()) != nullptr)
+  {
+    sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+    sqe->addr = URING_TIMEOUT_TAG;
+    sqe->user_data = URING_CANCEL_TAG;
+  }
+
+  // the receive ends with a completion without IORING_CQE_F_MORE
+  bool receive_done { uring_rearm };
+  uint64_t deadline = monotonic_ns() + URING_CANCEL_TIMEOUT_MS * NSEC_PER_MSEC;
+
+  uring->submit();
+  while (!receive_done && monotonic_ns() < deadline)
+  {
+    struct io_uring_cqe* cqe = uring->peek_cqe();
+    if (cqe == nullptr)
+    {
+      uring->submit(1, URING_CANCEL_TIMEOUT_MS);
+      continue;
+    }
+
+    if (cqe->user_data == URING_RECV_TAG)
+    {
+      if (cqe->flags & IORING_CQE_F_BUFFER)
+        uring_borrowed.push_back(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+      if (!(cqe->flags & IORING_CQE_F_MORE))
+        receive_done = true;
+    }
+    uring->cqe_seen();
+  }
+
+  // leftovers of the cancel/remove requests
+  struct io_uring_cqe* cqe;
+  while ((cqe = uring->peek_cqe()) != nullptr)
+  {
+    if (cqe->user_data == URING_RECV_TAG && (cqe->flags & IORING_CQE_F_BUFFER))
+      uring_borrowed.push_back(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+    uring->cqe_seen();
+  }
+
+  for (unsigned short id : uring_borrowed)
+    uring->recycle_buffer(id);
+  uring->commit_buffers();
+  uring_borrowed.clear();
+
+  uring_receiving = false;
+  uring_rearm = false;
+}
+
+
+/**
+ * @brief Whether the batched calls need control message buffers
+ */
+bool SocketEntity::control_needed() const
+{
+  return timestamping != NO_TIMESTAMPING || gro || gso_segments > 1 || drop_counting;
+}
+
+
+/**
+ * @brief Turns on the SO_RXQ_OVFL drop counter
+ * 
+ * @desc Every received datagram then carries the number of datagrams the
+ * kernel dropped on this socket so far (attached only once there is any), it
+ * is taken from the control data by the receive calls.
+ * @return false when the kernel does not support it
+ */
+bool SocketEntity::enable_drop_counter()
+{
+  int one = 1;
+  if (setsockopt(socket_fd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one)) < 0)
+    return false;
+
+  drop_counting = true;
+  set_batch_depth(batch_depth);
+  return true;
+}
+
+
+/**
+ * @brief Turns on busy polling of the receive calls
+ * 
+ * @desc Instead of sleeping until the interrupt, a receive on an empty queue
+ * polls the device queue of the socket, which takes the interrupt & wakeup
+ * latency out of the receive timestamps at the price of a spinning core.
+ * Preferring busy polling also keeps the softirq away from the queue while
+ * the socket polls it. Values above net.core.busy_read need CAP_NET_ADMIN.
+ * @param usec longest poll of one receive
+ * @return false when SO_BUSY_POLL was refused
+ */
+bool SocketEntity::enable_busy_poll(unsigned usec)
+{
+  int value = static_cast<int>(usec);
+  if (setsockopt(socket_fd, SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value)) < 0)
+    return false;
+
+  // kernel 5.11+, busy polling works without it
+  int one = 1;
+  setsockopt(socket_fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one));
+  return true;
+}
+
+
+/**
+ * @brief Takes the drop counter out of the control data of a received datagram
+ * 
+ * @param msg received message with control data
+ */
+void SocketEntity::drops_from_cmsg(struct msghdr* msg)
+{
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg))
+  {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+    {
+      uint32_t dropped;
+      std::memcpy(&dropped, CMSG_DATA(cmsg), sizeof(dropped));
+      rx_dropped.store(dropped, std::memory_order_relaxed);
+    }
+  }
+}
+
+
+/**
+ * @brief Size of a socket buffer
+ * 
+ * @param option SO_RCVBUF or SO_SNDBUF
+ * @return bytes usable for datagrams, the kernel reports twice that (bookkeeping overhead)
+ */
+size_t SocketEntity::get_buffer(int option)
+{
+  int value = 0;
+  socklen_t length = sizeof(value);
+  if (getsockopt(socket_fd, SOL_SOCKET, option, &value, &length) < 0)
+    return 0;
+
+  return static_cast<size_t>(value) / 2;
+}
+
+
+/**
+ * @brief Grows a socket buffer, a bigger one is left alone
+ * 
+ * @desc The privileged FORCE option is tried first, without CAP_NET_ADMIN
+ * the plain one is capped by net.core.rmem_max / wmem_max.
+ * @param option SO_RCVBUF or SO_SNDBUF
+ * @param force_option SO_RCVBUFFORCE or SO_SNDBUFFORCE
+ * @param bytes size wanted
+ * @return size the kernel set, may be less than 'bytes'
+ */
+size_t SocketEntity::grow_buffer(int option, int force_option, size_t bytes)
+{
+  size_t current = get_buffer(option);
+  if (current >= bytes)
+    return current;
+
+  int value = static_cast<int>(std::min<size_t>(bytes, INT32_MAX / 2));
+  if (setsockopt(socket_fd, SOL_SOCKET, force_option, &value, sizeof(value)) < 0)
+    setsockopt(socket_fd, SOL_SOCKET, option, &value, sizeof(value));
+
+  return get_buffer(option);
+}
+
+
+/**
+ * @brief Socket buffer for a stream of datagrams
+ * 
+ * @desc Holds SOCKET_BUFFER_MS of the traffic, the time a receiver may be
+ * descheduled (or a sender outpace the NIC) without a drop, but never more
+ * than a whole round of it.
+ * @param packet_rate datagrams/second
+ * @param datagram_size bytes of every datagram
+ * @param round_ms length of a round
+ * @return buffer size in bytes, within SOCKET_BUFFER_MIN & SOCKET_BUFFER_MAX
+ */
+size_t SocketEntity::buffer_size_for(double packet_rate, size_t datagram_size, unsigned round_ms)
+{
+  double window_s = std::min<unsigned>(SOCKET_BUFFER_MS, std::max(round_ms, 1U)) / 1000.0;
+  double bytes = packet_rate * datagram_size * window_s;
+
+  return static_cast<size_t>(std::max<double>(SOCKET_BUFFER_MIN, std::min<double>(bytes, SOCKET_BUFFER_MAX)));
+}
+
+
+/**
+ * @brief Enables UDP generic segmentation offload for send_batch()
+ * 
+ * @desc send_batch() then hands the kernel up to MAX_GSO_SEGMENTS datagrams
+ * as one message, it is split into datagrams as late as possible (by the NIC
+ * when it supports it). Every segment has to fit the path MTU, bigger probes
+ * are sent one datagram per message as before. Zerocopy (when used) has to
+ * be enabled first, it limits the number of segments per send.
+ * @param segment_size size of the datagrams
+ * @return datagrams per GSO send, 0 when GSO is not usable
+ */
+unsigned SocketEntity::enable_gso(size_t segment_size)
+{
+  gso_segments = 0;
+  gso_size = 0;
+
+  // the MTU is known once the socket is connected
+  int mtu = get_mtu();
+  if (mtu < 0 || segment_size + get_header_size() > static_cast<size_t>(mtu))
+    return 0;
+
+  // probe for kernel support, the size itself is passed with every send
+  int probe = static_cast<int>(segment_size);
+  if (setsockopt(socket_fd, SOL_UDP, UDP_SEGMENT, &probe, sizeof(probe)) < 0)
+    return 0;
+  probe = 0;
+  setsockopt(socket_fd, SOL_UDP, UDP_SEGMENT, &probe, sizeof(probe));
+
+  unsigned segments = std::min<size_t>(MAX_GSO_SEGMENTS, MAX_DATAGRAM_SIZE / segment_size);
+
+  // zerocopy pins every segment separately, each may span one more page than its size
+  if (zerocopy)
+  {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t pages = (segment_size + page_size - 1) / page_size + 1;
+    segments = std::min<size_t>(segments, ZEROCOPY_MAX_FRAGS / pages);
+  }
+
+  if (segments < 2)
+    return 0;
+
+  gso_segments = segments;
+  gso_size = segment_size;
+  set_batch_depth(batch_depth);
+
+  return gso_segments;
+}
+
+
+/**
+ * @brief Sets DF on every datagram and stops the kernel from fragmenting
+ * 
+ * @desc With the default policy the kernel fragments datagrams above the
+ * path MTU it has learnt from ICMP, so a lost "fragmentation needed" makes
+ * probes of any size look deliverable. In the probe mode the cached value is
+ * ignored: every datagram leaves whole with DF set, only the MTU of the
+ * outgoing interface is still enforced (EMSGSIZE on send).
+ * @return false when the option was refused
+ */
+bool SocketEntity::set_mtu_probing()
+{
+  int value = family == AF_INET6 ? IPV6_PMTUDISC_PROBE : IP_PMTUDISC_PROBE;
+  return family == AF_INET6 ? setsockopt(socket_fd, IPPROTO_IPV6, IPV6_MTU_DISCOVER, &value, sizeof(value)) == 0
+                            : setsockopt(socket_fd, IPPROTO_IP, IP_MTU_DISCOVER, &value, sizeof(value)) == 0;
+}
+
+
+/**
+ * @brief MTU of the route to the connected peer
+ * 
+ * @return MTU in bytes (the path MTU when the kernel knows it), -1 when the socket is not connected
+ */
+int SocketEntity::get_mtu()
+{
+  int mtu { 0 };
+  socklen_t mtu_length = sizeof(mtu);
+  int result = family == AF_INET6 ? getsockopt(socket_fd, IPPROTO_IPV6, IPV6_MTU, &mtu, &mtu_length)
+                                  : getsockopt(socket_fd, IPPROTO_IP, IP_MTU, &mtu, &mtu_length);
+  return result < 0 ? -1 : mtu;
+}
+
+
+/**
+ * @brief IP + UDP headers of one datagram
+ */
+size_t SocketEntity::get_header_size() const
+{
+  return family == AF_INET6 ? UDP_IP6_HEADERS : UDP_IP_HEADERS;
+}
+
+
+/**
+ * @brief Switches UDP generic receive offload on or off
+ * 
+ * @desc Datagrams of one flow may then be delivered coalesced into one buffer,
+ * recv_batch() reports the size of the original datagrams.
+ * @param enabled new state
+ * @return false when the kernel does not support UDP GRO
+ */
+bool SocketEntity::set_gro(bool enabled)
+{
+  int value = enabled ? 1 : 0;
+  if (setsockopt(socket_fd, SOL_UDP, UDP_GRO, &value, sizeof(value)) < 0)
+    return false;
+
+  if (gro != enabled)
+  {
+    gro = enabled;
+    set_batch_depth(batch_depth);
+  }
+
+  return true;
+}
+
+
+/**
+ * @brief Enables MSG_ZEROCOPY sends for send_batch()
+ * 
+ * @desc The kernel then pins the user pages instead of copying them, they may
+ * not be modified until the completion of the send is reaped (wait_zerocopy()).
+ * @return false when the kernel does not support SO_ZEROCOPY
+ */
+bool SocketEntity::enable_zerocopy()
+{
+  int one = 1;
+  zerocopy = setsockopt(socket_fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+  return zerocopy;
+}
+
+
+/**
+ * @brief Counts a zerocopy completion notification from the error queue
+ * 
+ * @param msg message read from the error queue
+ * @return false when the message is no zerocopy notification
+ */
+bool SocketEntity::zerocopy_from_cmsg(struct msghdr* msg)
+{
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg))
+  {
+    bool recv_error = (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+                      || (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR);
+    if (!recv_error)
+      continue;
+
+    struct sock_extended_err error;
+    std::memcpy(&error, CMSG_DATA(cmsg), sizeof(error));
+    if (error.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+      continue;
+
+    // range of the send ids completed, inclusive
+    uint32_t completed = error.ee_data - error.ee_info + 1;
+    zerocopy_completed += completed;
+    if (error.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+      zerocopy_copied += completed;
+
+    return true;
+  }
+
+  return false;
+}
+
+
+/**
+ * @brief Reaps zerocopy completions from the error queue
+ * 
+ * @desc Notifications are counted, not matched by id. The kernel completes
+ * sends of one socket in order, so after 'n' completions the first 'n'
+ * sends are done.
+ * @param sends number of sends (counted from the first one) to wait for
+ * @param timeout_ms longest time to wait for them
+ * @return true when all of them were completed
+ */
+bool SocketEntity::wait_zerocopy(uint32_t sends, int timeout_ms)
+{
+  char control[CONTROL_SIZE];
+  struct msghdr msg {};
+  struct pollfd pfd { socket_fd, 0, 0 };
+  uint64_t deadline = monotonic_ns() + timeout_ms * NSEC_PER_MSEC;
+
+  while (static_cast<int32_t>(zerocopy_completed - sends) < 0)
+  {
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(socket_fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) >= 0)
+    {
+      zerocopy_from_cmsg(&msg);
+      continue;
+    }
+
+    uint64_t now = monotonic_ns();
+    if (now >= deadline || poll(&pfd, 1, static_cast<int>((deadline - now) / NSEC_PER_MSEC) + 1) <= 0)
+      return false;
+  }
+
+  return true;
+}
+
+
+/**
+ * @brief Enables kernel (and NIC) packet timestamping
+ * 
+ * @desc RX timestamps are then delivered with every datagram, TX timestamps
+ * only for datagrams sent by send_message_ts(). Hardware timestamping has to be
+ * switched on at the interface, which needs CAP_NET_ADMIN and a capable NIC,
+ * otherwise the socket falls back to software timestamps (works on loopback).
+ * @param requested wanted source of the timestamps
+ * @param interface network interface for hardware timestamping
+ * @return timestamping that is really enabled
+ */
+SocketEntity::timestamping_t SocketEntity::enable_timestamping(timestamping_t requested, const std::string& interface)
+{
+  timestamping = NO_TIMESTAMPING;
+  if (requested == NO_TIMESTAMPING)
+    return timestamping;
+
+  unsigned flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE
+                 | SOF_TIMESTAMPING_OPT_TSONLY | SOF_TIMESTAMPING_OPT_ID;
+  timestamping_t enabled = SOFTWARE_TIMESTAMPING;
+
+  if (requested == HARDWARE_TIMESTAMPING)
+  {
+    struct hwtstamp_config config {};
+    config.tx_type = HWTSTAMP_TX_ON;
+    config.rx_filter = HWTSTAMP_FILTER_ALL;
+
+    struct ifreq request {};
+    strncpy(request.ifr_name, interface.c_str(), IFNAMSIZ - 1);
+    request.ifr_data = reinterpret_cast<char*>(&config);
+
+    if (!interface.empty() && ioctl(socket_fd, SIOCSHWTSTAMP, &request) == 0)
+    {
+      flags |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+      enabled = HARDWARE_TIMESTAMPING;
+    }
+    else
+      cerr << "hardware timestamping not available on '" << interface << "', using software timestamps" << endl;
+  }
+
+  if (setsockopt(socket_fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0)
+  {
+    cerr << "SO_TIMESTAMPING not available, using user space timestamps" << endl;
+    return timestamping;
+  }
+
+  timestamping = enabled;
+  set_batch_depth(batch_depth);
+
+  return timestamping;
+}
+
+
+/**
+ * @brief Extracts SCM_TIMESTAMPING from the control messages
+ * 
+ * @param msg received message with control data
+ * @param timestamp output, hardware timestamp when available, software otherwise (ns)
+ * @param hardware optional output, whether the timestamp came from the NIC
+ * @return false when the message carries no timestamp
+ */
+bool SocketEntity::timestamp_from_cmsg(struct msghdr* msg, uint64_t& timestamp, bool* hardware)
+{
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg))
+  {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_TIMESTAMPING)
+      continue;
+
+    struct scm_timestamping stamps;
+    std::memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+
+    // [0] software, [2] raw hardware
+    bool from_nic = timestamping == HARDWARE_TIMESTAMPING && (stamps.ts[2].tv_sec || stamps.ts[2].tv_nsec);
+    const struct timespec& ts = from_nic ? stamps.ts[2] : stamps.ts[0];
+    if (ts.tv_sec == 0 && ts.tv_nsec == 0)
+      return false;
+
+    if (hardware)
+      *hardware = from_nic;
+
+    timestamp = static_cast<uint64_t>(ts.tv_sec) * NSEC_PER_SEC + ts.tv_nsec;
+    return true;
+  }
+
+  return false;
+}
+
+
+/**
+ * @brief Sends a message and returns its TX timestamp
+ * 
+ * @desc The timestamp is requested for this datagram only (SO_TIMESTAMPING
+ * control message) and read back from the socket error queue.
+ * @param buffer pointer to the data to send
+ * @param buf_size size being sent
+ * @param tx_timestamp output, kernel/NIC TX time, user space time before the send as fallback (ns)
+ * @return number of bytes sent
+ */
+ssize_t SocketEntity::send_message_ts(char* buffer, size_t buf_size, uint64_t& tx_timestamp)
+{
+  char control[CMSG_SPACE(sizeof(uint32_t))] = {};
+  struct iovec iov { buffer, buf_size };
+  struct msghdr msg {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  if (timestamping != NO_TIMESTAMPING)
+  {
+    uint32_t tx_flags = SOF_TIMESTAMPING_TX_SOFTWARE;
+    if (timestamping == HARDWARE_TIMESTAMPING)
+      tx_flags |= SOF_TIMESTAMPING_TX_HARDWARE;
+
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SO_TIMESTAMPING;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(tx_flags));
+    std::memcpy(CMSG_DATA(cmsg), &tx_flags, sizeof(tx_flags));
+  }
+
+  char error_control[CONTROL_SIZE];
+  struct msghdr error_msg {};
+  uint64_t timestamp;
+  bool hardware { false };
+
+  // reads one entry of the error queue, false when it is empty
+  auto read_error_queue = [&]() {
+    error_msg.msg_control = error_control;
+    error_msg.msg_controllen = sizeof(error_control);
+    return recvmsg(socket_fd, &error_msg, MSG_ERRQUEUE | MSG_DONTWAIT) >= 0;
+  };
+
+  // timestamps of earlier datagrams (that came too late) must not be taken for this one,
+  // zerocopy notifications on the way are still counted
+  if (timestamping != NO_TIMESTAMPING)
+    while (read_error_queue())
+      zerocopy_from_cmsg(&error_msg);
+
+  tx_timestamp = realtime_ns();
+  ssize_t bytes_sent = sendmsg(socket_fd, &msg, 0);
+  if (bytes_sent < 0 || timestamping == NO_TIMESTAMPING)
+    return bytes_sent;
+
+  // the timestamp shows up on the error queue once the packet left, the NIC one a bit
+  // later than the software one, which is kept when the NIC does not deliver any
+  struct pollfd pfd { socket_fd, 0, 0 };
+  uint64_t deadline = monotonic_ns() + TX_TIMESTAMP_TIMEOUT_MS * NSEC_PER_MSEC;
+
+  while (!hardware && monotonic_ns() < deadline)
+  {
+    if (poll(&pfd, 1, TX_TIMESTAMP_TIMEOUT_MS) <= 0 || !(pfd.revents & POLLERR))
+      break;
+
+    while (read_error_queue())
+    {
+      if (zerocopy_from_cmsg(&error_msg))
+        continue;
+
+      if (timestamp_from_cmsg(&error_msg, timestamp, &hardware))
+      {
+        tx_timestamp = timestamp;
+        if (timestamping != HARDWARE_TIMESTAMPING)
+          return bytes_sent;
+      }
+    }
+  }
+
+  return bytes_sent;
+}
+
+
+/**
+ * @brief Receives a message and returns its RX timestamp
+ * 
+ * @param buffer pointer to the receive buffer
+ * @param buf_size size being received
+ * @param rx_timestamp output, kernel/NIC RX time, user space time after the receive as fallback (ns)
+ * @return number of bytes received
+ */
+ssize_t SocketEntity::recv_message_ts(char* buffer, size_t buf_size, uint64_t& rx_timestamp)
+{
+  char control[CONTROL_SIZE];
+  struct iovec iov { buffer, buf_size };
+  struct msghdr msg {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t bytes_received = recvmsg(socket_fd, &msg, 0);
+
+  if (bytes_received < 0 || timestamping == NO_TIMESTAMPING || !timestamp_from_cmsg(&msg, rx_timestamp))
+    rx_timestamp = realtime_ns();
+
+  return bytes_received;
+}
+
+
+/**
+ * @brief Length of an address as its family needs it
+ * 
+ * @param address IPv4 or IPv6 address
+ * @return sizeof the sockaddr of its family
+ */
+socklen_t address_length(const struct sockaddr_storage& address)
+{
+  return address.ss_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+}
+
+
+/**
+ * @brief Address for printing
+ * 
+ * @param address IPv4 or IPv6 address
+ * @param with_port append the port
+ * @return "192.0.2.1:4000" / "[2001:db8::1]:4000"
+ */
+std::string address_name(const struct sockaddr_storage& address, bool with_port)
+{
+  char text[INET6_ADDRSTRLEN] = "";
+  unsigned short port = 0;
+  bool ipv6 = false;
+
+  if (address.ss_family == AF_INET6)
+  {
+    const struct sockaddr_in6* in6 = reinterpret_cast<const struct sockaddr_in6*>(&address);
+    port = ntohs(in6->sin6_port);
+    if (IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr))
+      inet_ntop(AF_INET, &in6->sin6_addr.s6_addr[12], text, sizeof(text));
+    else
+    {
+      inet_ntop(AF_INET6, &in6->sin6_addr, text, sizeof(text));
+      ipv6 = true;
+    }
+  }
+  else if (address.ss_family == AF_INET)
+  {
+    const struct sockaddr_in* in = reinterpret_cast<const struct sockaddr_in*>(&address);
+    port = ntohs(in->sin_port);
+    inet_ntop(AF_INET, &in->sin_addr, text, sizeof(text));
+  }
+
+  if (!with_port)
+    return text;
+  return ipv6 ? "[" + string(text) + "]:" + std::to_string(port) : string(text) + ":" + std::to_string(port);
+}
+
+
+/**
+ * @brief Family of an address for printing
+ * 
+ * @param address IPv4 or IPv6 address
+ * @return "IPv4" / "IPv6", IPv4-mapped IPv6 addresses are IPv4
+ */
+const char* address_family_name(const struct sockaddr_storage& address)
+{
+  if (address.ss_family != AF_INET6)
+    return "IPv4";
+
+  const struct sockaddr_in6* in6 = reinterpret_cast<const struct sockaddr_in6*>(&address);
+  return IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr) ? "IPv4" : "IPv6";
+}
+
+
+/**
+ * @brief Copy of an address with another port
+ * 
+ * @param address IPv4 or IPv6 address
+ * @param port the new port
+ * @return the address
+ */
+struct sockaddr_storage address_with_port(const struct sockaddr_storage& address, unsigned short port)
+{
+  struct sockaddr_storage copy = address;
+  if (copy.ss_family == AF_INET6)
+    reinterpret_cast<struct sockaddr_in6*>(&copy)->sin6_port = htons(port);
+  else
+    reinterpret_cast<struct sockaddr_in*>(&copy)->sin_port = htons(port);
+  return copy;
+}
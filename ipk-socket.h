@@ -13,6 +13,31 @@
     #include <sys/socket.h> // Core socket functions and data structures.
     #include <sys/types.h> 
     #include <netinet/in.h>
+    #include <netdb.h>  // getaddrinfo
+    #include <unistd.h> // close
+    #include <vector>
+    #include <string>
+    #include <memory>
+    #include <atomic>
+    #include <stdint.h>
+
+    #include "ipk-uring.h"
+
+    // default number of datagrams moved by one sendmmsg/recvmmsg call
+    #define DEFAULT_BATCH_DEPTH 32
+
+    // largest UDP payload, also the receive buffer needed for GRO coalesced datagrams
+    #define MAX_DATAGRAM_SIZE 65507
+
+    // kernel limit of segments in one UDP GSO send
+    #define MAX_GSO_SEGMENTS 64
+
+    // socket buffers are sized to hold this much of the traffic (at most a round of it)
+    #define SOCKET_BUFFER_MS 50
+
+    // range of the sized socket buffers
+    #define SOCKET_BUFFER_MIN (256 * 1024)
+    #define SOCKET_BUFFER_MAX (64 * 1024 * 1024)
     
     /**
      * @brief Socket data & operations wrapper
@@ -28,13 +53,83 @@
      */  
     class SocketEntity
     {
+        public:
+
+            // source of the packet timestamps
+            enum timestamping_t
+            {
+                NO_TIMESTAMPING       = 0, // user space clock after the syscall
+                SOFTWARE_TIMESTAMPING = 1, // kernel timestamps (SO_TIMESTAMPING)
+                HARDWARE_TIMESTAMPING = 2  // NIC timestamps, software ones where the NIC has none
+            };
+
+            // how the batched calls reach the kernel
+            enum io_backend_t
+            {
+                BLOCKING_IO = 0, // sendmmsg/recvmmsg
+                URING_IO    = 1  // io_uring, multishot receive into provided buffers
+            };
+
         private:
             int socket_fd;
-            struct sockaddr_in local;  // from server view -> its address
-            struct sockaddr_in remote; // from clients view -> server address, from server view -> client address
+            int family;                     // AF_INET / AF_INET6 once set up, AF_UNSPEC before
+            struct sockaddr_storage local;  // from server view -> its address
+            struct sockaddr_storage remote; // from clients view -> server address, from server view -> client address
             socklen_t local_length;
             socklen_t remote_length;
-            hostent* hp;
+
+            // creates the descriptor of the family, false when the family is not supported
+            bool open_socket(int socket_family);
+
+            // preallocated message headers for the batched interface, the send calls and
+            // recv_batch() have their own, so one thread may send while another receives
+            unsigned batch_depth;
+            std::vector<struct mmsghdr> batch_msgs;
+            std::vector<struct iovec> batch_iovs;
+            std::vector<struct mmsghdr> recv_msgs;
+            std::vector<struct iovec> recv_iovs;
+
+            // kernel timestamping, control message buffers for the batched interface (send / receive)
+            timestamping_t timestamping;
+            std::vector<char> batch_control;
+            std::vector<char> recv_control;
+
+            bool timestamp_from_cmsg(struct msghdr* msg, uint64_t& timestamp, bool* hardware = nullptr);
+
+            // offloads, UDP GSO (segments per send, 0 = off), UDP GRO and MSG_ZEROCOPY
+            unsigned gso_segments;
+            size_t gso_size;
+            bool gro;
+            bool zerocopy;
+            uint32_t zerocopy_sent;      // zerocopy sends so far, the kernel numbers them from 0
+            uint32_t zerocopy_completed; // completion notifications reaped
+            uint64_t zerocopy_copied;    // sends the kernel had to copy after all
+
+            bool zerocopy_from_cmsg(struct msghdr* msg);
+            bool control_needed() const;
+            size_t segment_from_cmsg(struct msghdr* msg, size_t length);
+
+            // SO_RXQ_OVFL, datagrams the kernel dropped on the full receive queue so far
+            bool drop_counting;
+            std::atomic<uint32_t> rx_dropped;
+
+            void drops_from_cmsg(struct msghdr* msg);
+
+            // SO_RCVBUF / SO_SNDBUF, the FORCE variant first (ignores rmem_max/wmem_max, needs CAP_NET_ADMIN)
+            size_t grow_buffer(int option, int force_option, size_t bytes);
+            size_t get_buffer(int option);
+
+            // io_uring backend, nullptr while the blocking calls are used
+            std::unique_ptr<IoUring> uring;
+            struct msghdr uring_msg;                     // layout of the multishot receives
+            struct __kernel_timespec uring_deadline;
+            std::vector<unsigned short> uring_borrowed;  // buffers held by the caller
+            bool uring_receiving;
+            bool uring_rearm;
+            bool uring_deadline_hit;
+
+            void uring_arm_receive();
+            unsigned uring_send(unsigned messages, int flags);
 
         public:
             SocketEntity();
@@ -51,11 +146,128 @@
             ssize_t send_message(char* buffer, size_t buf_size);
             ssize_t recv_message(char* buffer, size_t buf_size, bool save_connection = false);
 
-            // setup and bind a server on this host:port
-            int setup_server(unsigned short port);
+            // reply on an unconnected socket
+            ssize_t send_to(const char* buffer, size_t buf_size, const struct sockaddr_storage& destination);
+            ssize_t recv_from(char* buffer, size_t buf_size, struct sockaddr_storage& source);
+
+            // SO_RCVTIMEO of the blocking receives, 0 blocks forever
+            void set_recv_timeout(unsigned timeout_ms);
+
+            // waits until a datagram can be received, false on timeout
+            bool wait_readable(int timeout_ms);
+
+            // socket buffers are only ever grown, return the size the kernel really set (bytes)
+            inline size_t grow_recv_buffer(size_t bytes) { return grow_buffer(SO_RCVBUF, SO_RCVBUFFORCE, bytes); }
+            inline size_t grow_send_buffer(size_t bytes) { return grow_buffer(SO_SNDBUF, SO_SNDBUFFORCE, bytes); }
+            inline size_t get_recv_buffer() { return get_buffer(SO_RCVBUF); }
+            inline size_t get_send_buffer() { return get_buffer(SO_SNDBUF); }
+
+            // buffer holding SOCKET_BUFFER_MS of 'packet_rate' datagrams (at most 'round_ms' of them)
+            static size_t buffer_size_for(double packet_rate, size_t datagram_size, unsigned round_ms);
+
+            // SO_RXQ_OVFL, the receive calls then keep the number of datagrams dropped on the full
+            // receive queue, any thread may read it
+            bool enable_drop_counter();
+            inline uint32_t get_rx_dropped() const { return rx_dropped.load(std::memory_order_relaxed); }
+
+            // SO_BUSY_POLL (& SO_PREFER_BUSY_POLL where the kernel has it), a receive on an empty queue
+            // polls the NIC for up to 'usec' before it sleeps, false when not permitted
+            bool enable_busy_poll(unsigned usec);
+
+            // batched interface (sendmmsg/recvmmsg), up to 'batch_depth' datagrams per syscall,
+            // one thread may call recv_batch() while another sends on the same socket (echo mode)
+            void set_batch_depth(unsigned depth);
+            inline unsigned get_batch_depth() { return batch_depth; }
+            int send_batch(char* const* buffers, size_t buf_size, unsigned count);
+            // replies on an unconnected socket, datagram i ('lengths[i]' bytes) goes to 'destinations[i]',
+            // always sendmmsg (the io_uring of the socket may be receiving)
+            int send_batch_to(char* const* buffers, const size_t* lengths, const struct sockaddr_storage* const* destinations,
+                              unsigned count);
+            int recv_batch(char* const* buffers, size_t buf_size, unsigned count, size_t* lengths,
+                           uint64_t* timestamps = nullptr, size_t* segment_sizes = nullptr,
+                           struct sockaddr_storage* sources = nullptr);
+
+            // UDP GSO for 'segment_size' datagrams, returns segments per send (0 when not usable),
+            // fewer segments fit one zerocopy send, so zerocopy has to be enabled first
+            unsigned enable_gso(size_t segment_size);
+            inline unsigned get_gso_segments() { return gso_segments; }
+
+            // DF on every datagram whatever path MTU the kernel has cached (IP_PMTUDISC_PROBE), datagrams
+            // bigger than the interface MTU fail with EMSGSIZE instead of being fragmented, false when refused
+            bool set_mtu_probing();
+
+            // MTU of the route to the connected peer, -1 when not known
+            int get_mtu();
+
+            // IP + UDP headers in front of every datagram of the socket family
+            size_t get_header_size() const;
+
+            // UDP GRO, coalesced datagrams need MAX_DATAGRAM_SIZE receive buffers
+            bool set_gro(bool enabled);
+
+            // MSG_ZEROCOPY for send_batch, buffers may be reused only after their completion
+            bool enable_zerocopy();
+            inline bool get_zerocopy() { return zerocopy; }
+            inline uint32_t get_zerocopy_sent() { return zerocopy_sent; }
+            inline uint64_t get_zerocopy_copied() { return zerocopy_copied; }
+
+            // reaps completions until the first 'sends' sends are completed, false on timeout
+            bool wait_zerocopy(uint32_t sends, int timeout_ms);
+
+            // switches send_batch() and the receive calls below to io_uring, false when unavailable
+            bool enable_uring();
+            inline io_backend_t get_io_backend() { return uring ? URING_IO : BLOCKING_IO; }
+
+            // io_uring receiving: datagrams of up to 'buf_size' bytes land in the provided buffers,
+            // recv_borrowed() lends them to the caller until its next call, 'timeout_ms' -1 waits for
+            // the deadline, returns 0 when the deadline passed, -1 on timeout/error
+            bool start_receiving(size_t buf_size, unsigned buffers);
+            int recv_borrowed(const char** payloads, unsigned count, size_t* lengths, uint64_t* timestamps,
+                              size_t* segment_sizes, int timeout_ms, struct sockaddr_storage* sources = nullptr);
+            void stop_receiving();
+
+            // timeout SQE completing at 'deadline_ns' (CLOCK_MONOTONIC)
+            void set_deadline(uint64_t deadline_ns);
+            inline bool deadline_expired() { return uring_deadline_hit; }
+
+            // SO_TIMESTAMPING, returns what was really enabled ('interface' is needed for hardware)
+            timestamping_t enable_timestamping(timestamping_t requested, const std::string& interface = "");
+            inline timestamping_t get_timestamping() { return timestamping; }
+
+            // single datagram with the TX timestamp from the error queue / RX timestamp from cmsg,
+            // both fall back to CLOCK_REALTIME read around the syscall
+            ssize_t send_message_ts(char* buffer, size_t buf_size, uint64_t& tx_timestamp);
+            ssize_t recv_message_ts(char* buffer, size_t buf_size, uint64_t& rx_timestamp);
+
+            // setup and bind a server on this host:port, 'reuse_port' joins SO_REUSEPORT group,
+            // AF_UNSPEC binds dual-stack (IPv6 socket taking IPv4 as mapped addresses) where IPv6 is available
+            int setup_server(unsigned short port, bool reuse_port = false, int server_family = AF_UNSPEC);
             
-            // prepare address 
+            // prepare address, the first one 'hostname' resolves to
             int setup_connection(const char* hostname, unsigned short port);
+            int setup_connection(const struct sockaddr_storage& address);
+
+            inline int get_family() const { return family; }
+
+            // port the socket is bound to (the one the kernel picked for port 0), 0 when not bound
+            unsigned short get_local_port();
+
+            // all addresses of 'hostname' of the family (AF_UNSPEC = both) in the order of preference (RFC 6724),
+            // empty when it does not resolve
+            static std::vector<struct sockaddr_storage> resolve(const char* hostname, unsigned short port, int address_family = AF_UNSPEC);
     };
 
+
+    // length of 'address' as its family needs it
+    socklen_t address_length(const struct sockaddr_storage& address);
+
+    // "192.0.2.1:4000" / "[2001:db8::1]:4000", IPv4-mapped IPv6 addresses are shown as IPv4
+    std::string address_name(const struct sockaddr_storage& address, bool with_port = true);
+
+    // "IPv4" / "IPv6", IPv4-mapped IPv6 addresses are IPv4
+    const char* address_family_name(const struct sockaddr_storage& address);
+
+    // copy of 'address' with another port
+    struct sockaddr_storage address_with_port(const struct sockaddr_storage& address, unsigned short port);
+
 #endif // IPK_SOCKET_H_
\ No newline at end of file
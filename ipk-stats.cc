@@ -0,0 +1,325 @@
+/**
+ *  @file       ipk-stats.cc
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Streaming statistics implementation.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "ipk-stats.h"
+
+
+/**
+ * @brief Forgets all samples
+ */
+void RunningStats::reset()
+{
+  n = 0;
+  mean_value = 0.0;
+  m2 = 0.0;
+  min_value = std::numeric_limits<double>::infinity();
+  max_value = -std::numeric_limits<double>::infinity();
+}
+
+
+/**
+ * @brief Adds one sample
+ */
+void RunningStats::add(double sample)
+{
+  n++;
+  double delta = sample - mean_value;
+  mean_value += delta / n;
+  m2 += delta * (sample - mean_value);
+
+  if (sample < min_value)
+    min_value = sample;
+  if (sample > max_value)
+    max_value = sample;
+}
+
+
+/**
+ * @brief Sample variance, 0 for less than 2 samples
+ */
+double RunningStats::variance() const
+{
+  return n > 1 ? m2 / (n - 1) : 0.0;
+}
+
+
+/**
+ * @brief Sample standard deviation, 0 for less than 2 samples
+ */
+double RunningStats::std_dev() const
+{
+  return std::sqrt(variance());
+}
+
+
+/*****************************************************************************/
+
+/**
+ * @brief Forgets all samples
+ */
+void DelayEstimator::reset()
+{
+  transit.reset();
+  last_transit = 0;
+  jitter_ns = 0.0;
+  first_rx = 0;
+  last_rx = 0;
+}
+
+
+/**
+ * @brief Accounts one probe
+ * 
+ * @desc J(i) = J(i-1) + (|D(i-1,i)| - J(i-1)) / 16, where D is the difference
+ * of transit times of two consecutive probes (in arrival order).
+ * @param tx_timestamp sender timestamp from the probe header
+ * @param rx_timestamp receive timestamp
+ */
+void DelayEstimator::add(uint64_t tx_timestamp, uint64_t rx_timestamp)
+{
+  int64_t current = static_cast<int64_t>(rx_timestamp - tx_timestamp);
+
+  if (transit.count() > 0)
+  {
+    double d = std::fabs(static_cast<double>(current - last_transit));
+    jitter_ns += (d - jitter_ns) / 16.0;
+    first_rx = std::min(first_rx, rx_timestamp);
+    last_rx = std::max(last_rx, rx_timestamp);
+  }
+  else
+    first_rx = last_rx = rx_timestamp;
+
+  last_transit = current;
+  transit.add(static_cast<double>(current));
+}
+
+
+/**
+ * @brief Forgets all counts, the interval stays
+ */
+void Timeline::reset()
+{
+  base = 0;
+  counts.clear();
+  dropped = 0;
+}
+
+
+/**
+ * @brief Accounts events in the bin of 'timestamp'
+ * 
+ * @desc The kept bins grow to both sides, an event before the first bin
+ * (e.g. from a stream that started later in another worker) moves it back.
+ * @param timestamp time of the events (ns)
+ * @param count number of events
+ */
+void Timeline::add(uint64_t timestamp, uint32_t count)
+{
+  if (interval_ns == 0)
+    return;
+
+  uint64_t bin = timestamp / interval_ns;
+  if (counts.empty())
+  {
+    base = bin;
+    counts.push_back(0);
+  }
+  else if (bin < base)
+  {
+    if (base - bin + counts.size() > max_bins)
+    {
+      dropped += count;
+      return;
+    }
+    counts.insert(counts.begin(), base - bin, 0);
+    base = bin;
+  }
+  else if (bin - base >= max_bins)
+  {
+    dropped += count;
+    return;
+  }
+  else if (bin - base >= counts.size())
+    counts.resize(bin - base + 1, 0);
+
+  counts[bin - base] += count;
+}
+
+
+/**
+ * @brief Adds the counts of another timeline of the same interval
+ */
+void Timeline::merge(const Timeline& other)
+{
+  for (size_t i = 0; i < other.counts.size(); i++)
+  {
+    if (other.counts[i] > 0)
+      add((other.base + i) * interval_ns, other.counts[i]);
+  }
+  dropped += other.dropped;
+}
+
+
+/**
+ * @brief Replaces the bins by received ones
+ * 
+ * @param first_bin absolute index of the first bin
+ * @param bins counts, at most 'max_bins' are kept
+ */
+void Timeline::assign(uint64_t first_bin, const std::vector<uint32_t>& bins)
+{
+  base = first_bin;
+  counts.assign(bins.begin(), bins.begin() + std::min(bins.size(), max_bins));
+  dropped = 0;
+}
+
+
+/**
+ * @brief Count of one bin
+ * 
+ * @param bin absolute index of the bin (timestamp / interval)
+ */
+uint32_t Timeline::at(uint64_t bin) const
+{
+  if (bin < base || bin - base >= counts.size())
+    return 0;
+
+  return counts[bin - base];
+}
+
+
+/**
+ * @brief Adds the samples of one aggregate to another
+ * 
+ * @desc Minima & maxima of an aggregate without samples do not count.
+ */
+void window_stats_merge(window_stats_t& stats, const window_stats_t& other)
+{
+  if (other.rounds > 0)
+  {
+    stats.speed_min = stats.rounds > 0 ? std::min(stats.speed_min, other.speed_min) : other.speed_min;
+    stats.speed_max = stats.rounds > 0 ? std::max(stats.speed_max, other.speed_max) : other.speed_max;
+    stats.queueing_max = stats.rounds > 0 ? std::max(stats.queueing_max, other.queueing_max) : other.queueing_max;
+    stats.rounds += other.rounds;
+    stats.speed_sum += other.speed_sum;
+    stats.sent += other.sent;
+    stats.received += other.received;
+    stats.queueing_sum += other.queueing_sum;
+    stats.jitter_sum += other.jitter_sum;
+  }
+
+  if (other.rtt_samples > 0)
+  {
+    stats.rtt_min = stats.rtt_samples > 0 ? std::min(stats.rtt_min, other.rtt_min) : other.rtt_min;
+    stats.rtt_max = stats.rtt_samples > 0 ? std::max(stats.rtt_max, other.rtt_max) : other.rtt_max;
+    stats.rtt_samples += other.rtt_samples;
+    stats.rtt_sum += other.rtt_sum;
+  }
+}
+
+
+/**
+ * @brief Creates an empty window
+ * 
+ * @param span_ns length of the window
+ * @param count number of buckets, the window moves on by span_ns / count
+ */
+RollingWindow::RollingWindow(uint64_t span_ns, size_t count)
+  : bucket_ns {std::max<uint64_t>(span_ns / std::max<size_t>(count, 1), 1)},
+    buckets (std::max<size_t>(count, 1), bucket_t {0, {}})
+{}
+
+
+window_stats_t& RollingWindow::current(uint64_t now_ns)
+{
+  uint64_t slot = now_ns / bucket_ns;
+  bucket_t& bucket = buckets[slot % buckets.size()];
+
+  if (bucket.slot != slot)
+  {
+    bucket.slot = slot;
+    bucket.stats = {};
+  }
+  return bucket.stats;
+}
+
+
+/**
+ * @brief Accounts one measured round
+ * 
+ * @param now_ns time of the round (any clock, the same for all calls)
+ * @param speed received Mb/s
+ * @param sent probes sent
+ * @param received probes received
+ * @param queueing_us mean queueing delay of the round
+ * @param jitter_us interarrival jitter of the round
+ */
+void RollingWindow::add_round(uint64_t now_ns, double speed, int64_t sent, int64_t received, double queueing_us, double jitter_us)
+{
+  window_stats_t sample {1, speed, speed, speed, sent, received, queueing_us, queueing_us, jitter_us, 0, 0.0, 0.0, 0.0};
+  window_stats_merge(current(now_ns), sample);
+}
+
+
+/**
+ * @brief Accounts one RTT sample
+ */
+void RollingWindow::add_rtt(uint64_t now_ns, double rtt_ms)
+{
+  window_stats_t sample {};
+  sample.rtt_samples = 1;
+  sample.rtt_sum = sample.rtt_min = sample.rtt_max = rtt_ms;
+  window_stats_merge(current(now_ns), sample);
+}
+
+
+/**
+ * @brief Aggregate of the window
+ * 
+ * @desc The bucket of 'now_ns' is only partly filled, so the window reaches
+ * back span() - (one bucket at most).
+ * @param now_ns end of the window
+ */
+window_stats_t RollingWindow::stats(uint64_t now_ns) const
+{
+  uint64_t slot = now_ns / bucket_ns;
+  window_stats_t result {};
+
+  for (const bucket_t& bucket : buckets)
+  {
+    if (bucket.slot <= slot && slot - bucket.slot < buckets.size())
+      window_stats_merge(result, bucket.stats);
+  }
+  return result;
+}
+
+
+/**
+ * @brief Median of a set of samples
+ * 
+ * @param samples values in any order (a copy, it gets reordered)
+ * @return median, 0 when there are no samples
+ */
+double median(std::vector<double> samples)
+{
+  if (samples.empty())
+    return 0.0;
+
+  size_t middle = samples.size() / 2;
+  std::nth_element(samples.begin(), samples.begin() + middle, samples.end());
+  if (samples.size() % 2)
+    return samples[middle];
+
+  double upper = samples[middle];
+  return (*std::max_element(samples.begin(), samples.begin() + middle) + upper) / 2;
+}
@@ -0,0 +1,195 @@
+/**
+ *  @file       ipk-stats.h
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Streaming statistics.
+ *  
+ *  @section Description
+ *  
+ *  Estimators that are updated once per sample in constant time and memory,
+ *  so they can sit on the packet path without storing the samples.
+ */
+
+#ifndef IPK_STATS_H_
+#define IPK_STATS_H_
+
+    #include <stdint.h>
+    #include <vector>
+
+    /**
+     * @brief Count, min, max, mean and variance (Welford's online algorithm)
+     */
+    class RunningStats
+    {
+        private:
+            long n;
+            double mean_value;
+            double m2;
+            double min_value;
+            double max_value;
+
+        public:
+            RunningStats() { reset(); }
+
+            void reset();
+            void add(double sample);
+
+            inline long count() const { return n; }
+            inline double mean() const { return mean_value; }
+            inline double min() const { return min_value; }
+            inline double max() const { return max_value; }
+            double variance() const;
+            double std_dev() const;
+    };
+
+
+    /**
+     * @brief One-way delay and interarrival jitter of one stream (RFC 3550, 6.4.1)
+     * 
+     * @desc Transit time is receive minus send timestamp. Unless both clocks are
+     * synchronized it contains an unknown offset, so only its variation (current
+     * minus minimal transit, i.e. queueing delay) and the jitter are meaningful.
+     */
+    class DelayEstimator
+    {
+        private:
+            RunningStats transit;
+            int64_t last_transit;
+            double jitter_ns;
+            uint64_t first_rx; // arrival of the first/last probe, their distance is the dispersion
+            uint64_t last_rx;
+
+        public:
+            DelayEstimator() { reset(); }
+
+            void reset();
+
+            // account one probe, both timestamps in ns
+            void add(uint64_t tx_timestamp, uint64_t rx_timestamp);
+
+            inline long samples() const { return transit.count(); }
+            inline double min_transit() const { return transit.min(); }
+            inline double mean_transit() const { return transit.mean(); }
+            inline double max_transit() const { return transit.max(); }
+
+            // mean transit above the minimal one (ns)
+            inline double variation() const { return transit.mean() - transit.min(); }
+
+            // RFC 3550 interarrival jitter (ns)
+            inline double jitter() const { return jitter_ns; }
+
+            // receive timestamps of the earliest & latest probe (ns)
+            inline uint64_t first_arrival() const { return first_rx; }
+            inline uint64_t last_arrival() const { return last_rx; }
+    };
+
+
+    /**
+     * @brief Event counts in fixed intervals of time
+     * 
+     * @desc Intervals are aligned to multiples of the interval length since the
+     * epoch of the clock, so two hosts binning the same timestamps get the same
+     * bins without agreeing on a start. Only 'max_bins' consecutive bins are
+     * kept, events outside of them are counted as dropped.
+     */
+    class Timeline
+    {
+        private:
+            uint64_t interval_ns;
+            size_t max_bins;
+            uint64_t base;                // index of the first kept bin
+            std::vector<uint32_t> counts;
+            int64_t dropped;
+
+        public:
+            Timeline(uint64_t interval_ns = 0, size_t max_bins = 0)
+                : interval_ns {interval_ns}, max_bins {max_bins}, base {0}, dropped {0} {}
+
+            void reset();
+
+            // accounts 'count' events at 'timestamp' (ns)
+            void add(uint64_t timestamp, uint32_t count = 1);
+
+            // adds the counts of 'other' (same interval)
+            void merge(const Timeline& other);
+
+            // replaces the bins, 'first_bin' is the index of counts[0]
+            void assign(uint64_t first_bin, const std::vector<uint32_t>& bins);
+
+            inline bool enabled() const { return interval_ns > 0; }
+            inline uint64_t interval() const { return interval_ns; }
+            inline uint64_t first_bin() const { return base; }
+            inline size_t size() const { return counts.size(); }
+            inline int64_t get_dropped() const { return dropped; }
+
+            // count of bin 'bin' (absolute index), 0 outside of the kept ones
+            uint32_t at(uint64_t bin) const;
+    };
+
+
+    /**
+     * @brief Aggregate of the rounds & RTT samples of a stretch of time
+     */
+    struct window_stats_t
+    {
+        long rounds;
+        double speed_sum;     // Mb/s
+        double speed_min;
+        double speed_max;
+        int64_t sent;
+        int64_t received;
+        double queueing_sum;  // us
+        double queueing_max;
+        double jitter_sum;    // us
+        long rtt_samples;
+        double rtt_sum;       // ms
+        double rtt_min;
+        double rtt_max;
+    };
+
+    // adds 'other' to 'stats'
+    void window_stats_merge(window_stats_t& stats, const window_stats_t& other);
+
+
+    /**
+     * @brief Statistics of the last stretch of time in a fixed ring of buckets
+     * 
+     * @desc Every bucket covers an equal slice of the window, aligned like the
+     * bins of a timeline. A bucket is cleared when the time comes round to it
+     * again, so old samples fall out slice by slice and the memory stays the
+     * same however long the window keeps rolling.
+     */
+    class RollingWindow
+    {
+        private:
+            struct bucket_t
+            {
+                uint64_t slot; // time / bucket_ns of the samples inside
+                window_stats_t stats;
+            };
+
+            uint64_t bucket_ns;
+            std::vector<bucket_t> buckets;
+
+            // bucket of 'now_ns', cleared when it holds an older slot
+            window_stats_t& current(uint64_t now_ns);
+
+        public:
+            // window of 'span_ns' in 'count' buckets
+            RollingWindow(uint64_t span_ns, size_t count);
+
+            void add_round(uint64_t now_ns, double speed, int64_t sent, int64_t received, double queueing_us, double jitter_us);
+            void add_rtt(uint64_t now_ns, double rtt_ms);
+
+            // aggregate of the buckets within the window ending at 'now_ns'
+            window_stats_t stats(uint64_t now_ns) const;
+
+            inline uint64_t span() const { return bucket_ns * buckets.size(); }
+    };
+
+    // middle value of 'samples' (mean of the two middle ones for an even count), 0 when empty
+    double median(std::vector<double> samples);
+
+#endif // IPK_STATS_H_
@@ -0,0 +1,184 @@
+/**
+ *  @file       ipk-train.cc
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Packet trains & chirps implementation.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "ipk-train.h"
+#include "ipk-clock.h"
+#include "ipk-stats.h"
+
+
+/**
+ * @brief Plans the send times of the probes
+ * 
+ * @desc A train has all offsets 0, the sender puts the probes out as fast
+ * as it can. The gaps of a chirp shrink by CHIRP_SPREAD from probe to probe,
+ * the last one matches 'top_rate'.
+ * @param pattern train or chirp
+ * @param probes number of probes, at least 2
+ * @param probe_size size of the probes in bytes
+ * @param top_rate highest rate of a chirp in packets/second
+ */
+ProbeTrain::ProbeTrain(pattern_t pattern, unsigned probes, size_t probe_size, double top_rate)
+  : pattern {pattern},
+    probe_size {probe_size},
+    offsets (std::max(probes, 2U), 0)
+{
+  if (pattern != CHIRP)
+    return;
+
+  double top_gap = NSEC_PER_SEC / std::max(top_rate, 1.0);
+  double offset = 0.0;
+  for (size_t i = 1; i < offsets.size(); i++)
+  {
+    offset += top_gap * std::pow(CHIRP_SPREAD, static_cast<double>(offsets.size() - 1 - i));
+    offsets[i] = static_cast<uint64_t>(offset);
+  }
+}
+
+
+/**
+ * @brief Estimates capacity & available bandwidth from one dispersion vector
+ * 
+ * @desc Only probes both sent and received take part, losses just leave
+ * holes. Rates are in bits/second of probe payload.
+ * @param tx_times CLOCK_REALTIME send time of every probe by sequence, 0 when it was not sent
+ * @param arrivals arrival offsets reported by the reflector, sorted by sequence
+ * @return the estimate, the dispersion rate is 0 when less than 2 probes made it or they share a timestamp
+ */
+train_estimate_t ProbeTrain::estimate(const std::vector<uint64_t>& tx_times, const std::vector<dispersion_sample_t>& arrivals) const
+{
+  train_estimate_t result {};
+  result.sent = std::count_if(tx_times.begin(), tx_times.end(), [](uint64_t tx) { return tx != 0; });
+  result.received = arrivals.size();
+
+  std::vector<const dispersion_sample_t*> points;
+  for (const dispersion_sample_t& sample : arrivals)
+  {
+    if (sample.sequence < tx_times.size() && sample.sequence < offsets.size() && tx_times[sample.sequence] != 0)
+      points.push_back(&sample);
+  }
+  if (points.size() < 2)
+    return result;
+
+  double bits = probe_size * 8.0;
+  size_t n = points.size();
+  auto tx = [&](size_t i) { return static_cast<double>(tx_times[points[i]->sequence] - tx_times[points[0]->sequence]); };
+  auto rx = [&](size_t i) { return static_cast<double>(points[i]->rx_timestamp) - static_cast<double>(points[0]->rx_timestamp); };
+
+  double tx_span = tx(n - 1);
+  double rx_span = 0.0;
+  for (size_t i = 1; i < n; i++)
+    rx_span = std::max(rx_span, rx(i));
+
+  result.input_rate = tx_span > 0 ? (n - 1) * bits * NSEC_PER_SEC / tx_span : 0.0;
+
+  // the whole train was received in one batch with user space timestamps, nothing to learn from
+  if (rx_span <= 0)
+    return result;
+  result.dispersion_rate = (n - 1) * bits * NSEC_PER_SEC / rx_span;
+
+  if (pattern == TRAIN)
+  {
+    // packet pairs, neighbours in the sequence only
+    std::vector<double> tx_gaps, rx_gaps;
+    for (size_t i = 1; i < n; i++)
+    {
+      if (points[i]->sequence != points[i - 1]->sequence + 1)
+        continue;
+      tx_gaps.push_back(tx(i) - tx(i - 1));
+      rx_gaps.push_back(rx(i) - rx(i - 1));
+    }
+
+    double rx_gap = median(rx_gaps);
+    result.sender_limited = !tx_gaps.empty() && median(tx_gaps) >= rx_gap;
+
+    // probes received in one batch may share a timestamp, then the train as a whole is all there is
+    result.capacity = std::max(rx_gap > 0 ? bits * NSEC_PER_SEC / rx_gap : 0.0, result.dispersion_rate);
+
+    // fluid model of a FIFO bottleneck: R_out = R_in * C / (R_in + C - A) as long as R_in > A
+    double input_rate = result.input_rate > 0 ? result.input_rate : result.capacity;
+    if (result.dispersion_rate >= input_rate)
+    {
+      result.available = input_rate;
+      result.available_bound = true;
+    }
+    else
+    {
+      double available = result.capacity - input_rate * (result.capacity / result.dispersion_rate - 1.0);
+      result.available = std::max(0.0, std::min(result.capacity, available));
+    }
+  }
+  else
+  {
+    // queueing delay relative to the first probe & the rate each probe was sent at (to its successor),
+    // probes that were overdue went out together, their gap is the planned one
+    std::vector<double> queueing(n), rate(n, 0.0);
+    for (size_t i = 0; i < n; i++)
+    {
+      queueing[i] = rx(i) - tx(i);
+      if (i + 1 == n)
+        continue;
+
+      double planned = static_cast<double>(offsets[points[i + 1]->sequence] - offsets[points[i]->sequence]);
+      double gap = std::max(tx(i + 1) - tx(i), planned);
+      if (gap > 0)
+        rate[i] = bits * NSEC_PER_SEC * (points[i + 1]->sequence - points[i]->sequence) / gap;
+    }
+
+    // lowest delay from each probe on, the excursion that never comes back starts above the available bandwidth
+    std::vector<double> lowest_after(queueing);
+    for (size_t i = n - 1; i > 0; i--)
+      lowest_after[i - 1] = std::min(lowest_after[i - 1], lowest_after[i]);
+
+    for (size_t i = 0; i + 1 < n; i++)
+    {
+      if (rate[i] > 0 && lowest_after[i + 1] > queueing[i] && queueing[n - 1] - queueing[i] >= CHIRP_RISE_NS)
+      {
+        result.available = rate[i];
+        break;
+      }
+    }
+
+    if (result.available == 0.0)
+    {
+      result.available = *std::max_element(rate.begin(), rate.end());
+      result.available_bound = true;
+    }
+  }
+
+  return result;
+}
+
+
+/**
+ * @brief Parses the name of a pattern
+ * 
+ * @param name "train" or "chirp"
+ * @param pattern output
+ * @return false on unknown name
+ */
+bool ProbeTrain::parse_pattern(const std::string& name, pattern_t& pattern)
+{
+  if (name == "train")
+    pattern = TRAIN;
+  else if (name == "chirp")
+    pattern = CHIRP;
+  else
+    return false;
+
+  return true;
+}
+
+
+const char* ProbeTrain::pattern_name(pattern_t pattern)
+{
+  return pattern == CHIRP ? "chirp" : "train";
+}
@@ -0,0 +1,95 @@
+/**
+ *  @file       ipk-train.h
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). Packet trains & chirps.
+ *  
+ *  @section Description
+ *  
+ *  Instead of loading the path for a whole round, the meter sends one short
+ *  group of probes per round and learns from how the path spread it out. The
+ *  reflector reports the arrival time of every probe (the dispersion vector),
+ *  the meter knows when it sent each of them.
+ *  
+ *  * train - back-to-back probes. Pairs of neighbouring probes leave at the
+ *            line rate of the sender, their median arrival gap is the gap of
+ *            the bottleneck (its capacity). The rate the whole train arrived
+ *            at gives the available bandwidth through the fluid model of a
+ *            FIFO bottleneck shared with cross traffic.
+ *  * chirp - probes with exponentially shrinking gaps, so the rate grows
+ *            within one chirp. The queueing delay starts to grow for good
+ *            at the probe whose rate exceeds the available bandwidth
+ *            (pathChirp).
+ */
+
+#ifndef IPK_TRAIN_H_
+#define IPK_TRAIN_H_
+
+    #include <stdint.h>
+    #include <stddef.h>
+    #include <string>
+    #include <vector>
+
+    #include "ipk-probe.h"
+
+    // probes of one train / chirp unless given on the command line
+    #define TRAIN_DEFAULT_PROBES 64
+    #define CHIRP_DEFAULT_PROBES 32
+
+    // ratio of two neighbouring gaps of a chirp
+    #define CHIRP_SPREAD 1.2
+
+    // growth of the queueing delay till the end of the chirp that counts as lasting (not a burst of cross traffic)
+    #define CHIRP_RISE_NS 2000
+
+    /**
+     * @brief What one train or chirp tells about the path
+     */
+    struct train_estimate_t
+    {
+        long sent;
+        long received;
+        double input_rate;      // bits/second the probes left the meter at
+        double dispersion_rate; // bits/second they arrived at the reflector
+        double capacity;        // bits/second of the bottleneck, 0 when unknown (chirps)
+        double available;       // bits/second left by the cross traffic, 0 when unknown
+        bool available_bound;   // the path took everything, 'available' is only a lower bound
+        bool sender_limited;    // the sender spread the probes more than the path, 'capacity' is the sender
+    };
+
+    /**
+     * @brief Sending schedule of one train or chirp and the estimation from its dispersion
+     */
+    class ProbeTrain
+    {
+        public:
+
+            enum pattern_t
+            {
+                TRAIN = 0, // back-to-back probes
+                CHIRP = 1  // exponentially shrinking gaps
+            };
+
+        private:
+            pattern_t pattern;
+            size_t probe_size;
+            std::vector<uint64_t> offsets; // send time of every probe, ns after the first one
+
+        public:
+            // 'probes' probes of 'probe_size' bytes, a chirp ends at 'top_rate' packets/second
+            ProbeTrain(pattern_t pattern, unsigned probes, size_t probe_size, double top_rate);
+
+            inline pattern_t get_pattern() const { return pattern; }
+            inline const std::vector<uint64_t>& schedule() const { return offsets; }
+
+            // estimate from the send times (indexed by sequence, 0 = not sent) and the reported arrivals
+            train_estimate_t estimate(const std::vector<uint64_t>& tx_times, const std::vector<dispersion_sample_t>& arrivals) const;
+
+            // "train" / "chirp" -> pattern, returns false on unknown name
+            static bool parse_pattern(const std::string& name, pattern_t& pattern);
+            static const char* pattern_name(pattern_t pattern);
+    };
+
+#endif // IPK_TRAIN_H_
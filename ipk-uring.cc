@@ -0,0 +1,299 @@
+/**
+ *  @file       ipk-uring.cc
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). io_uring wrapper implementation.
+ *  
+ *  @section Description
+ *  
+ *  The kernel reads the SQ tail and writes the CQ tail concurrently, those are
+ *  accessed with acquire/release atomics. The SQ index array is filled with an
+ *  identity mapping once, so SQE slot = tail & mask.
+ */
+
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "ipk-uring.h"
+#include "ipk-clock.h"
+
+
+/**
+ * @brief Creates an empty (invalid) ring, see setup()
+ */
+IoUring::IoUring()
+  : ring_fd {-1},
+    ring_memory {nullptr},
+    ring_size {0},
+    sqes {nullptr},
+    sqes_size {0},
+    sq_head {nullptr},
+    sq_tail {nullptr},
+    sq_mask {0},
+    sq_entries {0},
+    sqe_tail {0},
+    cq_head {nullptr},
+    cq_tail {nullptr},
+    cq_mask {0},
+    cqes {nullptr},
+    buffer_ring {nullptr},
+    buffer_ring_tail {nullptr},
+    buffer_group {0},
+    buffer_count {0},
+    buffer_tail {0},
+    buffers_pending {0}
+{}
+
+
+/**
+ * @brief Unregisters the buffers and releases the ring
+ */
+IoUring::~IoUring()
+{
+  unregister_buffers();
+
+  if (sqes != nullptr)
+    munmap(sqes, sqes_size);
+  if (ring_memory != nullptr)
+    munmap(ring_memory, ring_size);
+  if (ring_fd >= 0)
+    close(ring_fd);
+}
+
+
+/**
+ * @brief Creates the ring and maps its queues
+ * 
+ * @param entries submission queue size
+ * @param cq_entries completion queue size, multishot receives need more than 'entries'
+ * @return false when io_uring is not available, blocked or lacks the needed features
+ */
+bool IoUring::setup(unsigned entries, unsigned cq_entries)
+{
+  struct io_uring_params params {};
+  params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+  params.cq_entries = cq_entries;
+
+  ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+  if (ring_fd < 0)
+    return false;
+
+  // one mapping for both rings (5.4+), timeouts on enter (5.11+)
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG))
+  {
+    close(ring_fd);
+    ring_fd = -1;
+    return false;
+  }
+
+  size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  ring_size = sq_size > cq_size ? sq_size : cq_size;
+
+  void* mapping = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  if (mapping == MAP_FAILED)
+  {
+    close(ring_fd);
+    ring_fd = -1;
+    return false;
+  }
+  ring_memory = mapping;
+
+  sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  mapping = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+  if (mapping == MAP_FAILED)
+  {
+    munmap(ring_memory, ring_size);
+    ring_memory = nullptr;
+    close(ring_fd);
+    ring_fd = -1;
+    return false;
+  }
+  sqes = static_cast<struct io_uring_sqe*>(mapping);
+
+  char* ring = static_cast<char*>(ring_memory);
+  sq_head = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+  sq_tail = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+  sq_mask = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+  sq_entries = params.sq_entries;
+  sqe_tail = *sq_tail;
+
+  unsigned* sq_array = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+  for (unsigned i = 0; i < sq_entries; i++)
+    sq_array[i] = i;
+
+  cq_head = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+  cq_tail = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+  cq_mask = *reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+  cqes = reinterpret_cast<struct io_uring_cqe*>(ring + params.cq_off.cqes);
+
+  return true;
+}
+
+
+/**
+ * @brief Returns a free, zeroed submission queue entry
+ */
+struct io_uring_sqe* IoUring::get_sqe()
+{
+  unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+  if (sqe_tail - head >= sq_entries)
+    return nullptr;
+
+  struct io_uring_sqe* sqe = &sqes[sqe_tail & sq_mask];
+  std::memset(sqe, 0, sizeof(*sqe));
+  sqe_tail++;
+
+  return sqe;
+}
+
+
+/**
+ * @brief Publishes new SQEs to the kernel and optionally waits for completions
+ * 
+ * @param wait_nr completions to wait for
+ * @param timeout_ms longest wait, -1 waits without a limit
+ * @return number of SQEs submitted, -errno on failure
+ */
+int IoUring::submit(unsigned wait_nr, int timeout_ms)
+{
+  unsigned tail = *sq_tail;
+  unsigned to_submit = sqe_tail - tail;
+  __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+
+  unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+
+  struct __kernel_timespec ts {};
+  struct io_uring_getevents_arg arg {};
+  void* argp = nullptr;
+  size_t argsz = 0;
+
+  if (wait_nr > 0 && timeout_ms >= 0)
+  {
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * NSEC_PER_MSEC;
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+    argp = &arg;
+    argsz = sizeof(arg);
+    flags |= IORING_ENTER_EXT_ARG;
+  }
+
+  int result = syscall(__NR_io_uring_enter, ring_fd, to_submit, wait_nr, flags, argp, argsz);
+  return result < 0 ? -errno : result;
+}
+
+
+/**
+ * @brief Oldest unseen completion, nullptr when there is none
+ */
+struct io_uring_cqe* IoUring::peek_cqe()
+{
+  unsigned head = *cq_head;
+  unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+  if (head == tail)
+    return nullptr;
+
+  return &cqes[head & cq_mask];
+}
+
+
+/**
+ * @brief Marks the completion returned by peek_cqe() as consumed
+ */
+void IoUring::cqe_seen()
+{
+  __atomic_store_n(cq_head, *cq_head + 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * @brief Maps the receive buffers and registers them as a provided buffer ring
+ * 
+ * @desc The kernel picks a free buffer for every datagram a buffer-select
+ * receive completes, the completion carries its id. It stays owned by the
+ * application until it is recycled.
+ * @param group buffer group id receives refer to
+ * @param count number of buffers, power of 2 (at most 32768)
+ * @param size bytes per buffer
+ * @return false when the kernel does not support provided buffer rings
+ */
+bool IoUring::register_buffers(unsigned short group, unsigned count, size_t size)
+{
+  unregister_buffers();
+
+  buffers.reset(new BufferArena(size, count));
+  buffer_ring_memory.reset(new BufferArena(count * sizeof(struct io_uring_buf), 1));
+  if (!buffers->valid() || !buffer_ring_memory->valid())
+    return false;
+
+  struct io_uring_buf_reg reg {};
+  reg.ring_addr = reinterpret_cast<uint64_t>(buffer_ring_memory->frame(0));
+  reg.ring_entries = count;
+  reg.bgid = group;
+
+  if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    return false;
+
+  // struct io_uring_buf_ring is not used, its flexible array is misplaced by C++ compilers
+  buffer_ring = reinterpret_cast<struct io_uring_buf*>(buffer_ring_memory->frame(0));
+  buffer_ring_tail = reinterpret_cast<uint16_t*>(buffer_ring_memory->frame(0) + offsetof(struct io_uring_buf, resv));
+  buffer_group = group;
+  buffer_count = count;
+  buffer_tail = 0;
+  buffers_pending = 0;
+
+  for (unsigned i = 0; i < count; i++)
+    recycle_buffer(i);
+  commit_buffers();
+
+  return true;
+}
+
+
+/**
+ * @brief Takes the provided buffers away from the kernel
+ */
+void IoUring::unregister_buffers()
+{
+  if (buffer_ring == nullptr)
+    return;
+
+  struct io_uring_buf_reg reg {};
+  reg.bgid = buffer_group;
+  syscall(__NR_io_uring_register, ring_fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+
+  buffer_ring = nullptr;
+  buffers.reset();
+  buffer_ring_memory.reset();
+}
+
+
+/**
+ * @brief Puts a buffer back into the ring (after the next commit_buffers())
+ */
+void IoUring::recycle_buffer(unsigned short id)
+{
+  struct io_uring_buf* entry = &buffer_ring[(buffer_tail + buffers_pending) & (buffer_count - 1)];
+  entry->addr = reinterpret_cast<uint64_t>(buffers->frame(id));
+  entry->len = buffers->get_frame_size();
+  entry->bid = id;
+  buffers_pending++;
+}
+
+
+/**
+ * @brief Makes the recycled buffers visible to the kernel
+ */
+void IoUring::commit_buffers()
+{
+  buffer_tail += buffers_pending;
+  buffers_pending = 0;
+  __atomic_store_n(buffer_ring_tail, buffer_tail, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,98 @@
+/**
+ *  @file       ipk-uring.h
+ *  @author     Andrej Nano (xnanoa00)
+ *  @date       2018-04-09
+ *  @version    1.0
+ * 
+ *  @brief IPK 2018, 2nd project - Bandwidth Measurement (Ryšavý). io_uring wrapper.
+ *  
+ *  @section Description
+ *  
+ *  Minimal io_uring ring on top of the raw syscalls (no liburing needed):
+ *  submission/completion queues shared with the kernel and one provided
+ *  buffer ring the kernel picks receive buffers from. SocketEntity uses it
+ *  as its asynchronous backend.
+ */
+
+#ifndef IPK_URING_H_
+#define IPK_URING_H_
+
+    #include <stddef.h>
+    #include <stdint.h>
+    #include <memory>
+    #include <linux/io_uring.h>
+
+    #include "ipk-buffer.h"
+
+    /**
+     * @brief io_uring instance with a single provided buffer group
+     */
+    class IoUring
+    {
+        private:
+            int ring_fd;
+
+            // shared ring memory (SQ and CQ rings in one mapping) and the SQE array
+            void* ring_memory;
+            size_t ring_size;
+            struct io_uring_sqe* sqes;
+            size_t sqes_size;
+
+            unsigned* sq_head;
+            unsigned* sq_tail;
+            unsigned sq_mask;
+            unsigned sq_entries;
+            unsigned sqe_tail;   // SQEs handed out, published to the kernel on submit
+
+            unsigned* cq_head;
+            unsigned* cq_tail;
+            unsigned cq_mask;
+            struct io_uring_cqe* cqes;
+
+            // provided buffers
+            std::unique_ptr<BufferArena> buffers;
+            std::unique_ptr<BufferArena> buffer_ring_memory;
+            struct io_uring_buf* buffer_ring;   // entries, the tail overlays the 'resv' field of the first one
+            uint16_t* buffer_ring_tail;
+            unsigned short buffer_group;
+            unsigned buffer_count;
+            unsigned short buffer_tail;
+            unsigned short buffers_pending;
+
+        public:
+            IoUring();
+            ~IoUring();
+
+            IoUring(const IoUring&) = delete;
+            IoUring& operator=(const IoUring&) = delete;
+
+            // creates the ring, false when io_uring is not available (or too old)
+            bool setup(unsigned entries, unsigned cq_entries);
+            inline bool valid() const { return ring_fd >= 0; }
+
+            // free SQE (zeroed), nullptr when the submission queue is full
+            struct io_uring_sqe* get_sqe();
+
+            // submits all new SQEs and waits for 'wait_nr' completions (-1 ms = no timeout),
+            // returns -errno on failure (-ETIME when the wait timed out)
+            int submit(unsigned wait_nr = 0, int timeout_ms = -1);
+
+            // oldest completion or nullptr, cqe_seen() hands it back to the kernel
+            struct io_uring_cqe* peek_cqe();
+            void cqe_seen();
+
+            // registers 'count' (power of 2) buffers of 'size' bytes as buffer group 'group',
+            // buffers registered before are dropped
+            bool register_buffers(unsigned short group, unsigned count, size_t size);
+            void unregister_buffers();
+            inline bool has_buffers() const { return buffer_ring != nullptr; }
+            inline unsigned short get_buffer_group() const { return buffer_group; }
+            inline size_t get_buffer_size() const { return buffers ? buffers->get_frame_size() : 0; }
+            inline char* buffer(unsigned short id) const { return buffers->frame(id); }
+
+            // gives a buffer back to the kernel, visible after commit_buffers()
+            void recycle_buffer(unsigned short id);
+            void commit_buffers();
+    };
+
+#endif // IPK_URING_H_